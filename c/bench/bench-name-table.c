@@ -0,0 +1,116 @@
+/* -*- coding: utf-8 -*-
+ * Copyright © 2016, Swanson Project.
+ * Please see the COPYING file in this distribution for license details.
+ */
+
+/* Measures how well s0_name_table scales as more threads share it.  Each
+ * thread interns names drawn from a shared pool; most lookups hit names that
+ * are already in the table, and the first pass through the pool races to insert
+ * them. */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "swanson.h"
+
+#define NAME_POOL_SIZE  4096
+#define OPERATIONS_PER_THREAD  200000
+#define MAX_THREAD_COUNT  64
+
+static char  name_pool[NAME_POOL_SIZE][16];
+static size_t  name_pool_sizes[NAME_POOL_SIZE];
+
+struct bench_thread {
+    pthread_t  thread;
+    struct s0_name_table  *table;
+    unsigned int  seed;
+    size_t  failures;
+};
+
+static void *
+run_thread(void *ud)
+{
+    struct bench_thread  *thread = ud;
+    size_t  i;
+    for (i = 0; i < OPERATIONS_PER_THREAD; i++) {
+        size_t  index = rand_r(&thread->seed) % NAME_POOL_SIZE;
+        const struct s0_name  *name = s0_name_table_intern
+            (thread->table, name_pool_sizes[index], name_pool[index]);
+        if (name == NULL) {
+            thread->failures++;
+        }
+    }
+    return NULL;
+}
+
+static double
+now(void)
+{
+    struct timespec  ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+run(size_t thread_count)
+{
+    struct s0_name_table  *table;
+    struct bench_thread  threads[MAX_THREAD_COUNT];
+    double  start;
+    double  elapsed;
+    size_t  i;
+    size_t  failures = 0;
+
+    table = s0_name_table_new(NAME_POOL_SIZE);
+    if (table == NULL) {
+        fprintf(stderr, "%s\n", s0_error_get_last_description());
+        return -1;
+    }
+
+    start = now();
+    for (i = 0; i < thread_count; i++) {
+        threads[i].table = table;
+        threads[i].seed = i + 1;
+        threads[i].failures = 0;
+        if (pthread_create(&threads[i].thread, NULL, run_thread,
+                           &threads[i]) != 0) {
+            fprintf(stderr, "Cannot create thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (i = 0; i < thread_count; i++) {
+        pthread_join(threads[i].thread, NULL);
+        failures += threads[i].failures;
+    }
+    elapsed = now() - start;
+
+    printf("%zu\t%zu\t%.3f\t%.2f\n",
+           thread_count, thread_count * OPERATIONS_PER_THREAD, elapsed,
+           thread_count * OPERATIONS_PER_THREAD / elapsed / 1e6);
+    s0_name_table_free(table);
+    return (failures == 0)? 0: -1;
+}
+
+int
+main(void)
+{
+    size_t  i;
+    size_t  thread_count;
+
+    for (i = 0; i < NAME_POOL_SIZE; i++) {
+        name_pool_sizes[i] =
+            snprintf(name_pool[i], sizeof(name_pool[i]), "name%zu", i);
+    }
+
+    printf("# threads\toperations\tseconds\tMops/sec\n");
+    for (thread_count = 1; thread_count <= MAX_THREAD_COUNT;
+         thread_count *= 2) {
+        if (run(thread_count) != 0) {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
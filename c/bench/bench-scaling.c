@@ -0,0 +1,391 @@
+/* -*- coding: utf-8 -*-
+ * Copyright © 2016, Swanson Project.
+ * Please see the COPYING file in this distribution for license details.
+ */
+
+/* Measures how the cost of loading, type-checking, and executing a module
+ * scales along each of the dimensions that bench/generator.h can tune.  We vary
+ * one dimension at a time, leaving the others at their defaults, and print a
+ * TSV row for each module, which you can feed straight into a plotting tool.
+ * Anything that grows faster than linearly along a dimension is worth a
+ * look.
+ *
+ * With --counters, we also read hardware performance counters, and report
+ * them per byte of YAML while loading, and per statement while executing. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "bench/generator.h"
+#include "swanson.h"
+#include "swanson/perf-counters.h"
+
+/* We take the fastest of this many measurements of each module. */
+#define REPETITIONS  5
+
+static double
+now(void)
+{
+    struct timespec  ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+die(void)
+{
+    fprintf(stderr, "%s\n", s0_error_get_last_description());
+    exit(EXIT_FAILURE);
+}
+
+#define check_alloc(call) \
+    do { \
+        if ((call) == NULL) { \
+            die(); \
+        } \
+    } while (0)
+
+#define check0(call) \
+    do { \
+        if ((call) != 0) { \
+            die(); \
+        } \
+    } while (0)
+
+/* Returns the number of bytes currently allocated from the heap, or -1 if we
+ * can't tell on this platform. */
+static long
+heap_in_use(void)
+{
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2  info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return -1;
+#endif
+}
+
+
+/*-----------------------------------------------------------------------------
+ * Measurements
+ */
+
+/* NULL unless we're reading hardware counters */
+static struct swanson_perf_counters  *counters = NULL;
+
+struct measurement {
+    double  parse;
+    double  load;
+    /* Just the module-building part of `load`, timed in the same repetition */
+    double  build;
+    long  memory;
+    double  execute;
+    size_t  statements;
+    /* The smallest value of each counter across all repetitions */
+    struct swanson_perf_sample  load_counters;
+    struct swanson_perf_sample  execute_counters;
+};
+
+static void
+start_counting(struct swanson_perf_sample *start)
+{
+    if (counters != NULL) {
+        swanson_perf_counters_read(counters, start);
+    }
+}
+
+/* Keeps the smaller of each counter's value in `min` and the value that it's
+ * counted since `start`. */
+static void
+stop_counting(const struct swanson_perf_sample *start,
+              struct swanson_perf_sample *min)
+{
+    struct swanson_perf_sample  end;
+    size_t  i;
+    if (counters == NULL) {
+        return;
+    }
+    swanson_perf_counters_read(counters, &end);
+    for (i = 0; i < SWANSON_PERF_COUNTER_COUNT; i++) {
+        uint64_t  value = end.values[i] - start->values[i];
+        if (value < min->values[i]) {
+            min->values[i] = value;
+        }
+    }
+}
+
+static void
+fail_load(struct s0_yaml_stream *stream)
+{
+    fprintf(stderr, "%s\n", s0_yaml_stream_last_error(stream));
+    exit(EXIT_FAILURE);
+}
+
+/* Parses the YAML document, without interpreting it as a module. */
+static double
+measure_parse(const char *content)
+{
+    struct s0_yaml_stream  *stream;
+    struct s0_yaml_node  doc;
+    double  start = now();
+    double  elapsed;
+    check_alloc(stream = s0_yaml_stream_new_from_string(content));
+    doc = s0_yaml_stream_parse_document(stream);
+    elapsed = now() - start;
+    if (!s0_yaml_node_is_valid(doc)) {
+        fail_load(stream);
+    }
+    s0_yaml_stream_free(stream);
+    return elapsed;
+}
+
+/* Parses the YAML document and loads the module from it, which builds and
+ * type-checks all of its blocks.  Fills in `elapsed` with the time that the
+ * whole thing took, and `build` with the time spent on the module after the
+ * document was parsed. */
+static struct s0_block *
+load(const char *content, double *elapsed, double *build,
+     struct swanson_perf_sample *min)
+{
+    struct s0_yaml_stream  *stream;
+    struct s0_yaml_node  doc;
+    struct s0_entity  *module;
+    struct s0_name  *name;
+    struct s0_block  *block;
+    struct swanson_perf_sample  sample;
+    double  start;
+    double  build_start;
+    double  end;
+
+    start_counting(&sample);
+    start = now();
+
+    check_alloc(stream = s0_yaml_stream_new_from_string(content));
+    doc = s0_yaml_stream_parse_document(stream);
+    if (!s0_yaml_node_is_valid(doc)) {
+        fail_load(stream);
+    }
+    build_start = now();
+    module = s0_yaml_document_parse_module(doc);
+    if (module == NULL) {
+        fail_load(stream);
+    }
+    end = now();
+    *elapsed = end - start;
+    *build = end - build_start;
+    stop_counting(&sample, min);
+    s0_yaml_stream_free(stream);
+
+    check_alloc(name = s0_name_new_str("module"));
+    block = s0_named_blocks_delete(s0_closure_named_blocks(module), name);
+    s0_name_free(name);
+    s0_entity_free(module);
+    return block;
+}
+
+/* Includes the cost of creating the execution's `return` input. */
+static double
+measure_execute(struct s0_block *block, struct measurement *measurement)
+{
+    struct s0_environment  *env;
+    struct s0_name  *name;
+    struct s0_name  *input_name;
+    struct s0_entity_type  *result_type;
+    struct s0_entity  *extractor;
+    struct s0_entity  *result = NULL;
+    struct swanson_perf_sample  sample;
+    size_t  start_statements = s0_execution_statement_count();
+    double  start;
+    double  elapsed;
+
+    start_counting(&sample);
+    start = now();
+
+    check_alloc(env = s0_environment_new());
+    check_alloc(input_name = s0_name_new_str("result"));
+    check_alloc(result_type = s0_any_entity_type_new());
+    check_alloc(extractor =
+                s0_extractor_new(input_name, result_type, &result));
+    check_alloc(name = s0_name_new_str("return"));
+    check0(s0_environment_add(env, name, extractor));
+    check0(s0_block_execute(block, env));
+    elapsed = now() - start;
+    stop_counting(&sample, &measurement->execute_counters);
+    measurement->statements =
+        s0_execution_statement_count() - start_statements;
+
+    s0_environment_free(env);
+    s0_entity_free(result);
+    return elapsed;
+}
+
+static double
+min(double a, double b)
+{
+    return (a < b)? a: b;
+}
+
+static void
+measure(const char *content, struct measurement *result)
+{
+    size_t  i;
+    result->parse = 1e9;
+    result->load = 1e9;
+    result->build = 1e9;
+    result->execute = 1e9;
+    result->memory = -1;
+    memset(&result->load_counters, 0xff, sizeof(struct swanson_perf_sample));
+    memset(&result->execute_counters, 0xff,
+           sizeof(struct swanson_perf_sample));
+    for (i = 0; i < REPETITIONS; i++) {
+        struct s0_block  *block;
+        double  load_time;
+        double  build_time;
+        long  before = heap_in_use();
+
+        result->parse = min(result->parse, measure_parse(content));
+        block = load(content, &load_time, &build_time,
+                     &result->load_counters);
+        result->load = min(result->load, load_time);
+        result->build = min(result->build, build_time);
+        if (before >= 0) {
+            result->memory = heap_in_use() - before;
+        }
+        result->execute =
+            min(result->execute, measure_execute(block, result));
+        s0_block_free(block);
+    }
+}
+
+
+/*-----------------------------------------------------------------------------
+ * Dimensions
+ */
+
+struct dimension {
+    const char  *name;
+    size_t  *param;
+    size_t  values[8];
+};
+
+#define END_OF_VALUES  0
+
+static void
+print_counter_headers(const char *region, const char *unit)
+{
+    size_t  i;
+    for (i = 0; i < SWANSON_PERF_COUNTER_COUNT; i++) {
+        printf("\t%s %s/%s", region, swanson_perf_counter_name(i), unit);
+    }
+}
+
+static void
+print_counters(const struct swanson_perf_sample *sample, size_t per)
+{
+    size_t  i;
+    for (i = 0; i < SWANSON_PERF_COUNTER_COUNT; i++) {
+        if (!swanson_perf_counter_available(counters, i) || per == 0) {
+            printf("\t-");
+        } else {
+            printf("\t%.3f", (double) sample->values[i] / per);
+        }
+    }
+}
+
+static void
+usage(FILE *out)
+{
+    fprintf(out, "Usage: bench-scaling [--counters]\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    struct swanson_perf_counters  perf_counters;
+    struct generator_params  params;
+    struct dimension  dimensions[] = {
+        { "statements", &params.statement_count,
+            { 1, 4, 16, 64, 256, 1024, END_OF_VALUES } },
+        { "width", &params.environment_width,
+            { 1, 4, 16, 64, 256, 1024, END_OF_VALUES } },
+        { "depth", &params.closure_depth,
+            { 1, 4, 16, 64, 128, END_OF_VALUES } },
+        { "branches", &params.branch_count,
+            { 1, 4, 16, 64, 256, END_OF_VALUES } },
+        { "object-width", &params.object_width,
+            { 1, 4, 16, 64, 256, 1024, END_OF_VALUES } },
+        { "literal-size", &params.literal_size,
+            { 16, 256, 4096, 65536, 1048576, END_OF_VALUES } },
+        { NULL, NULL, { END_OF_VALUES } }
+    };
+    struct dimension  *dimension;
+
+    if (argc == 2 && strcmp(argv[1], "--counters") == 0) {
+        if (swanson_perf_counters_open(&perf_counters)) {
+            counters = &perf_counters;
+        } else {
+            fprintf(stderr,
+                    "Hardware performance counters are unavailable: %s\n",
+                    strerror(perf_counters.error));
+        }
+    } else if (argc != 1) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    printf("# dimension\tvalue\tbytes\tparse µs\tload µs\tbuild+check µs"
+           "\tmemory KiB\texecute µs");
+    if (counters != NULL) {
+        print_counter_headers("load", "byte");
+        print_counter_headers("execute", "statement");
+    }
+    printf("\n");
+    for (dimension = dimensions; dimension->name != NULL; dimension++) {
+        const size_t  *value;
+        for (value = dimension->values; *value != END_OF_VALUES; value++) {
+            struct measurement  result;
+            char  *content;
+            size_t  size;
+
+            generator_params_init(&params);
+            *dimension->param = *value;
+            content = generate_module(&params, &size);
+            if (content == NULL) {
+                fprintf(stderr, "Cannot allocate module\n");
+                return EXIT_FAILURE;
+            }
+
+            measure(content, &result);
+            printf("%s\t%zu\t%zu\t%.1f\t%.1f\t%.1f\t",
+                   dimension->name, *value, size,
+                   result.parse * 1e6, result.load * 1e6,
+                   result.build * 1e6);
+            if (result.memory >= 0) {
+                printf("%.1f\t", result.memory / 1024.0);
+            } else {
+                printf("-\t");
+            }
+            printf("%.1f", result.execute * 1e6);
+            if (counters != NULL) {
+                print_counters(&result.load_counters, size);
+                print_counters(&result.execute_counters, result.statements);
+            }
+            printf("\n");
+            fflush(stdout);
+            free(content);
+        }
+    }
+    if (counters != NULL) {
+        swanson_perf_counters_close(counters);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,219 @@
+/* -*- coding: utf-8 -*-
+ * Copyright © 2016, Swanson Project.
+ * Please see the COPYING file in this distribution for license details.
+ */
+
+/* Measures how quickly s0_shm_ring can pass entities between two processes.
+ * First we stream messages of a few different sizes from the parent to the
+ * child, to measure throughput; then we bounce a small message back and forth,
+ * to measure round-trip latency. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "swanson.h"
+
+#define RING_CAPACITY  (1 << 20)
+#define THROUGHPUT_MESSAGES  200000
+#define LATENCY_ROUND_TRIPS  100000
+
+static const size_t  payload_sizes[] = { 16, 256, 4096 };
+#define PAYLOAD_SIZE_COUNT  (sizeof(payload_sizes) / sizeof(payload_sizes[0]))
+
+static double
+now(void)
+{
+    struct timespec  ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+die(const char *what)
+{
+    fprintf(stderr, "%s: %s\n", what, s0_error_get_last_description());
+    exit(EXIT_FAILURE);
+}
+
+/* Creates an object with a `payload` literal of the given size. */
+static struct s0_entity *
+create_message(size_t size)
+{
+    struct s0_entity  *object;
+    char  *payload = malloc(size);
+    if (payload == NULL) {
+        fprintf(stderr, "Cannot allocate payload\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(payload, 'x', size);
+    object = s0_object_new();
+    if (object == NULL
+        || s0_object_add
+           (object, s0_name_new_str("payload"),
+            s0_literal_new(size, payload)) != 0) {
+        die("Cannot create message");
+    }
+    free(payload);
+    return object;
+}
+
+static void
+run_child(const char *to_child_name, const char *to_parent_name)
+{
+    struct s0_shm_ring  *in;
+    struct s0_shm_ring  *out;
+    struct s0_entity  *message;
+    size_t  i;
+    size_t  j;
+
+    in = s0_shm_ring_open(to_child_name);
+    out = s0_shm_ring_open(to_parent_name);
+    if (in == NULL || out == NULL) {
+        die("Cannot open rings");
+    }
+
+    /* Throughput: acknowledge each batch once all of it has arrived */
+    for (i = 0; i < PAYLOAD_SIZE_COUNT; i++) {
+        for (j = 0; j < THROUGHPUT_MESSAGES; j++) {
+            message = s0_shm_ring_receive(in);
+            if (message == NULL) {
+                die("Cannot receive message");
+            }
+            s0_entity_free(message);
+        }
+        message = s0_literal_new_str("done");
+        if (message == NULL || s0_shm_ring_send(out, message) != 0) {
+            die("Cannot send acknowledgement");
+        }
+        s0_entity_free(message);
+    }
+
+    /* Latency: echo everything back */
+    for (i = 0; i < LATENCY_ROUND_TRIPS; i++) {
+        message = s0_shm_ring_receive(in);
+        if (message == NULL || s0_shm_ring_send(out, message) != 0) {
+            die("Cannot echo message");
+        }
+        s0_entity_free(message);
+    }
+
+    s0_shm_ring_free(in);
+    s0_shm_ring_free(out);
+}
+
+static int
+compare_doubles(const void *a, const void *b)
+{
+    double  da = *(const double *) a;
+    double  db = *(const double *) b;
+    return (da < db)? -1: (da > db)? 1: 0;
+}
+
+static void
+run_parent(struct s0_shm_ring *out, struct s0_shm_ring *in)
+{
+    static const double  percentiles[] = { 50, 90, 99, 99.9, 100 };
+    struct s0_entity  *message;
+    double  *round_trips;
+    size_t  i;
+    size_t  j;
+
+    printf("# payload bytes\tmessages\tseconds\tmessages/sec\n");
+    for (i = 0; i < PAYLOAD_SIZE_COUNT; i++) {
+        double  start;
+        double  elapsed;
+        struct s0_entity  *ack;
+        message = create_message(payload_sizes[i]);
+        start = now();
+        for (j = 0; j < THROUGHPUT_MESSAGES; j++) {
+            if (s0_shm_ring_send(out, message) != 0) {
+                die("Cannot send message");
+            }
+        }
+        ack = s0_shm_ring_receive(in);
+        if (ack == NULL) {
+            die("Cannot receive acknowledgement");
+        }
+        elapsed = now() - start;
+        s0_entity_free(ack);
+        s0_entity_free(message);
+        printf("%zu\t%d\t%.3f\t%.0f\n",
+               payload_sizes[i], THROUGHPUT_MESSAGES, elapsed,
+               THROUGHPUT_MESSAGES / elapsed);
+    }
+
+    round_trips = malloc(LATENCY_ROUND_TRIPS * sizeof(double));
+    if (round_trips == NULL) {
+        fprintf(stderr, "Cannot allocate latency samples\n");
+        exit(EXIT_FAILURE);
+    }
+    message = create_message(payload_sizes[0]);
+    for (i = 0; i < LATENCY_ROUND_TRIPS; i++) {
+        struct s0_entity  *echo;
+        double  start = now();
+        if (s0_shm_ring_send(out, message) != 0) {
+            die("Cannot send message");
+        }
+        echo = s0_shm_ring_receive(in);
+        if (echo == NULL) {
+            die("Cannot receive echo");
+        }
+        round_trips[i] = now() - start;
+        s0_entity_free(echo);
+    }
+    s0_entity_free(message);
+
+    qsort(round_trips, LATENCY_ROUND_TRIPS, sizeof(double), compare_doubles);
+    printf("\n# percentile\tround trip µs\n");
+    for (i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+        size_t  index = percentiles[i] / 100 * (LATENCY_ROUND_TRIPS - 1);
+        printf("p%g\t%.2f\n", percentiles[i], round_trips[index] * 1e6);
+    }
+    free(round_trips);
+}
+
+int
+main(void)
+{
+    char  to_child_name[64];
+    char  to_parent_name[64];
+    struct s0_shm_ring  *to_child;
+    struct s0_shm_ring  *to_parent;
+    pid_t  pid;
+    int  status;
+
+    snprintf(to_child_name, sizeof(to_child_name),
+             "/bench-shm-ring-%ld-a", (long) getpid());
+    snprintf(to_parent_name, sizeof(to_parent_name),
+             "/bench-shm-ring-%ld-b", (long) getpid());
+    to_child = s0_shm_ring_new(to_child_name, RING_CAPACITY);
+    to_parent = s0_shm_ring_new(to_parent_name, RING_CAPACITY);
+    if (to_child == NULL || to_parent == NULL) {
+        die("Cannot create rings");
+    }
+
+    fflush(stdout);
+    pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return EXIT_FAILURE;
+    }
+    if (pid == 0) {
+        run_child(to_child_name, to_parent_name);
+        _exit(EXIT_SUCCESS);
+    }
+
+    run_parent(to_child, to_parent);
+    if (waitpid(pid, &status, 0) != pid
+        || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        fprintf(stderr, "Child process failed\n");
+        return EXIT_FAILURE;
+    }
+    s0_shm_ring_free(to_child);
+    s0_shm_ring_free(to_parent);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,600 @@
+/* -*- coding: utf-8 -*-
+ * Copyright © 2016, Swanson Project.
+ * Please see the COPYING file in this distribution for license details.
+ */
+
+/* Microbenchmarks for the core libswanson data structures, the YAML loader, and
+ * the execution engine.  Each benchmark performs a fixed number of operations,
+ * so the set of rows and their iteration counts are the same from run to run;
+ * only the timings change, which makes it easy to diff the output from two
+ * versions of the library. */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "swanson.h"
+
+/* Each row performs roughly this many operations. */
+#define OPERATIONS_PER_ROW  200000
+#define MAX_ENVIRONMENT_SIZE  256
+
+static double
+now(void)
+{
+    struct timespec  ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+die(void)
+{
+    fprintf(stderr, "%s\n", s0_error_get_last_description());
+    exit(EXIT_FAILURE);
+}
+
+#define check_alloc(call) \
+    do { \
+        if ((call) == NULL) { \
+            die(); \
+        } \
+    } while (0)
+
+#define check0(call) \
+    do { \
+        if ((call) != 0) { \
+            die(); \
+        } \
+    } while (0)
+
+static size_t
+iterations_for(size_t operations_per_iteration)
+{
+    size_t  iterations = OPERATIONS_PER_ROW / operations_per_iteration;
+    return (iterations == 0)? 1: iterations;
+}
+
+static void
+report(const char *benchmark, size_t size, size_t iterations,
+       size_t operations_per_iteration, double elapsed)
+{
+    printf("%s\t%zu\t%zu\t%.1f\n", benchmark, size, iterations,
+           elapsed * 1e9 / (iterations * operations_per_iteration));
+}
+
+/* Keeps the compiler from optimizing away the results that we're measuring. */
+static volatile size_t  sink;
+
+
+/*-----------------------------------------------------------------------------
+ * Names
+ */
+
+static char  name_content[1024];
+
+static void
+bench_name_new(size_t size)
+{
+    size_t  iterations = iterations_for(1);
+    size_t  i;
+    double  start = now();
+    for (i = 0; i < iterations; i++) {
+        struct s0_name  *name;
+        check_alloc(name = s0_name_new(size, name_content));
+        s0_name_free(name);
+    }
+    report("name-new", size, iterations, 1, now() - start);
+}
+
+static void
+bench_name_eq(size_t size)
+{
+    size_t  iterations = iterations_for(1);
+    struct s0_name  *a;
+    struct s0_name  *b;
+    size_t  i;
+    double  start;
+    check_alloc(a = s0_name_new(size, name_content));
+    check_alloc(b = s0_name_new(size, name_content));
+    start = now();
+    for (i = 0; i < iterations; i++) {
+        sink += s0_name_eq(a, b);
+    }
+    report("name-eq", size, iterations, 1, now() - start);
+    s0_name_free(a);
+    s0_name_free(b);
+}
+
+
+/*-----------------------------------------------------------------------------
+ * Environments
+ */
+
+static struct s0_name  *names[MAX_ENVIRONMENT_SIZE];
+static struct s0_name  *other_names[MAX_ENVIRONMENT_SIZE];
+
+static struct s0_environment *
+environment_new(struct s0_name **entry_names, size_t size)
+{
+    struct s0_environment  *env;
+    size_t  i;
+    check_alloc(env = s0_environment_new());
+    for (i = 0; i < size; i++) {
+        struct s0_name  *name;
+        struct s0_entity  *atom;
+        check_alloc(name = s0_name_new_copy(entry_names[i]));
+        check_alloc(atom = s0_atom_new());
+        check0(s0_environment_add(env, name, atom));
+    }
+    return env;
+}
+
+static void
+bench_environment_add(size_t size)
+{
+    size_t  iterations = iterations_for(size);
+    size_t  i;
+    double  start = now();
+    for (i = 0; i < iterations; i++) {
+        s0_environment_free(environment_new(names, size));
+    }
+    report("environment-add", size, iterations, size, now() - start);
+}
+
+static void
+bench_environment_get(size_t size)
+{
+    size_t  iterations = iterations_for(size);
+    struct s0_environment  *env = environment_new(names, size);
+    size_t  i;
+    size_t  j;
+    double  start = now();
+    for (i = 0; i < iterations; i++) {
+        for (j = 0; j < size; j++) {
+            sink += (s0_environment_get(env, names[j]) != NULL);
+        }
+    }
+    report("environment-get", size, iterations, size, now() - start);
+    s0_environment_free(env);
+}
+
+/* Deletes each entry and adds it back again. */
+static void
+bench_environment_delete(size_t size)
+{
+    size_t  iterations = iterations_for(size);
+    struct s0_environment  *env = environment_new(names, size);
+    size_t  i;
+    size_t  j;
+    double  start = now();
+    for (i = 0; i < iterations; i++) {
+        for (j = 0; j < size; j++) {
+            struct s0_entity  *entity = s0_environment_delete(env, names[j]);
+            struct s0_name  *name;
+            check_alloc(name = s0_name_new_copy(names[j]));
+            check0(s0_environment_add(env, name, entity));
+        }
+    }
+    report("environment-delete-add", size, iterations, size, now() - start);
+    s0_environment_free(env);
+}
+
+/* Merges one environment into another, and then extracts its entries back
+ * out, as when invoking a closure. */
+static void
+bench_environment_merge(size_t size)
+{
+    size_t  iterations = iterations_for(size);
+    struct s0_environment  *src = environment_new(names, size);
+    struct s0_environment  *dest = environment_new(other_names, size);
+    struct s0_name_set  *set;
+    size_t  i;
+    double  start;
+
+    check_alloc(set = s0_name_set_new());
+    for (i = 0; i < size; i++) {
+        struct s0_name  *name;
+        check_alloc(name = s0_name_new_copy(names[i]));
+        check0(s0_name_set_add(set, name));
+    }
+
+    start = now();
+    for (i = 0; i < iterations; i++) {
+        check0(s0_environment_merge(dest, src));
+        check0(s0_environment_extract(src, dest, set));
+    }
+    report("environment-merge-extract", size, iterations, 1, now() - start);
+    s0_name_set_free(set);
+    s0_environment_free(src);
+    s0_environment_free(dest);
+}
+
+static struct s0_name_mapping *
+name_mapping_new(struct s0_name **from, struct s0_name **to, size_t size)
+{
+    struct s0_name_mapping  *mapping;
+    size_t  i;
+    check_alloc(mapping = s0_name_mapping_new());
+    for (i = 0; i < size; i++) {
+        struct s0_name  *from_name;
+        struct s0_name  *to_name;
+        check_alloc(from_name = s0_name_new_copy(from[i]));
+        check_alloc(to_name = s0_name_new_copy(to[i]));
+        check0(s0_name_mapping_add(mapping, from_name, to_name));
+    }
+    return mapping;
+}
+
+/* Renames every entry, and then renames them back again. */
+static void
+bench_environment_rename(size_t size)
+{
+    size_t  iterations = iterations_for(size);
+    struct s0_environment  *env = environment_new(names, size);
+    struct s0_name_mapping  *forward =
+        name_mapping_new(names, other_names, size);
+    struct s0_name_mapping  *backward =
+        name_mapping_new(other_names, names, size);
+    size_t  i;
+    double  start = now();
+    for (i = 0; i < iterations; i++) {
+        check0(s0_environment_rename(env, forward));
+        check0(s0_environment_rename(env, backward));
+    }
+    report("environment-rename", size, iterations, 2, now() - start);
+    s0_name_mapping_free(forward);
+    s0_name_mapping_free(backward);
+    s0_environment_free(env);
+}
+
+
+/*-----------------------------------------------------------------------------
+ * Types
+ */
+
+/* An object type with `size` elements, each of which is a method that takes an
+ * object and a closure. */
+static struct s0_entity_type *
+object_type_new(size_t size)
+{
+    struct s0_environment_type  *elements;
+    size_t  i;
+    check_alloc(elements = s0_environment_type_new());
+    for (i = 0; i < size; i++) {
+        struct s0_environment_type  *body;
+        struct s0_environment_type  *self_elements;
+        struct s0_environment_type_mapping  *branches;
+        struct s0_entity_type  *type;
+        struct s0_name  *name;
+
+        check_alloc(body = s0_environment_type_new());
+        check_alloc(self_elements = s0_environment_type_new());
+        check_alloc(type = s0_object_entity_type_new(self_elements));
+        check_alloc(name = s0_name_new_str("self"));
+        check0(s0_environment_type_add(body, name, type));
+        check_alloc(branches = s0_environment_type_mapping_new());
+        check_alloc(type = s0_closure_entity_type_new(branches));
+        check_alloc(name = s0_name_new_str("then"));
+        check0(s0_environment_type_add(body, name, type));
+
+        check_alloc(type = s0_method_entity_type_new(body));
+        check_alloc(name = s0_name_new_copy(names[i]));
+        check0(s0_environment_type_add(elements, name, type));
+    }
+    return s0_object_entity_type_new(elements);
+}
+
+static void
+bench_type_new(size_t size)
+{
+    size_t  iterations = iterations_for(size);
+    size_t  i;
+    double  start = now();
+    for (i = 0; i < iterations; i++) {
+        struct s0_entity_type  *type;
+        check_alloc(type = object_type_new(size));
+        s0_entity_type_free(type);
+    }
+    report("object-type-new", size, iterations, 1, now() - start);
+}
+
+static void
+bench_type_satisfied_by_type(size_t size)
+{
+    size_t  iterations = iterations_for(size);
+    struct s0_entity_type  *requires;
+    struct s0_entity_type  *have;
+    size_t  i;
+    double  start;
+    check_alloc(requires = object_type_new(size));
+    check_alloc(have = object_type_new(size));
+    start = now();
+    for (i = 0; i < iterations; i++) {
+        sink += s0_entity_type_satisfied_by_type(requires, have);
+    }
+    report("object-type-satisfied-by-type", size, iterations, 1,
+           now() - start);
+    s0_entity_type_free(requires);
+    s0_entity_type_free(have);
+}
+
+
+/*-----------------------------------------------------------------------------
+ * Modules
+ */
+
+struct buffer {
+    char  *content;
+    size_t  size;
+    size_t  allocated;
+};
+
+static void
+buffer_init(struct buffer *buf)
+{
+    buf->content = NULL;
+    buf->size = 0;
+    buf->allocated = 0;
+}
+
+static void
+buffer_done(struct buffer *buf)
+{
+    free(buf->content);
+}
+
+static void
+buffer_printf(struct buffer *buf, const char *fmt, ...)
+{
+    va_list  args;
+    int  length;
+
+    va_start(args, fmt);
+    length = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    if (buf->size + length + 1 > buf->allocated) {
+        size_t  new_allocated = (buf->allocated == 0)? 4096: buf->allocated;
+        while (buf->size + length + 1 > new_allocated) {
+            new_allocated *= 2;
+        }
+        buf->content = realloc(buf->content, new_allocated);
+        if (buf->content == NULL) {
+            fprintf(stderr, "Cannot allocate %zu bytes\n", new_allocated);
+            exit(EXIT_FAILURE);
+        }
+        buf->allocated = new_allocated;
+    }
+
+    va_start(args, fmt);
+    vsnprintf(buf->content + buf->size, length + 1, fmt, args);
+    va_end(args);
+    buf->size += length;
+}
+
+#define RETURN_TYPE \
+    "!s0!closure {branches: {body: {result: !s0!any {}}}}"
+
+/* The body of a loop that runs for `size` iterations, unrolled into a chain of
+ * nested closures, each of which invokes the next. */
+static void
+closure_chain_block(struct buffer *buf, size_t size)
+{
+    buffer_printf(buf, "{inputs: {return: " RETURN_TYPE "}, ");
+    if (size == 0) {
+        buffer_printf
+            (buf,
+             "statements: [!s0!create-literal {dest: result, content: done}], "
+             "invocation: !s0!invoke-closure {src: return, branch: body, "
+             "parameters: {result: result}}}");
+    } else {
+        buffer_printf
+            (buf,
+             "statements: [!s0!create-closure {dest: next, closed-over: [], "
+             "branches: {body: ");
+        closure_chain_block(buf, size - 1);
+        buffer_printf
+            (buf,
+             "}}], "
+             "invocation: !s0!invoke-closure {src: next, branch: body, "
+             "parameters: {return: return}}}");
+    }
+}
+
+static void
+closure_chain_module(struct buffer *buf, size_t size)
+{
+    buffer_printf(buf, "%%TAG !s0! " SWANSON_TAG_PREFIX "\n");
+    buffer_printf(buf, "--- !s0!module\n");
+    closure_chain_block(buf, size);
+    buffer_printf(buf, "\n");
+}
+
+static struct s0_entity *
+load_module(const char *content)
+{
+    struct s0_yaml_stream  *stream;
+    struct s0_yaml_node  doc;
+    struct s0_entity  *module;
+    check_alloc(stream = s0_yaml_stream_new_from_string(content));
+    doc = s0_yaml_stream_parse_document(stream);
+    if (!s0_yaml_node_is_valid(doc)) {
+        fprintf(stderr, "%s\n", s0_yaml_stream_last_error(stream));
+        exit(EXIT_FAILURE);
+    }
+    module = s0_yaml_document_parse_module(doc);
+    if (module == NULL) {
+        fprintf(stderr, "%s\n", s0_yaml_stream_last_error(stream));
+        exit(EXIT_FAILURE);
+    }
+    s0_yaml_stream_free(stream);
+    return module;
+}
+
+static struct s0_block *
+load_module_block(const char *content)
+{
+    struct s0_entity  *module = load_module(content);
+    struct s0_name  *name;
+    struct s0_block  *block;
+    check_alloc(name = s0_name_new_str("module"));
+    block = s0_named_blocks_delete(s0_closure_named_blocks(module), name);
+    s0_name_free(name);
+    s0_entity_free(module);
+    return block;
+}
+
+static void
+bench_yaml_parse(size_t size)
+{
+    size_t  iterations = iterations_for(size * 10);
+    struct buffer  buf;
+    size_t  i;
+    double  start;
+    buffer_init(&buf);
+    closure_chain_module(&buf, size);
+    start = now();
+    for (i = 0; i < iterations; i++) {
+        struct s0_yaml_stream  *stream;
+        struct s0_yaml_node  doc;
+        check_alloc(stream = s0_yaml_stream_new_from_string(buf.content));
+        doc = s0_yaml_stream_parse_document(stream);
+        sink += s0_yaml_node_is_valid(doc);
+        s0_yaml_stream_free(stream);
+    }
+    report("yaml-parse", size, iterations, 1, now() - start);
+    buffer_done(&buf);
+}
+
+static void
+bench_module_load(size_t size)
+{
+    size_t  iterations = iterations_for(size * 10);
+    struct buffer  buf;
+    size_t  i;
+    double  start;
+    buffer_init(&buf);
+    closure_chain_module(&buf, size);
+    start = now();
+    for (i = 0; i < iterations; i++) {
+        s0_entity_free(load_module(buf.content));
+    }
+    report("module-load", size, iterations, 1, now() - start);
+    buffer_done(&buf);
+}
+
+/* Includes the cost of creating each execution's `return` input. */
+static void
+bench_execute(const char *benchmark, struct s0_block *block, size_t size)
+{
+    size_t  iterations = iterations_for(size + 1);
+    size_t  i;
+    double  start = now();
+    for (i = 0; i < iterations; i++) {
+        struct s0_environment  *env;
+        struct s0_name  *name;
+        struct s0_name  *input_name;
+        struct s0_entity_type  *result_type;
+        struct s0_entity  *extractor;
+        struct s0_entity  *result = NULL;
+
+        check_alloc(env = s0_environment_new());
+        check_alloc(input_name = s0_name_new_str("result"));
+        check_alloc(result_type = s0_any_entity_type_new());
+        check_alloc(extractor =
+                    s0_extractor_new(input_name, result_type, &result));
+        check_alloc(name = s0_name_new_str("return"));
+        check0(s0_environment_add(env, name, extractor));
+        check0(s0_block_execute(block, env));
+        s0_environment_free(env);
+        s0_entity_free(result);
+    }
+    report(benchmark, size, iterations, 1, now() - start);
+}
+
+static void
+bench_execute_closure_chain(size_t size)
+{
+    struct buffer  buf;
+    struct s0_block  *block;
+    buffer_init(&buf);
+    closure_chain_module(&buf, size);
+    check_alloc(block = load_module_block(buf.content));
+    bench_execute("execute-closure-chain", block, size);
+    s0_block_free(block);
+    buffer_done(&buf);
+}
+
+
+/*-----------------------------------------------------------------------------
+ * Driver
+ */
+
+static const size_t  name_sizes[] = { 8, 64, 1024 };
+static const size_t  environment_sizes[] = { 1, 4, 16, 64, 256 };
+static const size_t  module_sizes[] = { 1, 8, 64 };
+
+#define COUNT(array)  (sizeof(array) / sizeof(array[0]))
+
+int
+main(void)
+{
+    size_t  i;
+
+    memset(name_content, 'x', sizeof(name_content));
+    for (i = 0; i < MAX_ENVIRONMENT_SIZE; i++) {
+        char  buf[32];
+        snprintf(buf, sizeof(buf), "name%zu", i);
+        check_alloc(names[i] = s0_name_new_str(buf));
+        snprintf(buf, sizeof(buf), "other%zu", i);
+        check_alloc(other_names[i] = s0_name_new_str(buf));
+    }
+
+    printf("# benchmark\tsize\titerations\tns/op\n");
+    for (i = 0; i < COUNT(name_sizes); i++) {
+        bench_name_new(name_sizes[i]);
+    }
+    for (i = 0; i < COUNT(name_sizes); i++) {
+        bench_name_eq(name_sizes[i]);
+    }
+    for (i = 0; i < COUNT(environment_sizes); i++) {
+        bench_environment_add(environment_sizes[i]);
+    }
+    for (i = 0; i < COUNT(environment_sizes); i++) {
+        bench_environment_get(environment_sizes[i]);
+    }
+    for (i = 0; i < COUNT(environment_sizes); i++) {
+        bench_environment_delete(environment_sizes[i]);
+    }
+    for (i = 0; i < COUNT(environment_sizes); i++) {
+        bench_environment_merge(environment_sizes[i]);
+    }
+    for (i = 0; i < COUNT(environment_sizes); i++) {
+        bench_environment_rename(environment_sizes[i]);
+    }
+    for (i = 0; i < COUNT(environment_sizes); i++) {
+        bench_type_new(environment_sizes[i]);
+    }
+    for (i = 0; i < COUNT(environment_sizes); i++) {
+        bench_type_satisfied_by_type(environment_sizes[i]);
+    }
+    for (i = 0; i < COUNT(module_sizes); i++) {
+        bench_yaml_parse(module_sizes[i]);
+    }
+    for (i = 0; i < COUNT(module_sizes); i++) {
+        bench_module_load(module_sizes[i]);
+    }
+    for (i = 0; i < COUNT(module_sizes); i++) {
+        bench_execute_closure_chain(module_sizes[i]);
+    }
+
+    for (i = 0; i < MAX_ENVIRONMENT_SIZE; i++) {
+        s0_name_free(names[i]);
+        s0_name_free(other_names[i]);
+    }
+    return EXIT_SUCCESS;
+}
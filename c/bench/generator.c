@@ -0,0 +1,300 @@
+/* -*- coding: utf-8 -*-
+ * Copyright © 2016, Swanson Project.
+ * Please see the COPYING file in this distribution for license details.
+ */
+
+#include "bench/generator.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "swanson.h"
+
+void
+generator_params_init(struct generator_params *params)
+{
+    params->statement_count = 4;
+    params->environment_width = 4;
+    params->closure_depth = 4;
+    params->branch_count = 2;
+    params->object_width = 4;
+    params->literal_size = 16;
+}
+
+
+/*-----------------------------------------------------------------------------
+ * Output buffer
+ */
+
+struct generator {
+    const struct generator_params  *params;
+    char  *content;
+    size_t  size;
+    size_t  allocated;
+    bool  out_of_memory;
+};
+
+static void
+generator_reserve(struct generator *gen, size_t length)
+{
+    size_t  new_allocated;
+    char  *new_content;
+
+    if (gen->size + length + 1 <= gen->allocated) {
+        return;
+    }
+    new_allocated = (gen->allocated == 0)? 4096: gen->allocated;
+    while (gen->size + length + 1 > new_allocated) {
+        new_allocated *= 2;
+    }
+    new_content = realloc(gen->content, new_allocated);
+    if (new_content == NULL) {
+        gen->out_of_memory = true;
+        return;
+    }
+    gen->content = new_content;
+    gen->allocated = new_allocated;
+}
+
+/* Appends a line, indented by `indent` spaces. */
+static void
+line(struct generator *gen, size_t indent, const char *fmt, ...)
+{
+    va_list  args;
+    int  length;
+
+    if (gen->out_of_memory) {
+        return;
+    }
+
+    va_start(args, fmt);
+    length = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    generator_reserve(gen, indent + length + 1);
+    if (gen->out_of_memory) {
+        return;
+    }
+
+    memset(gen->content + gen->size, ' ', indent);
+    gen->size += indent;
+    va_start(args, fmt);
+    vsnprintf(gen->content + gen->size, length + 1, fmt, args);
+    va_end(args);
+    gen->size += length;
+    gen->content[gen->size++] = '\n';
+    gen->content[gen->size] = '\0';
+}
+
+
+/*-----------------------------------------------------------------------------
+ * Modules
+ */
+
+#define RETURN_TYPE \
+    "!s0!closure {branches: {body: {result: !s0!any {}}}}"
+
+/* The names of the literals that a block at `level` has in its environment.
+ * The first environment_width are carried all the way down the closure chain;
+ * the innermost block creates the rest itself. */
+static size_t
+literal_count(const struct generator *gen, size_t level)
+{
+    return (level == gen->params->closure_depth)?
+        gen->params->environment_width + gen->params->statement_count:
+        gen->params->environment_width;
+}
+
+static void
+object_type(struct generator *gen, size_t indent, const char *name)
+{
+    size_t  i;
+    if (gen->params->object_width == 0) {
+        line(gen, indent, "%s: !s0!object {}", name);
+        return;
+    }
+    line(gen, indent, "%s: !s0!object", name);
+    for (i = 0; i < gen->params->object_width; i++) {
+        line(gen, indent + 2,
+             "method%zu: !s0!method {inputs: {self: !s0!object {}}}", i);
+    }
+}
+
+/* The body of the closure that the innermost block returns.  It's never
+ * executed, but it has to type-check, and like every block, it has to pass
+ * along everything in its environment: the `count` literals that it closes
+ * over, and its own inputs. */
+static void
+bundle_body(struct generator *gen, size_t indent, size_t count)
+{
+    size_t  i;
+    line(gen, indent, "inputs:");
+    line(gen, indent + 2, "then: !s0!closure");
+    line(gen, indent + 4, "branches:");
+    line(gen, indent + 6, "body:");
+    for (i = 0; i < count; i++) {
+        line(gen, indent + 8, "literal%zu: !s0!any {}", i);
+    }
+    object_type(gen, indent + 8, "object");
+    object_type(gen, indent + 2, "object");
+    line(gen, indent, "statements: []");
+    line(gen, indent, "invocation:");
+    line(gen, indent + 2, "!s0!invoke-closure");
+    line(gen, indent + 2, "src: then");
+    line(gen, indent + 2, "branch: body");
+    line(gen, indent + 2, "parameters:");
+    for (i = 0; i < count; i++) {
+        line(gen, indent + 4, "literal%zu: literal%zu", i, i);
+    }
+    line(gen, indent + 4, "object: object");
+}
+
+/* Statements that close over `count` literals and pass the resulting closure to
+ * `return`. */
+static void
+return_bundle(struct generator *gen, size_t indent, size_t count)
+{
+    size_t  i;
+    line(gen, indent, "- !s0!create-closure");
+    line(gen, indent + 2, "dest: result");
+    if (count == 0) {
+        line(gen, indent + 2, "closed-over: []");
+    } else {
+        line(gen, indent + 2, "closed-over:");
+        for (i = 0; i < count; i++) {
+            line(gen, indent + 4, "- literal%zu", i);
+        }
+    }
+    line(gen, indent + 2, "branches:");
+    line(gen, indent + 4, "body:");
+    bundle_body(gen, indent + 6, count);
+}
+
+static void
+return_invocation(struct generator *gen, size_t indent)
+{
+    line(gen, indent, "invocation:");
+    line(gen, indent + 2, "!s0!invoke-closure");
+    line(gen, indent + 2, "src: return");
+    line(gen, indent + 2, "branch: body");
+    line(gen, indent + 2, "parameters:");
+    line(gen, indent + 4, "result: result");
+}
+
+static void
+create_literal(struct generator *gen, size_t indent, size_t index)
+{
+    size_t  length = gen->params->literal_size;
+    line(gen, indent, "- !s0!create-literal");
+    line(gen, indent + 2, "dest: literal%zu", index);
+    /* Build the content in place, since it can be arbitrarily large. */
+    line(gen, indent + 2, "content: \"");
+    generator_reserve(gen, length + 2);
+    if (gen->out_of_memory) {
+        return;
+    }
+    /* Overwrite the newline that `line` added. */
+    gen->size--;
+    memset(gen->content + gen->size, 'x', length);
+    gen->size += length;
+    gen->content[gen->size++] = '"';
+    gen->content[gen->size++] = '\n';
+    gen->content[gen->size] = '\0';
+}
+
+static void
+block_inputs(struct generator *gen, size_t indent, size_t level)
+{
+    size_t  i;
+    line(gen, indent, "inputs:");
+    line(gen, indent + 2, "return: " RETURN_TYPE);
+    if (level > 0) {
+        for (i = 0; i < gen->params->environment_width; i++) {
+            line(gen, indent + 2, "literal%zu: !s0!any {}", i);
+        }
+    }
+}
+
+/* A block that immediately returns everything it was given. */
+static void
+leaf_block(struct generator *gen, size_t indent, size_t level)
+{
+    block_inputs(gen, indent, level);
+    line(gen, indent, "statements:");
+    return_bundle(gen, indent + 2, gen->params->environment_width);
+    return_invocation(gen, indent);
+}
+
+/* The block at `level` of the closure chain.  The module itself is level 0. */
+static void
+chain_block(struct generator *gen, size_t indent, size_t level)
+{
+    const struct generator_params  *params = gen->params;
+    size_t  i;
+
+    block_inputs(gen, indent, level);
+    line(gen, indent, "statements:");
+    if (level == 0) {
+        for (i = 0; i < params->environment_width; i++) {
+            create_literal(gen, indent + 2, i);
+        }
+    }
+
+    if (level == params->closure_depth) {
+        for (i = params->environment_width;
+             i < literal_count(gen, level); i++) {
+            create_literal(gen, indent + 2, i);
+        }
+        return_bundle(gen, indent + 2, literal_count(gen, level));
+        return_invocation(gen, indent);
+        return;
+    }
+
+    line(gen, indent + 2, "- !s0!create-closure");
+    line(gen, indent + 4, "dest: next");
+    line(gen, indent + 4, "closed-over: []");
+    line(gen, indent + 4, "branches:");
+    line(gen, indent + 6, "branch0:");
+    chain_block(gen, indent + 8, level + 1);
+    for (i = 1; i < params->branch_count; i++) {
+        line(gen, indent + 6, "branch%zu:", i);
+        leaf_block(gen, indent + 8, level + 1);
+    }
+
+    line(gen, indent, "invocation:");
+    line(gen, indent + 2, "!s0!invoke-closure");
+    line(gen, indent + 2, "src: next");
+    line(gen, indent + 2, "branch: branch0");
+    line(gen, indent + 2, "parameters:");
+    line(gen, indent + 4, "return: return");
+    for (i = 0; i < params->environment_width; i++) {
+        line(gen, indent + 4, "literal%zu: literal%zu", i, i);
+    }
+}
+
+char *
+generate_module(const struct generator_params *params, size_t *size)
+{
+    struct generator  gen;
+    gen.params = params;
+    gen.content = NULL;
+    gen.size = 0;
+    gen.allocated = 0;
+    gen.out_of_memory = false;
+
+    line(&gen, 0, "%%TAG !s0! " SWANSON_TAG_PREFIX);
+    line(&gen, 0, "--- !s0!module");
+    chain_block(&gen, 0, 0);
+
+    if (gen.out_of_memory) {
+        free(gen.content);
+        return NULL;
+    }
+    if (size != NULL) {
+        *size = gen.size;
+    }
+    return gen.content;
+}
@@ -0,0 +1,43 @@
+/* -*- coding: utf-8 -*-
+ * Copyright © 2016, Swanson Project.
+ * Please see the COPYING file in this distribution for license details.
+ */
+
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <stddef.h>
+
+/* Generates synthetic S₀ modules, whose size along each of several dimensions
+ * can be tuned independently.  Each module takes a single `return` input (a
+ * closure with a `body` branch that takes a `result`), and executes
+ * successfully.
+ *
+ * The module creates `environment_width` literals, and then passes them down a
+ * chain of `closure_depth` nested closures.  Each of those closures has
+ * `branch_count` branches; the first continues the chain, and the rest return
+ * immediately.  The innermost block creates `statement_count` more literals,
+ * and returns a closure that has closed over all of the literals.  That
+ * closure's (never executed) body passes everything it has, along with an
+ * object with `object_width` methods, to another closure.  Each literal's
+ * content is `literal_size` bytes long. */
+struct generator_params {
+    size_t  statement_count;
+    size_t  environment_width;
+    size_t  closure_depth;
+    size_t  branch_count;
+    size_t  object_width;
+    size_t  literal_size;
+};
+
+/* Fills in a small default value for each dimension. */
+void
+generator_params_init(struct generator_params *params);
+
+/* Returns a NUL-terminated YAML document containing the module, or NULL if we
+ * can't allocate it.  You're responsible for freeing the result.  If size is
+ * not NULL, we fill it in with the length of the document. */
+char *
+generate_module(const struct generator_params *params, size_t *size);
+
+#endif /* GENERATOR_H */
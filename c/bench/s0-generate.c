@@ -0,0 +1,123 @@
+/* -*- coding: utf-8 -*-
+ * Copyright © 2016, Swanson Project.
+ * Please see the COPYING file in this distribution for license details.
+ */
+
+/* Prints a synthetic S₀ module to stdout.  See bench/generator.h for what the
+ * module looks like, and how each option affects it. */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench/generator.h"
+
+static void
+usage(FILE *out)
+{
+    struct generator_params  defaults;
+    generator_params_init(&defaults);
+    fprintf(out,
+            "Usage: s0-generate [options]\n"
+            "\n"
+            "Options (defaults in parentheses):\n"
+            "  --statements=N     Statements in the innermost block (%zu)\n"
+            "  --width=N          Literals passed down the closure chain "
+            "(%zu)\n"
+            "  --depth=N          Length of the closure chain (%zu)\n"
+            "  --branches=N       Branches in each closure (%zu)\n"
+            "  --object-width=N   Methods in the bundled object type (%zu)\n"
+            "  --literal-size=N   Bytes in each literal (%zu)\n"
+            "  -h, --help         Print this message\n",
+            defaults.statement_count, defaults.environment_width,
+            defaults.closure_depth, defaults.branch_count,
+            defaults.object_width, defaults.literal_size);
+}
+
+enum {
+    OPTION_STATEMENTS = 256,
+    OPTION_WIDTH,
+    OPTION_DEPTH,
+    OPTION_BRANCHES,
+    OPTION_OBJECT_WIDTH,
+    OPTION_LITERAL_SIZE
+};
+
+static const struct option  options[] = {
+    { "statements", required_argument, NULL, OPTION_STATEMENTS },
+    { "width", required_argument, NULL, OPTION_WIDTH },
+    { "depth", required_argument, NULL, OPTION_DEPTH },
+    { "branches", required_argument, NULL, OPTION_BRANCHES },
+    { "object-width", required_argument, NULL, OPTION_OBJECT_WIDTH },
+    { "literal-size", required_argument, NULL, OPTION_LITERAL_SIZE },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+};
+
+static size_t *
+option_dest(struct generator_params *params, int opt)
+{
+    switch (opt) {
+        case OPTION_STATEMENTS:
+            return &params->statement_count;
+        case OPTION_WIDTH:
+            return &params->environment_width;
+        case OPTION_DEPTH:
+            return &params->closure_depth;
+        case OPTION_BRANCHES:
+            return &params->branch_count;
+        case OPTION_OBJECT_WIDTH:
+            return &params->object_width;
+        case OPTION_LITERAL_SIZE:
+            return &params->literal_size;
+        default:
+            return NULL;
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    struct generator_params  params;
+    char  *module;
+    size_t  size;
+    int  opt;
+
+    generator_params_init(&params);
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        size_t  *dest = option_dest(&params, opt);
+        if (dest != NULL) {
+            char  *end;
+            unsigned long  value = strtoul(optarg, &end, 10);
+            if (*optarg == '\0' || *optarg == '-' || *end != '\0') {
+                fprintf(stderr, "Invalid count `%s`\n", optarg);
+                return EXIT_FAILURE;
+            }
+            *dest = value;
+        } else if (opt == 'h') {
+            usage(stdout);
+            return EXIT_SUCCESS;
+        } else {
+            usage(stderr);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+    if (params.branch_count == 0) {
+        fprintf(stderr, "Each closure needs at least one branch\n");
+        return EXIT_FAILURE;
+    }
+
+    module = generate_module(&params, &size);
+    if (module == NULL) {
+        fprintf(stderr, "Cannot allocate module\n");
+        return EXIT_FAILURE;
+    }
+    fwrite(module, 1, size, stdout);
+    free(module);
+    return EXIT_SUCCESS;
+}
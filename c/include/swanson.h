@@ -35,7 +35,8 @@ enum s0_error_code {
 };
 
 /* If any function below returns NULL or -1 to signify an error, you can then
- * call this function to find outwhat kind of error it was. */
+ * call this function to find outwhat kind of error it was.  Errors are
+ * recorded in the calling thread's current runtime (see below). */
 enum s0_error_code
 s0_error_get_last_code(void);
 
@@ -47,6 +48,76 @@ const char *
 s0_error_get_last_description(void);
 
 
+/*-----------------------------------------------------------------------------
+ * S₀: Allocation
+ */
+
+/* Returns the number of times that libswanson has allocated or reallocated
+ * memory so far, on any thread.  This only counts our own allocations, and not
+ * those of libyaml or of the code that's calling us. */
+size_t
+s0_allocation_count(void);
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: Runtimes
+ */
+
+/* A runtime holds the state that libswanson keeps on behalf of whoever is
+ * running it: the details of the most recent error, and the name table that
+ * the YAML loader interns names into.  Everything else (modules, executions,
+ * schedulers, event loops, I/O contexts) is an explicit object that you create
+ * and pass around yourself, so that it can be shared between runtimes.
+ *
+ * Each thread has its own default runtime, so threads never see each other's
+ * errors; you can also create runtimes explicitly and switch between them,
+ * which lets several interpreters share a thread without clobbering each
+ * other's state.  The default runtimes all share a single name table, which
+ * is never freed, so a module loaded on one thread can be run on any other. */
+struct s0_runtime;
+
+struct s0_runtime *
+s0_runtime_new(void);
+
+/* runtime MUST NOT be the calling thread's current runtime.  This frees the
+ * runtime's name table, so nothing that was loaded while the runtime was
+ * current can outlive it. */
+void
+s0_runtime_free(struct s0_runtime *runtime);
+
+/* Returns the calling thread's current runtime.  This is the thread's default
+ * runtime unless you've selected a different one with s0_runtime_set_current.
+ * We retain ownership of the default runtime; you must not free it. */
+struct s0_runtime *
+s0_runtime_current(void);
+
+/* Makes runtime the calling thread's current runtime, and returns the
+ * previously selected one (or NULL if the thread was using its default).  Pass
+ * in NULL to switch back to the thread's default runtime.  You retain
+ * ownership of runtime, and MUST keep it alive while it's current. */
+struct s0_runtime *
+s0_runtime_set_current(struct s0_runtime *runtime);
+
+/* Returns the code of the most recent error recorded in runtime. */
+enum s0_error_code
+s0_runtime_error_code(const struct s0_runtime *runtime);
+
+/* Returns a human-readable description of the most recent error recorded in
+ * runtime.  Errors are only rendered into text when you call this function.
+ * The runtime retains ownership of the result, which is only valid until the
+ * next error is recorded in the runtime. */
+const char *
+s0_runtime_error_description(struct s0_runtime *runtime);
+
+struct s0_name_table;
+
+/* Returns the name table that the YAML loader interns names into while
+ * runtime is current.  You can intern your own names in it, too.  The runtime
+ * retains ownership of the table.  Returns NULL if we can't allocate it. */
+struct s0_name_table *
+s0_runtime_name_table(struct s0_runtime *runtime);
+
+
 /*-----------------------------------------------------------------------------
  * S₀: Names
  */
@@ -64,6 +135,7 @@ s0_name_new_str(const void *content);
 struct s0_name *
 s0_name_new_copy(const struct s0_name *other);
 
+/* Does nothing if name is interned (see s0_name_table_intern). */
 void
 s0_name_free(struct s0_name *);
 
@@ -80,6 +152,48 @@ bool
 s0_name_eq(const struct s0_name *, const struct s0_name *);
 
 
+/*-----------------------------------------------------------------------------
+ * S₀: Name tables
+ */
+
+/* A name table interns names, giving you a single canonical s0_name instance
+ * for each distinct name.  Canonical names can be compared by pointer (and
+ * s0_name_eq takes advantage of that).  Name tables can be shared by any number
+ * of threads: lookups never block, inserts only contend when two threads add
+ * names next to each other at the same time, and the table grows as needed
+ * without blocking anyone. */
+struct s0_name_table;
+
+/* bucket_count is rounded up to a power of two; the table doubles it whenever
+ * it gets too full. */
+struct s0_name_table *
+s0_name_table_new(size_t bucket_count);
+
+/* No other threads can be using the table when you free it.  Frees all of the
+ * canonical names, too, so nothing that holds one can outlive the table. */
+void
+s0_name_table_free(struct s0_name_table *);
+
+/* Returns the canonical instance of the name with the given content, adding it
+ * to the table if needed.  Returns NULL if we can't allocate a new entry.
+ *
+ * The table retains ownership of the result, which lives until the table is
+ * freed.  s0_name_free does nothing to an interned name, so you can hand it to
+ * anything that takes control of a name (a statement, say) without copying
+ * it.  Anything that would modify a name (like s0_environment_rename) replaces
+ * an interned one with a copy instead. */
+struct s0_name *
+s0_name_table_intern(struct s0_name_table *, size_t size, const void *content);
+
+/* Returns the canonical instance of name.  name still belongs to you. */
+struct s0_name *
+s0_name_table_intern_name(struct s0_name_table *, const struct s0_name *name);
+
+/* The number of distinct names in the table. */
+size_t
+s0_name_table_size(const struct s0_name_table *);
+
+
 /*-----------------------------------------------------------------------------
  * S₀: Name sets
  */
@@ -201,10 +315,10 @@ s0_environment_delete(struct s0_environment *, const struct s0_name *name);
  * closure, since the entries being closed over are moved from the containing
  * environment into the closure's environment.
  *
- * All of the names in `set` MUST exist in `src`, and MUST NOT exist in `dest`.
+ * None of the names in `set` can exist in `dest`.
  *
- * Returns 0 if all of the entries were created successfully; returns -1 if
- * there is an error moving the entries. */
+ * Returns 0 if all of the entries were moved successfully; returns -1 if any
+ * of the names in `set` don't exist in `src`. */
 int
 s0_environment_extract(struct s0_environment *dest, struct s0_environment *src,
                        const struct s0_name_set *set);
@@ -243,6 +357,14 @@ s0_named_blocks_new(void);
 struct s0_named_blocks *
 s0_named_blocks_new_copy(const struct s0_named_blocks *other);
 
+/* Named blocks are reference-counted, so that closures created by the same
+ * statement (possibly in different threads) can share them.  This adds a new
+ * reference, and returns blocks.  You MUST NOT add or delete blocks once a
+ * collection has more than one reference. */
+struct s0_named_blocks *
+s0_named_blocks_ref(struct s0_named_blocks *blocks);
+
+/* Releases a reference, freeing the collection if that was the last one. */
 void
 s0_named_blocks_free(struct s0_named_blocks *);
 
@@ -464,7 +586,10 @@ s0_invoke_method_params(const struct s0_invocation *);
 
 struct s0_environment_type;
 
-/* Takes control of inputs, statements, and invocation */
+/* Takes control of inputs, statements, and invocation.  The block moves each
+ * statement record and the invocation record into a single allocation for
+ * execution, and frees statements and invocation themselves, so you MUST NOT
+ * use them after creating the block. */
 struct s0_block *
 s0_block_new(struct s0_environment_type *inputs,
              struct s0_statement_list *statements,
@@ -473,12 +598,21 @@ s0_block_new(struct s0_environment_type *inputs,
 struct s0_block *
 s0_block_new_copy(const struct s0_block *other);
 
+/* Blocks are immutable and reference-counted, so a loaded module can be shared
+ * by any number of executions, including executions in different threads.
+ * This adds a new reference, and returns block. */
+struct s0_block *
+s0_block_ref(struct s0_block *block);
+
+/* Releases a reference, freeing the block if that was the last one. */
 void
 s0_block_free(struct s0_block *);
 
 struct s0_environment_type *
 s0_block_inputs(const struct s0_block *);
 
+/* These return views of the block's packed records.  The block still owns
+ * them; you MUST NOT modify or free them. */
 struct s0_statement_list *
 s0_block_statements(const struct s0_block *);
 
@@ -489,15 +623,174 @@ bool
 s0_block_eq(const struct s0_block *, const struct s0_block *);
 
 
+/*-----------------------------------------------------------------------------
+ * S₀: Source maps
+ */
+
+/* A source map records where each of a module's blocks, statements, and
+ * invocations was defined, so that the profiler, the tracer, and error messages
+ * can describe them in terms of the YAML that they came from.  The YAML loader
+ * creates a source map for each module, and each block that it loads holds a
+ * reference to it.  The map is a side table, so it doesn't make the blocks any
+ * larger, and executing a block never consults it except to describe an
+ * error. */
+struct s0_source_map;
+
+/* Where something was defined.  Lines and columns start at 1. */
+struct s0_source_location {
+    /* NULL if the module wasn't loaded from a file */
+    const char  *filename;
+    size_t  line;
+    size_t  column;
+};
+
+/* The parent of a block that isn't nested inside of any other block. */
+#define S0_SOURCE_NO_PARENT  SIZE_MAX
+
+/* Makes a copy of filename, which can be NULL. */
+struct s0_source_map *
+s0_source_map_new(const char *filename);
+
+/* Source maps are reference-counted.  This adds a new reference, and returns
+ * map. */
+struct s0_source_map *
+s0_source_map_ref(struct s0_source_map *map);
+
+/* Releases a reference, freeing the map if that was the last one. */
+void
+s0_source_map_free(struct s0_source_map *map);
+
+/* Records a block that was defined at line and column, lexically nested inside
+ * of the block whose index is `parent`.  `name` (which we copy) says what the
+ * block is called in its parent, and can be NULL.  Fills in *index with the
+ * new block's index.  You MUST add a block before any of the blocks nested
+ * inside of it, and you MUST NOT add anything once any block that refers to
+ * the map might be executing.  Returns -1 if we can't allocate the entry. */
+int
+s0_source_map_add_block(struct s0_source_map *map, size_t parent,
+                        const struct s0_name *name, size_t line,
+                        size_t column, size_t *index);
+
+/* Records that the next statement of the block at `index` was defined at line
+ * and column.  Add one position for each of the block's statements, in order,
+ * followed by one for its invocation.  You MUST add all of a block's positions
+ * together, without adding positions for any other block in between.  Returns
+ * -1 if we can't allocate the entry. */
+int
+s0_source_map_add_position(struct s0_source_map *map, size_t index,
+                           size_t line, size_t column);
+
+/* Records that `block` is the one at `index` in `map`, and adds a reference to
+ * map.  You MUST call this before sharing block with anyone else. */
+void
+s0_block_set_source(struct s0_block *block, struct s0_source_map *map,
+                    size_t index);
+
+/* Fills in where `block` was defined.  Returns false if we don't know.
+ * `location->filename` is only valid as long as you hold onto block. */
+bool
+s0_block_source_location(const struct s0_block *block,
+                         struct s0_source_location *location);
+
+/* Fills in where the statement at `index` in `block` was defined.  Returns
+ * false if we don't know.  `index` can be block's statement count, which refers
+ * to its invocation. */
+bool
+s0_block_statement_location(const struct s0_block *block, size_t index,
+                            struct s0_source_location *location);
+
+/* Fills in where `block`'s invocation was defined.  Returns false if we don't
+ * know. */
+bool
+s0_block_invocation_location(const struct s0_block *block,
+                             struct s0_source_location *location);
+
+/* Returns what `block` is called in the block that it's nested in, or NULL if
+ * we don't know. */
+const struct s0_name *
+s0_block_source_name(const struct s0_block *block);
+
+
 /*-----------------------------------------------------------------------------
  * S₀: Execution
  */
 
 /* Executes `block` within `env`.  Returns 0 if the execution is successful, -1
- * otherwise. */
+ * otherwise.  Execution never modifies `block`, so any number of threads can
+ * execute the same block at the same time, as long as each uses its own
+ * environment.  Errors are recorded in the calling thread's current runtime. */
 int
 s0_block_execute(struct s0_block *block, struct s0_environment *env);
 
+enum s0_execution_status {
+    /* The execution ran to completion */
+    S0_EXECUTION_FINISHED,
+    /* The execution failed; the error is in the current runtime */
+    S0_EXECUTION_ERROR,
+    /* The execution ran out of steps, and can be resumed */
+    S0_EXECUTION_SUSPENDED,
+    /* A primitive is waiting for some operation to finish; the execution can
+     * be resumed once someone calls s0_execution_complete */
+    S0_EXECUTION_PENDING
+};
+
+/* A paused execution, which can be resumed or cancelled. */
+struct s0_execution;
+
+/* Creates a handle for executing `block` within `env`, without running any of
+ * it yet; use s0_execution_resume to start it.  Returns NULL if env doesn't
+ * satisfy the block's inputs.  The handle holds its own reference to `block`;
+ * you retain ownership of `env`, which MUST remain valid until the execution
+ * is finished or cancelled. */
+struct s0_execution *
+s0_execution_new(struct s0_block *block, struct s0_environment *env);
+
+/* Called when a pending execution's primitive completes, possibly from
+ * another thread.  You'll typically use this to arrange for someone to resume
+ * the execution. */
+typedef void
+s0_execution_wake_f(void *ud, struct s0_execution *execution);
+
+/* Registers a function that will be called whenever this execution goes from
+ * PENDING to ready to resume.  You MUST call this before the execution first
+ * becomes PENDING. */
+void
+s0_execution_set_wake(struct s0_execution *execution,
+                      s0_execution_wake_f *wake, void *ud);
+
+/* Executes `block` within `env`, but only for at most `max_steps` steps.  (Each
+ * step invokes one continuation: executing a block's statements and starting
+ * its invocation, or running a primitive method.)  If the execution finishes
+ * or fails within that many steps, returns FINISHED or ERROR.  Otherwise,
+ * returns SUSPENDED or PENDING, and fills in `execution` with a handle that you
+ * can pass to s0_execution_resume to continue the execution, or
+ * s0_execution_cancel to abandon it.  The handle holds its own reference to
+ * `block`; you retain ownership of `env`, which MUST remain valid until the
+ * execution is finished or cancelled.
+ *
+ * Since the handle doesn't exist until this returns, there's no way to be told
+ * when a PENDING execution is ready; use s0_execution_new and
+ * s0_execution_set_wake for executions that might call asynchronous
+ * primitives. */
+enum s0_execution_status
+s0_block_execute_bounded(struct s0_block *block, struct s0_environment *env,
+                         size_t max_steps, struct s0_execution **execution);
+
+/* Continues a suspended execution for at most `max_steps` more steps.  The
+ * handle is freed automatically once this returns FINISHED or ERROR; if it
+ * returns SUSPENDED, you can resume (or cancel) it again.  If the execution is
+ * waiting on a primitive that hasn't completed yet, returns PENDING right
+ * away. */
+enum s0_execution_status
+s0_execution_resume(struct s0_execution *execution, size_t max_steps);
+
+/* Abandons a suspended execution, releasing everything that it holds onto.
+ * The environment is left as-is, and still belongs to you.  You MUST NOT cancel
+ * an execution while it's waiting on a primitive; complete it (perhaps with
+ * s0_error_continuation) first. */
+void
+s0_execution_cancel(struct s0_execution *execution);
+
 struct s0_continuation {
     void  *ud;
     struct s0_continuation (*invoke)(void *ud, struct s0_environment *env);
@@ -509,6 +802,224 @@ s0_error_continuation(void);
 struct s0_continuation
 s0_finish_continuation(void);
 
+/* A primitive method can return this to suspend the current execution while
+ * it waits for some operation (like I/O) to finish.  Before returning it, the
+ * primitive must grab the execution's handle via s0_execution_current, and
+ * arrange for s0_execution_complete to be called once the operation finishes.
+ * It must not touch its environment after handing off the handle. */
+struct s0_continuation
+s0_pending_continuation(void);
+
+/* Returns the execution that's currently running on this thread, or NULL if
+ * there isn't one that can be suspended.  (Executions started with
+ * s0_block_execute can't be suspended; a primitive that sees NULL here must
+ * block or fail instead of returning s0_pending_continuation.) */
+struct s0_execution *
+s0_execution_current(void);
+
+/* Completes the primitive that a pending execution is waiting on.  If `name` is
+ * not NULL, we add `entity` to the execution's environment under that name,
+ * taking ownership of both.  When the execution is resumed, it will continue
+ * by invoking `next`.  This can be called from any thread, including from
+ * within the primitive itself before it returns.  Returns -1 if we couldn't
+ * add the entity, in which case the execution will fail when resumed. */
+int
+s0_execution_complete(struct s0_execution *execution, struct s0_name *name,
+                      struct s0_entity *entity, struct s0_continuation next);
+
+/* Returns the total number of steps that every execution in this process has
+ * taken so far, on any thread. */
+size_t
+s0_execution_step_count(void);
+
+/* Returns the total number of statements that every execution in this process
+ * has executed so far, on any thread. */
+size_t
+s0_execution_statement_count(void);
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: Profiling
+ */
+
+/* The profiler counts how many times each block and each primitive method is
+ * invoked, and how long those invocations take, across every execution on
+ * every thread.  Each block's time only includes its own statements and
+ * invocation, since whatever it invokes runs afterwards, as a separate step of
+ * the trampoline.  While the profiler is stopped, it costs a single check each
+ * time an execution starts or resumes. */
+
+/* Starts profiling.  Executions that are already running are profiled once
+ * they're next resumed. */
+void
+s0_profiler_start(void);
+
+/* Stops profiling, keeping everything recorded so far. */
+void
+s0_profiler_stop(void);
+
+/* Discards everything recorded so far, and frees the buffers of any threads
+ * that have exited since they recorded into them.  You MUST NOT call this
+ * while any executions are running. */
+void
+s0_profiler_reset(void);
+
+/* Writes the profile in the "folded stacks" format that flamegraph.pl and
+ * speedscope can read.  Each line describes one block or primitive method: a
+ * list of frames separated by semicolons, followed by the total number of
+ * nanoseconds spent in it.  A block's frames are its module's file, followed by
+ * each block that it's lexically nested inside of, so that a flame graph shows
+ * time spent in each part of the module's source.  Primitive methods appear
+ * under a `[primitives]` frame.  You SHOULD NOT call this while any executions
+ * are running.  Returns -1 if we can't write the profile. */
+int
+s0_profiler_write_folded(FILE *out);
+
+/* Writes a human-readable table of the profile, with one row for each block and
+ * primitive method, with the most expensive first.  Returns -1 if we can't
+ * write the profile. */
+int
+s0_profiler_write_table(FILE *out);
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: Tracing
+ */
+
+/* The tracer records a timestamped event for every block that an execution
+ * enters, every statement it executes, every invocation, and every primitive
+ * method call, so that you can see exactly what an execution did and when.
+ * Each thread records into its own fixed-size ring buffer; once a thread's
+ * buffer is full, its newest events overwrite its oldest ones.  While the
+ * tracer is stopped, it costs a single check each time an execution starts or
+ * resumes. */
+
+/* Starts tracing.  Executions that are already running are traced once
+ * they're next resumed. */
+void
+s0_tracer_start(void);
+
+/* Stops tracing, keeping everything recorded so far. */
+void
+s0_tracer_stop(void);
+
+/* Discards everything recorded so far, and frees the buffers of any threads
+ * that have exited since they recorded into them.  You MUST NOT call this
+ * while any executions are running. */
+void
+s0_tracer_reset(void);
+
+/* Writes the trace in the Chrome trace event format, which chrome://tracing,
+ * Perfetto, and speedscope can all read.  Each event is a complete ("X")
+ * event, with its source location (if we know it) in its arguments.  You
+ * SHOULD NOT call this while any executions are running.  Returns -1 if we
+ * can't write the trace. */
+int
+s0_tracer_write_chrome_json(FILE *out);
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: Scheduler
+ */
+
+/* A scheduler runs many independent S₀ executions as tasks, spread across a
+ * pool of worker threads.  Each worker has its own queue of tasks, and idle
+ * workers steal tasks from busy ones.  Tasks are preempted after each time
+ * slice (see s0_block_execute_bounded), so a long-running task can't starve
+ * the others.  Tasks that are waiting on an asynchronous primitive don't tie up
+ * a worker; they're requeued once the primitive completes. */
+struct s0_scheduler;
+
+/* Called (on a worker thread) when a task finishes.  rc is the result of the
+ * execution, as with s0_block_execute; if it's -1, you can get the details of
+ * the error from s0_error_get_last_description.  You take control of env. */
+typedef void
+s0_scheduler_done_f(void *ud, struct s0_environment *env, int rc);
+
+/* Starts worker_count worker threads. */
+struct s0_scheduler *
+s0_scheduler_new(size_t worker_count);
+
+/* Waits for all submitted tasks to finish, and then stops the workers. */
+void
+s0_scheduler_free(struct s0_scheduler *);
+
+/* Submits a task that will execute block within env.  We take a new reference
+ * to block, and take control of env, which we'll hand back to `done` when the
+ * task finishes.  Returns 0 if the task was submitted, -1 if there was an
+ * error (in which case `done` won't be called). */
+int
+s0_scheduler_submit(struct s0_scheduler *, struct s0_block *block,
+                    struct s0_environment *env,
+                    s0_scheduler_done_f *done, void *ud);
+
+/* Sets the number of steps that a task can run before it's preempted.  The
+ * default is 1000. */
+void
+s0_scheduler_set_time_slice(struct s0_scheduler *, size_t max_steps);
+
+/* Blocks until every task that has been submitted so far has finished. */
+void
+s0_scheduler_wait(struct s0_scheduler *);
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: Event loops
+ */
+
+/* An event loop drives many S₀ executions from a single thread.  Executions
+ * that call asynchronous primitives are parked until those primitives
+ * complete; in the meantime, the loop runs other executions, or waits (via
+ * epoll) for any of the file descriptors that the primitives are watching to
+ * become ready.  Except for s0_event_loop_add and s0_execution_complete, you
+ * must only use the loop from the thread that runs it. */
+struct s0_event_loop;
+
+/* Called when an execution finishes.  rc is the result of the execution, as
+ * with s0_block_execute.  You take control of env. */
+typedef void
+s0_event_loop_done_f(void *ud, struct s0_environment *env, int rc);
+
+/* Called once when a watched file descriptor becomes ready.  `events` is a
+ * mask of epoll events. */
+typedef void
+s0_event_loop_watch_f(void *ud, uint32_t events);
+
+struct s0_event_loop *
+s0_event_loop_new(void);
+
+/* The loop MUST not have any unfinished executions. */
+void
+s0_event_loop_free(struct s0_event_loop *);
+
+/* Sets the number of steps that an execution can run before the loop moves on
+ * to the next one.  The default is 1000. */
+void
+s0_event_loop_set_time_slice(struct s0_event_loop *, size_t max_steps);
+
+/* Adds an execution of `block` within `env` to the loop.  We take a new
+ * reference to block, and take control of env, which we'll hand back to
+ * `done` when the execution finishes.  Returns -1 if env doesn't satisfy the
+ * block's inputs or if there was an error (in which case `done` won't be
+ * called).  You can call this from any thread; `done` is always called on the
+ * loop's thread. */
+int
+s0_event_loop_add(struct s0_event_loop *, struct s0_block *block,
+                  struct s0_environment *env,
+                  s0_event_loop_done_f *done, void *ud);
+
+/* Calls `callback` (on the loop's thread) the next time `fd` is ready for any
+ * of `events` (a mask of epoll events).  Each watch only fires once, and there
+ * can only be one watch for each file descriptor at a time. */
+int
+s0_event_loop_watch(struct s0_event_loop *, int fd, uint32_t events,
+                    s0_event_loop_watch_f *callback, void *ud);
+
+/* Runs executions until all of them have finished.  Returns -1 if there was
+ * an error waiting for events. */
+int
+s0_event_loop_run(struct s0_event_loop *);
+
 
 /*-----------------------------------------------------------------------------
  * S₀: Entities
@@ -559,6 +1070,16 @@ s0_literal_new(size_t size, const void *content);
 struct s0_entity *
 s0_literal_new_str(const void *content);
 
+typedef void
+s0_literal_release_f(void *ud, const void *content);
+
+/* Creates a literal that refers to `content` directly, without copying it.
+ * When the literal is freed, we call `release` to hand the content back to
+ * you.  (We also call it right away if we can't create the literal.) */
+struct s0_entity *
+s0_literal_new_view(size_t size, const void *content,
+                    s0_literal_release_f *release, void *ud);
+
 /* Entity MUST be a literal */
 const char *
 s0_literal_content(const struct s0_entity *);
@@ -874,6 +1395,230 @@ struct s0_entity *
 s0_finish_new(void);
 
 
+/*-----------------------------------------------------------------------------
+ * S₀: File I/O
+ */
+
+/* The most that a single `read` will return */
+#define S0_IO_READ_SIZE  65536
+
+enum s0_io_backend {
+    /* Use io_uring if the kernel supports it, and a thread pool if not */
+    S0_IO_BACKEND_DEFAULT,
+    /* Perform blocking I/O calls on a pool of threads */
+    S0_IO_BACKEND_THREADS,
+    /* Submit I/O requests to an io_uring */
+    S0_IO_BACKEND_IO_URING
+};
+
+/* Performs file I/O on behalf of the I/O primitives.  When they're invoked by
+ * an execution that can be suspended (see s0_execution_new), the primitives
+ * hand their requests off to the backend and suspend the execution until the
+ * request finishes.  In a synchronous execution (s0_block_execute), they
+ * perform the I/O directly.  Reads are served from a pool of preallocated
+ * buffers, which are registered with the kernel when we're using io_uring;
+ * the literals that `read` produces refer to those buffers directly, and
+ * return them to the pool when they're freed. */
+struct s0_io;
+
+/* Returns NULL if `backend` isn't available. */
+struct s0_io *
+s0_io_new(enum s0_io_backend backend);
+
+/* MUST NOT be called until every entity created from this context (including
+ * literals produced by `read`) has been freed. */
+void
+s0_io_free(struct s0_io *);
+
+/* Returns the backend that's actually in use. */
+enum s0_io_backend
+s0_io_backend(const struct s0_io *);
+
+/* An object with a single `open` method, which takes `path` and `mode`
+ * literals and a `then` closure.  `mode` is `r`, `w`, or `a`, as with
+ * fopen(3).  If the file can be opened, we invoke the `success` branch of
+ * `then`, passing in `io` (the object itself, so that you can open more files
+ * with it) and a `file` object; otherwise we invoke the `failure` branch,
+ * passing in `io` and an `error` literal.
+ *
+ * A file object has three methods, each of which also takes a `then` closure:
+ *
+ *   read:  passes `file` and a `data` literal (empty at end of file) to
+ *          `success`, or `file` and `error` to `failure`
+ *   write: takes a `data` literal; passes `file` to `success`, or `file` and
+ *          `error` to `failure`
+ *   close: consumes the file; passes nothing to `success`, or `error` to
+ *          `failure` */
+struct s0_entity *
+s0_io_object_new(struct s0_io *io);
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: Isolates and channels
+ */
+
+/* An isolate is a separate S₀ runtime with its own thread, which drives any
+ * executions that you spawn in it with an event loop.  Entities don't belong
+ * to any particular runtime, so the only thing keeping isolates apart is that
+ * an entity is only ever in one environment at a time.  Channels let you move
+ * entities from one isolate to another without copying them. */
+struct s0_isolate;
+
+/* Starts the isolate's thread. */
+struct s0_isolate *
+s0_isolate_new(void);
+
+/* Waits for every execution that's been spawned in the isolate to finish, and
+ * then stops its thread. */
+void
+s0_isolate_free(struct s0_isolate *);
+
+/* Adds an execution of `block` within `env` to the isolate's event loop, as
+ * with s0_event_loop_add.  You can call this from any thread.  `done` is
+ * called on the isolate's thread, where s0_runtime_current is the isolate's
+ * runtime, so that's where you'll find the details of any error. */
+int
+s0_isolate_spawn(struct s0_isolate *, struct s0_block *block,
+                 struct s0_environment *env,
+                 s0_event_loop_done_f *done, void *ud);
+
+
+/* A channel is a queue of entities that any number of threads can send to,
+ * and one thread at a time can receive from.  Sending an entity moves the
+ * entity itself (including the environment of a closure) into the queue;
+ * receiving it hands you that same entity. */
+struct s0_channel;
+
+struct s0_channel *
+s0_channel_new(void);
+
+/* Releases your reference to the channel.  The sender and receiver objects
+ * have their own references, so the channel stays alive until they're freed
+ * too.  Any messages that are still queued are freed along with it. */
+void
+s0_channel_free(struct s0_channel *);
+
+/* Takes control of message.  You can call this from any thread.  Returns -1
+ * if we can't allocate space for the message, in which case we free it. */
+int
+s0_channel_send(struct s0_channel *, struct s0_entity *message);
+
+/* Returns the oldest message in the channel, or NULL if it's empty.  You take
+ * control of the result.  Only one thread can receive from a channel at a
+ * time. */
+struct s0_entity *
+s0_channel_try_receive(struct s0_channel *);
+
+/* An object with a single `send` method, which takes a `message` and a `then`
+ * closure.  We move `message` into the channel, and then invoke the `body`
+ * branch of `then`, passing the sender back in as `sender`.  You can create as
+ * many senders for a channel as you want. */
+struct s0_entity *
+s0_channel_sender_new(struct s0_channel *);
+
+/* An object with a single `receive` method, which takes a `then` closure.  We
+ * wait for the next message, and then invoke the `body` branch of `then`,
+ * passing in the receiver as `receiver` and the message as `message`.  If the
+ * channel is empty, `receive` suspends the current execution (see
+ * s0_execution_new) until a message arrives; in a synchronous execution, it
+ * blocks the thread instead.  There MUST only be one receiver for each
+ * channel, and you MUST NOT call s0_channel_try_receive while it exists. */
+struct s0_entity *
+s0_channel_receiver_new(struct s0_channel *);
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: Binary encoding
+ */
+
+/* A compact binary encoding of literals, and of objects whose entries are
+ * (recursively) literals and objects.  Other kinds of entities refer to code
+ * or to state in the current process, so they can't be encoded. */
+
+/* Returns the number of bytes that s0_entity_encode will produce, or 0 if the
+ * entity can't be encoded. */
+size_t
+s0_entity_encoded_size(const struct s0_entity *);
+
+/* `dest` MUST have room for s0_entity_encoded_size bytes, and the entity MUST
+ * be encodable. */
+void
+s0_entity_encode(const struct s0_entity *, void *dest);
+
+/* Returns NULL if `src` isn't exactly one encoded entity. */
+struct s0_entity *
+s0_entity_decode(const void *src, size_t size);
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: Shared-memory rings
+ */
+
+/* A ring is a single-producer, single-consumer queue in a POSIX shared memory
+ * object, which lets you pass entities between processes on the same host.
+ * Each message is copied into the ring using the binary encoding above, and
+ * decoded into a new entity on the other side.  When the ring is full (or
+ * empty), the sender (or receiver) sleeps on a futex in the ring. */
+struct s0_shm_ring;
+
+/* Creates a new shared memory object called `name` (see shm_open(3)), which
+ * MUST NOT already exist, with room for at least `capacity` bytes of encoded
+ * messages.  A single message can use at most half of the ring.  The name is
+ * removed when this ring is freed; anyone who has already opened it can keep
+ * using it. */
+struct s0_shm_ring *
+s0_shm_ring_new(const char *name, size_t capacity);
+
+/* Opens a ring that another process created with s0_shm_ring_new. */
+struct s0_shm_ring *
+s0_shm_ring_open(const char *name);
+
+/* Releases your reference to the ring.  The sender and receiver objects have
+ * their own references, so the ring stays mapped until they're freed too. */
+void
+s0_shm_ring_free(struct s0_shm_ring *);
+
+/* Encodes a copy of message into the ring, waiting for space if necessary.
+ * You retain ownership of message.  Only one thread (in any process) can send
+ * to a ring at a time. */
+int
+s0_shm_ring_send(struct s0_shm_ring *, const struct s0_entity *message);
+
+/* Fills in `message` with the oldest message in the ring, or with NULL if the
+ * ring is empty.  You take control of the message.  Returns -1 if the message
+ * can't be decoded (in which case we skip over it).  Only one thread (in any
+ * process) can receive from a ring at a time. */
+int
+s0_shm_ring_try_receive(struct s0_shm_ring *, struct s0_entity **message);
+
+/* Waits for the next message.  Returns NULL if it can't be decoded. */
+struct s0_entity *
+s0_shm_ring_receive(struct s0_shm_ring *);
+
+/* The primitives below wait for the other side of the ring in one of two
+ * ways.  In a synchronous execution (s0_block_execute), they block the calling
+ * thread on the ring's futex.  A resumable execution (in an event loop or a
+ * scheduler) is parked instead, so that it doesn't tie up the thread that's
+ * running it: the ring hands the wait off to a watcher thread of its own,
+ * which retries the primitive once the other side has made progress.  Each
+ * direction of the ring has its own watcher thread, which is only started the
+ * first time an execution parks in that direction, and is stopped once the
+ * last reference to the ring is released.  Only one execution can be parked
+ * in each direction at a time; if another one tries, its primitive fails with
+ * "Another execution is already waiting on this ring". */
+
+/* An object with a `send` method, just like s0_channel_sender_new, except
+ * that the sender consumes the message and sends an encoded copy of it.
+ * `send` waits (as described above) while the ring is full. */
+struct s0_entity *
+s0_shm_ring_sender_new(struct s0_shm_ring *);
+
+/* An object with a `receive` method, just like s0_channel_receiver_new.
+ * `receive` waits (as described above) while the ring is empty. */
+struct s0_entity *
+s0_shm_ring_receiver_new(struct s0_shm_ring *);
+
+
 /*-----------------------------------------------------------------------------
  * S₀: YAML
  */
@@ -6,19 +6,99 @@
 #include "swanson.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/futex.h>
+
+/* We use io_uring for file I/O if the kernel headers are new enough (5.6 or
+ * later); otherwise we only have the thread pool. */
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_FEAT_RW_CUR_POS) && defined(__NR_io_uring_setup)
+#define S0_HAVE_IO_URING  1
+#endif
+#endif
+#endif
 #include "ccan/compiler/compiler.h"
 #include "ccan/likely/likely.h"
 
 
+/*-----------------------------------------------------------------------------
+ * Allocation
+ */
+
+/* We count every allocation that we make ourselves, so that tools and tests
+ * can check allocation budgets without having to replace the process's
+ * allocator.  Everything below this point allocates through these. */
+static size_t  s0_allocations = 0;
+
+static inline void *
+s0_counted_malloc(size_t size)
+{
+    __atomic_add_fetch(&s0_allocations, 1, __ATOMIC_RELAXED);
+    return malloc(size);
+}
+
+static inline void *
+s0_counted_calloc(size_t count, size_t size)
+{
+    __atomic_add_fetch(&s0_allocations, 1, __ATOMIC_RELAXED);
+    return calloc(count, size);
+}
+
+static inline void *
+s0_counted_realloc(void *ptr, size_t size)
+{
+    __atomic_add_fetch(&s0_allocations, 1, __ATOMIC_RELAXED);
+    return realloc(ptr, size);
+}
+
+static inline char *
+s0_counted_strdup(const char *str)
+{
+    __atomic_add_fetch(&s0_allocations, 1, __ATOMIC_RELAXED);
+    return strdup(str);
+}
+
+#define malloc(size)  s0_counted_malloc(size)
+#define calloc(count, size)  s0_counted_calloc(count, size)
+#define realloc(ptr, size)  s0_counted_realloc(ptr, size)
+#define strdup(str)  s0_counted_strdup(str)
+
+size_t
+s0_allocation_count(void)
+{
+    return __atomic_load_n(&s0_allocations, __ATOMIC_RELAXED);
+}
+
+
 /*-----------------------------------------------------------------------------
  * Structs
  */
 
 struct s0_name {
     size_t  size;
+    size_t  allocated_size;
+    uint32_t  hash;
+    /* Interned names belong to their name table, and are never modified or
+     * freed while it's alive. */
+    bool  interned;
     const void  *content;
 };
 
@@ -26,12 +106,18 @@ struct s0_name_set {
     size_t  size;
     size_t  allocated_size;
     struct s0_name  **names;
+    /* The same names, sorted with s0_name_cmp */
+    struct s0_name  **sorted;
+    /* One bit set for each name's hash; see s0_name_signature */
+    uint64_t  signature;
 };
 
 struct s0_name_mapping {
     size_t  size;
     size_t  allocated_size;
     struct s0_name_mapping_entry  *entries;
+    /* Indexes into `entries`, sorted by `from` name */
+    size_t  *sorted;
 };
 
 struct s0_environment_entry {
@@ -45,21 +131,17 @@ struct s0_environment {
     size_t  size;
 };
 
-struct s0_block {
-    struct s0_environment_type  *inputs;
-    struct s0_statement_list  *statements;
-    struct s0_invocation  *invocation;
-};
-
 struct s0_named_blocks_entry {
-    struct s0_named_blocks_entry  *next;
     struct s0_name  *name;
     struct s0_block  *block;
 };
 
 struct s0_named_blocks {
-    struct s0_named_blocks_entry  *head;
+    size_t  ref_count;
     size_t  size;
+    size_t  allocated_size;
+    /* Sorted by name, using s0_name_cmp */
+    struct s0_named_blocks_entry  *entries;
 };
 
 struct s0_statement {
@@ -107,6 +189,66 @@ struct s0_invocation {
     } _;
 };
 
+/* A block moves each of its statement records, followed by its invocation
+ * record, into the same allocation as the block itself, so that executing a
+ * block walks a single contiguous array instead of chasing a pointer per
+ * statement.  The packed records are the only copy, and own their names, sets,
+ * and nested blocks.  The accessors hand out `statements`, a statement list
+ * whose pointers (which live at the very end of the allocation) point into
+ * the packed records.  The inputs type is only needed for type checking, so it
+ * stays out of line.
+ *
+ * Blocks are immutable once created, and are reference-counted so that a loaded
+ * module can be shared by any number of executions, in any number of threads.
+ * (The same goes for named blocks.) */
+struct s0_block {
+    size_t  ref_count;
+    struct s0_environment_type  *inputs;
+    struct s0_statement_list  statements;
+    /* Where the block was defined; NULL if we don't know */
+    struct s0_source_map  *source;
+    size_t  source_index;
+    size_t  statement_count;
+    struct s0_statement  code[];
+};
+
+/* Everything we know about where one block was defined. */
+struct s0_source_block {
+    size_t  parent;
+    /* NULL if the block doesn't have a name */
+    struct s0_name  *name;
+    size_t  line;
+    size_t  column;
+    /* Where this block's statements and invocation are in the map's
+     * `positions` table, if we know; position_count is 0 if we don't. */
+    size_t  first_position;
+    size_t  position_count;
+};
+
+/* Where one statement or invocation was defined.  There are far more of these
+ * than there are blocks, so we keep them small. */
+struct s0_source_position {
+    uint32_t  line;
+    uint32_t  column;
+};
+
+/* A source map is only modified while its module is being loaded, so it
+ * doesn't need a lock; once any of its blocks can be executed, it's
+ * immutable. */
+struct s0_source_map {
+    size_t  ref_count;
+    /* NULL if the module wasn't loaded from a file */
+    char  *filename;
+    size_t  block_count;
+    size_t  allocated_block_count;
+    struct s0_source_block  *blocks;
+    /* Each block's positions are contiguous, in the same order as the
+     * statements and invocation in the block's code. */
+    size_t  position_count;
+    size_t  allocated_position_count;
+    struct s0_source_position  *positions;
+};
+
 struct s0_entity {
     enum s0_entity_kind  kind;
     union {
@@ -117,6 +259,9 @@ struct s0_entity {
         struct {
             size_t  size;
             const void  *content;
+            /* NULL if we own content */
+            s0_literal_release_f  *release;
+            void  *release_ud;
         } literal;
         struct {
             struct s0_block  *body;
@@ -161,36 +306,120 @@ struct s0_environment_type_mapping {
     struct s0_environment_type_mapping_entry  *entries;
 };
 
+/* Reference counts can be updated from several threads at once. */
+static inline void
+s0_ref_count_increment(size_t *ref_count)
+{
+    __atomic_add_fetch(ref_count, 1, __ATOMIC_RELAXED);
+}
 
-/*-----------------------------------------------------------------------------
- * S₀: Errors
- */
+/* Returns true if that was the last reference. */
+static inline bool
+s0_ref_count_decrement(size_t *ref_count)
+{
+    return __atomic_sub_fetch(ref_count, 1, __ATOMIC_ACQ_REL) == 0;
+}
 
 #define MAX_ERROR_DESCRIPTION_LENGTH  4096
+#define MAX_ERROR_FRAMES  32
+#define MAX_ERROR_FRAME_ARGS  4
+#define ERROR_ARENA_SIZE  2048
+
+/* We don't format error messages when they're reported, since most errors
+ * (especially type mismatches found while probing for subtypes) are never
+ * displayed.  Instead, each call to s0_set_error or s0_prefix_error records a
+ * frame containing its format string and arguments, and we only render the
+ * frames into text when someone asks for the description.  Format strings
+ * MUST be literals, and can only contain `%s` and `%zu` specifiers. */
+union s0_error_arg {
+    const char  *s;
+    size_t  zu;
+};
 
-static struct {
+struct s0_error_frame {
+    const char  *fmt;
+    union s0_error_arg  args[MAX_ERROR_FRAME_ARGS];
+};
+
+struct s0_runtime {
     enum s0_error_code  code;
-    char  description1[MAX_ERROR_DESCRIPTION_LENGTH];
-    char  description2[MAX_ERROR_DESCRIPTION_LENGTH];
-    char  *current_description;
-    char  *other_description;
-} last_error = {
-    S0_ERROR_NONE,
-    "",
-    "",
-    last_error.description1,
-    last_error.description2
+    /* Innermost (s0_set_error) frame first, followed by each prefix. */
+    size_t  frame_count;
+    struct s0_error_frame  frames[MAX_ERROR_FRAMES];
+    /* `%s` arguments often point into things that are about to be freed, so
+     * we copy them into this arena. */
+    size_t  arena_used;
+    char  arena[ERROR_ARENA_SIZE];
+    /* The rendered description, valid if `rendered` is true. */
+    bool  rendered;
+    char  description[MAX_ERROR_DESCRIPTION_LENGTH];
+    /* Where the YAML loader interns names.  NULL for the threads' default
+     * runtimes, which all share s0_shared_names. */
+    struct s0_name_table  *names;
 };
 
+/*-----------------------------------------------------------------------------
+ * S₀: Errors
+ */
+
+static const char  s0_error_arena_full[] = "...";
+
+static const char *
+s0_error_save_string(struct s0_runtime *runtime, const char *str)
+{
+    size_t  size = strlen(str) + 1;
+    char  *dest;
+    if (unlikely(size > ERROR_ARENA_SIZE - runtime->arena_used)) {
+        return s0_error_arena_full;
+    }
+    dest = &runtime->arena[runtime->arena_used];
+    memcpy(dest, str, size);
+    runtime->arena_used += size;
+    return dest;
+}
+
+static void
+s0_error_add_frame(struct s0_runtime *runtime, const char *fmt, va_list args)
+{
+    struct s0_error_frame  *frame;
+    const char  *curr;
+    size_t  arg_count = 0;
+
+    if (unlikely(runtime->frame_count == MAX_ERROR_FRAMES)) {
+        /* Drop the outermost prefixes of a very deeply nested error. */
+        return;
+    }
+
+    frame = &runtime->frames[runtime->frame_count++];
+    frame->fmt = fmt;
+    for (curr = fmt; *curr != '\0'; curr++) {
+        if (*curr != '%') {
+            continue;
+        }
+        curr++;
+        assert(arg_count < MAX_ERROR_FRAME_ARGS);
+        if (*curr == 's') {
+            frame->args[arg_count++].s =
+                s0_error_save_string(runtime, va_arg(args, const char *));
+        } else {
+            assert(curr[0] == 'z' && curr[1] == 'u');
+            frame->args[arg_count++].zu = va_arg(args, size_t);
+            curr++;
+        }
+    }
+}
+
 static PRINTF_FMT(2,3) void
 s0_set_error(enum s0_error_code code, const char *fmt, ...)
 {
     va_list  args;
-    last_error.code = code;
+    struct s0_runtime  *runtime = s0_runtime_current();
+    runtime->code = code;
+    runtime->frame_count = 0;
+    runtime->arena_used = 0;
+    runtime->rendered = false;
     va_start(args, fmt);
-    vsnprintf(last_error.current_description, MAX_ERROR_DESCRIPTION_LENGTH,
-              fmt, args);
-    last_error.current_description[MAX_ERROR_DESCRIPTION_LENGTH - 1] = '\0';
+    s0_error_add_frame(runtime, fmt, args);
     va_end(args);
 }
 
@@ -198,27 +427,69 @@ static PRINTF_FMT(1,2) void
 s0_prefix_error(const char *fmt, ...)
 {
     va_list  args;
-    int  prefix_size;
-    char  *swap;
-
-    /* Write the prefix into the unused buffer. */
+    struct s0_runtime  *runtime = s0_runtime_current();
+    runtime->rendered = false;
     va_start(args, fmt);
-    prefix_size = vsnprintf
-        (last_error.other_description, MAX_ERROR_DESCRIPTION_LENGTH, fmt, args);
+    s0_error_add_frame(runtime, fmt, args);
     va_end(args);
+}
+
+/* Appends as much of str as will fit into the runtime's description, starting
+ * at *size. */
+static void
+s0_error_render_string(struct s0_runtime *runtime, size_t *size,
+                       const char *str, size_t length)
+{
+    size_t  available = MAX_ERROR_DESCRIPTION_LENGTH - 1 - *size;
+    if (length > available) {
+        length = available;
+    }
+    memcpy(&runtime->description[*size], str, length);
+    *size += length;
+}
+
+static void
+s0_error_render_frame(struct s0_runtime *runtime, size_t *size,
+                      const struct s0_error_frame *frame)
+{
+    const char  *curr;
+    const char  *literal_start = frame->fmt;
+    size_t  arg_index = 0;
 
-    /* The copy the existing buffer to the end of the unused buffer. */
-    if (prefix_size < MAX_ERROR_DESCRIPTION_LENGTH) {
-        strncpy(last_error.other_description + prefix_size,
-                last_error.current_description,
-                MAX_ERROR_DESCRIPTION_LENGTH - prefix_size);
+    for (curr = frame->fmt; *curr != '\0'; curr++) {
+        const union s0_error_arg  *arg;
+        if (*curr != '%') {
+            continue;
+        }
+        s0_error_render_string
+            (runtime, size, literal_start, curr - literal_start);
+        arg = &frame->args[arg_index++];
+        curr++;
+        if (*curr == 's') {
+            s0_error_render_string(runtime, size, arg->s, strlen(arg->s));
+        } else {
+            char  buf[32];
+            int  length = snprintf(buf, sizeof(buf), "%zu", arg->zu);
+            s0_error_render_string(runtime, size, buf, length);
+            curr++;
+        }
+        literal_start = curr + 1;
     }
-    last_error.other_description[MAX_ERROR_DESCRIPTION_LENGTH - 1] = '\0';
+    s0_error_render_string(runtime, size, literal_start, curr - literal_start);
+}
 
-    /* Then swap the two buffers so that the new error message is "current". */
-    swap = last_error.other_description;
-    last_error.other_description = last_error.current_description;
-    last_error.current_description = swap;
+static void
+s0_error_render(struct s0_runtime *runtime)
+{
+    size_t  size = 0;
+    size_t  i;
+    /* Prefixes were added from the inside out, so render the frames in
+     * reverse order. */
+    for (i = runtime->frame_count; i > 0; i--) {
+        s0_error_render_frame(runtime, &size, &runtime->frames[i - 1]);
+    }
+    runtime->description[size] = '\0';
+    runtime->rendered = true;
 }
 
 #define s0_set_memory_error_(func) \
@@ -228,13 +499,110 @@ s0_prefix_error(const char *fmt, ...)
 enum s0_error_code
 s0_error_get_last_code(void)
 {
-    return last_error.code;
+    return s0_runtime_error_code(s0_runtime_current());
 }
 
 const char *
 s0_error_get_last_description(void)
 {
-    return last_error.current_description;
+    return s0_runtime_error_description(s0_runtime_current());
+}
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: Runtimes
+ */
+
+#define DEFAULT_NAME_TABLE_SIZE  64
+
+/* Each thread gets its own default runtime, which is used whenever the thread
+ * hasn't selected one explicitly via s0_runtime_set_current. */
+static __thread struct s0_runtime  default_runtime;
+static __thread struct s0_runtime  *current_runtime = NULL;
+
+/* The default runtimes' name table.  Modules are routinely loaded in one
+ * thread and run in others, so this outlives every thread, and is never
+ * freed.  Created the first time anyone needs it. */
+static struct s0_name_table  *s0_shared_names = NULL;
+
+struct s0_runtime *
+s0_runtime_new(void)
+{
+    struct s0_runtime  *runtime = calloc(1, sizeof(struct s0_runtime));
+    if (unlikely(runtime == NULL)) {
+        s0_set_memory_error();
+        return NULL;
+    }
+    runtime->code = S0_ERROR_NONE;
+    runtime->names = s0_name_table_new(DEFAULT_NAME_TABLE_SIZE);
+    if (unlikely(runtime->names == NULL)) {
+        free(runtime);
+        return NULL;
+    }
+    return runtime;
+}
+
+void
+s0_runtime_free(struct s0_runtime *runtime)
+{
+    assert(runtime != current_runtime);
+    s0_name_table_free(runtime->names);
+    free(runtime);
+}
+
+struct s0_name_table *
+s0_runtime_name_table(struct s0_runtime *runtime)
+{
+    struct s0_name_table  *names;
+    struct s0_name_table  *expected = NULL;
+    if (runtime->names != NULL) {
+        return runtime->names;
+    }
+    names = __atomic_load_n(&s0_shared_names, __ATOMIC_ACQUIRE);
+    if (likely(names != NULL)) {
+        return names;
+    }
+    names = s0_name_table_new(DEFAULT_NAME_TABLE_SIZE);
+    if (unlikely(names == NULL)) {
+        return NULL;
+    }
+    if (!__atomic_compare_exchange_n
+        (&s0_shared_names, &expected, names, false,
+         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        /* Someone else created it first. */
+        s0_name_table_free(names);
+        names = expected;
+    }
+    return names;
+}
+
+struct s0_runtime *
+s0_runtime_current(void)
+{
+    return likely(current_runtime == NULL)? &default_runtime: current_runtime;
+}
+
+struct s0_runtime *
+s0_runtime_set_current(struct s0_runtime *runtime)
+{
+    struct s0_runtime  *previous = current_runtime;
+    current_runtime = runtime;
+    return previous;
+}
+
+enum s0_error_code
+s0_runtime_error_code(const struct s0_runtime *runtime)
+{
+    return runtime->code;
+}
+
+const char *
+s0_runtime_error_description(struct s0_runtime *runtime)
+{
+    if (!runtime->rendered) {
+        s0_error_render(runtime);
+    }
+    return runtime->description;
 }
 
 
@@ -242,6 +610,25 @@ s0_error_get_last_description(void)
  * Names
  */
 
+/* We never allocate less than this for a name's content.  Most names are
+ * short, and malloc won't give us a smaller chunk anyway; rounding up lets
+ * s0_name_assign overwrite a name in place without reallocating. */
+#define MIN_NAME_ALLOCATION  16
+
+/* 32-bit FNV-1a */
+static uint32_t
+s0_name_hash(size_t size, const void *content)
+{
+    const unsigned char  *curr = content;
+    uint32_t  hash = 2166136261u;
+    size_t  i;
+    for (i = 0; i < size; i++) {
+        hash ^= curr[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
 struct s0_name *
 s0_name_new(size_t size, const void *content)
 {
@@ -251,7 +638,9 @@ s0_name_new(size_t size, const void *content)
         return NULL;
     }
     name->size = size;
-    name->content = malloc(size + 1);
+    name->allocated_size =
+        (size + 1 < MIN_NAME_ALLOCATION)? MIN_NAME_ALLOCATION: size + 1;
+    name->content = malloc(name->allocated_size);
     if (unlikely(name->content == NULL)) {
         free(name);
         s0_set_memory_error();
@@ -259,6 +648,8 @@ s0_name_new(size_t size, const void *content)
     }
     memcpy((void *) name->content, content, size);
     ((char *) name->content)[size] = '\0';
+    name->hash = s0_name_hash(size, content);
+    name->interned = false;
     return name;
 }
 
@@ -277,6 +668,9 @@ s0_name_new_copy(const struct s0_name *other)
 void
 s0_name_free(struct s0_name *name)
 {
+    if (name->interned) {
+        return;
+    }
     free((void *) name->content);
     free(name);
 }
@@ -303,116 +697,499 @@ s0_name_size(const struct s0_name *name)
 bool
 s0_name_eq(const struct s0_name *n1, const struct s0_name *n2)
 {
-    return n1->size == n2->size
-        && (memcmp(n1->content, n2->content, n1->size) == 0);
+    /* Interned names can be compared by pointer. */
+    return n1 == n2
+        || (n1->size == n2->size && n1->hash == n2->hash
+            && (memcmp(n1->content, n2->content, n1->size) == 0));
+}
+
+/* A total order on names.  This isn't lexicographic; we compare sizes first
+ * since that's cheaper and usually enough to tell two names apart. */
+static int
+s0_name_cmp(const struct s0_name *n1, const struct s0_name *n2)
+{
+    if (n1->size != n2->size) {
+        return (n1->size < n2->size)? -1: 1;
+    }
+    return memcmp(n1->content, n2->content, n1->size);
+}
+
+/* Overwrites the content of `*name` with a copy of `other`'s.  We reuse the
+ * existing buffer whenever it's large enough, so this usually doesn't need to
+ * allocate anything.  Interned names can't be modified, so we replace those
+ * with a new copy instead. */
+static int
+s0_name_assign(struct s0_name **name_ptr, const struct s0_name *other)
+{
+    struct s0_name  *name = *name_ptr;
+    if (unlikely(name->interned)) {
+        name = s0_name_new_copy(other);
+        if (unlikely(name == NULL)) {
+            return -1;
+        }
+        *name_ptr = name;
+        return 0;
+    }
+    if (unlikely(other->size + 1 > name->allocated_size)) {
+        size_t  new_size = other->size + 1;
+        void  *new_content = realloc((void *) name->content, new_size);
+        if (unlikely(new_content == NULL)) {
+            s0_set_memory_error();
+            return -1;
+        }
+        name->content = new_content;
+        name->allocated_size = new_size;
+    }
+    memcpy((void *) name->content, other->content, other->size);
+    ((char *) name->content)[other->size] = '\0';
+    name->size = other->size;
+    name->hash = other->hash;
+    return 0;
 }
 
 
 /*-----------------------------------------------------------------------------
- * Name sets
+ * Name tables
  */
 
-#define DEFAULT_INITIAL_NAME_SET_SIZE  4
+/* A name table is a lock-free split-ordered list (Shalev and Shavit): every
+ * entry lives in a single linked list, sorted by the bit-reversal of its hash,
+ * and each bucket points at a dummy entry that marks where that bucket's
+ * entries start.  Doubling the number of buckets doesn't move any entries; it
+ * just means that new buckets get dummies spliced into the list (lazily, the
+ * first time they're used) in between the entries of their parent bucket.
+ * Since we never remove anything, every list operation is a plain
+ * compare-and-swap on a `next` pointer, and readers never block.
+ *
+ * The buckets live in segments that we allocate as the table grows: segment 0
+ * holds bucket 0, and segment k holds buckets [2^(k-1), 2^k).  Segments are
+ * never moved or freed, so a bucket's address never changes. */
+
+#define NAME_TABLE_SEGMENT_COUNT  33
+#define NAME_TABLE_MAX_BUCKETS  (UINT32_C(1) << 31)
+/* We double the number of buckets once there are this many names per bucket */
+#define NAME_TABLE_MAX_LOAD  2
+
+struct s0_name_table_entry {
+    struct s0_name_table_entry  *next;
+    /* The bit-reversed hash; odd for real entries, even for dummies */
+    uint32_t  key;
+    /* NULL for dummies */
+    struct s0_name  *name;
+};
 
-struct s0_name_set *
-s0_name_set_new(void)
+struct s0_name_table {
+    size_t  bucket_count;
+    size_t  size;
+    struct s0_name_table_entry  **segments[NAME_TABLE_SEGMENT_COUNT];
+};
+
+static uint32_t
+s0_name_table_reverse(uint32_t value)
+{
+    value = ((value >> 1) & 0x55555555u) | ((value & 0x55555555u) << 1);
+    value = ((value >> 2) & 0x33333333u) | ((value & 0x33333333u) << 2);
+    value = ((value >> 4) & 0x0f0f0f0fu) | ((value & 0x0f0f0f0fu) << 4);
+    value = ((value >> 8) & 0x00ff00ffu) | ((value & 0x00ff00ffu) << 8);
+    return (value >> 16) | (value << 16);
+}
+
+/* Returns the slot for a bucket, allocating its segment if needed.  Returns
+ * NULL if we can't allocate the segment. */
+static struct s0_name_table_entry **
+s0_name_table_bucket(struct s0_name_table *table, uint32_t bucket)
+{
+    size_t  segment = (bucket == 0)? 0: 32 - __builtin_clz(bucket);
+    size_t  first = (segment == 0)? 0: (size_t) 1 << (segment - 1);
+    struct s0_name_table_entry  **slots =
+        __atomic_load_n(&table->segments[segment], __ATOMIC_ACQUIRE);
+    if (unlikely(slots == NULL)) {
+        struct s0_name_table_entry  **expected = NULL;
+        size_t  slot_count = (segment == 0)? 1: first;
+        slots = calloc(slot_count, sizeof(struct s0_name_table_entry *));
+        if (unlikely(slots == NULL)) {
+            s0_set_memory_error();
+            return NULL;
+        }
+        if (!__atomic_compare_exchange_n
+            (&table->segments[segment], &expected, slots, false,
+             __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            /* Someone else allocated it first. */
+            free(slots);
+            slots = expected;
+        }
+    }
+    return &slots[bucket - first];
+}
+
+/* Walks the list from `start` looking for `key` (and, for real entries, the
+ * name with the given content).  If it's there, returns it; otherwise links in
+ * `entry`, which MUST have the same key, and returns that. */
+static struct s0_name_table_entry *
+s0_name_table_insert(struct s0_name_table_entry *start,
+                     struct s0_name_table_entry *entry,
+                     size_t size, const void *content)
 {
-    struct s0_name_set  *set = malloc(sizeof(struct s0_name_set));
-    if (unlikely(set == NULL)) {
-        s0_set_memory_error();
+    struct s0_name_table_entry  *prev = start;
+    struct s0_name_table_entry  *curr =
+        __atomic_load_n(&prev->next, __ATOMIC_ACQUIRE);
+    while (true) {
+        while (curr != NULL && curr->key <= entry->key) {
+            if (curr->key == entry->key) {
+                if (curr->name == NULL) {
+                    return curr;
+                }
+                if (curr->name->size == size
+                    && memcmp(curr->name->content, content, size) == 0) {
+                    return curr;
+                }
+            }
+            prev = curr;
+            curr = __atomic_load_n(&prev->next, __ATOMIC_ACQUIRE);
+        }
+        entry->next = curr;
+        /* If this fails, someone else linked something in after `prev`, and
+         * `curr` now holds it.  Since we never remove entries, `prev` is
+         * still in the list, so we can pick up from there. */
+        if (__atomic_compare_exchange_n
+            (&prev->next, &curr, entry, false,
+             __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+            return entry;
+        }
+    }
+}
+
+/* Returns the dummy entry for a bucket, splicing it into the list if this is
+ * the first time that anyone has used the bucket.  Returns NULL if we can't
+ * allocate anything. */
+static struct s0_name_table_entry *
+s0_name_table_dummy(struct s0_name_table *table, uint32_t bucket)
+{
+    struct s0_name_table_entry  **slot;
+    struct s0_name_table_entry  *dummy;
+    struct s0_name_table_entry  *parent;
+    struct s0_name_table_entry  *found;
+
+    slot = s0_name_table_bucket(table, bucket);
+    if (unlikely(slot == NULL)) {
         return NULL;
     }
-    set->size = 0;
-    set->allocated_size = DEFAULT_INITIAL_NAME_SET_SIZE;
-    set->names =
-        malloc(DEFAULT_INITIAL_NAME_SET_SIZE * sizeof(struct s0_name *));
-    if (unlikely(set->names == NULL)) {
-        free(set);
+    found = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (likely(found != NULL)) {
+        return found;
+    }
+
+    /* A bucket's entries are a subrange of its parent's, which is the bucket
+     * that we'd get by clearing the highest bit. */
+    parent = s0_name_table_dummy
+        (table, bucket & ~(UINT32_C(1) << (31 - __builtin_clz(bucket))));
+    if (unlikely(parent == NULL)) {
+        return NULL;
+    }
+
+    dummy = malloc(sizeof(struct s0_name_table_entry));
+    if (unlikely(dummy == NULL)) {
         s0_set_memory_error();
         return NULL;
     }
-    return set;
+    dummy->key = s0_name_table_reverse(bucket);
+    dummy->name = NULL;
+    found = s0_name_table_insert(parent, dummy, 0, NULL);
+    if (found != dummy) {
+        free(dummy);
+    }
+    __atomic_store_n(slot, found, __ATOMIC_RELEASE);
+    return found;
 }
 
-struct s0_name_set *
-s0_name_set_new_copy(const struct s0_name_set *other)
+struct s0_name_table *
+s0_name_table_new(size_t bucket_count)
 {
-    size_t  i;
-    struct s0_name_set  *set = s0_name_set_new();
-    if (unlikely(set == NULL)) {
-        return NULL;
+    struct s0_name_table  *table;
+    struct s0_name_table_entry  *head;
+    size_t  actual_count = 1;
+    while (actual_count < bucket_count
+           && actual_count < NAME_TABLE_MAX_BUCKETS) {
+        actual_count *= 2;
     }
 
-    for (i = 0; i < other->size; i++) {
-        int  rc;
-        struct s0_name  *copy;
-
-        copy = s0_name_new_copy(other->names[i]);
-        if (unlikely(copy == NULL)) {
-            s0_name_set_free(set);
-            return NULL;
-        }
-
-        rc = s0_name_set_add(set, copy);
-        if (unlikely(rc != 0)) {
-            s0_name_set_free(set);
-            return NULL;
-        }
+    table = calloc(1, sizeof(struct s0_name_table));
+    if (unlikely(table == NULL)) {
+        s0_set_memory_error();
+        return NULL;
     }
+    table->bucket_count = actual_count;
+    table->size = 0;
 
-    return set;
+    /* Bucket 0's dummy is the head of the list. */
+    head = malloc(sizeof(struct s0_name_table_entry));
+    if (unlikely(head == NULL)) {
+        free(table);
+        s0_set_memory_error();
+        return NULL;
+    }
+    head->next = NULL;
+    head->key = 0;
+    head->name = NULL;
+    table->segments[0] = calloc(1, sizeof(struct s0_name_table_entry *));
+    if (unlikely(table->segments[0] == NULL)) {
+        free(head);
+        free(table);
+        s0_set_memory_error();
+        return NULL;
+    }
+    table->segments[0][0] = head;
+    return table;
 }
 
 void
-s0_name_set_free(struct s0_name_set *set)
+s0_name_table_free(struct s0_name_table *table)
 {
     size_t  i;
-    for (i = 0; i < set->size; i++) {
-        s0_name_free(set->names[i]);
+    struct s0_name_table_entry  *curr;
+    struct s0_name_table_entry  *next;
+    for (curr = table->segments[0][0]; curr != NULL; curr = next) {
+        next = curr->next;
+        if (curr->name != NULL) {
+            free((void *) curr->name->content);
+            free(curr->name);
+        }
+        free(curr);
     }
-    free(set->names);
-    free(set);
+    for (i = 0; i < NAME_TABLE_SEGMENT_COUNT; i++) {
+        free(table->segments[i]);
+    }
+    free(table);
 }
 
-int
-s0_name_set_add(struct s0_name_set *set, struct s0_name *name)
-{
-#if !defined(NDEBUG)
-    {
-        size_t  i;
-        for (i = 0; i < set->size; i++) {
-            assert(!s0_name_eq(name, set->names[i]));
-        }
+struct s0_name *
+s0_name_table_intern(struct s0_name_table *table,
+                     size_t size, const void *content)
+{
+    uint32_t  hash = s0_name_hash(size, content);
+    uint32_t  key = s0_name_table_reverse(hash) | 1;
+    size_t  bucket_count =
+        __atomic_load_n(&table->bucket_count, __ATOMIC_ACQUIRE);
+    struct s0_name_table_entry  *dummy;
+    struct s0_name_table_entry  *curr;
+    struct s0_name_table_entry  *entry;
+    struct s0_name_table_entry  *found;
+    size_t  new_size;
+
+    dummy = s0_name_table_dummy(table, hash & (bucket_count - 1));
+    if (unlikely(dummy == NULL)) {
+        return NULL;
     }
-#endif
 
-    if (unlikely(set->size == set->allocated_size)) {
-        size_t  new_size = set->allocated_size * 2;
-        struct s0_name  **new_names =
-            realloc(set->names, new_size * sizeof(struct s0_name *));
-        if (unlikely(new_names == NULL)) {
-            s0_name_free(name);
-            s0_set_memory_error();
-            return -1;
+    /* Fast path: the name is already in the table. */
+    for (curr = __atomic_load_n(&dummy->next, __ATOMIC_ACQUIRE);
+         curr != NULL && curr->key <= key;
+         curr = __atomic_load_n(&curr->next, __ATOMIC_ACQUIRE)) {
+        if (curr->key == key && curr->name->size == size
+            && memcmp(curr->name->content, content, size) == 0) {
+            return curr->name;
+        }
+    }
+
+    entry = malloc(sizeof(struct s0_name_table_entry));
+    if (unlikely(entry == NULL)) {
+        s0_set_memory_error();
+        return NULL;
+    }
+    entry->key = key;
+    entry->name = s0_name_new(size, content);
+    if (unlikely(entry->name == NULL)) {
+        free(entry);
+        return NULL;
+    }
+    entry->name->interned = true;
+
+    found = s0_name_table_insert(dummy, entry, size, content);
+    if (found != entry) {
+        /* Someone else added the same name first. */
+        free((void *) entry->name->content);
+        free(entry->name);
+        free(entry);
+        return found->name;
+    }
+
+    new_size = __atomic_add_fetch(&table->size, 1, __ATOMIC_RELAXED);
+    if (new_size > bucket_count * NAME_TABLE_MAX_LOAD
+        && bucket_count < NAME_TABLE_MAX_BUCKETS) {
+        /* If this fails, someone else already grew the table. */
+        __atomic_compare_exchange_n
+            (&table->bucket_count, &bucket_count, bucket_count * 2, false,
+             __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+    }
+    return entry->name;
+}
+
+struct s0_name *
+s0_name_table_intern_name(struct s0_name_table *table,
+                          const struct s0_name *name)
+{
+    return s0_name_table_intern(table, name->size, name->content);
+}
+
+size_t
+s0_name_table_size(const struct s0_name_table *table)
+{
+    return __atomic_load_n(&table->size, __ATOMIC_RELAXED);
+}
+
+
+/*-----------------------------------------------------------------------------
+ * Name sets
+ */
+
+#define DEFAULT_INITIAL_NAME_SET_SIZE  4
+
+/* Each name contributes one bit to its set's signature.  Two sets can only be
+ * equal if their signatures are, and a name can only be in a set if its bit is
+ * set in the set's signature, which lets us rule most things out with a single
+ * word operation. */
+static uint64_t
+s0_name_signature(const struct s0_name *name)
+{
+    return UINT64_C(1) << (name->hash & 63);
+}
+
+/* Returns the position in `set->sorted` where `name` is (if it's in the set)
+ * or where it would be inserted (if it isn't). */
+static size_t
+s0_name_set_search(const struct s0_name_set *set, const struct s0_name *name)
+{
+    size_t  lo = 0;
+    size_t  hi = set->size;
+    while (lo < hi) {
+        size_t  mid = lo + (hi - lo) / 2;
+        if (s0_name_cmp(set->sorted[mid], name) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+struct s0_name_set *
+s0_name_set_new(void)
+{
+    struct s0_name_set  *set = malloc(sizeof(struct s0_name_set));
+    if (unlikely(set == NULL)) {
+        s0_set_memory_error();
+        return NULL;
+    }
+    set->size = 0;
+    set->allocated_size = DEFAULT_INITIAL_NAME_SET_SIZE;
+    set->signature = 0;
+    set->names =
+        malloc(DEFAULT_INITIAL_NAME_SET_SIZE * sizeof(struct s0_name *));
+    if (unlikely(set->names == NULL)) {
+        free(set);
+        s0_set_memory_error();
+        return NULL;
+    }
+    set->sorted =
+        malloc(DEFAULT_INITIAL_NAME_SET_SIZE * sizeof(struct s0_name *));
+    if (unlikely(set->sorted == NULL)) {
+        free(set->names);
+        free(set);
+        s0_set_memory_error();
+        return NULL;
+    }
+    return set;
+}
+
+struct s0_name_set *
+s0_name_set_new_copy(const struct s0_name_set *other)
+{
+    size_t  i;
+    struct s0_name_set  *set = s0_name_set_new();
+    if (unlikely(set == NULL)) {
+        return NULL;
+    }
+
+    for (i = 0; i < other->size; i++) {
+        int  rc;
+        struct s0_name  *copy;
+
+        copy = s0_name_new_copy(other->names[i]);
+        if (unlikely(copy == NULL)) {
+            s0_name_set_free(set);
+            return NULL;
+        }
+
+        rc = s0_name_set_add(set, copy);
+        if (unlikely(rc != 0)) {
+            s0_name_set_free(set);
+            return NULL;
+        }
+    }
+
+    return set;
+}
+
+void
+s0_name_set_free(struct s0_name_set *set)
+{
+    size_t  i;
+    for (i = 0; i < set->size; i++) {
+        s0_name_free(set->names[i]);
+    }
+    free(set->names);
+    free(set->sorted);
+    free(set);
+}
+
+int
+s0_name_set_add(struct s0_name_set *set, struct s0_name *name)
+{
+    size_t  pos;
+
+    assert(!s0_name_set_contains(set, name));
+
+    if (unlikely(set->size == set->allocated_size)) {
+        size_t  new_size = set->allocated_size * 2;
+        struct s0_name  **new_names;
+        struct s0_name  **new_sorted;
+
+        new_names = realloc(set->names, new_size * sizeof(struct s0_name *));
+        if (unlikely(new_names == NULL)) {
+            s0_name_free(name);
+            s0_set_memory_error();
+            return -1;
         }
         set->names = new_names;
+
+        new_sorted = realloc(set->sorted, new_size * sizeof(struct s0_name *));
+        if (unlikely(new_sorted == NULL)) {
+            s0_name_free(name);
+            s0_set_memory_error();
+            return -1;
+        }
+        set->sorted = new_sorted;
         set->allocated_size = new_size;
     }
 
+    pos = s0_name_set_search(set, name);
+    memmove(&set->sorted[pos + 1], &set->sorted[pos],
+            (set->size - pos) * sizeof(struct s0_name *));
+    set->sorted[pos] = name;
     set->names[set->size++] = name;
+    set->signature |= s0_name_signature(name);
     return 0;
 }
 
 bool
 s0_name_set_contains(const struct s0_name_set *set, struct s0_name *name)
 {
-    size_t  i;
-    for (i = 0; i < set->size; i++) {
-        if (s0_name_eq(name, set->names[i])) {
-            return true;
-        }
+    size_t  pos;
+    if ((set->signature & s0_name_signature(name)) == 0) {
+        return false;
     }
-    return false;
+    pos = s0_name_set_search(set, name);
+    return pos < set->size && s0_name_eq(set->sorted[pos], name);
 }
 
 size_t
@@ -433,12 +1210,14 @@ s0_name_set_eq(const struct s0_name_set *s1, const struct s0_name_set *s2)
 {
     size_t  i;
 
-    if (s1->size != s2->size) {
+    if (s1->size != s2->size || s1->signature != s2->signature) {
         return false;
     }
 
+    /* Both sorted indexes use the same order, so the sets are equal exactly
+     * when the indexes match element for element. */
     for (i = 0; i < s1->size; i++) {
-        if (!s0_name_set_contains(s2, s1->names[i])) {
+        if (!s0_name_eq(s1->sorted[i], s2->sorted[i])) {
             return false;
         }
     }
@@ -471,6 +1250,14 @@ s0_name_mapping_new(void)
         s0_set_memory_error();
         return NULL;
     }
+    mapping->sorted =
+        malloc(DEFAULT_INITIAL_NAME_MAPPING_SIZE * sizeof(size_t));
+    if (unlikely(mapping->sorted == NULL)) {
+        free(mapping->entries);
+        free(mapping);
+        s0_set_memory_error();
+        return NULL;
+    }
     return mapping;
 }
 
@@ -520,14 +1307,37 @@ s0_name_mapping_free(struct s0_name_mapping *mapping)
         s0_name_free(mapping->entries[i].to);
     }
     free(mapping->entries);
+    free(mapping->sorted);
     free(mapping);
 }
 
+/* Returns the position in `mapping->sorted` where `from` is (if it's in the
+ * mapping's domain) or where it would be inserted (if it isn't). */
+static size_t
+s0_name_mapping_search(const struct s0_name_mapping *mapping,
+                       const struct s0_name *from)
+{
+    size_t  lo = 0;
+    size_t  hi = mapping->size;
+    while (lo < hi) {
+        size_t  mid = lo + (hi - lo) / 2;
+        const struct s0_name  *curr =
+            mapping->entries[mapping->sorted[mid]].from;
+        if (s0_name_cmp(curr, from) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
 int
 s0_name_mapping_add(struct s0_name_mapping *mapping, struct s0_name *from,
                     struct s0_name *to)
 {
     struct s0_name_mapping_entry  *new_entry;
+    size_t  pos;
 
 #if !defined(NDEBUG)
     {
@@ -541,9 +1351,11 @@ s0_name_mapping_add(struct s0_name_mapping *mapping, struct s0_name *from,
 
     if (unlikely(mapping->size == mapping->allocated_size)) {
         size_t  new_size = mapping->allocated_size * 2;
-        struct s0_name_mapping_entry  *new_entries =
-            realloc(mapping->entries,
-                    new_size * sizeof(struct s0_name_mapping_entry));
+        struct s0_name_mapping_entry  *new_entries;
+        size_t  *new_sorted;
+
+        new_entries = realloc(mapping->entries,
+                              new_size * sizeof(struct s0_name_mapping_entry));
         if (unlikely(new_entries == NULL)) {
             s0_name_free(from);
             s0_name_free(to);
@@ -551,9 +1363,24 @@ s0_name_mapping_add(struct s0_name_mapping *mapping, struct s0_name *from,
             return -1;
         }
         mapping->entries = new_entries;
+
+        new_sorted = realloc(mapping->sorted, new_size * sizeof(size_t));
+        if (unlikely(new_sorted == NULL)) {
+            s0_name_free(from);
+            s0_name_free(to);
+            s0_set_memory_error();
+            return -1;
+        }
+        mapping->sorted = new_sorted;
         mapping->allocated_size = new_size;
     }
 
+    /* Keep the index sorted, so that lookups can use a binary search. */
+    pos = s0_name_mapping_search(mapping, from);
+    memmove(&mapping->sorted[pos + 1], &mapping->sorted[pos],
+            (mapping->size - pos) * sizeof(size_t));
+    mapping->sorted[pos] = mapping->size;
+
     new_entry = &mapping->entries[mapping->size++];
     new_entry->from = from;
     new_entry->to = to;
@@ -577,10 +1404,12 @@ const struct s0_name *
 s0_name_mapping_get(const struct s0_name_mapping *mapping,
                     const struct s0_name *from)
 {
-    size_t  i;
-    for (i = 0; i < mapping->size; i++) {
-        if (s0_name_eq(mapping->entries[i].from, from)) {
-            return mapping->entries[i].to;
+    size_t  pos = s0_name_mapping_search(mapping, from);
+    if (pos < mapping->size) {
+        const struct s0_name_mapping_entry  *entry =
+            &mapping->entries[mapping->sorted[pos]];
+        if (s0_name_eq(entry->from, from)) {
+            return entry->to;
         }
     }
     return NULL;
@@ -731,33 +1560,44 @@ int
 s0_environment_extract(struct s0_environment *dest, struct s0_environment *src,
                        const struct s0_name_set *set)
 {
+    struct s0_environment_entry  **prev;
+    size_t  remaining = set->size;
     size_t  i;
 
 #if !defined(NDEBUG)
     for (i = 0; i < set->size; i++) {
-        const struct s0_name  *name = set->names[i];
-        assert(s0_environment_get(src, name) != NULL);
-        assert(s0_environment_get(dest, name) == NULL);
+        assert(s0_environment_get(dest, set->names[i]) == NULL);
     }
 #endif
 
-    for (i = 0; i < set->size; i++) {
-        const struct s0_name  *name = set->names[i];
-        struct s0_entity  *entity;
-
-        entity = s0_environment_delete(src, name);
-        if (entity == NULL) {
-            return -1;
+    /* Make a single pass through src, unlinking each entry that belongs to the
+     * set and pushing it onto dest.  The entry (and its name) moves over as-is,
+     * so we don't have to allocate or free anything. */
+    prev = &src->head;
+    while (remaining > 0 && *prev != NULL) {
+        struct s0_environment_entry  *curr = *prev;
+        if (s0_name_set_contains(set, curr->name)) {
+            *prev = curr->next;
+            src->size--;
+            curr->next = dest->head;
+            dest->head = curr;
+            dest->size++;
+            remaining--;
         } else {
-            int  rc;
-            struct s0_name  *name_copy = s0_name_new_copy(name);
-            if (unlikely(name_copy == NULL)) {
-                s0_entity_free(entity);
-                return -1;
-            }
+            prev = &curr->next;
+        }
+    }
 
-            rc = s0_environment_add(dest, name_copy, entity);
-            if (unlikely(rc != 0)) {
+    if (unlikely(remaining > 0)) {
+        /* Anything that we didn't move over is missing from src.  Only now do
+         * we pay to find out which name it was. */
+        for (i = 0; i < set->size; i++) {
+            const struct s0_name  *name = set->names[i];
+            if (s0_environment_get(dest, name) == NULL) {
+                s0_set_error
+                    (S0_ERROR_UNDEFINED,
+                     "Environment doesn't have an entry named `%s`",
+                     s0_name_human_readable(name));
                 return -1;
             }
         }
@@ -802,21 +1642,15 @@ s0_environment_rename(struct s0_environment *env,
 
     assert(env->size == mapping->size);
 
-    for (curr = env->head; curr != NULL; curr = curr->next){
-        const struct s0_name  *from = curr->name;
-        const struct s0_name  *to;
-        struct s0_name  *to_copy;
-
-        to = s0_name_mapping_get(mapping, from);
+    /* Each entry is looked up by its old name before we overwrite it, and each
+     * entry is visited exactly once, so it's safe to rename in place even when
+     * the mapping swaps names around. */
+    for (curr = env->head; curr != NULL; curr = curr->next) {
+        const struct s0_name  *to = s0_name_mapping_get(mapping, curr->name);
         assert(to != NULL);
-
-        to_copy = s0_name_new_copy(to);
-        if (unlikely(to_copy == NULL)) {
+        if (unlikely(s0_name_assign(&curr->name, to) != 0)) {
             return -1;
         }
-
-        s0_name_free(curr->name);
-        curr->name = to_copy;
     }
 
     return 0;
@@ -827,12 +1661,32 @@ s0_environment_rename(struct s0_environment *env,
  * S₀: Blocks
  */
 
+static void
+s0_statement_done(struct s0_statement *stmt);
+
+static void
+s0_invocation_done(struct s0_invocation *invocation);
+
+/* Returns the block's packed invocation, which lives just past the end of its
+ * packed statements. */
+static inline struct s0_invocation *
+s0_block_code_invocation(const struct s0_block *block)
+{
+    return (struct s0_invocation *) &block->code[block->statement_count];
+}
+
 struct s0_block *
 s0_block_new(struct s0_environment_type *inputs,
              struct s0_statement_list *statements,
              struct s0_invocation *invocation)
 {
-    struct s0_block  *block = malloc(sizeof(struct s0_block));
+    size_t  i;
+    size_t  count = statements->size;
+    struct s0_block  *block =
+        malloc(sizeof(struct s0_block)
+               + count * sizeof(struct s0_statement)
+               + sizeof(struct s0_invocation)
+               + count * sizeof(struct s0_statement *));
     if (unlikely(block == NULL)) {
         s0_environment_type_free(inputs);
         s0_statement_list_free(statements);
@@ -840,9 +1694,26 @@ s0_block_new(struct s0_environment_type *inputs,
         s0_set_memory_error();
         return NULL;
     }
+    block->ref_count = 1;
     block->inputs = inputs;
-    block->statements = statements;
-    block->invocation = invocation;
+    block->source = NULL;
+    block->source_index = 0;
+    block->statement_count = count;
+
+    /* Move each record into place, and then free the shells that held them. */
+    block->statements.size = count;
+    block->statements.allocated_size = count;
+    block->statements.statements =
+        (struct s0_statement **) (s0_block_code_invocation(block) + 1);
+    for (i = 0; i < count; i++) {
+        block->code[i] = *statements->statements[i];
+        block->statements.statements[i] = &block->code[i];
+        free(statements->statements[i]);
+    }
+    free(statements->statements);
+    free(statements);
+    *s0_block_code_invocation(block) = *invocation;
+    free(invocation);
     return block;
 }
 
@@ -852,34 +1723,58 @@ s0_block_new_copy(const struct s0_block *other)
     struct s0_environment_type  *inputs;
     struct s0_statement_list  *statements;
     struct s0_invocation  *invocation;
+    struct s0_block  *block;
 
     inputs = s0_environment_type_new_copy(other->inputs);
     if (unlikely(inputs == NULL)) {
         return NULL;
     }
 
-    statements = s0_statement_list_new_copy(other->statements);
+    statements = s0_statement_list_new_copy(&other->statements);
     if (unlikely(statements == NULL)) {
         s0_environment_type_free(inputs);
         return NULL;
     }
 
-    invocation = s0_invocation_new_copy(other->invocation);
+    invocation = s0_invocation_new_copy(s0_block_code_invocation(other));
     if (unlikely(invocation == NULL)) {
         s0_environment_type_free(inputs);
         s0_statement_list_free(statements);
         return NULL;
     }
 
-    return s0_block_new(inputs, statements, invocation);
+    block = s0_block_new(inputs, statements, invocation);
+    if (unlikely(block == NULL)) {
+        return NULL;
+    }
+    if (other->source != NULL) {
+        s0_block_set_source(block, other->source, other->source_index);
+    }
+    return block;
+}
+
+struct s0_block *
+s0_block_ref(struct s0_block *block)
+{
+    s0_ref_count_increment(&block->ref_count);
+    return block;
 }
 
 void
 s0_block_free(struct s0_block *block)
 {
+    size_t  i;
+    if (!s0_ref_count_decrement(&block->ref_count)) {
+        return;
+    }
+    for (i = 0; i < block->statement_count; i++) {
+        s0_statement_done(&block->code[i]);
+    }
+    s0_invocation_done(s0_block_code_invocation(block));
     s0_environment_type_free(block->inputs);
-    s0_statement_list_free(block->statements);
-    s0_invocation_free(block->invocation);
+    if (block->source != NULL) {
+        s0_source_map_free(block->source);
+    }
     free(block);
 }
 
@@ -892,132 +1787,388 @@ s0_block_inputs(const struct s0_block *block)
 struct s0_statement_list *
 s0_block_statements(const struct s0_block *block)
 {
-    return block->statements;
+    return (struct s0_statement_list *) &block->statements;
 }
 
 struct s0_invocation *
 s0_block_invocation(const struct s0_block *block)
 {
-    return block->invocation;
+    return s0_block_code_invocation(block);
 }
 
 bool
 s0_block_eq(const struct s0_block *b1, const struct s0_block *b2)
 {
     return s0_environment_type_equiv(b1->inputs, b2->inputs)
-        && s0_statement_list_eq(b1->statements, b2->statements)
-        && s0_invocation_eq(b1->invocation, b2->invocation);
+        && s0_statement_list_eq(&b1->statements, &b2->statements)
+        && s0_invocation_eq(s0_block_code_invocation(b1),
+                            s0_block_code_invocation(b2));
 }
 
 
 /*-----------------------------------------------------------------------------
- * Named blocks
+ * S₀: Source maps
  */
 
-struct s0_named_blocks *
-s0_named_blocks_new(void)
+#define DEFAULT_INITIAL_SOURCE_MAP_SIZE  8
+
+struct s0_source_map *
+s0_source_map_new(const char *filename)
 {
-    struct s0_named_blocks  *blocks = malloc(sizeof(struct s0_named_blocks));
-    if (unlikely(blocks == NULL)) {
+    struct s0_source_map  *map = malloc(sizeof(struct s0_source_map));
+    if (unlikely(map == NULL)) {
         s0_set_memory_error();
         return NULL;
     }
-    blocks->head = NULL;
-    blocks->size = 0;
-    return blocks;
+    map->ref_count = 1;
+    map->filename = NULL;
+    if (filename != NULL) {
+        map->filename = strdup(filename);
+        if (unlikely(map->filename == NULL)) {
+            free(map);
+            s0_set_memory_error();
+            return NULL;
+        }
+    }
+    map->block_count = 0;
+    map->allocated_block_count = DEFAULT_INITIAL_SOURCE_MAP_SIZE;
+    map->blocks = malloc(DEFAULT_INITIAL_SOURCE_MAP_SIZE
+                         * sizeof(struct s0_source_block));
+    if (unlikely(map->blocks == NULL)) {
+        free(map->filename);
+        free(map);
+        s0_set_memory_error();
+        return NULL;
+    }
+    map->position_count = 0;
+    map->allocated_position_count = 0;
+    map->positions = NULL;
+    return map;
 }
 
-struct s0_named_blocks *
-s0_named_blocks_new_copy(const struct s0_named_blocks *other)
+struct s0_source_map *
+s0_source_map_ref(struct s0_source_map *map)
 {
-    struct s0_named_blocks  *blocks;
-    struct s0_named_blocks_entry  *curr;
+    s0_ref_count_increment(&map->ref_count);
+    return map;
+}
 
-    blocks = s0_named_blocks_new();
-    if (unlikely(blocks == NULL)) {
-        return NULL;
+void
+s0_source_map_free(struct s0_source_map *map)
+{
+    size_t  i;
+    if (!s0_ref_count_decrement(&map->ref_count)) {
+        return;
     }
+    for (i = 0; i < map->block_count; i++) {
+        if (map->blocks[i].name != NULL) {
+            s0_name_free(map->blocks[i].name);
+        }
+    }
+    free(map->blocks);
+    free(map->positions);
+    free(map->filename);
+    free(map);
+}
 
-    for (curr = other->head; curr != NULL; curr = curr->next) {
-        int  rc;
-        struct s0_name  *name_copy;
-        struct s0_block  *block_copy;
-
-        name_copy = s0_name_new_copy(curr->name);
-        if (unlikely(name_copy == NULL)) {
-            s0_named_blocks_free(blocks);
-            return NULL;
+int
+s0_source_map_add_block(struct s0_source_map *map, size_t parent,
+                        const struct s0_name *name, size_t line,
+                        size_t column, size_t *index)
+{
+    struct s0_source_block  *block;
+    assert(parent == S0_SOURCE_NO_PARENT || parent < map->block_count);
+
+    if (unlikely(map->block_count == map->allocated_block_count)) {
+        size_t  new_size = map->allocated_block_count * 2;
+        struct s0_source_block  *new_blocks =
+            realloc(map->blocks, new_size * sizeof(struct s0_source_block));
+        if (unlikely(new_blocks == NULL)) {
+            s0_set_memory_error();
+            return -1;
         }
+        map->blocks = new_blocks;
+        map->allocated_block_count = new_size;
+    }
 
-        block_copy = s0_block_new_copy(curr->block);
-        if (unlikely(block_copy == NULL)) {
-            s0_name_free(name_copy);
-            s0_named_blocks_free(blocks);
-            return NULL;
+    block = &map->blocks[map->block_count];
+    block->name = NULL;
+    if (name != NULL) {
+        block->name = s0_name_new_copy(name);
+        if (unlikely(block->name == NULL)) {
+            return -1;
         }
+    }
+    block->parent = parent;
+    block->line = line;
+    block->column = column;
+    block->first_position = 0;
+    block->position_count = 0;
+    *index = map->block_count++;
+    return 0;
+}
 
-        rc = s0_named_blocks_add(blocks, name_copy, block_copy);
-        if (unlikely(rc != 0)) {
-            s0_named_blocks_free(blocks);
-            return NULL;
+int
+s0_source_map_add_position(struct s0_source_map *map, size_t index,
+                           size_t line, size_t column)
+{
+    struct s0_source_block  *block;
+    struct s0_source_position  *position;
+    assert(index < map->block_count);
+    block = &map->blocks[index];
+    if (block->position_count == 0) {
+        block->first_position = map->position_count;
+    }
+    assert(block->first_position + block->position_count
+           == map->position_count);
+
+    if (unlikely(map->position_count == map->allocated_position_count)) {
+        size_t  new_size = (map->allocated_position_count == 0)?
+            DEFAULT_INITIAL_SOURCE_MAP_SIZE * 4:
+            map->allocated_position_count * 2;
+        struct s0_source_position  *new_positions = realloc
+            (map->positions, new_size * sizeof(struct s0_source_position));
+        if (unlikely(new_positions == NULL)) {
+            s0_set_memory_error();
+            return -1;
         }
+        map->positions = new_positions;
+        map->allocated_position_count = new_size;
     }
 
-    return blocks;
+    position = &map->positions[map->position_count++];
+    position->line = (line > UINT32_MAX)? UINT32_MAX: line;
+    position->column = (column > UINT32_MAX)? UINT32_MAX: column;
+    block->position_count++;
+    return 0;
 }
 
-void
-s0_named_blocks_free(struct s0_named_blocks *blocks)
+/* Returns where the statement (or, if index is the block's statement count, the
+ * invocation) at `index` of the block at `block_index` was defined, or NULL if
+ * we don't know. */
+static const struct s0_source_position *
+s0_source_map_position(const struct s0_source_map *map, size_t block_index,
+                       size_t index)
 {
-    struct s0_named_blocks_entry  *curr;
-    struct s0_named_blocks_entry  *next;
-    for (curr = blocks->head; curr != NULL; curr = next) {
-        next = curr->next;
-        s0_name_free(curr->name);
-        s0_block_free(curr->block);
-        free(curr);
+    const struct s0_source_block  *block = &map->blocks[block_index];
+    if (index >= block->position_count) {
+        return NULL;
     }
-    free(blocks);
+    return &map->positions[block->first_position + index];
 }
 
-size_t
-s0_named_blocks_size(const struct s0_named_blocks *blocks)
+void
+s0_block_set_source(struct s0_block *block, struct s0_source_map *map,
+                    size_t index)
 {
-    size_t  size = 0;
-    struct s0_named_blocks_entry  *curr;
-    for (curr = blocks->head; curr != NULL; curr = curr->next) {
-        size++;
+    assert(index < map->block_count);
+    if (block->source != NULL) {
+        s0_source_map_free(block->source);
     }
-    return size;
+    block->source = s0_source_map_ref(map);
+    block->source_index = index;
+}
+
+bool
+s0_block_source_location(const struct s0_block *block,
+                         struct s0_source_location *location)
+{
+    const struct s0_source_block  *source;
+    if (block->source == NULL) {
+        return false;
+    }
+    source = &block->source->blocks[block->source_index];
+    location->filename = block->source->filename;
+    location->line = source->line;
+    location->column = source->column;
+    return true;
+}
+
+bool
+s0_block_statement_location(const struct s0_block *block, size_t index,
+                            struct s0_source_location *location)
+{
+    const struct s0_source_position  *position;
+    assert(index <= block->statement_count);
+    if (block->source == NULL) {
+        return false;
+    }
+    position = s0_source_map_position
+        (block->source, block->source_index, index);
+    if (position == NULL) {
+        return false;
+    }
+    location->filename = block->source->filename;
+    location->line = position->line;
+    location->column = position->column;
+    return true;
+}
+
+bool
+s0_block_invocation_location(const struct s0_block *block,
+                             struct s0_source_location *location)
+{
+    return s0_block_statement_location
+        (block, block->statement_count, location);
+}
+
+const struct s0_name *
+s0_block_source_name(const struct s0_block *block)
+{
+    if (block->source == NULL) {
+        return NULL;
+    }
+    return block->source->blocks[block->source_index].name;
+}
+
+
+/*-----------------------------------------------------------------------------
+ * Named blocks
+ */
+
+#define DEFAULT_INITIAL_NAMED_BLOCKS_SIZE  4
+
+struct s0_named_blocks *
+s0_named_blocks_new(void)
+{
+    struct s0_named_blocks  *blocks = malloc(sizeof(struct s0_named_blocks));
+    if (unlikely(blocks == NULL)) {
+        s0_set_memory_error();
+        return NULL;
+    }
+    blocks->ref_count = 1;
+    blocks->size = 0;
+    blocks->allocated_size = DEFAULT_INITIAL_NAMED_BLOCKS_SIZE;
+    blocks->entries =
+        malloc(DEFAULT_INITIAL_NAMED_BLOCKS_SIZE *
+               sizeof(struct s0_named_blocks_entry));
+    if (unlikely(blocks->entries == NULL)) {
+        free(blocks);
+        s0_set_memory_error();
+        return NULL;
+    }
+    return blocks;
+}
+
+struct s0_named_blocks *
+s0_named_blocks_new_copy(const struct s0_named_blocks *other)
+{
+    size_t  i;
+    struct s0_named_blocks  *blocks;
+
+    blocks = malloc(sizeof(struct s0_named_blocks));
+    if (unlikely(blocks == NULL)) {
+        s0_set_memory_error();
+        return NULL;
+    }
+    blocks->ref_count = 1;
+    blocks->size = 0;
+    blocks->allocated_size = (other->size == 0)? 1: other->size;
+    blocks->entries =
+        malloc(blocks->allocated_size * sizeof(struct s0_named_blocks_entry));
+    if (unlikely(blocks->entries == NULL)) {
+        free(blocks);
+        s0_set_memory_error();
+        return NULL;
+    }
+
+    /* other is already sorted, so we can copy its entries over directly.
+     * Blocks are immutable, so the copy can share them with other. */
+    for (i = 0; i < other->size; i++) {
+        struct s0_name  *name_copy;
+
+        name_copy = s0_name_new_copy(other->entries[i].name);
+        if (unlikely(name_copy == NULL)) {
+            s0_named_blocks_free(blocks);
+            return NULL;
+        }
+
+        blocks->entries[i].name = name_copy;
+        blocks->entries[i].block = s0_block_ref(other->entries[i].block);
+        blocks->size++;
+    }
+
+    return blocks;
+}
+
+struct s0_named_blocks *
+s0_named_blocks_ref(struct s0_named_blocks *blocks)
+{
+    s0_ref_count_increment(&blocks->ref_count);
+    return blocks;
+}
+
+void
+s0_named_blocks_free(struct s0_named_blocks *blocks)
+{
+    size_t  i;
+    if (!s0_ref_count_decrement(&blocks->ref_count)) {
+        return;
+    }
+    for (i = 0; i < blocks->size; i++) {
+        s0_name_free(blocks->entries[i].name);
+        s0_block_free(blocks->entries[i].block);
+    }
+    free(blocks->entries);
+    free(blocks);
+}
+
+size_t
+s0_named_blocks_size(const struct s0_named_blocks *blocks)
+{
+    return blocks->size;
+}
+
+/* Returns the position in `blocks->entries` where `name` is (if it's present)
+ * or where it would be inserted (if it isn't). */
+static size_t
+s0_named_blocks_search(const struct s0_named_blocks *blocks,
+                       const struct s0_name *name)
+{
+    size_t  lo = 0;
+    size_t  hi = blocks->size;
+    while (lo < hi) {
+        size_t  mid = lo + (hi - lo) / 2;
+        if (s0_name_cmp(blocks->entries[mid].name, name) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
 }
 
 int
 s0_named_blocks_add(struct s0_named_blocks *blocks,
                     struct s0_name *name, struct s0_block *block)
 {
+    size_t  pos;
     struct s0_named_blocks_entry  *entry;
 
-#if !defined(NDEBUG)
-    {
-        struct s0_named_blocks_entry  *curr;
-        for (curr = blocks->head; curr != NULL; curr = curr->next) {
-            assert(!s0_name_eq(curr->name, name));
-        }
-    }
-#endif
+    assert(blocks->ref_count == 1);
+    assert(s0_named_blocks_get(blocks, name) == NULL);
 
-    entry = malloc(sizeof(struct s0_named_blocks_entry));
-    if (unlikely(entry == NULL)) {
-        s0_name_free(name);
-        s0_block_free(block);
-        s0_set_memory_error();
-        return -1;
+    if (unlikely(blocks->size == blocks->allocated_size)) {
+        size_t  new_size = blocks->allocated_size * 2;
+        struct s0_named_blocks_entry  *new_entries =
+            realloc(blocks->entries,
+                    new_size * sizeof(struct s0_named_blocks_entry));
+        if (unlikely(new_entries == NULL)) {
+            s0_name_free(name);
+            s0_block_free(block);
+            s0_set_memory_error();
+            return -1;
+        }
+        blocks->entries = new_entries;
+        blocks->allocated_size = new_size;
     }
 
+    pos = s0_named_blocks_search(blocks, name);
+    entry = &blocks->entries[pos];
+    memmove(entry + 1, entry,
+            (blocks->size - pos) * sizeof(struct s0_named_blocks_entry));
     entry->name = name;
     entry->block = block;
-    entry->next = blocks->head;
-    blocks->head = entry;
     blocks->size++;
     return 0;
 }
@@ -1026,11 +2177,9 @@ struct s0_block *
 s0_named_blocks_get(const struct s0_named_blocks *blocks,
                     const struct s0_name *name)
 {
-    struct s0_named_blocks_entry  *curr;
-    for (curr = blocks->head; curr != NULL; curr = curr->next) {
-        if (s0_name_eq(curr->name, name)) {
-            return curr->block;
-        }
+    size_t  pos = s0_named_blocks_search(blocks, name);
+    if (pos < blocks->size && s0_name_eq(blocks->entries[pos].name, name)) {
+        return blocks->entries[pos].block;
     }
     return NULL;
 }
@@ -1039,21 +2188,17 @@ struct s0_block *
 s0_named_blocks_delete(struct s0_named_blocks *blocks,
                        const struct s0_name *name)
 {
-    struct s0_named_blocks_entry  *prev;
-    struct s0_named_blocks_entry  *curr;
-    for (prev = NULL, curr = blocks->head; curr != NULL;
-         prev = curr, curr = curr->next) {
-        if (s0_name_eq(curr->name, name)) {
-            struct s0_block  *block = curr->block;
-            if (prev == NULL) {
-                blocks->head = curr->next;
-            } else {
-                prev->next = curr->next;
-            }
-            s0_name_free(curr->name);
-            free(curr);
-            return block;
-        }
+    size_t  pos;
+    assert(blocks->ref_count == 1);
+    pos = s0_named_blocks_search(blocks, name);
+    if (pos < blocks->size && s0_name_eq(blocks->entries[pos].name, name)) {
+        struct s0_named_blocks_entry  *entry = &blocks->entries[pos];
+        struct s0_block  *block = entry->block;
+        s0_name_free(entry->name);
+        blocks->size--;
+        memmove(entry, entry + 1,
+                (blocks->size - pos) * sizeof(struct s0_named_blocks_entry));
+        return block;
     }
     return NULL;
 }
@@ -1062,15 +2207,17 @@ bool
 s0_named_blocks_eq(const struct s0_named_blocks *nb1,
                    const struct s0_named_blocks *nb2)
 {
-    struct s0_named_blocks_entry  *curr;
+    size_t  i;
 
     if (nb1->size != nb2->size) {
         return false;
     }
 
-    for (curr = nb1->head; curr != NULL; curr = curr->next) {
-        struct s0_block  *nb2_block = s0_named_blocks_get(nb2, curr->name);
-        if (nb2_block == NULL || !s0_block_eq(nb2_block, curr->block)) {
+    /* Both collections are sorted the same way, so we can compare them entry
+     * by entry. */
+    for (i = 0; i < nb1->size; i++) {
+        if (!s0_name_eq(nb1->entries[i].name, nb2->entries[i].name)
+            || !s0_block_eq(nb1->entries[i].block, nb2->entries[i].block)) {
             return false;
         }
     }
@@ -1321,12 +2468,8 @@ s0_create_method_new_copy(const struct s0_statement *other)
         return NULL;
     }
 
-    body = s0_block_new_copy(other->_.create_method.body);
-    if (unlikely(body == NULL)) {
-        s0_name_free(dest);
-        return NULL;
-    }
-
+    /* Blocks are immutable, so the copy can share the body. */
+    body = s0_block_ref(other->_.create_method.body);
     return s0_create_method_new(dest, body);
 }
 
@@ -1378,8 +2521,9 @@ s0_statement_new_copy(const struct s0_statement *other)
     }
 }
 
-void
-s0_statement_free(struct s0_statement *stmt)
+/* Frees everything that stmt owns, but not stmt itself. */
+static void
+s0_statement_done(struct s0_statement *stmt)
 {
     switch (stmt->kind) {
         case S0_STATEMENT_KIND_CREATE_ATOM:
@@ -1398,6 +2542,12 @@ s0_statement_free(struct s0_statement *stmt)
             assert(false);
             break;
     }
+}
+
+void
+s0_statement_free(struct s0_statement *stmt)
+{
+    s0_statement_done(stmt);
     free(stmt);
 }
 
@@ -1741,8 +2891,9 @@ s0_invocation_new_copy(const struct s0_invocation *other)
     }
 }
 
-void
-s0_invocation_free(struct s0_invocation *invocation)
+/* Frees everything that invocation owns, but not invocation itself. */
+static void
+s0_invocation_done(struct s0_invocation *invocation)
 {
     switch (invocation->kind) {
         case S0_INVOCATION_KIND_INVOKE_CLOSURE:
@@ -1755,6 +2906,12 @@ s0_invocation_free(struct s0_invocation *invocation)
             assert(false);
             break;
     }
+}
+
+void
+s0_invocation_free(struct s0_invocation *invocation)
+{
+    s0_invocation_done(invocation);
     free(invocation);
 }
 
@@ -1861,6 +3018,8 @@ s0_literal_new(size_t size, const void *content)
     }
     literal->kind = S0_ENTITY_KIND_LITERAL;
     literal->_.literal.size = size;
+    literal->_.literal.release = NULL;
+    literal->_.literal.release_ud = NULL;
     literal->_.literal.content = malloc(size);
     if (unlikely(literal->_.literal.content == NULL)) {
         free(literal);
@@ -1877,10 +3036,33 @@ s0_literal_new_str(const void *content)
     return s0_literal_new(strlen(content), content);
 }
 
+struct s0_entity *
+s0_literal_new_view(size_t size, const void *content,
+                    s0_literal_release_f *release, void *ud)
+{
+    struct s0_entity  *literal = malloc(sizeof(struct s0_entity));
+    if (unlikely(literal == NULL)) {
+        release(ud, content);
+        s0_set_memory_error();
+        return NULL;
+    }
+    literal->kind = S0_ENTITY_KIND_LITERAL;
+    literal->_.literal.size = size;
+    literal->_.literal.content = content;
+    literal->_.literal.release = release;
+    literal->_.literal.release_ud = ud;
+    return literal;
+}
+
 static void
 s0_literal_free(struct s0_entity *literal)
 {
-    free((void *) literal->_.literal.content);
+    if (literal->_.literal.release == NULL) {
+        free((void *) literal->_.literal.content);
+    } else {
+        literal->_.literal.release
+            (literal->_.literal.release_ud, literal->_.literal.content);
+    }
 }
 
 const char *
@@ -2149,21 +3331,22 @@ static struct s0_entity_type *
 s0_closure_entity_type_new_from_named_blocks(
         const struct s0_named_blocks *blocks)
 {
+    size_t  i;
     struct s0_environment_type_mapping  *branches;
-    struct s0_named_blocks_entry  *curr;
 
     branches = s0_environment_type_mapping_new();
     if (unlikely(branches == NULL)) {
         return NULL;
     }
 
-    for (curr = blocks->head; curr != NULL; curr = curr->next) {
+    for (i = 0; i < blocks->size; i++) {
         int  rc;
-        struct s0_environment_type  *inputs = curr->block->inputs;
+        const struct s0_named_blocks_entry  *entry = &blocks->entries[i];
+        struct s0_environment_type  *inputs = entry->block->inputs;
         struct s0_name  *name_copy;
         struct s0_environment_type  *branch_type;
 
-        name_copy = s0_name_new_copy(curr->name);
+        name_copy = s0_name_new_copy(entry->name);
         if (unlikely(name_copy == NULL)) {
             s0_environment_type_mapping_free(branches);
             return NULL;
@@ -2960,7 +4143,6 @@ s0_environment_type_rename(struct s0_environment_type *type,
     for (i = 0; i < type->size; i++) {
         const struct s0_name  *from = type->entries[i].name;
         const struct s0_name  *to;
-        struct s0_name  *to_copy;
 
         to = s0_name_mapping_get(mapping, from);
         if (unlikely(to == NULL)) {
@@ -2971,13 +4153,9 @@ s0_environment_type_rename(struct s0_environment_type *type,
             return -1;
         }
 
-        to_copy = s0_name_new_copy(to);
-        if (unlikely(to_copy == NULL)) {
+        if (unlikely(s0_name_assign(&type->entries[i].name, to) != 0)) {
             return -1;
         }
-
-        s0_name_free(type->entries[i].name);
-        type->entries[i].name = to_copy;
     }
 
     return 0;
@@ -3547,6 +4725,25 @@ s0_finish_continuation(void)
     return s0_finish_continuation_;
 }
 
+/* Like the finish continuation, this will never get called; it tells the
+ * trampoline loop that a primitive has suspended the current execution. */
+static struct s0_continuation
+s0_execute_pending_continuation(void *ud, struct s0_environment *env)
+{
+    assert(false);
+}
+
+static const struct s0_continuation  s0_pending_continuation_ = {
+    NULL,
+    s0_execute_pending_continuation
+};
+
+struct s0_continuation
+s0_pending_continuation(void)
+{
+    return s0_pending_continuation_;
+}
+
 
 static int
 s0_create_atom_execute(struct s0_statement *stmt, struct s0_environment *env)
@@ -3600,13 +4797,7 @@ s0_create_closure_execute(struct s0_statement *stmt, struct s0_environment *env)
         return rc;
     }
 
-    blocks = s0_named_blocks_new_copy(stmt->_.create_closure.branches);
-    if (unlikely(blocks == NULL)) {
-        s0_name_free(dest);
-        s0_environment_free(closure_set);
-        return -1;
-    }
-
+    blocks = s0_named_blocks_ref(stmt->_.create_closure.branches);
     closure = s0_closure_new(closure_set, blocks);
     if (unlikely(closure == NULL)) {
         s0_name_free(dest);
@@ -3653,12 +4844,7 @@ s0_create_method_execute(struct s0_statement *stmt, struct s0_environment *env)
         return -1;
     }
 
-    body = s0_block_new_copy(stmt->_.create_method.body);
-    if (unlikely(body == NULL)) {
-        s0_name_free(dest);
-        return -1;
-    }
-
+    body = s0_block_ref(stmt->_.create_method.body);
     method = s0_method_new(body);
     if (unlikely(method == NULL)) {
         s0_name_free(dest);
@@ -3686,17 +4872,47 @@ s0_statement_execute(struct s0_statement *stmt, struct s0_environment *env)
     }
 }
 
+/* The number of statements that every execution has executed.  Each thread
+ * tallies its own statements, and s0_continuation_run adds that tally to the
+ * total when it returns, just like it does for steps. */
+static size_t  s0_total_statements = 0;
+static __thread size_t  s0_thread_statements = 0;
+
+size_t
+s0_execution_statement_count(void)
+{
+    return __atomic_load_n(&s0_total_statements, __ATOMIC_RELAXED);
+}
+
+/* Prefixes the current error with where the statement at `index` of block (or
+ * its invocation, if index is the statement count) was defined.  We only
+ * consult the source map once something has already failed, so it costs
+ * nothing while execution succeeds. */
+static void
+s0_block_prefix_error_location(const struct s0_block *block, size_t index)
+{
+    struct s0_source_location  location;
+    if (s0_block_statement_location(block, index, &location)) {
+        s0_prefix_error("%s:%zu:%zu: ",
+                        (location.filename == NULL)? "[string]":
+                        location.filename,
+                        location.line, location.column);
+    }
+}
+
 static int
-s0_statement_list_execute(struct s0_statement_list *list,
-                          struct s0_environment *env)
+s0_block_statements_execute(struct s0_block *block, struct s0_environment *env)
 {
     size_t  i;
-    for (i = 0; i < list->size; i++) {
-        int  rc = s0_statement_execute(list->statements[i], env);
+    for (i = 0; i < block->statement_count; i++) {
+        int  rc = s0_statement_execute(&block->code[i], env);
         if (unlikely(rc != 0)) {
+            s0_block_prefix_error_location(block, i);
+            s0_thread_statements += i;
             return rc;
         }
     }
+    s0_thread_statements += i;
     return 0;
 }
 
@@ -3715,9 +4931,13 @@ s0_invoke_closure_execute(struct s0_invocation *invocation,
     assert(closure != NULL);
     assert(closure->kind == S0_ENTITY_KIND_CLOSURE);
 
-    branch = s0_named_blocks_delete
+    /* The closure's blocks might be shared with other closures (created by the
+     * same statement), so we take our own reference to the branch instead of
+     * removing it. */
+    branch = s0_named_blocks_get
         (closure->_.closure.blocks, invocation->_.invoke_closure.branch);
     assert(branch != NULL);
+    s0_block_ref(branch);
 
     rc = s0_environment_rename(env, invocation->_.invoke_closure.params);
     if (unlikely(rc != 0)) {
@@ -3790,18 +5010,29 @@ s0_invocation_execute(struct s0_invocation *invocation,
     }
 }
 
+static struct s0_continuation
+s0_block_invocation_execute(struct s0_block *block, struct s0_environment *env)
+{
+    struct s0_continuation  cont =
+        s0_invocation_execute(s0_block_code_invocation(block), env);
+    if (unlikely(cont.invoke == s0_execute_error_continuation)) {
+        s0_block_prefix_error_location(block, block->statement_count);
+    }
+    return cont;
+}
+
 struct s0_continuation
 s0_execute_block(void *ud, struct s0_environment *env)
 {
     int  rc;
     struct s0_block  *block = ud;
 
-    rc = s0_statement_list_execute(block->statements, env);
+    rc = s0_block_statements_execute(block, env);
     if (unlikely(rc != 0)) {
         return s0_error_continuation_;
     }
 
-    return s0_invocation_execute(block->invocation, env);
+    return s0_block_invocation_execute(block, env);
 }
 
 static struct s0_continuation
@@ -3820,13 +5051,13 @@ s0_execute_and_free_block(void *ud, struct s0_environment *env)
     struct s0_block  *block = ud;
     struct s0_continuation  cont;
 
-    rc = s0_statement_list_execute(block->statements, env);
+    rc = s0_block_statements_execute(block, env);
     if (unlikely(rc != 0)) {
         s0_block_free(block);
         return s0_error_continuation_;
     }
 
-    cont = s0_invocation_execute(block->invocation, env);
+    cont = s0_block_invocation_execute(block, env);
     s0_block_free(block);
     return cont;
 }
@@ -3846,18 +5077,118 @@ s0_continuation_invoke(struct s0_continuation cont, struct s0_environment *env)
     return cont.invoke(cont.ud, env);
 }
 
+/* The number of steps that every execution has taken.  Each call to
+ * s0_continuation_run adds to this once, when it returns, so that the
+ * trampoline loop itself doesn't touch any shared state. */
+static size_t  s0_total_steps = 0;
+
+size_t
+s0_execution_step_count(void)
+{
+    return __atomic_load_n(&s0_total_steps, __ATOMIC_RELAXED);
+}
+
+/* Returns whether the trampoline loop should stop instead of invoking curr,
+ * and if so, fills in why.  *steps counts the steps that we've taken so far,
+ * including this one. */
+static inline bool
+s0_continuation_should_stop(struct s0_continuation curr, size_t *steps,
+                            size_t max_steps,
+                            enum s0_execution_status *status)
+{
+    if (curr.invoke == s0_execute_finish_continuation) {
+        *status = S0_EXECUTION_FINISHED;
+        return true;
+    } else if (unlikely(curr.invoke == s0_execute_error_continuation)) {
+        *status = S0_EXECUTION_ERROR;
+        return true;
+    } else if (unlikely(curr.invoke == s0_execute_pending_continuation)) {
+        *status = S0_EXECUTION_PENDING;
+        return true;
+    } else if (unlikely((*steps)++ == max_steps)) {
+        *status = S0_EXECUTION_SUSPENDED;
+        return true;
+    }
+    return false;
+}
+
+/* Which kinds of instrumentation are turned on; see the profiling and tracing
+ * sections below. */
+#define S0_INSTRUMENT_PROFILE  0x1
+#define S0_INSTRUMENT_TRACE    0x2
+static unsigned int  s0_instrumentation = 0;
+
+static uint64_t
+s0_instrument_now(void)
+{
+    struct timespec  ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static enum s0_execution_status
+s0_continuation_run_instrumented(struct s0_continuation *cont,
+                                 struct s0_environment *env, size_t max_steps,
+                                 size_t *steps, unsigned int instrumentation);
+
+/* Runs the trampoline loop for at most max_steps steps, where each step is one
+ * invocation.  We update *cont as we go, so that if we run out of steps, *cont
+ * is the next continuation to invoke. */
+static enum s0_execution_status
+s0_continuation_run(struct s0_continuation *cont, struct s0_environment *env,
+                    size_t max_steps)
+{
+    struct s0_continuation  curr = *cont;
+    enum s0_execution_status  status;
+    size_t  steps = 0;
+    /* We only check for instrumentation once per run, so that it costs nothing
+     * per step when it's turned off. */
+    unsigned int  instrumentation =
+        __atomic_load_n(&s0_instrumentation, __ATOMIC_RELAXED);
+    if (unlikely(instrumentation != 0)) {
+        status = s0_continuation_run_instrumented
+            (&curr, env, max_steps, &steps, instrumentation);
+    } else {
+        while (!s0_continuation_should_stop
+               (curr, &steps, max_steps, &status)) {
+            curr = s0_continuation_invoke(curr, env);
+        }
+    }
+    *cont = curr;
+    /* steps also counts the check that ran us out of steps, which we didn't
+     * take. */
+    __atomic_add_fetch
+        (&s0_total_steps,
+         (status == S0_EXECUTION_SUSPENDED)? max_steps: steps,
+         __ATOMIC_RELAXED);
+    __atomic_add_fetch
+        (&s0_total_statements, s0_thread_statements, __ATOMIC_RELAXED);
+    s0_thread_statements = 0;
+    return status;
+}
+
+static __thread struct s0_execution  *current_execution;
+
 static int
 s0_continuation_execute(struct s0_continuation cont, struct s0_environment *env)
 {
-    while (true) {
-        if (cont.invoke == s0_execute_finish_continuation) {
-            return 0;
-        } else if (unlikely(cont.invoke == s0_execute_error_continuation)) {
-            return -1;
-        } else {
-            cont = s0_continuation_invoke(cont, env);
-        }
+    enum s0_execution_status  status;
+    /* A synchronous execution doesn't have a handle, even if a primitive
+     * started it from within some other resumable execution, so primitives
+     * must not see the outer execution while this one runs. */
+    struct s0_execution  *previous = current_execution;
+    current_execution = NULL;
+    status = s0_continuation_run(&cont, env, SIZE_MAX);
+    current_execution = previous;
+    if (unlikely(status == S0_EXECUTION_PENDING)) {
+        /* There's no execution handle that anyone could use to complete the
+         * primitive, so we can't ever continue. */
+        s0_set_error
+            (S0_ERROR_UNKNOWN,
+             "Primitive method suspended a synchronous execution");
+        return -1;
     }
+    return (status == S0_EXECUTION_FINISHED)? 0: -1;
 }
 
 int
@@ -3869,439 +5200,5394 @@ s0_block_execute(struct s0_block *block, struct s0_environment *env)
     return s0_continuation_execute(s0_execute_block_continuation(block), env);
 }
 
+/* An execution is RUNNING while some thread is resuming it (or could resume
+ * it), and PARKED once a primitive has suspended it.  s0_execution_complete
+ * moves it to COMPLETED, which is also how it finds out whether the execution
+ * made it all the way to PARKED before the primitive's operation finished. */
+#define S0_EXECUTION_STATE_RUNNING    0
+#define S0_EXECUTION_STATE_PARKED     1
+#define S0_EXECUTION_STATE_COMPLETED  2
 
-/*-----------------------------------------------------------------------------
- * S₀: Common primitives
- */
-
-struct s0_extractor {
-    struct s0_name  *input_name;
-    struct s0_entity  **dest;
+struct s0_execution {
+    struct s0_continuation  cont;
+    struct s0_environment  *env;
+    int  state;
+    /* Where to continue once a pending primitive completes */
+    struct s0_continuation  completion;
+    s0_execution_wake_f  *wake;
+    void  *wake_ud;
 };
 
-static struct s0_continuation
-s0_extractor_method_execute(void *ud, struct s0_environment *env)
-{
-    struct s0_extractor  *extractor = ud;
-    struct s0_entity  *result;
-    result = s0_environment_delete(env, extractor->input_name);
-    assert(result != NULL);
-    *extractor->dest = result;
-    return s0_finish_continuation_;
-}
+/* The execution that's being resumed on this thread, if any.  (Declared above,
+ * so that synchronous executions can hide it.) */
+static __thread struct s0_execution  *current_execution = NULL;
 
-static void
-s0_extractor_method_free_ud(void *ud)
+struct s0_execution *
+s0_execution_new(struct s0_block *block, struct s0_environment *env)
 {
-    struct s0_extractor  *extractor = ud;
-    s0_name_free(extractor->input_name);
-    free(extractor);
-}
-
-static struct s0_entity *
-s0_extractor_method_new(struct s0_name *input_name,
-                        struct s0_entity_type *result_type,
-                        struct s0_entity **dest)
-{
-    int  rc;
-    struct s0_extractor  *extractor;
-    struct s0_environment_type  *inputs;
-    struct s0_name  *self_name;
-    struct s0_environment_type  *self_elements;
-    struct s0_entity_type  *self_type;
-    struct s0_continuation  cont;
+    struct s0_execution  *execution;
 
-    extractor = malloc(sizeof(struct s0_extractor));
-    if (unlikely(extractor == NULL)) {
-        s0_set_memory_error();
+    if (!s0_environment_type_satisfied_by(block->inputs, env)) {
         return NULL;
     }
 
-    extractor->input_name = s0_name_new_copy(input_name);
-    if (unlikely(extractor->input_name == NULL)) {
-        free(extractor);
+    execution = malloc(sizeof(struct s0_execution));
+    if (unlikely(execution == NULL)) {
+        s0_set_memory_error();
         return NULL;
     }
 
-    extractor->dest = dest;
+    /* Take our own reference to the block, since we might still be executing
+     * it when we return. */
+    execution->cont =
+        s0_execute_and_free_block_continuation(s0_block_ref(block));
+    execution->env = env;
+    execution->state = S0_EXECUTION_STATE_RUNNING;
+    execution->wake = NULL;
+    execution->wake_ud = NULL;
+    return execution;
+}
 
-    inputs = s0_environment_type_new();
-    if (unlikely(inputs == NULL)) {
-        free(extractor);
-        return NULL;
+void
+s0_execution_set_wake(struct s0_execution *execution,
+                      s0_execution_wake_f *wake, void *ud)
+{
+    execution->wake = wake;
+    execution->wake_ud = ud;
+}
+
+enum s0_execution_status
+s0_block_execute_bounded(struct s0_block *block, struct s0_environment *env,
+                         size_t max_steps, struct s0_execution **execution)
+{
+    enum s0_execution_status  status;
+    struct s0_execution  *new_execution;
+
+    *execution = NULL;
+    new_execution = s0_execution_new(block, env);
+    if (unlikely(new_execution == NULL)) {
+        return S0_EXECUTION_ERROR;
     }
 
-    rc = s0_environment_type_add(inputs, input_name, result_type);
-    if (unlikely(rc != 0)) {
-        s0_environment_type_free(inputs);
-        free(extractor);
-        return NULL;
+    status = s0_execution_resume(new_execution, max_steps);
+    if (status == S0_EXECUTION_SUSPENDED || status == S0_EXECUTION_PENDING) {
+        *execution = new_execution;
     }
+    return status;
+}
 
-    self_name = s0_name_new_str("self");
-    if (unlikely(inputs == NULL)) {
-        s0_environment_type_free(inputs);
-        free(extractor);
-        return NULL;
+enum s0_execution_status
+s0_execution_resume(struct s0_execution *execution, size_t max_steps)
+{
+    enum s0_execution_status  status;
+    struct s0_execution  *previous;
+    int  state = __atomic_load_n(&execution->state, __ATOMIC_ACQUIRE);
+
+    if (state == S0_EXECUTION_STATE_PARKED) {
+        return S0_EXECUTION_PENDING;
+    } else if (state == S0_EXECUTION_STATE_COMPLETED) {
+        execution->cont = execution->completion;
+        execution->state = S0_EXECUTION_STATE_RUNNING;
     }
 
-    self_elements = s0_environment_type_new();
-    if (unlikely(self_elements == NULL)) {
-        s0_environment_type_free(inputs);
-        s0_name_free(self_name);
-        free(extractor);
-        return NULL;
+    previous = current_execution;
+    current_execution = execution;
+    for (;;) {
+        int  expected = S0_EXECUTION_STATE_RUNNING;
+        status = s0_continuation_run
+            (&execution->cont, execution->env, max_steps);
+        if (likely(status != S0_EXECUTION_PENDING)) {
+            break;
+        }
+        if (__atomic_compare_exchange_n
+            (&execution->state, &expected, S0_EXECUTION_STATE_PARKED, false,
+             __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        /* The primitive's operation completed before we could park, so we can
+         * keep going right away. */
+        execution->cont = execution->completion;
+        execution->state = S0_EXECUTION_STATE_RUNNING;
     }
+    current_execution = previous;
 
-    self_type = s0_object_entity_type_new(self_elements);
-    if (unlikely(self_type == NULL)) {
-        s0_environment_type_free(inputs);
-        s0_name_free(self_name);
-        free(extractor);
-        return NULL;
+    if (status == S0_EXECUTION_FINISHED || status == S0_EXECUTION_ERROR) {
+        free(execution);
     }
+    return status;
+}
 
-    rc = s0_environment_type_add(inputs, self_name, self_type);
-    if (unlikely(rc != 0)) {
-        s0_environment_type_free(inputs);
-        free(extractor);
-        return NULL;
+struct s0_execution *
+s0_execution_current(void)
+{
+    return current_execution;
+}
+
+int
+s0_execution_complete(struct s0_execution *execution, struct s0_name *name,
+                      struct s0_entity *entity, struct s0_continuation next)
+{
+    int  rc = 0;
+    int  previous;
+    /* Once we've marked the execution as completed, someone else might resume
+     * (and free) it, so grab everything we need first. */
+    s0_execution_wake_f  *wake = execution->wake;
+    void  *wake_ud = execution->wake_ud;
+
+    if (name != NULL) {
+        rc = s0_environment_add(execution->env, name, entity);
+        if (unlikely(rc != 0)) {
+            next = s0_error_continuation_;
+        }
     }
 
-    cont.ud = extractor;
-    cont.invoke = s0_extractor_method_execute;
-    return s0_primitive_method_new(inputs, cont, s0_extractor_method_free_ud);
+    execution->completion = next;
+    previous = __atomic_exchange_n
+        (&execution->state, S0_EXECUTION_STATE_COMPLETED, __ATOMIC_ACQ_REL);
+    assert(previous != S0_EXECUTION_STATE_COMPLETED);
+    if (previous == S0_EXECUTION_STATE_PARKED && wake != NULL) {
+        wake(wake_ud, execution);
+    }
+    return rc;
 }
 
-struct s0_entity *
-s0_extractor_new(struct s0_name *input_name, struct s0_entity_type *result_type,
-                 struct s0_entity **dest)
+void
+s0_execution_cancel(struct s0_execution *execution)
 {
-    int  rc;
-    struct s0_environment  *closed_over;
-    struct s0_entity  *object;
+    assert(execution->state != S0_EXECUTION_STATE_PARKED);
+    if (execution->state == S0_EXECUTION_STATE_COMPLETED) {
+        execution->cont = execution->completion;
+    }
+    /* The only continuations that hold onto resources are the ones for
+     * branches that we're executing on behalf of an invoked closure. */
+    if (execution->cont.invoke == s0_execute_and_free_block) {
+        s0_block_free(execution->cont.ud);
+    }
+    free(execution);
+}
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: Profiling
+ */
+
+/* Each thread records its own profile, so that profiled executions don't
+ * contend with each other.  We keep every thread's profile in a global list,
+ * even after the thread exits, so that we can merge them when someone asks for
+ * the results.  Each profile is a vector of entries, one for each block or
+ * primitive method that the thread has invoked, along with an open-addressed
+ * hash table that maps from a block (or from a primitive's C function) to its
+ * entry.  We refer to entries by index, since a step can invoke a nested
+ * execution that grows the vector. */
+
+#define S0_PROFILE_NO_ENTRY  SIZE_MAX
+#define DEFAULT_INITIAL_PROFILE_SIZE  32
+
+struct s0_profile_entry {
+    uintptr_t  key;
+    /* NULL for primitive methods.  We hold a reference, so that the block (and
+     * its source map) are still around when we report on them. */
+    struct s0_block  *block;
+    /* The name that a primitive method was invoked with, if we know it */
     struct s0_name  *name;
-    struct s0_name  *input_name_copy;
-    struct s0_entity_type  *result_type_copy;
-    struct s0_entity  *method;
-    struct s0_named_blocks  *blocks;
-    struct s0_environment_type  *inputs;
-    struct s0_statement_list  *statements;
-    struct s0_name  *src;
-    struct s0_name  *method_name;
-    struct s0_name_mapping  *params;
-    struct s0_name  *from;
-    struct s0_name  *to;
-    struct s0_invocation  *invocation;
-    struct s0_block  *body;
+    uint64_t  count;
+    uint64_t  nanoseconds;
+};
 
-    object = s0_object_new();
-    if (unlikely(object == NULL)) {
-        return NULL;
+struct s0_profile {
+    struct s0_profile  *next;
+    size_t  size;
+    size_t  allocated_size;
+    struct s0_profile_entry  *entries;
+    /* Always a power of two, and at least twice as large as size */
+    size_t  bucket_count;
+    size_t  *buckets;
+};
+
+static pthread_mutex_t  s0_profiles_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct s0_profile  *s0_profiles = NULL;
+static __thread struct s0_profile  *s0_thread_profile = NULL;
+
+void
+s0_profiler_start(void)
+{
+    __atomic_or_fetch
+        (&s0_instrumentation, S0_INSTRUMENT_PROFILE, __ATOMIC_RELAXED);
+}
+
+void
+s0_profiler_stop(void)
+{
+    __atomic_and_fetch
+        (&s0_instrumentation, ~S0_INSTRUMENT_PROFILE, __ATOMIC_RELAXED);
+}
+
+static void
+s0_profile_clear_buckets(size_t *buckets, size_t count)
+{
+    size_t  i;
+    for (i = 0; i < count; i++) {
+        buckets[i] = S0_PROFILE_NO_ENTRY;
     }
+}
 
-    input_name_copy = s0_name_new_copy(input_name);
-    if (unlikely(input_name_copy == NULL)) {
-        s0_entity_free(object);
-        return NULL;
+/* Returns the current thread's profile, or NULL if we can't allocate it. */
+static struct s0_profile *
+s0_profile_get(void)
+{
+    struct s0_profile  *profile = s0_thread_profile;
+    if (likely(profile != NULL)) {
+        return profile;
     }
 
-    result_type_copy = s0_entity_type_new_copy(result_type);
-    if (unlikely(result_type_copy == NULL)) {
-        s0_entity_free(object);
-        s0_name_free(input_name_copy);
+    profile = malloc(sizeof(struct s0_profile));
+    if (unlikely(profile == NULL)) {
         return NULL;
     }
-
-    method = s0_extractor_method_new(input_name_copy, result_type_copy, dest);
-    if (unlikely(method == NULL)) {
-        s0_entity_free(object);
+    profile->size = 0;
+    profile->allocated_size = DEFAULT_INITIAL_PROFILE_SIZE;
+    profile->entries = malloc(DEFAULT_INITIAL_PROFILE_SIZE
+                              * sizeof(struct s0_profile_entry));
+    profile->bucket_count = DEFAULT_INITIAL_PROFILE_SIZE * 2;
+    profile->buckets = malloc(profile->bucket_count * sizeof(size_t));
+    if (unlikely(profile->entries == NULL || profile->buckets == NULL)) {
+        free(profile->entries);
+        free(profile->buckets);
+        free(profile);
         return NULL;
     }
+    s0_profile_clear_buckets(profile->buckets, profile->bucket_count);
 
-    name = s0_name_new_str("extractor");
-    if (unlikely(name == NULL)) {
-        s0_entity_free(object);
-        s0_entity_free(method);
-        return NULL;
+    pthread_mutex_lock(&s0_profiles_lock);
+    profile->next = s0_profiles;
+    s0_profiles = profile;
+    pthread_mutex_unlock(&s0_profiles_lock);
+    s0_thread_profile = profile;
+    return profile;
+}
+
+static size_t
+s0_profile_bucket(uintptr_t key, size_t bucket_count)
+{
+    /* Blocks and functions are aligned, so the low bits aren't useful. */
+    return ((uint64_t) (key >> 4) * UINT64_C(0x9e3779b97f4a7c15))
+        & (bucket_count - 1);
+}
+
+/* Returns the slot where key lives, or where we should add it. */
+static size_t *
+s0_profile_find(size_t *buckets, size_t bucket_count,
+                const struct s0_profile_entry *entries, uintptr_t key)
+{
+    size_t  i = s0_profile_bucket(key, bucket_count);
+    while (buckets[i] != S0_PROFILE_NO_ENTRY
+           && entries[buckets[i]].key != key) {
+        i = (i + 1) & (bucket_count - 1);
     }
+    return &buckets[i];
+}
 
-    rc = s0_object_add(object, name, method);
-    if (unlikely(rc != 0)) {
-        s0_entity_free(object);
-        return NULL;
+static int
+s0_profile_grow(struct s0_profile *profile)
+{
+    size_t  new_size;
+    struct s0_profile_entry  *new_entries;
+    size_t  new_bucket_count;
+    size_t  *new_buckets;
+    size_t  i;
+
+    new_size = profile->allocated_size * 2;
+    new_entries = realloc(profile->entries,
+                          new_size * sizeof(struct s0_profile_entry));
+    if (unlikely(new_entries == NULL)) {
+        return -1;
     }
+    profile->entries = new_entries;
+    profile->allocated_size = new_size;
 
-    closed_over = s0_environment_new();
-    if (unlikely(closed_over == NULL)) {
-        s0_entity_free(object);
-        return NULL;
+    new_bucket_count = new_size * 2;
+    new_buckets = malloc(new_bucket_count * sizeof(size_t));
+    if (unlikely(new_buckets == NULL)) {
+        return -1;
     }
+    s0_profile_clear_buckets(new_buckets, new_bucket_count);
+    for (i = 0; i < profile->size; i++) {
+        *s0_profile_find(new_buckets, new_bucket_count, profile->entries,
+                         profile->entries[i].key) = i;
+    }
+    free(profile->buckets);
+    profile->buckets = new_buckets;
+    profile->bucket_count = new_bucket_count;
+    return 0;
+}
 
-    name = s0_name_new_str("object");
-    if (unlikely(name == NULL)) {
-        s0_entity_free(object);
-        s0_environment_free(closed_over);
-        return NULL;
+/* Returns the block that cont will execute, or NULL if it's a primitive. */
+static struct s0_block *
+s0_continuation_block(struct s0_continuation cont)
+{
+    if (cont.invoke == s0_execute_block
+            || cont.invoke == s0_execute_and_free_block) {
+        return cont.ud;
     }
+    return NULL;
+}
 
-    rc = s0_environment_add(closed_over, name, object);
-    if (unlikely(rc != 0)) {
-        s0_environment_free(closed_over);
-        return NULL;
+/* Returns the index of the entry for the block or primitive that cont will
+ * invoke, adding it if needed.  `caller` is the block whose invocation
+ * produced cont, if there is one; we use it to name primitive methods.
+ * Returns S0_PROFILE_NO_ENTRY if we can't allocate a new entry; profiling is
+ * best-effort, so we just won't count that step. */
+static size_t
+s0_profile_entry_for(struct s0_profile *profile, struct s0_continuation cont,
+                     const struct s0_block *caller)
+{
+    struct s0_block  *block = s0_continuation_block(cont);
+    uintptr_t  key = (block != NULL)? (uintptr_t) block:
+        (uintptr_t) cont.invoke;
+    struct s0_profile_entry  *entry;
+    size_t  *bucket;
+
+    bucket = s0_profile_find(profile->buckets, profile->bucket_count,
+                             profile->entries, key);
+    if (likely(*bucket != S0_PROFILE_NO_ENTRY)) {
+        return *bucket;
     }
 
-    statements = s0_statement_list_new();
-    if (unlikely(statements == NULL)) {
-        s0_environment_free(closed_over);
-        return NULL;
+    if (unlikely(profile->size == profile->allocated_size)) {
+        if (unlikely(s0_profile_grow(profile) != 0)) {
+            return S0_PROFILE_NO_ENTRY;
+        }
+        bucket = s0_profile_find(profile->buckets, profile->bucket_count,
+                                 profile->entries, key);
+    }
+
+    entry = &profile->entries[profile->size];
+    entry->key = key;
+    entry->block = (block == NULL)? NULL: s0_block_ref(block);
+    entry->name = NULL;
+    if (block == NULL && caller != NULL) {
+        const struct s0_invocation  *invocation =
+            s0_block_code_invocation(caller);
+        if (invocation->kind == S0_INVOCATION_KIND_INVOKE_METHOD) {
+            entry->name = s0_name_new_copy(invocation->_.invoke_method.method);
+        }
+    }
+    entry->count = 0;
+    entry->nanoseconds = 0;
+    *bucket = profile->size;
+    return profile->size++;
+}
+
+static void
+s0_profile_entry_done(struct s0_profile_entry *entry)
+{
+    if (entry->block != NULL) {
+        s0_block_free(entry->block);
     }
+    if (entry->name != NULL) {
+        s0_name_free(entry->name);
+    }
+}
 
-    src = s0_name_new_str("object");
-    if (unlikely(src == NULL)) {
-        s0_environment_free(closed_over);
-        s0_statement_list_free(statements);
-        return NULL;
+void
+s0_profiler_reset(void)
+{
+    struct s0_profile  *profile;
+    pthread_mutex_lock(&s0_profiles_lock);
+    for (profile = s0_profiles; profile != NULL; profile = profile->next) {
+        size_t  i;
+        for (i = 0; i < profile->size; i++) {
+            s0_profile_entry_done(&profile->entries[i]);
+        }
+        profile->size = 0;
+        s0_profile_clear_buckets(profile->buckets, profile->bucket_count);
     }
+    pthread_mutex_unlock(&s0_profiles_lock);
+}
 
-    method_name = s0_name_new_str("extractor");
-    if (unlikely(method == NULL)) {
-        s0_environment_free(closed_over);
-        s0_statement_list_free(statements);
-        s0_name_free(src);
+/* A block or primitive method's results, merged across every thread.  We
+ * borrow the block and name from one of the threads' entries. */
+struct s0_profile_row {
+    uintptr_t  key;
+    const struct s0_block  *block;
+    const struct s0_name  *name;
+    uint64_t  count;
+    uint64_t  nanoseconds;
+};
+
+static int
+s0_profile_row_cmp_key(const void *vr1, const void *vr2)
+{
+    const struct s0_profile_row  *r1 = vr1;
+    const struct s0_profile_row  *r2 = vr2;
+    return (r1->key < r2->key)? -1: (r1->key > r2->key)? 1: 0;
+}
+
+static int
+s0_profile_row_cmp_time(const void *vr1, const void *vr2)
+{
+    const struct s0_profile_row  *r1 = vr1;
+    const struct s0_profile_row  *r2 = vr2;
+    return (r1->nanoseconds > r2->nanoseconds)? -1:
+        (r1->nanoseconds < r2->nanoseconds)? 1: 0;
+}
+
+/* Merges every thread's profile into a single array of rows, which you must
+ * free.  You must hold s0_profiles_lock while you use the rows.  Returns NULL
+ * (and sets *count to 0) if the profile is empty or we can't allocate the
+ * array. */
+static struct s0_profile_row *
+s0_profile_merge(size_t *count)
+{
+    struct s0_profile  *profile;
+    struct s0_profile_row  *rows;
+    size_t  total = 0;
+    size_t  i;
+    size_t  j;
+
+    *count = 0;
+    for (profile = s0_profiles; profile != NULL; profile = profile->next) {
+        total += profile->size;
+    }
+    if (total == 0) {
         return NULL;
     }
 
-    params = s0_name_mapping_new();
-    if (unlikely(method == NULL)) {
-        s0_environment_free(closed_over);
-        s0_statement_list_free(statements);
-        s0_name_free(src);
-        s0_name_free(method_name);
+    rows = malloc(total * sizeof(struct s0_profile_row));
+    if (unlikely(rows == NULL)) {
+        s0_set_memory_error();
         return NULL;
     }
 
-    from = s0_name_new_copy(input_name);
-    if (unlikely(from == NULL)) {
-        s0_environment_free(closed_over);
-        s0_statement_list_free(statements);
-        s0_name_free(src);
-        s0_name_free(method_name);
-        s0_name_mapping_free(params);
-        return NULL;
+    i = 0;
+    for (profile = s0_profiles; profile != NULL; profile = profile->next) {
+        for (j = 0; j < profile->size; j++) {
+            const struct s0_profile_entry  *entry = &profile->entries[j];
+            rows[i].key = entry->key;
+            rows[i].block = entry->block;
+            rows[i].name = entry->name;
+            rows[i].count = entry->count;
+            rows[i].nanoseconds = entry->nanoseconds;
+            i++;
+        }
     }
 
-    to = s0_name_new_copy(input_name);
-    if (unlikely(to == NULL)) {
-        s0_environment_free(closed_over);
-        s0_statement_list_free(statements);
-        s0_name_free(src);
-        s0_name_free(method_name);
-        s0_name_mapping_free(params);
-        s0_name_free(from);
-        return NULL;
+    /* Combine the rows for the same block or primitive. */
+    qsort(rows, total, sizeof(struct s0_profile_row), s0_profile_row_cmp_key);
+    j = 0;
+    for (i = 1; i < total; i++) {
+        if (rows[i].key == rows[j].key) {
+            rows[j].count += rows[i].count;
+            rows[j].nanoseconds += rows[i].nanoseconds;
+            if (rows[j].name == NULL) {
+                rows[j].name = rows[i].name;
+            }
+        } else {
+            rows[++j] = rows[i];
+        }
+    }
+    *count = j + 1;
+    return rows;
+}
+
+/* Folded stack frames are separated by semicolons, and each stack is on its
+ * own line, so we can't let either of those appear in a frame. */
+static void
+s0_profile_write_frame_text(FILE *out, const char *text)
+{
+    for (; *text != '\0'; text++) {
+        fputc((*text == ';' || *text == '\n')? '_': *text, out);
+    }
+}
+
+static void
+s0_profile_write_source_frames(FILE *out, const struct s0_source_map *map,
+                               size_t index)
+{
+    const struct s0_source_block  *block = &map->blocks[index];
+    if (block->parent == S0_SOURCE_NO_PARENT) {
+        s0_profile_write_frame_text
+            (out, (map->filename == NULL)? "[string]": map->filename);
+    } else {
+        s0_profile_write_source_frames(out, map, block->parent);
+    }
+    fputc(';', out);
+    if (block->name != NULL) {
+        s0_profile_write_frame_text(out, s0_name_human_readable(block->name));
+        fputc(' ', out);
+    }
+    fprintf(out, "%zu:%zu", block->line, block->column);
+}
+
+int
+s0_profiler_write_folded(FILE *out)
+{
+    struct s0_profile_row  *rows;
+    size_t  count;
+    size_t  i;
+
+    pthread_mutex_lock(&s0_profiles_lock);
+    rows = s0_profile_merge(&count);
+    for (i = 0; i < count; i++) {
+        const struct s0_profile_row  *row = &rows[i];
+        if (row->block == NULL) {
+            fprintf(out, "[primitives];");
+            s0_profile_write_frame_text
+                (out, (row->name == NULL)? "[unknown]":
+                 s0_name_human_readable(row->name));
+        } else if (row->block->source == NULL) {
+            fprintf(out, "[unknown block]");
+        } else {
+            s0_profile_write_source_frames
+                (out, row->block->source, row->block->source_index);
+        }
+        fprintf(out, " %" PRIu64 "\n", row->nanoseconds);
+    }
+    pthread_mutex_unlock(&s0_profiles_lock);
+    free(rows);
+    if (unlikely(ferror(out))) {
+        s0_set_error(S0_ERROR_UNKNOWN, "Cannot write profile");
+        return -1;
+    }
+    return 0;
+}
+
+int
+s0_profiler_write_table(FILE *out)
+{
+    struct s0_profile_row  *rows;
+    size_t  count;
+    size_t  i;
+    uint64_t  total = 0;
+
+    pthread_mutex_lock(&s0_profiles_lock);
+    rows = s0_profile_merge(&count);
+    qsort(rows, count, sizeof(struct s0_profile_row),
+          s0_profile_row_cmp_time);
+    for (i = 0; i < count; i++) {
+        total += rows[i].nanoseconds;
+    }
+
+    /* µ takes up two bytes but only one column. */
+    fprintf(out, "%13s  %7s  %12s  %10s  %s\n",
+            "self µs", "self %", "calls", "ns/call", "block");
+    for (i = 0; i < count; i++) {
+        const struct s0_profile_row  *row = &rows[i];
+        struct s0_source_location  location;
+        fprintf(out, "%12.3f  %6.2f%%  %12" PRIu64 "  %10.1f  ",
+                row->nanoseconds / 1e3,
+                (total == 0)? 0.0: 100.0 * row->nanoseconds / total,
+                row->count,
+                (row->count == 0)? 0.0:
+                (double) row->nanoseconds / row->count);
+        if (row->block == NULL) {
+            fprintf(out, "primitive `%s`",
+                    (row->name == NULL)? "[unknown]":
+                    s0_name_human_readable(row->name));
+        } else if (s0_block_source_location(row->block, &location)) {
+            const struct s0_name  *name = s0_block_source_name(row->block);
+            fprintf(out, "%s:%zu:%zu",
+                    (location.filename == NULL)? "[string]":
+                    location.filename,
+                    location.line, location.column);
+            if (name != NULL) {
+                fprintf(out, " `%s`", s0_name_human_readable(name));
+            }
+        } else {
+            fprintf(out, "[unknown block]");
+        }
+        fputc('\n', out);
+    }
+    pthread_mutex_unlock(&s0_profiles_lock);
+    free(rows);
+    if (unlikely(ferror(out))) {
+        s0_set_error(S0_ERROR_UNKNOWN, "Cannot write profile");
+        return -1;
+    }
+    return 0;
+}
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: Tracing
+ */
+
+/* Each thread records events into its own fixed-size ring buffer, so that
+ * recording an event never allocates, never takes a lock, and never contends
+ * with another thread.  Only the owning thread writes to a buffer; it publishes
+ * each event by advancing the buffer's head.  Once a buffer is full, each new
+ * event overwrites the oldest one, so a trace always holds each thread's most
+ * recent events.  We keep every thread's buffer in a global list.  When a
+ * thread exits, we retire its buffer rather than freeing it, so that its
+ * events still show up in the trace; s0_tracer_reset frees retired buffers.
+ *
+ * Events refer to their block's source map by pointer, so each buffer holds a
+ * reference to every source map that its events refer to.  That keeps the
+ * source map alive (so that we can describe the event) even if the block that
+ * the event came from is freed. */
+
+/* Must be a power of two */
+#define S0_TRACE_BUFFER_SIZE  65536
+#define DEFAULT_INITIAL_TRACE_SOURCES_SIZE  4
+
+enum s0_trace_event_kind {
+    S0_TRACE_EVENT_BLOCK,
+    S0_TRACE_EVENT_STATEMENT,
+    S0_TRACE_EVENT_INVOCATION,
+    S0_TRACE_EVENT_PRIMITIVE
+};
+
+struct s0_trace_event {
+    uint64_t  start;
+    /* Saturates at about 4 seconds */
+    uint32_t  duration;
+    /* An s0_trace_event_kind */
+    uint8_t  kind;
+    /* The s0_statement_kind or s0_invocation_kind, if there is one */
+    uint8_t  detail;
+    /* The statement's index within its block (saturating) */
+    uint16_t  position;
+    /* The block that the event belongs to; for a primitive method, the block
+     * that invoked it.  NULL if we don't know where it came from. */
+    const struct s0_source_map  *source;
+    size_t  source_index;
+};
+
+struct s0_trace_buffer {
+    struct s0_trace_buffer  *next;
+    size_t  thread_id;
+    /* Set once the owning thread has exited */
+    bool  retired;
+    /* The number of events that we've ever recorded into this buffer */
+    size_t  head;
+    size_t  source_count;
+    size_t  allocated_source_count;
+    struct s0_source_map  **sources;
+    struct s0_trace_event  events[S0_TRACE_BUFFER_SIZE];
+};
+
+static pthread_mutex_t  s0_trace_buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct s0_trace_buffer  *s0_trace_buffers = NULL;
+static size_t  s0_trace_buffer_count = 0;
+static __thread struct s0_trace_buffer  *s0_thread_trace_buffer = NULL;
+/* Lets us find out when a thread that owns a buffer exits */
+static pthread_once_t  s0_trace_buffer_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t  s0_trace_buffer_key;
+static bool  s0_trace_buffer_key_created = false;
+
+void
+s0_tracer_start(void)
+{
+    __atomic_or_fetch
+        (&s0_instrumentation, S0_INSTRUMENT_TRACE, __ATOMIC_RELAXED);
+}
+
+void
+s0_tracer_stop(void)
+{
+    __atomic_and_fetch
+        (&s0_instrumentation, ~S0_INSTRUMENT_TRACE, __ATOMIC_RELAXED);
+}
+
+/* Called when a thread that owns a buffer exits. */
+static void
+s0_trace_buffer_retire(void *ud)
+{
+    struct s0_trace_buffer  *buffer = ud;
+    pthread_mutex_lock(&s0_trace_buffers_lock);
+    buffer->retired = true;
+    pthread_mutex_unlock(&s0_trace_buffers_lock);
+}
+
+static void
+s0_trace_buffer_key_create(void)
+{
+    s0_trace_buffer_key_created =
+        pthread_key_create(&s0_trace_buffer_key, s0_trace_buffer_retire) == 0;
+}
+
+static void
+s0_trace_buffer_free(struct s0_trace_buffer *buffer)
+{
+    size_t  i;
+    for (i = 0; i < buffer->source_count; i++) {
+        s0_source_map_free(buffer->sources[i]);
+    }
+    free(buffer->sources);
+    free(buffer);
+}
+
+/* Returns the current thread's buffer, or NULL if we can't allocate it. */
+static struct s0_trace_buffer *
+s0_trace_buffer_get(void)
+{
+    struct s0_trace_buffer  *buffer = s0_thread_trace_buffer;
+    if (likely(buffer != NULL)) {
+        return buffer;
+    }
+
+    buffer = malloc(sizeof(struct s0_trace_buffer));
+    if (unlikely(buffer == NULL)) {
+        return NULL;
+    }
+    buffer->retired = false;
+    buffer->head = 0;
+    buffer->source_count = 0;
+    buffer->allocated_source_count = 0;
+    buffer->sources = NULL;
+
+    pthread_mutex_lock(&s0_trace_buffers_lock);
+    buffer->thread_id = ++s0_trace_buffer_count;
+    buffer->next = s0_trace_buffers;
+    s0_trace_buffers = buffer;
+    pthread_mutex_unlock(&s0_trace_buffers_lock);
+    s0_thread_trace_buffer = buffer;
+
+    /* If we can't get a key, the buffer just lives forever. */
+    pthread_once(&s0_trace_buffer_key_once, s0_trace_buffer_key_create);
+    if (likely(s0_trace_buffer_key_created)) {
+        pthread_setspecific(s0_trace_buffer_key, buffer);
+    }
+    return buffer;
+}
+
+/* Returns the source map to record for an event in block, taking a reference
+ * to it if this buffer hasn't seen it before.  A block's events are usually
+ * followed by events from the same module, so we check the most recent source
+ * map first.  Returns NULL if the block doesn't have a source map, or if we
+ * can't allocate room to remember it; tracing is best-effort, so the event
+ * will just be missing its location. */
+static const struct s0_source_map *
+s0_trace_source(struct s0_trace_buffer *buffer, const struct s0_block *block)
+{
+    struct s0_source_map  *map = block->source;
+    size_t  i;
+
+    if (map == NULL) {
+        return NULL;
+    }
+    if (likely(buffer->source_count > 0
+               && buffer->sources[buffer->source_count - 1] == map)) {
+        return map;
+    }
+    for (i = 0; i < buffer->source_count; i++) {
+        if (buffer->sources[i] == map) {
+            return map;
+        }
+    }
+
+    if (buffer->source_count == buffer->allocated_source_count) {
+        size_t  new_size = (buffer->allocated_source_count == 0)?
+            DEFAULT_INITIAL_TRACE_SOURCES_SIZE:
+            buffer->allocated_source_count * 2;
+        struct s0_source_map  **new_sources =
+            realloc(buffer->sources, new_size * sizeof(struct s0_source_map *));
+        if (unlikely(new_sources == NULL)) {
+            return NULL;
+        }
+        buffer->sources = new_sources;
+        buffer->allocated_source_count = new_size;
+    }
+    buffer->sources[buffer->source_count++] = s0_source_map_ref(map);
+    return map;
+}
+
+static inline void
+s0_trace_record(struct s0_trace_buffer *buffer, enum s0_trace_event_kind kind,
+                unsigned int detail, size_t position,
+                const struct s0_source_map *source, size_t source_index,
+                uint64_t start, uint64_t end)
+{
+    size_t  head = buffer->head;
+    struct s0_trace_event  *event =
+        &buffer->events[head & (S0_TRACE_BUFFER_SIZE - 1)];
+    uint64_t  duration = end - start;
+    event->start = start;
+    event->duration = (duration > UINT32_MAX)? UINT32_MAX: duration;
+    event->kind = kind;
+    event->detail = detail;
+    event->position = (position > UINT16_MAX)? UINT16_MAX: position;
+    event->source = source;
+    event->source_index = source_index;
+    __atomic_store_n(&buffer->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* Does the same thing as s0_execute_block, recording an event for each
+ * statement, for the invocation, and for the block as a whole. */
+static struct s0_continuation
+s0_trace_execute_block(struct s0_trace_buffer *buffer, struct s0_block *block,
+                       struct s0_environment *env,
+                       const struct s0_source_map *source)
+{
+    struct s0_continuation  cont = s0_error_continuation_;
+    uint64_t  block_start = s0_instrument_now();
+    uint64_t  start = block_start;
+    uint64_t  end = block_start;
+    size_t  i;
+
+    for (i = 0; i < block->statement_count; i++) {
+        int  rc = s0_statement_execute(&block->code[i], env);
+        end = s0_instrument_now();
+        s0_trace_record(buffer, S0_TRACE_EVENT_STATEMENT,
+                        block->code[i].kind, i, source, block->source_index,
+                        start, end);
+        start = end;
+        if (unlikely(rc != 0)) {
+            s0_block_prefix_error_location(block, i);
+            break;
+        }
+    }
+    s0_thread_statements += i;
+
+    if (likely(i == block->statement_count)) {
+        cont = s0_block_invocation_execute(block, env);
+        end = s0_instrument_now();
+        s0_trace_record(buffer, S0_TRACE_EVENT_INVOCATION,
+                        s0_block_code_invocation(block)->kind, i,
+                        source, block->source_index, start, end);
+    }
+
+    s0_trace_record(buffer, S0_TRACE_EVENT_BLOCK, 0, 0,
+                    source, block->source_index, block_start, end);
+    return cont;
+}
+
+void
+s0_tracer_reset(void)
+{
+    struct s0_trace_buffer  **curr;
+    pthread_mutex_lock(&s0_trace_buffers_lock);
+    curr = &s0_trace_buffers;
+    while (*curr != NULL) {
+        struct s0_trace_buffer  *buffer = *curr;
+        size_t  i;
+        if (buffer->retired) {
+            *curr = buffer->next;
+            s0_trace_buffer_free(buffer);
+            continue;
+        }
+        for (i = 0; i < buffer->source_count; i++) {
+            s0_source_map_free(buffer->sources[i]);
+        }
+        buffer->source_count = 0;
+        __atomic_store_n(&buffer->head, 0, __ATOMIC_RELEASE);
+        curr = &buffer->next;
+    }
+    pthread_mutex_unlock(&s0_trace_buffers_lock);
+}
+
+static const char *
+s0_statement_kind_name(unsigned int kind)
+{
+    switch (kind) {
+        case S0_STATEMENT_KIND_CREATE_ATOM:
+            return "create-atom";
+        case S0_STATEMENT_KIND_CREATE_CLOSURE:
+            return "create-closure";
+        case S0_STATEMENT_KIND_CREATE_LITERAL:
+            return "create-literal";
+        case S0_STATEMENT_KIND_CREATE_METHOD:
+            return "create-method";
+        default:
+            return "statement";
+    }
+}
+
+static const char *
+s0_invocation_kind_name(unsigned int kind)
+{
+    switch (kind) {
+        case S0_INVOCATION_KIND_INVOKE_CLOSURE:
+            return "invoke-closure";
+        case S0_INVOCATION_KIND_INVOKE_METHOD:
+            return "invoke-method";
+        default:
+            return "invocation";
+    }
+}
+
+/* Writes str into a JSON string, escaping anything that needs it. */
+static void
+s0_trace_write_json_text(FILE *out, const char *str)
+{
+    for (; *str != '\0'; str++) {
+        unsigned char  ch = *str;
+        if (ch == '"' || ch == '\\') {
+            fputc('\\', out);
+            fputc(ch, out);
+        } else if (ch < 0x20) {
+            fprintf(out, "\\u%04x", ch);
+        } else {
+            fputc(ch, out);
+        }
+    }
+}
+
+/* Writes `, "key": "file:line:column"` if we know where event came from. */
+static void
+s0_trace_write_location(FILE *out, const char *key,
+                        const struct s0_trace_event *event)
+{
+    const struct s0_source_block  *block;
+    if (event->source == NULL) {
+        return;
+    }
+    block = &event->source->blocks[event->source_index];
+    fprintf(out, ", \"%s\": \"", key);
+    s0_trace_write_json_text
+        (out, (event->source->filename == NULL)? "[string]":
+         event->source->filename);
+    fprintf(out, ":%zu:%zu\"", block->line, block->column);
+}
+
+/* Writes `, "location": "file:line:column"` if we know where the statement or
+ * invocation that event describes was defined. */
+static void
+s0_trace_write_position(FILE *out, const struct s0_trace_event *event)
+{
+    const struct s0_source_position  *position;
+    /* The position saturates, so the largest one is ambiguous. */
+    if (event->source == NULL || event->position == UINT16_MAX) {
+        return;
+    }
+    position = s0_source_map_position
+        (event->source, event->source_index, event->position);
+    if (position == NULL) {
+        return;
+    }
+    fprintf(out, ", \"location\": \"");
+    s0_trace_write_json_text
+        (out, (event->source->filename == NULL)? "[string]":
+         event->source->filename);
+    fprintf(out, ":%" PRIu32 ":%" PRIu32 "\"", position->line,
+            position->column);
+}
+
+static void
+s0_trace_write_event(FILE *out, const struct s0_trace_event *event,
+                     size_t thread_id, uint64_t epoch)
+{
+    const char  *category;
+    fprintf(out, "{\"name\": \"");
+    switch (event->kind) {
+        case S0_TRACE_EVENT_BLOCK:
+            category = "block";
+            if (event->source != NULL
+                    && event->source->blocks[event->source_index].name
+                       != NULL) {
+                s0_trace_write_json_text
+                    (out, s0_name_human_readable
+                     (event->source->blocks[event->source_index].name));
+            } else {
+                fprintf(out, "block");
+            }
+            break;
+        case S0_TRACE_EVENT_STATEMENT:
+            category = "statement";
+            fprintf(out, "%s", s0_statement_kind_name(event->detail));
+            break;
+        case S0_TRACE_EVENT_INVOCATION:
+            category = "invocation";
+            fprintf(out, "%s", s0_invocation_kind_name(event->detail));
+            break;
+        default:
+            category = "primitive";
+            fprintf(out, "primitive");
+            break;
+    }
+    fprintf(out, "\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, "
+            "\"tid\": %zu, \"ts\": %.3f, \"dur\": %.3f, \"args\": {",
+            category, thread_id, (event->start - epoch) / 1e3,
+            event->duration / 1e3);
+    switch (event->kind) {
+        case S0_TRACE_EVENT_BLOCK:
+            fprintf(out, "\"kind\": \"block\"");
+            s0_trace_write_location(out, "location", event);
+            break;
+        case S0_TRACE_EVENT_STATEMENT:
+        case S0_TRACE_EVENT_INVOCATION:
+            fprintf(out, "\"index\": %u", (unsigned int) event->position);
+            s0_trace_write_position(out, event);
+            s0_trace_write_location(out, "block", event);
+            break;
+        default:
+            fprintf(out, "\"kind\": \"primitive\"");
+            s0_trace_write_location(out, "caller", event);
+            break;
+    }
+    fprintf(out, "}}");
+}
+
+/* Returns the index of the oldest event that buffer still holds. */
+static size_t
+s0_trace_buffer_first(size_t head)
+{
+    return (head > S0_TRACE_BUFFER_SIZE)? head - S0_TRACE_BUFFER_SIZE: 0;
+}
+
+int
+s0_tracer_write_chrome_json(FILE *out)
+{
+    struct s0_trace_buffer  *buffer;
+    uint64_t  epoch = UINT64_MAX;
+    size_t  dropped = 0;
+    bool  first = true;
+
+    pthread_mutex_lock(&s0_trace_buffers_lock);
+    /* Timestamps are relative to the oldest event that we still have. */
+    for (buffer = s0_trace_buffers; buffer != NULL; buffer = buffer->next) {
+        size_t  head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+        size_t  i;
+        for (i = s0_trace_buffer_first(head); i < head; i++) {
+            const struct s0_trace_event  *event =
+                &buffer->events[i & (S0_TRACE_BUFFER_SIZE - 1)];
+            if (event->start < epoch) {
+                epoch = event->start;
+            }
+        }
+    }
+
+    fprintf(out, "{\"traceEvents\": [");
+    for (buffer = s0_trace_buffers; buffer != NULL; buffer = buffer->next) {
+        size_t  head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+        size_t  i;
+        dropped += s0_trace_buffer_first(head);
+        for (i = s0_trace_buffer_first(head); i < head; i++) {
+            fprintf(out, first? "\n": ",\n");
+            first = false;
+            s0_trace_write_event
+                (out, &buffer->events[i & (S0_TRACE_BUFFER_SIZE - 1)],
+                 buffer->thread_id, epoch);
+        }
+    }
+    fprintf(out, "\n], \"displayTimeUnit\": \"ns\", "
+            "\"otherData\": {\"dropped_events\": \"%zu\"}}\n", dropped);
+    pthread_mutex_unlock(&s0_trace_buffers_lock);
+
+    if (unlikely(ferror(out))) {
+        s0_set_error(S0_ERROR_UNKNOWN, "Cannot write trace");
+        return -1;
+    }
+    return 0;
+}
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: Instrumented execution
+ */
+
+/* The trampoline that s0_continuation_run uses when the profiler or the tracer
+ * is running.  Steps that execute a block are traced statement by statement;
+ * any other step is a primitive method, which we trace as a single event,
+ * attributed to the block that invoked it. */
+static enum s0_execution_status
+s0_continuation_run_instrumented(struct s0_continuation *cont,
+                                 struct s0_environment *env, size_t max_steps,
+                                 size_t *steps, unsigned int instrumentation)
+{
+    struct s0_profile  *profile = NULL;
+    struct s0_trace_buffer  *trace = NULL;
+    struct s0_continuation  curr = *cont;
+    enum s0_execution_status  status;
+    /* The block that we invoked in the previous step, if any.  Its profile
+     * entry keeps it alive. */
+    const struct s0_block  *caller = NULL;
+    /* Where the block that we invoked in the previous step came from, if we're
+     * tracing */
+    const struct s0_source_map  *caller_source = NULL;
+    size_t  caller_source_index = 0;
+
+    if (instrumentation & S0_INSTRUMENT_PROFILE) {
+        profile = s0_profile_get();
+    }
+    if (instrumentation & S0_INSTRUMENT_TRACE) {
+        trace = s0_trace_buffer_get();
+    }
+
+    while (!s0_continuation_should_stop(curr, steps, max_steps, &status)) {
+        struct s0_block  *block = s0_continuation_block(curr);
+        struct s0_continuation  next;
+        size_t  index = S0_PROFILE_NO_ENTRY;
+        uint64_t  start;
+        uint64_t  end;
+
+        if (profile != NULL) {
+            index = s0_profile_entry_for(profile, curr, caller);
+        }
+        start = s0_instrument_now();
+        if (trace != NULL && block != NULL) {
+            const struct s0_source_map  *source = s0_trace_source(trace, block);
+            size_t  source_index = block->source_index;
+            next = s0_trace_execute_block(trace, block, env, source);
+            if (curr.invoke == s0_execute_and_free_block) {
+                s0_block_free(block);
+            }
+            caller_source = source;
+            caller_source_index = source_index;
+        } else {
+            next = s0_continuation_invoke(curr, env);
+        }
+        end = s0_instrument_now();
+        if (trace != NULL && block == NULL) {
+            s0_trace_record(trace, S0_TRACE_EVENT_PRIMITIVE, 0, 0,
+                            caller_source, caller_source_index, start, end);
+            caller_source = NULL;
+        }
+
+        if (index != S0_PROFILE_NO_ENTRY) {
+            struct s0_profile_entry  *entry = &profile->entries[index];
+            entry->count++;
+            entry->nanoseconds += end - start;
+            caller = entry->block;
+        } else {
+            caller = NULL;
+        }
+        curr = next;
+    }
+
+    *cont = curr;
+    return status;
+}
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: Scheduler
+ */
+
+struct s0_task {
+    struct s0_scheduler  *scheduler;
+    struct s0_block  *block;
+    struct s0_environment  *env;
+    /* NULL until the task has run for its first time slice */
+    struct s0_execution  *execution;
+    s0_scheduler_done_f  *done;
+    void  *ud;
+    /* Links together the tasks in a worker's inbox */
+    struct s0_task  *next;
+};
+
+#define DEFAULT_INITIAL_TASK_DEQUE_SIZE  16
+
+/* The ring buffer behind a task deque.  When a deque outgrows its array, the
+ * old one might still be in use by a thief, so we keep it around (linked
+ * through `retired`) until the deque itself is freed. */
+struct s0_task_array {
+    size_t  size;
+    struct s0_task_array  *retired;
+    struct s0_task  *tasks[];
+};
+
+/* A Chase-Lev work-stealing deque.  Only the owning worker pushes, at the
+ * bottom; everyone (the owner included) takes from the top, so the owner runs
+ * its tasks in the order they arrived, and a task that has used up a time
+ * slice goes to the back of the line.  Tasks submitted from other threads
+ * land in `inbox`, a lock-free stack, until a worker moves them over in
+ * arrival order. */
+struct s0_task_deque {
+    size_t  top;
+    size_t  bottom;
+    struct s0_task_array  *array;
+    struct s0_task  *inbox;
+};
+
+struct s0_scheduler_worker {
+    pthread_t  thread;
+    struct s0_scheduler  *scheduler;
+    size_t  index;
+    struct s0_task_deque  deque;
+};
+
+#define DEFAULT_SCHEDULER_TIME_SLICE  1000
+
+struct s0_scheduler {
+    size_t  worker_count;
+    size_t  time_slice;
+    struct s0_scheduler_worker  *workers;
+    /* Only used to put idle workers (and s0_scheduler_wait) to sleep; the
+     * deques synchronize on their own. */
+    pthread_mutex_t  lock;
+    pthread_cond_t  work_available;
+    pthread_cond_t  all_done;
+    /* The number of tasks sitting in deques or inboxes */
+    size_t  queued;
+    /* The number of workers asleep on `work_available` */
+    size_t  sleepers;
+    /* The number of tasks that have been submitted but haven't finished */
+    size_t  pending;
+    size_t  next_worker;
+    bool  shutting_down;
+};
+
+static struct s0_task_array *
+s0_task_array_new(size_t size)
+{
+    struct s0_task_array  *array =
+        malloc(sizeof(struct s0_task_array) + size * sizeof(struct s0_task *));
+    if (unlikely(array == NULL)) {
+        s0_set_memory_error();
+        return NULL;
+    }
+    array->size = size;
+    array->retired = NULL;
+    return array;
+}
+
+static int
+s0_task_deque_init(struct s0_task_deque *deque)
+{
+    deque->top = 0;
+    deque->bottom = 0;
+    deque->inbox = NULL;
+    deque->array = s0_task_array_new(DEFAULT_INITIAL_TASK_DEQUE_SIZE);
+    if (unlikely(deque->array == NULL)) {
+        return -1;
+    }
+    return 0;
+}
+
+static void
+s0_task_deque_done(struct s0_task_deque *deque)
+{
+    struct s0_task_array  *array = deque->array;
+    assert(deque->top == deque->bottom);
+    assert(deque->inbox == NULL);
+    while (array != NULL) {
+        struct s0_task_array  *retired = array->retired;
+        free(array);
+        array = retired;
+    }
+}
+
+/* Adds a task to the bottom of the deque.  Only the owner may call this. */
+static int
+s0_task_deque_push(struct s0_task_deque *deque, struct s0_task *task)
+{
+    size_t  bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    size_t  top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    struct s0_task_array  *array =
+        __atomic_load_n(&deque->array, __ATOMIC_RELAXED);
+    if (unlikely(bottom - top >= array->size)) {
+        size_t  i;
+        struct s0_task_array  *new_array = s0_task_array_new(array->size * 2);
+        if (unlikely(new_array == NULL)) {
+            return -1;
+        }
+        for (i = top; i < bottom; i++) {
+            new_array->tasks[i % new_array->size] =
+                __atomic_load_n(&array->tasks[i % array->size],
+                                __ATOMIC_RELAXED);
+        }
+        new_array->retired = array;
+        __atomic_store_n(&deque->array, new_array, __ATOMIC_RELEASE);
+        array = new_array;
+    }
+    __atomic_store_n
+        (&array->tasks[bottom % array->size], task, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* Takes the least recently pushed task.  Both the owner and thieves use this.
+ * Returns NULL if the deque is empty. */
+static struct s0_task *
+s0_task_deque_take(struct s0_task_deque *deque)
+{
+    size_t  top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    while (true) {
+        struct s0_task_array  *array;
+        struct s0_task  *task;
+        size_t  bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+        if (top >= bottom) {
+            return NULL;
+        }
+        array = __atomic_load_n(&deque->array, __ATOMIC_ACQUIRE);
+        task = __atomic_load_n
+            (&array->tasks[top % array->size], __ATOMIC_RELAXED);
+        /* If this fails, someone else got there first, and `top` now holds
+         * the new top of the deque. */
+        if (__atomic_compare_exchange_n
+            (&deque->top, &top, top + 1, false,
+             __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE)) {
+            return task;
+        }
+    }
+}
+
+/* Adds a task to the deque's inbox.  Any thread can call this, and it can't
+ * fail. */
+static void
+s0_task_deque_post(struct s0_task_deque *deque, struct s0_task *task)
+{
+    task->next = __atomic_load_n(&deque->inbox, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n
+           (&deque->inbox, &task->next, task, true,
+            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+}
+
+/* Takes everything from the deque's inbox, oldest first.  Any thread can call
+ * this. */
+static struct s0_task *
+s0_task_deque_take_inbox(struct s0_task_deque *deque)
+{
+    struct s0_task  *reversed = NULL;
+    struct s0_task  *task;
+    if (__atomic_load_n(&deque->inbox, __ATOMIC_RELAXED) == NULL) {
+        return NULL;
+    }
+    task = __atomic_exchange_n(&deque->inbox, NULL, __ATOMIC_ACQUIRE);
+    while (task != NULL) {
+        struct s0_task  *next = task->next;
+        task->next = reversed;
+        reversed = task;
+        task = next;
+    }
+    return reversed;
+}
+
+/* Wakes up a sleeping worker, if there are any, now that there's a new task
+ * for it.  Callers must count the task in `queued` first; since we check
+ * `sleepers` afterwards, and a worker registers itself in `sleepers` before
+ * checking `queued`, one of the two is guaranteed to see the other. */
+static void
+s0_scheduler_notify(struct s0_scheduler *scheduler)
+{
+    if (__atomic_load_n(&scheduler->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&scheduler->lock);
+        pthread_cond_signal(&scheduler->work_available);
+        pthread_mutex_unlock(&scheduler->lock);
+    }
+}
+
+/* Hands a task to one of the workers from any thread.  Can't fail. */
+static void
+s0_scheduler_post(struct s0_scheduler *scheduler, struct s0_task *task)
+{
+    /* Spread tasks around the workers; stealing evens things out from
+     * there. */
+    size_t  index =
+        __atomic_fetch_add(&scheduler->next_worker, 1, __ATOMIC_RELAXED)
+        % scheduler->worker_count;
+    __atomic_add_fetch(&scheduler->queued, 1, __ATOMIC_SEQ_CST);
+    s0_task_deque_post(&scheduler->workers[index].deque, task);
+    s0_scheduler_notify(scheduler);
+}
+
+/* Adds a task to the bottom of a worker's own deque.  Only the worker's own
+ * thread may call this. */
+static int
+s0_scheduler_push(struct s0_scheduler_worker *worker, struct s0_task *task)
+{
+    struct s0_scheduler  *scheduler = worker->scheduler;
+    __atomic_add_fetch(&scheduler->queued, 1, __ATOMIC_SEQ_CST);
+    if (unlikely(s0_task_deque_push(&worker->deque, task) != 0)) {
+        __atomic_sub_fetch(&scheduler->queued, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    s0_scheduler_notify(scheduler);
+    return 0;
+}
+
+static void
+s0_scheduler_finish_task(struct s0_scheduler *scheduler, struct s0_task *task,
+                         int rc);
+
+/* Moves a list of tasks taken from an inbox onto the bottom of the worker's
+ * own deque, where the worker (or a thief) will find them in order.  They're
+ * already counted in `queued`. */
+static void
+s0_scheduler_adopt(struct s0_scheduler_worker *worker, struct s0_task *task)
+{
+    struct s0_scheduler  *scheduler = worker->scheduler;
+    while (task != NULL) {
+        struct s0_task  *next = task->next;
+        if (unlikely(s0_task_deque_push(&worker->deque, task) != 0)) {
+            __atomic_sub_fetch(&scheduler->queued, 1, __ATOMIC_RELAXED);
+            if (task->execution != NULL) {
+                s0_execution_cancel(task->execution);
+            }
+            s0_scheduler_finish_task(scheduler, task, -1);
+        }
+        task = next;
+    }
+}
+
+/* Finds the next task for a worker to run: first from its own inbox and deque,
+ * and then by stealing from the other workers.  Blocks until there's a task
+ * available.  Returns NULL if the scheduler is shutting down. */
+static struct s0_task *
+s0_scheduler_next_task(struct s0_scheduler_worker *worker)
+{
+    struct s0_scheduler  *scheduler = worker->scheduler;
+    while (true) {
+        size_t  i;
+        struct s0_task  *task;
+
+        s0_scheduler_adopt(worker, s0_task_deque_take_inbox(&worker->deque));
+        task = s0_task_deque_take(&worker->deque);
+        for (i = 1; task == NULL && i < scheduler->worker_count; i++) {
+            struct s0_task_deque  *victim =
+                &scheduler->workers[(worker->index + i)
+                                    % scheduler->worker_count].deque;
+            task = s0_task_deque_take(victim);
+            if (task == NULL) {
+                /* The victim's owner is busy; take over its inbox. */
+                s0_scheduler_adopt(worker, s0_task_deque_take_inbox(victim));
+                task = s0_task_deque_take(&worker->deque);
+            }
+        }
+        if (task != NULL) {
+            __atomic_sub_fetch(&scheduler->queued, 1, __ATOMIC_RELAXED);
+            return task;
+        }
+
+        pthread_mutex_lock(&scheduler->lock);
+        __atomic_add_fetch(&scheduler->sleepers, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&scheduler->queued, __ATOMIC_SEQ_CST) == 0
+               && !scheduler->shutting_down) {
+            pthread_cond_wait(&scheduler->work_available, &scheduler->lock);
+        }
+        __atomic_sub_fetch(&scheduler->sleepers, 1, __ATOMIC_RELAXED);
+        if (scheduler->shutting_down
+            && __atomic_load_n(&scheduler->queued, __ATOMIC_SEQ_CST) == 0) {
+            pthread_mutex_unlock(&scheduler->lock);
+            return NULL;
+        }
+        pthread_mutex_unlock(&scheduler->lock);
+    }
+}
+
+static void
+s0_scheduler_finish_task(struct s0_scheduler *scheduler, struct s0_task *task,
+                         int rc)
+{
+    struct s0_environment  *env = task->env;
+    s0_scheduler_done_f  *done = task->done;
+    void  *ud = task->ud;
+    s0_block_free(task->block);
+    free(task);
+
+    done(ud, env, rc);
+
+    if (__atomic_sub_fetch(&scheduler->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&scheduler->lock);
+        pthread_cond_broadcast(&scheduler->all_done);
+        pthread_mutex_unlock(&scheduler->lock);
+    }
+}
+
+static void
+s0_scheduler_wake_task(void *ud, struct s0_execution *execution)
+{
+    struct s0_task  *task = ud;
+    s0_scheduler_post(task->scheduler, task);
+}
+
+static void *
+s0_scheduler_worker_run(void *ud)
+{
+    struct s0_scheduler_worker  *worker = ud;
+    struct s0_scheduler  *scheduler = worker->scheduler;
+    struct s0_task  *task;
+    while ((task = s0_scheduler_next_task(worker)) != NULL) {
+        enum s0_execution_status  status;
+        if (task->execution == NULL) {
+            task->execution = s0_execution_new(task->block, task->env);
+            if (unlikely(task->execution == NULL)) {
+                s0_scheduler_finish_task(scheduler, task, -1);
+                continue;
+            }
+            s0_execution_set_wake
+                (task->execution, s0_scheduler_wake_task, task);
+        }
+
+        status = s0_execution_resume(task->execution, scheduler->time_slice);
+        if (status == S0_EXECUTION_PENDING) {
+            /* s0_scheduler_wake_task will requeue the task once the primitive
+             * completes. */
+            continue;
+        } else if (status == S0_EXECUTION_SUSPENDED) {
+            /* Send the task to the back of the line. */
+            if (likely(s0_scheduler_push(worker, task) == 0)) {
+                continue;
+            }
+            s0_execution_cancel(task->execution);
+            status = S0_EXECUTION_ERROR;
+        }
+
+        s0_scheduler_finish_task
+            (scheduler, task, (status == S0_EXECUTION_FINISHED)? 0: -1);
+    }
+    return NULL;
+}
+
+/* Stops and joins the first `thread_count` workers, and then frees everything.
+ * Used both for normal shutdown, and to clean up after a partially constructed
+ * scheduler. */
+static void
+s0_scheduler_destroy(struct s0_scheduler *scheduler, size_t thread_count)
+{
+    size_t  i;
+
+    pthread_mutex_lock(&scheduler->lock);
+    scheduler->shutting_down = true;
+    pthread_cond_broadcast(&scheduler->work_available);
+    pthread_mutex_unlock(&scheduler->lock);
+
+    for (i = 0; i < thread_count; i++) {
+        pthread_join(scheduler->workers[i].thread, NULL);
+    }
+    for (i = 0; i < scheduler->worker_count; i++) {
+        s0_task_deque_done(&scheduler->workers[i].deque);
+    }
+    pthread_cond_destroy(&scheduler->all_done);
+    pthread_cond_destroy(&scheduler->work_available);
+    pthread_mutex_destroy(&scheduler->lock);
+    free(scheduler->workers);
+    free(scheduler);
+}
+
+struct s0_scheduler *
+s0_scheduler_new(size_t worker_count)
+{
+    size_t  i;
+    struct s0_scheduler  *scheduler;
+
+    assert(worker_count > 0);
+    scheduler = malloc(sizeof(struct s0_scheduler));
+    if (unlikely(scheduler == NULL)) {
+        s0_set_memory_error();
+        return NULL;
+    }
+
+    scheduler->workers =
+        malloc(worker_count * sizeof(struct s0_scheduler_worker));
+    if (unlikely(scheduler->workers == NULL)) {
+        free(scheduler);
+        s0_set_memory_error();
+        return NULL;
+    }
+
+    pthread_mutex_init(&scheduler->lock, NULL);
+    pthread_cond_init(&scheduler->work_available, NULL);
+    pthread_cond_init(&scheduler->all_done, NULL);
+    scheduler->worker_count = 0;
+    scheduler->time_slice = DEFAULT_SCHEDULER_TIME_SLICE;
+    scheduler->queued = 0;
+    scheduler->sleepers = 0;
+    scheduler->pending = 0;
+    scheduler->next_worker = 0;
+    scheduler->shutting_down = false;
+
+    for (i = 0; i < worker_count; i++) {
+        struct s0_scheduler_worker  *worker = &scheduler->workers[i];
+        worker->scheduler = scheduler;
+        worker->index = i;
+        if (unlikely(s0_task_deque_init(&worker->deque) != 0)) {
+            s0_scheduler_destroy(scheduler, 0);
+            return NULL;
+        }
+        scheduler->worker_count++;
+    }
+
+    /* Don't start any threads until all of the deques exist, since workers
+     * will try to steal from each other right away. */
+    for (i = 0; i < worker_count; i++) {
+        struct s0_scheduler_worker  *worker = &scheduler->workers[i];
+        int  rc = pthread_create
+            (&worker->thread, NULL, s0_scheduler_worker_run, worker);
+        if (unlikely(rc != 0)) {
+            s0_scheduler_destroy(scheduler, i);
+            s0_set_error(S0_ERROR_UNKNOWN, "Cannot start scheduler thread");
+            return NULL;
+        }
+    }
+
+    return scheduler;
+}
+
+void
+s0_scheduler_wait(struct s0_scheduler *scheduler)
+{
+    pthread_mutex_lock(&scheduler->lock);
+    while (__atomic_load_n(&scheduler->pending, __ATOMIC_ACQUIRE) > 0) {
+        pthread_cond_wait(&scheduler->all_done, &scheduler->lock);
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+void
+s0_scheduler_set_time_slice(struct s0_scheduler *scheduler, size_t max_steps)
+{
+    assert(max_steps > 0);
+    scheduler->time_slice = max_steps;
+}
+
+void
+s0_scheduler_free(struct s0_scheduler *scheduler)
+{
+    s0_scheduler_wait(scheduler);
+    s0_scheduler_destroy(scheduler, scheduler->worker_count);
+}
+
+int
+s0_scheduler_submit(struct s0_scheduler *scheduler, struct s0_block *block,
+                    struct s0_environment *env,
+                    s0_scheduler_done_f *done, void *ud)
+{
+    struct s0_task  *task = malloc(sizeof(struct s0_task));
+    if (unlikely(task == NULL)) {
+        s0_environment_free(env);
+        s0_set_memory_error();
+        return -1;
+    }
+    task->scheduler = scheduler;
+    task->block = s0_block_ref(block);
+    task->env = env;
+    task->execution = NULL;
+    task->done = done;
+    task->ud = ud;
+
+    __atomic_add_fetch(&scheduler->pending, 1, __ATOMIC_RELAXED);
+    s0_scheduler_post(scheduler, task);
+    return 0;
+}
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: Event loops
+ */
+
+#define DEFAULT_EVENT_LOOP_TIME_SLICE  1000
+#define EVENT_LOOP_MAX_EVENTS  64
+
+struct s0_event_task {
+    struct s0_event_loop  *loop;
+    struct s0_execution  *execution;
+    struct s0_environment  *env;
+    s0_event_loop_done_f  *done;
+    void  *ud;
+    /* Links together the loop's list of ready tasks */
+    struct s0_event_task  *next;
+};
+
+struct s0_event_watch {
+    int  fd;
+    s0_event_loop_watch_f  *callback;
+    void  *ud;
+};
+
+struct s0_event_loop {
+    int  epoll_fd;
+    /* An eventfd that wakes up the loop when a task becomes ready */
+    int  wake_fd;
+    size_t  time_slice;
+    /* The number of tasks that have been added but haven't finished.  Other
+     * threads can add tasks, so this is updated atomically. */
+    size_t  task_count;
+    /* Protects the ready list, which other threads can add to */
+    pthread_mutex_t  lock;
+    struct s0_event_task  *ready_head;
+    struct s0_event_task  *ready_tail;
+};
+
+static void
+s0_event_loop_push_ready(struct s0_event_loop *loop, struct s0_event_task *task)
+{
+    task->next = NULL;
+    pthread_mutex_lock(&loop->lock);
+    if (loop->ready_tail == NULL) {
+        loop->ready_head = task;
+    } else {
+        loop->ready_tail->next = task;
+    }
+    loop->ready_tail = task;
+    pthread_mutex_unlock(&loop->lock);
+}
+
+static struct s0_event_task *
+s0_event_loop_take_ready(struct s0_event_loop *loop)
+{
+    struct s0_event_task  *tasks;
+    pthread_mutex_lock(&loop->lock);
+    tasks = loop->ready_head;
+    loop->ready_head = NULL;
+    loop->ready_tail = NULL;
+    pthread_mutex_unlock(&loop->lock);
+    return tasks;
+}
+
+/* Adds task to the ready list, and wakes up the loop if it's waiting for
+ * events. */
+static void
+s0_event_loop_schedule(struct s0_event_loop *loop, struct s0_event_task *task)
+{
+    uint64_t  one = 1;
+    ssize_t  written;
+    s0_event_loop_push_ready(loop, task);
+    /* If this fails, the counter is already saturated, and the loop will wake
+     * up anyway. */
+    written = write(loop->wake_fd, &one, sizeof(one));
+    (void) written;
+}
+
+static void
+s0_event_loop_wake_task(void *ud, struct s0_execution *execution)
+{
+    struct s0_event_task  *task = ud;
+    s0_event_loop_schedule(task->loop, task);
+}
+
+static size_t
+s0_event_loop_task_count(struct s0_event_loop *loop)
+{
+    return __atomic_load_n(&loop->task_count, __ATOMIC_ACQUIRE);
+}
+
+struct s0_event_loop *
+s0_event_loop_new(void)
+{
+    struct epoll_event  event;
+    struct s0_event_loop  *loop = malloc(sizeof(struct s0_event_loop));
+    if (unlikely(loop == NULL)) {
+        s0_set_memory_error();
+        return NULL;
+    }
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (unlikely(loop->epoll_fd == -1)) {
+        s0_set_error
+            (S0_ERROR_UNKNOWN, "Cannot create epoll instance: %s",
+             strerror(errno));
+        free(loop);
+        return NULL;
+    }
+
+    loop->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (unlikely(loop->wake_fd == -1)) {
+        s0_set_error
+            (S0_ERROR_UNKNOWN, "Cannot create eventfd: %s", strerror(errno));
+        close(loop->epoll_fd);
+        free(loop);
+        return NULL;
+    }
+
+    /* The wake fd is the only one whose event data is NULL. */
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    if (unlikely(epoll_ctl
+                 (loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &event) != 0)) {
+        s0_set_error
+            (S0_ERROR_UNKNOWN, "Cannot watch eventfd: %s", strerror(errno));
+        close(loop->wake_fd);
+        close(loop->epoll_fd);
+        free(loop);
+        return NULL;
+    }
+
+    loop->time_slice = DEFAULT_EVENT_LOOP_TIME_SLICE;
+    loop->task_count = 0;
+    pthread_mutex_init(&loop->lock, NULL);
+    loop->ready_head = NULL;
+    loop->ready_tail = NULL;
+    return loop;
+}
+
+void
+s0_event_loop_free(struct s0_event_loop *loop)
+{
+    assert(s0_event_loop_task_count(loop) == 0);
+    pthread_mutex_destroy(&loop->lock);
+    close(loop->wake_fd);
+    close(loop->epoll_fd);
+    free(loop);
+}
+
+void
+s0_event_loop_set_time_slice(struct s0_event_loop *loop, size_t max_steps)
+{
+    assert(max_steps > 0);
+    loop->time_slice = max_steps;
+}
+
+int
+s0_event_loop_add(struct s0_event_loop *loop, struct s0_block *block,
+                  struct s0_environment *env,
+                  s0_event_loop_done_f *done, void *ud)
+{
+    struct s0_event_task  *task = malloc(sizeof(struct s0_event_task));
+    if (unlikely(task == NULL)) {
+        s0_environment_free(env);
+        s0_set_memory_error();
+        return -1;
+    }
+
+    task->execution = s0_execution_new(block, env);
+    if (unlikely(task->execution == NULL)) {
+        s0_environment_free(env);
+        free(task);
+        return -1;
+    }
+
+    task->loop = loop;
+    task->env = env;
+    task->done = done;
+    task->ud = ud;
+    s0_execution_set_wake(task->execution, s0_event_loop_wake_task, task);
+    __atomic_add_fetch(&loop->task_count, 1, __ATOMIC_ACQ_REL);
+    s0_event_loop_schedule(loop, task);
+    return 0;
+}
+
+int
+s0_event_loop_watch(struct s0_event_loop *loop, int fd, uint32_t events,
+                    s0_event_loop_watch_f *callback, void *ud)
+{
+    struct epoll_event  event;
+    struct s0_event_watch  *watch = malloc(sizeof(struct s0_event_watch));
+    if (unlikely(watch == NULL)) {
+        s0_set_memory_error();
+        return -1;
+    }
+
+    watch->fd = fd;
+    watch->callback = callback;
+    watch->ud = ud;
+    event.events = events | EPOLLONESHOT;
+    event.data.ptr = watch;
+    if (unlikely(epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)) {
+        s0_set_error
+            (S0_ERROR_UNKNOWN, "Cannot watch file descriptor: %s",
+             strerror(errno));
+        free(watch);
+        return -1;
+    }
+    return 0;
+}
+
+/* Runs every task that's currently ready for one time slice. */
+static void
+s0_event_loop_run_ready(struct s0_event_loop *loop)
+{
+    struct s0_event_task  *task = s0_event_loop_take_ready(loop);
+    while (task != NULL) {
+        struct s0_event_task  *next = task->next;
+        enum s0_execution_status  status =
+            s0_execution_resume(task->execution, loop->time_slice);
+        if (status == S0_EXECUTION_SUSPENDED) {
+            s0_event_loop_push_ready(loop, task);
+        } else if (status != S0_EXECUTION_PENDING) {
+            s0_event_loop_done_f  *done = task->done;
+            struct s0_environment  *env = task->env;
+            void  *ud = task->ud;
+            free(task);
+            __atomic_sub_fetch(&loop->task_count, 1, __ATOMIC_ACQ_REL);
+            done(ud, env, (status == S0_EXECUTION_FINISHED)? 0: -1);
+        }
+        task = next;
+    }
+}
+
+int
+s0_event_loop_run(struct s0_event_loop *loop)
+{
+    struct epoll_event  events[EVENT_LOOP_MAX_EVENTS];
+
+    while (true) {
+        int  i;
+        int  count;
+        int  timeout;
+
+        s0_event_loop_run_ready(loop);
+        if (s0_event_loop_task_count(loop) == 0) {
+            return 0;
+        }
+
+        /* Don't block if some tasks were preempted and are still ready. */
+        pthread_mutex_lock(&loop->lock);
+        timeout = (loop->ready_head == NULL)? -1: 0;
+        pthread_mutex_unlock(&loop->lock);
+
+        count = epoll_wait
+            (loop->epoll_fd, events, EVENT_LOOP_MAX_EVENTS, timeout);
+        if (unlikely(count == -1)) {
+            if (errno == EINTR) {
+                continue;
+            }
+            s0_set_error
+                (S0_ERROR_UNKNOWN, "Cannot wait for events: %s",
+                 strerror(errno));
+            return -1;
+        }
+
+        for (i = 0; i < count; i++) {
+            struct s0_event_watch  *watch = events[i].data.ptr;
+            if (watch == NULL) {
+                uint64_t  value;
+                ssize_t  bytes_read =
+                    read(loop->wake_fd, &value, sizeof(value));
+                (void) bytes_read;
+            } else {
+                epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, watch->fd, NULL);
+                watch->callback(watch->ud, events[i].events);
+                free(watch);
+            }
+        }
+    }
+}
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: Common primitives
+ */
+
+struct s0_extractor {
+    struct s0_name  *input_name;
+    struct s0_entity  **dest;
+};
+
+static struct s0_continuation
+s0_extractor_method_execute(void *ud, struct s0_environment *env)
+{
+    struct s0_extractor  *extractor = ud;
+    struct s0_entity  *result;
+    result = s0_environment_delete(env, extractor->input_name);
+    assert(result != NULL);
+    *extractor->dest = result;
+    return s0_finish_continuation_;
+}
+
+static void
+s0_extractor_method_free_ud(void *ud)
+{
+    struct s0_extractor  *extractor = ud;
+    s0_name_free(extractor->input_name);
+    free(extractor);
+}
+
+static struct s0_entity *
+s0_extractor_method_new(struct s0_name *input_name,
+                        struct s0_entity_type *result_type,
+                        struct s0_entity **dest)
+{
+    int  rc;
+    struct s0_extractor  *extractor;
+    struct s0_environment_type  *inputs;
+    struct s0_name  *self_name;
+    struct s0_environment_type  *self_elements;
+    struct s0_entity_type  *self_type;
+    struct s0_continuation  cont;
+
+    extractor = malloc(sizeof(struct s0_extractor));
+    if (unlikely(extractor == NULL)) {
+        s0_set_memory_error();
+        return NULL;
+    }
+
+    extractor->input_name = s0_name_new_copy(input_name);
+    if (unlikely(extractor->input_name == NULL)) {
+        free(extractor);
+        return NULL;
+    }
+
+    extractor->dest = dest;
+
+    inputs = s0_environment_type_new();
+    if (unlikely(inputs == NULL)) {
+        free(extractor);
+        return NULL;
+    }
+
+    rc = s0_environment_type_add(inputs, input_name, result_type);
+    if (unlikely(rc != 0)) {
+        s0_environment_type_free(inputs);
+        free(extractor);
+        return NULL;
+    }
+
+    self_name = s0_name_new_str("self");
+    if (unlikely(inputs == NULL)) {
+        s0_environment_type_free(inputs);
+        free(extractor);
+        return NULL;
+    }
+
+    self_elements = s0_environment_type_new();
+    if (unlikely(self_elements == NULL)) {
+        s0_environment_type_free(inputs);
+        s0_name_free(self_name);
+        free(extractor);
+        return NULL;
+    }
+
+    self_type = s0_object_entity_type_new(self_elements);
+    if (unlikely(self_type == NULL)) {
+        s0_environment_type_free(inputs);
+        s0_name_free(self_name);
+        free(extractor);
+        return NULL;
+    }
+
+    rc = s0_environment_type_add(inputs, self_name, self_type);
+    if (unlikely(rc != 0)) {
+        s0_environment_type_free(inputs);
+        free(extractor);
+        return NULL;
+    }
+
+    cont.ud = extractor;
+    cont.invoke = s0_extractor_method_execute;
+    return s0_primitive_method_new(inputs, cont, s0_extractor_method_free_ud);
+}
+
+struct s0_entity *
+s0_extractor_new(struct s0_name *input_name, struct s0_entity_type *result_type,
+                 struct s0_entity **dest)
+{
+    int  rc;
+    struct s0_environment  *closed_over;
+    struct s0_entity  *object;
+    struct s0_name  *name;
+    struct s0_name  *input_name_copy;
+    struct s0_entity_type  *result_type_copy;
+    struct s0_entity  *method;
+    struct s0_named_blocks  *blocks;
+    struct s0_environment_type  *inputs;
+    struct s0_statement_list  *statements;
+    struct s0_name  *src;
+    struct s0_name  *method_name;
+    struct s0_name_mapping  *params;
+    struct s0_name  *from;
+    struct s0_name  *to;
+    struct s0_invocation  *invocation;
+    struct s0_block  *body;
+
+    object = s0_object_new();
+    if (unlikely(object == NULL)) {
+        return NULL;
+    }
+
+    input_name_copy = s0_name_new_copy(input_name);
+    if (unlikely(input_name_copy == NULL)) {
+        s0_entity_free(object);
+        return NULL;
+    }
+
+    result_type_copy = s0_entity_type_new_copy(result_type);
+    if (unlikely(result_type_copy == NULL)) {
+        s0_entity_free(object);
+        s0_name_free(input_name_copy);
+        return NULL;
+    }
+
+    method = s0_extractor_method_new(input_name_copy, result_type_copy, dest);
+    if (unlikely(method == NULL)) {
+        s0_entity_free(object);
+        return NULL;
+    }
+
+    name = s0_name_new_str("extractor");
+    if (unlikely(name == NULL)) {
+        s0_entity_free(object);
+        s0_entity_free(method);
+        return NULL;
+    }
+
+    rc = s0_object_add(object, name, method);
+    if (unlikely(rc != 0)) {
+        s0_entity_free(object);
+        return NULL;
+    }
+
+    closed_over = s0_environment_new();
+    if (unlikely(closed_over == NULL)) {
+        s0_entity_free(object);
+        return NULL;
+    }
+
+    name = s0_name_new_str("object");
+    if (unlikely(name == NULL)) {
+        s0_entity_free(object);
+        s0_environment_free(closed_over);
+        return NULL;
+    }
+
+    rc = s0_environment_add(closed_over, name, object);
+    if (unlikely(rc != 0)) {
+        s0_environment_free(closed_over);
+        return NULL;
+    }
+
+    statements = s0_statement_list_new();
+    if (unlikely(statements == NULL)) {
+        s0_environment_free(closed_over);
+        return NULL;
+    }
+
+    src = s0_name_new_str("object");
+    if (unlikely(src == NULL)) {
+        s0_environment_free(closed_over);
+        s0_statement_list_free(statements);
+        return NULL;
+    }
+
+    method_name = s0_name_new_str("extractor");
+    if (unlikely(method == NULL)) {
+        s0_environment_free(closed_over);
+        s0_statement_list_free(statements);
+        s0_name_free(src);
+        return NULL;
+    }
+
+    params = s0_name_mapping_new();
+    if (unlikely(method == NULL)) {
+        s0_environment_free(closed_over);
+        s0_statement_list_free(statements);
+        s0_name_free(src);
+        s0_name_free(method_name);
+        return NULL;
+    }
+
+    from = s0_name_new_copy(input_name);
+    if (unlikely(from == NULL)) {
+        s0_environment_free(closed_over);
+        s0_statement_list_free(statements);
+        s0_name_free(src);
+        s0_name_free(method_name);
+        s0_name_mapping_free(params);
+        return NULL;
+    }
+
+    to = s0_name_new_copy(input_name);
+    if (unlikely(to == NULL)) {
+        s0_environment_free(closed_over);
+        s0_statement_list_free(statements);
+        s0_name_free(src);
+        s0_name_free(method_name);
+        s0_name_mapping_free(params);
+        s0_name_free(from);
+        return NULL;
+    }
+
+    rc = s0_name_mapping_add(params, from, to);
+    if (unlikely(rc != 0)) {
+        s0_environment_free(closed_over);
+        s0_statement_list_free(statements);
+        s0_name_free(src);
+        s0_name_free(method_name);
+        s0_name_mapping_free(params);
+        return NULL;
+    }
+
+    from = s0_name_new_str("object");
+    if (unlikely(from == NULL)) {
+        s0_environment_free(closed_over);
+        s0_statement_list_free(statements);
+        s0_name_free(src);
+        s0_name_free(method_name);
+        s0_name_mapping_free(params);
+        return NULL;
+    }
+
+    to = s0_name_new_str("self");
+    if (unlikely(to == NULL)) {
+        s0_environment_free(closed_over);
+        s0_statement_list_free(statements);
+        s0_name_free(src);
+        s0_name_free(method_name);
+        s0_name_mapping_free(params);
+        s0_name_free(from);
+        return NULL;
+    }
+
+    rc = s0_name_mapping_add(params, from, to);
+    if (unlikely(rc != 0)) {
+        s0_environment_free(closed_over);
+        s0_statement_list_free(statements);
+        s0_name_free(src);
+        s0_name_free(method_name);
+        s0_name_mapping_free(params);
+        return NULL;
+    }
+
+    invocation = s0_invoke_method_new(src, method_name, params);
+    if (unlikely(invocation == NULL)) {
+        s0_environment_free(closed_over);
+        s0_statement_list_free(statements);
+        return NULL;
+    }
+
+    inputs = s0_environment_type_new();
+    if (unlikely(inputs == NULL)) {
+        s0_environment_free(closed_over);
+        s0_statement_list_free(statements);
+        s0_invocation_free(invocation);
+        return NULL;
+    }
+
+    rc = s0_environment_type_add(inputs, input_name, result_type);
+    if (unlikely(rc != 0)) {
+        s0_environment_free(closed_over);
+        s0_statement_list_free(statements);
+        s0_invocation_free(invocation);
+        s0_environment_type_free(inputs);
+        return NULL;
+    }
+
+    body = s0_block_new(inputs, statements, invocation);
+    if (unlikely(body == NULL)) {
+        s0_environment_free(closed_over);
+        return NULL;
+    }
+
+    blocks = s0_named_blocks_new();
+    if (unlikely(blocks == NULL)) {
+        s0_environment_free(closed_over);
+        s0_block_free(body);
+        return NULL;
+    }
+
+    name = s0_name_new_str("body");
+    if (unlikely(name == NULL)) {
+        s0_environment_free(closed_over);
+        s0_block_free(body);
+        s0_named_blocks_free(blocks);
+        return NULL;
+    }
+
+    rc = s0_named_blocks_add(blocks, name, body);
+    if (unlikely(rc != 0)) {
+        s0_environment_free(closed_over);
+        s0_named_blocks_free(blocks);
+        return NULL;
+    }
+
+    return s0_closure_new(closed_over, blocks);
+}
+
+
+static struct s0_continuation
+s0_finish_method_execute(void *ud, struct s0_environment *env)
+{
+    struct s0_name  *name;
+    struct s0_entity  *self;
+
+    name = s0_name_new_str("self");
+    if (unlikely(name == NULL)) {
+        return s0_error_continuation_;
+    }
+
+    self = s0_environment_delete(env, name);
+    assert(self != NULL);
+    s0_name_free(name);
+    s0_entity_free(self);
+    return s0_finish_continuation_;
+}
+
+static void
+s0_finish_method_free_ud(void *ud)
+{
+}
+
+static const struct s0_continuation s0_finish_method_continuation = {
+    NULL,
+    s0_finish_method_execute
+};
+
+static struct s0_entity *
+s0_finish_method_new(void)
+{
+    int  rc;
+    struct s0_environment_type  *inputs;
+    struct s0_name  *name;
+    struct s0_environment_type  *elements;
+    struct s0_entity_type  *type;
+
+    inputs = s0_environment_type_new();
+    if (unlikely(inputs == NULL)) {
+        return NULL;
+    }
+
+    name = s0_name_new_str("self");
+    if (unlikely(name == NULL)) {
+        s0_environment_type_free(inputs);
+        return NULL;
+    }
+
+    elements = s0_environment_type_new();
+    if (unlikely(elements == NULL)) {
+        s0_environment_type_free(inputs);
+        s0_name_free(name);
+        return NULL;
+    }
+
+    type = s0_object_entity_type_new(elements);
+    if (unlikely(type == NULL)) {
+        s0_environment_type_free(inputs);
+        s0_name_free(name);
+        return NULL;
+    }
+
+    rc = s0_environment_type_add(inputs, name, type);
+    if (unlikely(rc != 0)) {
+        s0_environment_type_free(inputs);
+        return NULL;
+    }
+
+    return s0_primitive_method_new
+        (inputs, s0_finish_method_continuation, s0_finish_method_free_ud);
+}
+
+struct s0_entity *
+s0_finish_new(void)
+{
+    int  rc;
+    struct s0_entity  *object;
+    struct s0_name  *name;
+    struct s0_entity  *method;
+
+    object = s0_object_new();
+    if (unlikely(object == NULL)) {
+        return NULL;
+    }
+
+    name = s0_name_new_str("finish");
+    if (unlikely(name == NULL)) {
+        s0_entity_free(object);
+        return NULL;
+    }
+
+    method = s0_finish_method_new();
+    if (unlikely(method == NULL)) {
+        s0_entity_free(object);
+        s0_name_free(name);
+        return NULL;
+    }
+
+    rc = s0_object_add(object, name, method);
+    if (unlikely(rc != 0)) {
+        s0_entity_free(object);
+        return NULL;
+    }
+
+    return object;
+}
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: File I/O
+ */
+
+#define DEFAULT_IO_QUEUE_DEPTH  64
+#define DEFAULT_IO_BUFFER_COUNT  64
+#define DEFAULT_IO_THREAD_COUNT  4
+
+enum s0_io_op {
+    S0_IO_OPEN,
+    S0_IO_READ,
+    S0_IO_WRITE,
+    S0_IO_CLOSE,
+    S0_IO_OP_COUNT
+};
+
+#define S0_IO_SUCCESS  0
+#define S0_IO_FAILURE  1
+
+/* An open file, shared by the methods of its file object and by any request
+ * that's operating on it. */
+struct s0_io_file {
+    size_t  ref_count;
+    struct s0_io  *io;
+    int  fd;
+};
+
+struct s0_io_request {
+    enum s0_io_op  op;
+    struct s0_io  *io;
+    /* NULL if we're performing the request synchronously */
+    struct s0_execution  *execution;
+    struct s0_io_file  *file;
+    /* For open */
+    char  *path;
+    int  flags;
+    /* For read */
+    void  *buffer;
+    /* -1 if buffer isn't one of our registered buffers */
+    int  buffer_index;
+    /* For write */
+    struct s0_entity  *data;
+    size_t  written;
+    /* The number of bytes transferred, the new file descriptor, or -errno */
+    ssize_t  result;
+    /* If set, describes a failure better than strerror(-result) would */
+    const char  *error;
+    /* Links together the thread pool's queue */
+    struct s0_io_request  *next;
+};
+
+#if defined(S0_HAVE_IO_URING)
+struct s0_io_uring {
+    int  fd;
+    void  *ring;
+    size_t  ring_size;
+    struct io_uring_sqe  *sqes;
+    size_t  sqes_size;
+    unsigned int  *sq_head;
+    unsigned int  *sq_tail;
+    unsigned int  *sq_mask;
+    unsigned int  *sq_array;
+    unsigned int  sq_entries;
+    unsigned int  *cq_head;
+    unsigned int  *cq_tail;
+    unsigned int  *cq_mask;
+    struct io_uring_cqe  *cqes;
+    bool  fixed_buffers;
+    /* Submitters write to this to wake up the loop thread */
+    int  wake_fd;
+    /* Protects the submission queue */
+    pthread_mutex_t  lock;
+    pthread_cond_t  space_available;
+    unsigned int  in_flight;
+    /* Whether the loop thread is (about to be) blocked waiting for
+     * completions, and so needs to be woken up to submit anything new */
+    bool  waiting;
+    /* Submits requests and reaps their completions */
+    pthread_t  thread;
+};
+#endif
+
+struct s0_io_threads {
+    size_t  thread_count;
+    pthread_t  *threads;
+    pthread_mutex_t  lock;
+    pthread_cond_t  work_available;
+    struct s0_io_request  *head;
+    struct s0_io_request  *tail;
+    bool  shutting_down;
+};
+
+struct s0_io {
+    enum s0_io_backend  backend;
+#if defined(S0_HAVE_IO_URING)
+    struct s0_io_uring  uring;
+#endif
+    struct s0_io_threads  threads;
+    /* A pool of read buffers, each S0_IO_READ_SIZE bytes long */
+    char  *buffers;
+    size_t  buffer_count;
+    pthread_mutex_t  buffer_lock;
+    int  *free_buffers;
+    size_t  free_buffer_count;
+    /* What to do after each operation succeeds or fails */
+    struct s0_invocation  *invocations[S0_IO_OP_COUNT][2];
+    /* The inputs of each primitive method */
+    struct s0_environment_type  *inputs[S0_IO_OP_COUNT];
+};
+
+/* Read buffers */
+
+static void
+s0_io_release_buffer(void *ud, const void *content)
+{
+    struct s0_io  *io = ud;
+    pthread_mutex_lock(&io->buffer_lock);
+    io->free_buffers[io->free_buffer_count++] =
+        ((const char *) content - io->buffers) / S0_IO_READ_SIZE;
+    pthread_mutex_unlock(&io->buffer_lock);
+}
+
+static void
+s0_io_release_unregistered_buffer(void *ud, const void *content)
+{
+    free((void *) content);
+}
+
+/* Grabs a buffer from the pool if there's one available, and falls back on
+ * allocating one if not. */
+static int
+s0_io_request_acquire_buffer(struct s0_io_request *request)
+{
+    struct s0_io  *io = request->io;
+    request->buffer_index = -1;
+    pthread_mutex_lock(&io->buffer_lock);
+    if (likely(io->free_buffer_count > 0)) {
+        request->buffer_index = io->free_buffers[--io->free_buffer_count];
+    }
+    pthread_mutex_unlock(&io->buffer_lock);
+
+    if (likely(request->buffer_index != -1)) {
+        request->buffer =
+            io->buffers + (size_t) request->buffer_index * S0_IO_READ_SIZE;
+        return 0;
+    }
+
+    request->buffer = malloc(S0_IO_READ_SIZE);
+    if (unlikely(request->buffer == NULL)) {
+        s0_set_memory_error();
+        return -1;
+    }
+    return 0;
+}
+
+static void
+s0_io_request_release_buffer(struct s0_io_request *request)
+{
+    if (request->buffer_index == -1) {
+        s0_io_release_unregistered_buffer(request->io, request->buffer);
+    } else {
+        s0_io_release_buffer(request->io, request->buffer);
+    }
+}
+
+/* Files */
+
+static void
+s0_io_file_unref(void *ud)
+{
+    struct s0_io_file  *file = ud;
+    if (s0_ref_count_decrement(&file->ref_count)) {
+        if (file->fd != -1) {
+            close(file->fd);
+        }
+        free(file);
+    }
+}
+
+static struct s0_entity *
+s0_io_file_object_new(struct s0_io *io, int fd);
+
+/* Performing requests */
+
+/* Performs a request synchronously, using ordinary POSIX calls. */
+static void
+s0_io_request_perform(struct s0_io_request *request)
+{
+    ssize_t  rc;
+    switch (request->op) {
+        case S0_IO_OPEN:
+            rc = open(request->path, request->flags | O_CLOEXEC, 0666);
+            break;
+        case S0_IO_READ:
+            rc = read(request->file->fd, request->buffer, S0_IO_READ_SIZE);
+            break;
+        case S0_IO_WRITE:
+            do {
+                rc = write(request->file->fd,
+                           s0_literal_content(request->data)
+                           + request->written,
+                           s0_literal_size(request->data) - request->written);
+                if (rc > 0) {
+                    request->written += rc;
+                }
+            } while ((rc > 0 || (rc == -1 && errno == EINTR))
+                     && request->written < s0_literal_size(request->data));
+            if (rc >= 0) {
+                rc = request->written;
+            }
+            break;
+        case S0_IO_CLOSE:
+            rc = close(request->file->fd);
+            request->file->fd = -1;
+            break;
+        default:
+            assert(false);
+            rc = -1;
+            errno = EINVAL;
+            break;
+    }
+    request->result = (rc == -1)? -errno: rc;
+}
+
+static void
+s0_io_request_free(struct s0_io_request *request)
+{
+    if (request->file != NULL) {
+        s0_io_file_unref(request->file);
+    }
+    if (request->data != NULL) {
+        s0_entity_free(request->data);
+    }
+    free(request->path);
+    free(request);
+}
+
+/* Turns a finished request into the entity that we'll pass to the caller's
+ * `then` closure, and the invocation that passes it.  Frees the request.
+ * Returns NULL if there's an error. */
+static struct s0_invocation *
+s0_io_request_result(struct s0_io_request *request,
+                     struct s0_name **name, struct s0_entity **entity)
+{
+    struct s0_io  *io = request->io;
+    enum s0_io_op  op = request->op;
+    int  outcome = (request->result < 0)? S0_IO_FAILURE: S0_IO_SUCCESS;
+    const char  *name_str = NULL;
+
+    *name = NULL;
+    *entity = NULL;
+
+    if (request->result < 0) {
+        if (op == S0_IO_READ) {
+            s0_io_request_release_buffer(request);
+        }
+        name_str = "error";
+        *entity = s0_literal_new_str
+            ((request->error != NULL)?
+             request->error: strerror(-request->result));
+    } else if (op == S0_IO_OPEN) {
+        name_str = "file";
+        *entity = s0_io_file_object_new(io, request->result);
+    } else if (op == S0_IO_READ) {
+        name_str = "data";
+        if (request->buffer_index == -1) {
+            *entity = s0_literal_new_view
+                (request->result, request->buffer,
+                 s0_io_release_unregistered_buffer, NULL);
+        } else {
+            *entity = s0_literal_new_view
+                (request->result, request->buffer, s0_io_release_buffer, io);
+        }
+    }
+
+    if (name_str != NULL) {
+        if (unlikely(*entity == NULL)) {
+            s0_io_request_free(request);
+            return NULL;
+        }
+        *name = s0_name_new_str(name_str);
+        if (unlikely(*name == NULL)) {
+            s0_entity_free(*entity);
+            *entity = NULL;
+            s0_io_request_free(request);
+            return NULL;
+        }
+    }
+
+    s0_io_request_free(request);
+    return io->invocations[op][outcome];
+}
+
+static struct s0_continuation
+s0_io_invoke(void *ud, struct s0_environment *env)
+{
+    return s0_invocation_execute(ud, env);
+}
+
+/* Called by the backends once they've finished a request, to resume the
+ * execution that's waiting for it. */
+static void
+s0_io_request_completed(struct s0_io_request *request)
+{
+    struct s0_execution  *execution = request->execution;
+    struct s0_name  *name;
+    struct s0_entity  *entity;
+    struct s0_invocation  *invocation;
+    struct s0_continuation  next;
+
+    invocation = s0_io_request_result(request, &name, &entity);
+    if (unlikely(invocation == NULL)) {
+        s0_execution_complete(execution, NULL, NULL, s0_error_continuation_);
+        return;
+    }
+    next.ud = invocation;
+    next.invoke = s0_io_invoke;
+    s0_execution_complete(execution, name, entity, next);
+}
+
+/* Thread pool backend */
+
+static void *
+s0_io_threads_run(void *ud)
+{
+    struct s0_io_threads  *threads = ud;
+    while (true) {
+        struct s0_io_request  *request;
+        pthread_mutex_lock(&threads->lock);
+        while (threads->head == NULL && !threads->shutting_down) {
+            pthread_cond_wait(&threads->work_available, &threads->lock);
+        }
+        request = threads->head;
+        if (request == NULL) {
+            pthread_mutex_unlock(&threads->lock);
+            return NULL;
+        }
+        threads->head = request->next;
+        if (threads->head == NULL) {
+            threads->tail = NULL;
+        }
+        pthread_mutex_unlock(&threads->lock);
+
+        s0_io_request_perform(request);
+        s0_io_request_completed(request);
+    }
+}
+
+static void
+s0_io_threads_submit(struct s0_io_threads *threads,
+                     struct s0_io_request *request)
+{
+    request->next = NULL;
+    pthread_mutex_lock(&threads->lock);
+    if (threads->tail == NULL) {
+        threads->head = request;
+    } else {
+        threads->tail->next = request;
+    }
+    threads->tail = request;
+    pthread_cond_signal(&threads->work_available);
+    pthread_mutex_unlock(&threads->lock);
+}
+
+/* Stops and joins the first `thread_count` threads. */
+static void
+s0_io_threads_done(struct s0_io_threads *threads, size_t thread_count)
+{
+    size_t  i;
+    pthread_mutex_lock(&threads->lock);
+    threads->shutting_down = true;
+    pthread_cond_broadcast(&threads->work_available);
+    pthread_mutex_unlock(&threads->lock);
+    for (i = 0; i < thread_count; i++) {
+        pthread_join(threads->threads[i], NULL);
+    }
+    pthread_cond_destroy(&threads->work_available);
+    pthread_mutex_destroy(&threads->lock);
+    free(threads->threads);
+}
+
+static int
+s0_io_threads_init(struct s0_io_threads *threads, size_t thread_count)
+{
+    size_t  i;
+    threads->threads = malloc(thread_count * sizeof(pthread_t));
+    if (unlikely(threads->threads == NULL)) {
+        s0_set_memory_error();
+        return -1;
+    }
+    pthread_mutex_init(&threads->lock, NULL);
+    pthread_cond_init(&threads->work_available, NULL);
+    threads->head = NULL;
+    threads->tail = NULL;
+    threads->shutting_down = false;
+    for (i = 0; i < thread_count; i++) {
+        if (unlikely(pthread_create(&threads->threads[i], NULL,
+                                    s0_io_threads_run, threads) != 0)) {
+            s0_io_threads_done(threads, i);
+            s0_set_error(S0_ERROR_UNKNOWN, "Cannot create I/O thread");
+            return -1;
+        }
+    }
+    threads->thread_count = thread_count;
+    return 0;
+}
+
+/* io_uring backend */
+
+#if defined(S0_HAVE_IO_URING)
+
+static int
+s0_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+                  unsigned int flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                   NULL, 0);
+}
+
+/* The loop thread keeps a poll of the wake eventfd in flight at all times, so
+ * that submitters can interrupt its io_uring_enter.  We tell its completion
+ * apart from the others by its user_data, which is the ring itself. */
+#define S0_IO_URING_WAKE(uring)  ((uintptr_t) (uring))
+
+/* Must be called with the submission queue locked.  Returns a zeroed SQE,
+ * waiting for space if there are too many requests in flight. */
+static struct io_uring_sqe *
+s0_io_uring_get_sqe(struct s0_io_uring *uring)
+{
+    unsigned int  tail;
+    struct io_uring_sqe  *sqe;
+    while (uring->in_flight >= uring->sq_entries) {
+        pthread_cond_wait(&uring->space_available, &uring->lock);
+    }
+    tail = *uring->sq_tail;
+    sqe = &uring->sqes[tail & *uring->sq_mask];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    return sqe;
+}
+
+/* Must be called with the submission queue locked.  We don't submit the SQE
+ * ourselves; the loop thread submits everything that's queued up with a single
+ * io_uring_enter on each iteration, so we only have to wake it up if it's
+ * waiting for completions. */
+static void
+s0_io_uring_push_sqe(struct s0_io_uring *uring)
+{
+    unsigned int  tail = *uring->sq_tail;
+    unsigned int  index = tail & *uring->sq_mask;
+    uring->sq_array[index] = index;
+    __atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    uring->in_flight++;
+    if (uring->waiting) {
+        uint64_t  one = 1;
+        ssize_t  written;
+        uring->waiting = false;
+        /* If this fails, the counter is already saturated, and the loop will
+         * wake up anyway. */
+        written = write(uring->wake_fd, &one, sizeof(one));
+        (void) written;
+    }
+}
+
+/* Must be called with the submission queue locked. */
+static void
+s0_io_uring_arm_wake(struct s0_io_uring *uring)
+{
+    struct io_uring_sqe  *sqe = s0_io_uring_get_sqe(uring);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = uring->wake_fd;
+    sqe->poll_events = POLLIN;
+    sqe->user_data = S0_IO_URING_WAKE(uring);
+    s0_io_uring_push_sqe(uring);
+}
+
+/* Must be called with the submission queue locked. */
+static void
+s0_io_uring_submit_locked(struct s0_io_uring *uring,
+                          struct s0_io_request *request)
+{
+    struct io_uring_sqe  *sqe = s0_io_uring_get_sqe(uring);
+    sqe->user_data = (uintptr_t) request;
+    switch (request->op) {
+        case S0_IO_OPEN:
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uintptr_t) request->path;
+            sqe->len = 0666;
+            sqe->open_flags = request->flags | O_CLOEXEC;
+            break;
+        case S0_IO_READ:
+            sqe->fd = request->file->fd;
+            sqe->addr = (uintptr_t) request->buffer;
+            sqe->len = S0_IO_READ_SIZE;
+            /* Read from the file's current position */
+            sqe->off = (uint64_t) -1;
+            if (uring->fixed_buffers && request->buffer_index != -1) {
+                sqe->opcode = IORING_OP_READ_FIXED;
+                sqe->buf_index = request->buffer_index;
+            } else {
+                sqe->opcode = IORING_OP_READ;
+            }
+            break;
+        case S0_IO_WRITE:
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->fd = request->file->fd;
+            sqe->addr = (uintptr_t)
+                (s0_literal_content(request->data) + request->written);
+            sqe->len = s0_literal_size(request->data) - request->written;
+            sqe->off = (uint64_t) -1;
+            break;
+        case S0_IO_CLOSE:
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = request->file->fd;
+            break;
+        default:
+            assert(false);
+            break;
+    }
+    s0_io_uring_push_sqe(uring);
+}
+
+static void
+s0_io_uring_submit(struct s0_io_uring *uring, struct s0_io_request *request)
+{
+    pthread_mutex_lock(&uring->lock);
+    s0_io_uring_submit_locked(uring, request);
+    pthread_mutex_unlock(&uring->lock);
+}
+
+/* Must be called with the submission queue locked.  After io_uring_enter
+ * fails with `error`, takes back every SQE that the kernel hasn't consumed, and
+ * returns their requests (linked through `next`) so that the caller can fail
+ * them once it has unlocked the queue.  Sets `stopping` if one of them was the
+ * shutdown NOP. */
+static struct s0_io_request *
+s0_io_uring_unsubmit(struct s0_io_uring *uring, int error, bool *stopping)
+{
+    unsigned int  head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned int  tail = *uring->sq_tail;
+    bool  rearm = false;
+    struct s0_io_request  *failed = NULL;
+    while (tail != head) {
+        uintptr_t  user_data;
+        tail--;
+        user_data = uring->sqes[tail & *uring->sq_mask].user_data;
+        uring->in_flight--;
+        if (user_data == 0) {
+            *stopping = true;
+        } else if (user_data == S0_IO_URING_WAKE(uring)) {
+            rearm = true;
+        } else {
+            struct s0_io_request  *request =
+                (struct s0_io_request *) user_data;
+            request->result = -error;
+            request->next = failed;
+            failed = request;
+        }
+    }
+    __atomic_store_n(uring->sq_tail, head, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&uring->space_available);
+    if (rearm) {
+        s0_io_uring_arm_wake(uring);
+    }
+    return failed;
+}
+
+/* Handles every completion that's waiting in the completion queue.  Returns
+ * whether one of them was the shutdown NOP. */
+static bool
+s0_io_uring_reap(struct s0_io_uring *uring)
+{
+    bool  stopping = false;
+    while (true) {
+        unsigned int  head = *uring->cq_head;
+        unsigned int  tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+        struct io_uring_cqe  *cqe;
+        uintptr_t  user_data;
+        struct s0_io_request  *request;
+        int  result;
+
+        if (head == tail) {
+            return stopping;
+        }
+
+        cqe = &uring->cqes[head & *uring->cq_mask];
+        user_data = cqe->user_data;
+        result = cqe->res;
+        __atomic_store_n(uring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+        /* The submitter filled in the request while holding this lock, so
+         * taking it also makes sure that we see all of its fields. */
+        pthread_mutex_lock(&uring->lock);
+        uring->in_flight--;
+        if (user_data == S0_IO_URING_WAKE(uring)) {
+            /* Someone queued up new SQEs while we were waiting.  Reset the
+             * eventfd and keep watching it; the next iteration submits
+             * them. */
+            uint64_t  value;
+            ssize_t  bytes_read = read(uring->wake_fd, &value, sizeof(value));
+            (void) bytes_read;
+            s0_io_uring_arm_wake(uring);
+            pthread_mutex_unlock(&uring->lock);
+            continue;
+        }
+        request = (struct s0_io_request *) user_data;
+        if (request != NULL && request->op == S0_IO_WRITE && result > 0
+            && request->written + result < s0_literal_size(request->data)) {
+            /* Short write; send the rest, reusing the slot that just freed up
+             * so that we can't get stuck waiting on ourselves. */
+            request->written += result;
+            s0_io_uring_submit_locked(uring, request);
+            pthread_mutex_unlock(&uring->lock);
+            continue;
+        }
+        pthread_cond_signal(&uring->space_available);
+        pthread_mutex_unlock(&uring->lock);
+
+        /* A NOP without a request tells us to shut down. */
+        if (request == NULL) {
+            stopping = true;
+            continue;
+        }
+
+        request->result = result;
+        if (request->op == S0_IO_WRITE && result >= 0) {
+            request->written += result;
+            request->result = request->written;
+        } else if (request->op == S0_IO_CLOSE) {
+            /* The descriptor is gone even if close reported an error. */
+            request->file->fd = -1;
+        }
+        s0_io_request_completed(request);
+    }
+}
+
+/* The loop thread.  Each iteration submits everything that's been queued up
+ * since the last one, and waits for at least one completion, with a single
+ * io_uring_enter; and then handles whatever has completed. */
+static void *
+s0_io_uring_run(void *ud)
+{
+    struct s0_io  *io = ud;
+    struct s0_io_uring  *uring = &io->uring;
+    bool  stopping = false;
+    while (!stopping) {
+        unsigned int  to_submit;
+        int  rc;
+        int  error;
+        struct s0_io_request  *failed = NULL;
+
+        pthread_mutex_lock(&uring->lock);
+        to_submit = *uring->sq_tail
+            - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+        uring->waiting = true;
+        pthread_mutex_unlock(&uring->lock);
+
+        rc = s0_io_uring_enter
+            (uring->fd, to_submit, 1, IORING_ENTER_GETEVENTS);
+        error = errno;
+
+        pthread_mutex_lock(&uring->lock);
+        uring->waiting = false;
+        /* EAGAIN and EBUSY mean that the kernel needs us to reap some
+         * completions before it can take any more submissions; anything
+         * queued up will go out on the next iteration.  Any other error means
+         * that the requests aren't going anywhere. */
+        if (rc == -1 && error != EINTR && error != EAGAIN && error != EBUSY) {
+            failed = s0_io_uring_unsubmit(uring, error, &stopping);
+        }
+        pthread_mutex_unlock(&uring->lock);
+
+        while (failed != NULL) {
+            struct s0_io_request  *next = failed->next;
+            s0_io_request_completed(failed);
+            failed = next;
+        }
+        if (s0_io_uring_reap(uring)) {
+            stopping = true;
+        }
+    }
+    return NULL;
+}
+
+static void
+s0_io_uring_done(struct s0_io_uring *uring, bool started)
+{
+    if (started) {
+        struct io_uring_sqe  *sqe;
+        pthread_mutex_lock(&uring->lock);
+        sqe = s0_io_uring_get_sqe(uring);
+        sqe->opcode = IORING_OP_NOP;
+        sqe->user_data = 0;
+        s0_io_uring_push_sqe(uring);
+        pthread_mutex_unlock(&uring->lock);
+        pthread_join(uring->thread, NULL);
+    }
+    pthread_cond_destroy(&uring->space_available);
+    pthread_mutex_destroy(&uring->lock);
+    munmap(uring->sqes, uring->sqes_size);
+    munmap(uring->ring, uring->ring_size);
+    close(uring->fd);
+    close(uring->wake_fd);
+}
+
+/* Returns whether the kernel supports all of the operations that we need. */
+static bool
+s0_io_uring_supports_ops(int fd)
+{
+    static const int  ops[] = {
+        IORING_OP_NOP, IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_READ_FIXED,
+        IORING_OP_WRITE, IORING_OP_CLOSE, IORING_OP_POLL_ADD
+    };
+    size_t  probe_size = sizeof(struct io_uring_probe)
+        + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe  *probe = calloc(1, probe_size);
+    bool  result = true;
+    size_t  i;
+
+    if (unlikely(probe == NULL)) {
+        return false;
+    }
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe,
+                IORING_OP_LAST) != 0) {
+        free(probe);
+        return false;
+    }
+    for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+        if (ops[i] > probe->last_op
+            || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+            result = false;
+        }
+    }
+    free(probe);
+    return result;
+}
+
+/* Returns -1 if io_uring isn't available; the caller will fall back on the
+ * thread pool, so this doesn't record an error. */
+static int
+s0_io_uring_init(struct s0_io *io, unsigned int queue_depth)
+{
+    struct s0_io_uring  *uring = &io->uring;
+    struct io_uring_params  params;
+    size_t  sq_size;
+    size_t  cq_size;
+    struct iovec  *iovecs;
+    size_t  i;
+
+    memset(&params, 0, sizeof(params));
+    uring->fd = syscall(__NR_io_uring_setup, queue_depth, &params);
+    if (uring->fd == -1) {
+        return -1;
+    }
+
+    /* Reading from the current file position needs 5.6 or later. */
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)
+        || !(params.features & IORING_FEAT_RW_CUR_POS)
+        || !s0_io_uring_supports_ops(uring->fd)) {
+        close(uring->fd);
+        return -1;
+    }
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_size = params.cq_off.cqes
+        + params.cq_entries * sizeof(struct io_uring_cqe);
+    uring->ring_size = (sq_size > cq_size)? sq_size: cq_size;
+    uring->ring = mmap(NULL, uring->ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, uring->fd,
+                       IORING_OFF_SQ_RING);
+    if (uring->ring == MAP_FAILED) {
+        close(uring->fd);
+        return -1;
+    }
+
+    uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+    if (uring->sqes == MAP_FAILED) {
+        munmap(uring->ring, uring->ring_size);
+        close(uring->fd);
+        return -1;
+    }
+
+    uring->sq_head = (unsigned int *)
+        ((char *) uring->ring + params.sq_off.head);
+    uring->sq_tail = (unsigned int *)
+        ((char *) uring->ring + params.sq_off.tail);
+    uring->sq_mask = (unsigned int *)
+        ((char *) uring->ring + params.sq_off.ring_mask);
+    uring->sq_array = (unsigned int *)
+        ((char *) uring->ring + params.sq_off.array);
+    uring->sq_entries = params.sq_entries;
+    uring->cq_head = (unsigned int *)
+        ((char *) uring->ring + params.cq_off.head);
+    uring->cq_tail = (unsigned int *)
+        ((char *) uring->ring + params.cq_off.tail);
+    uring->cq_mask = (unsigned int *)
+        ((char *) uring->ring + params.cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe *)
+        ((char *) uring->ring + params.cq_off.cqes);
+    uring->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (uring->wake_fd == -1) {
+        munmap(uring->sqes, uring->sqes_size);
+        munmap(uring->ring, uring->ring_size);
+        close(uring->fd);
+        return -1;
+    }
+    uring->in_flight = 0;
+    uring->waiting = false;
+    pthread_mutex_init(&uring->lock, NULL);
+    pthread_cond_init(&uring->space_available, NULL);
+    /* The loop thread will submit this on its first iteration. */
+    s0_io_uring_arm_wake(uring);
+
+    /* Registering the read buffers lets the kernel skip pinning them on every
+     * read.  This can fail if the buffers are bigger than RLIMIT_MEMLOCK; we
+     * can still use them as ordinary buffers in that case. */
+    uring->fixed_buffers = false;
+    iovecs = malloc(io->buffer_count * sizeof(struct iovec));
+    if (likely(iovecs != NULL)) {
+        for (i = 0; i < io->buffer_count; i++) {
+            iovecs[i].iov_base = io->buffers + i * S0_IO_READ_SIZE;
+            iovecs[i].iov_len = S0_IO_READ_SIZE;
+        }
+        uring->fixed_buffers =
+            syscall(__NR_io_uring_register, uring->fd,
+                    IORING_REGISTER_BUFFERS, iovecs, io->buffer_count) == 0;
+        free(iovecs);
+    }
+
+    if (pthread_create(&uring->thread, NULL, s0_io_uring_run, io) != 0) {
+        s0_io_uring_done(uring, false);
+        return -1;
+    }
+    return 0;
+}
+
+#endif /* S0_HAVE_IO_URING */
+
+static void
+s0_io_submit(struct s0_io *io, struct s0_io_request *request)
+{
+#if defined(S0_HAVE_IO_URING)
+    if (io->backend == S0_IO_BACKEND_IO_URING) {
+        s0_io_uring_submit(&io->uring, request);
+        return;
+    }
+#endif
+    s0_io_threads_submit(&io->threads, request);
+}
+
+/* Methods */
+
+static struct s0_io_request *
+s0_io_request_new(struct s0_io *io, enum s0_io_op op)
+{
+    struct s0_io_request  *request = malloc(sizeof(struct s0_io_request));
+    if (unlikely(request == NULL)) {
+        s0_set_memory_error();
+        return NULL;
+    }
+    request->op = op;
+    request->io = io;
+    request->execution = NULL;
+    request->file = NULL;
+    request->path = NULL;
+    request->flags = 0;
+    request->buffer = NULL;
+    request->buffer_index = -1;
+    request->data = NULL;
+    request->written = 0;
+    request->result = 0;
+    request->error = NULL;
+    request->next = NULL;
+    return request;
+}
+
+/* Passes the result of a request that has already finished to the caller's
+ * `then` closure. */
+static struct s0_continuation
+s0_io_request_deliver(struct s0_io_request *request,
+                      struct s0_environment *env)
+{
+    int  rc;
+    struct s0_name  *name;
+    struct s0_entity  *entity;
+    struct s0_invocation  *invocation;
+
+    invocation = s0_io_request_result(request, &name, &entity);
+    if (unlikely(invocation == NULL)) {
+        return s0_error_continuation_;
+    }
+    if (name != NULL) {
+        rc = s0_environment_add(env, name, entity);
+        if (unlikely(rc != 0)) {
+            return s0_error_continuation_;
+        }
+    }
+    return s0_invocation_execute(invocation, env);
+}
+
+/* Starts a request on behalf of a primitive method.  If the current execution
+ * can be suspended, we hand the request off to the backend; otherwise we
+ * perform it right here. */
+static struct s0_continuation
+s0_io_request_start(struct s0_io_request *request, struct s0_environment *env)
+{
+    request->execution = s0_execution_current();
+    if (request->execution != NULL) {
+        s0_io_submit(request->io, request);
+        return s0_pending_continuation_;
+    }
+    s0_io_request_perform(request);
+    return s0_io_request_deliver(request, env);
+}
+
+/* Fails a request without starting it. */
+static struct s0_continuation
+s0_io_request_reject(struct s0_io_request *request, struct s0_environment *env,
+                     const char *error)
+{
+    request->result = -EINVAL;
+    request->error = error;
+    return s0_io_request_deliver(request, env);
+}
+
+/* Removes an input from env and returns it. */
+static struct s0_entity *
+s0_io_take_input(struct s0_environment *env, const char *name_str)
+{
+    struct s0_name  *name;
+    struct s0_entity  *entity;
+    name = s0_name_new_str(name_str);
+    if (unlikely(name == NULL)) {
+        return NULL;
+    }
+    entity = s0_environment_delete(env, name);
+    assert(entity != NULL);
+    s0_name_free(name);
+    return entity;
+}
+
+static int
+s0_io_open_flags(const struct s0_entity *mode)
+{
+    size_t  size = s0_literal_size(mode);
+    const char  *content = s0_literal_content(mode);
+    if (size == 1 && content[0] == 'r') {
+        return O_RDONLY;
+    } else if (size == 1 && content[0] == 'w') {
+        return O_WRONLY | O_CREAT | O_TRUNC;
+    } else if (size == 1 && content[0] == 'a') {
+        return O_WRONLY | O_CREAT | O_APPEND;
+    } else {
+        return -1;
+    }
+}
+
+static struct s0_continuation
+s0_io_open_execute(void *ud, struct s0_environment *env)
+{
+    struct s0_io  *io = ud;
+    struct s0_io_request  *request;
+    struct s0_entity  *path;
+    struct s0_entity  *mode;
+
+    /* We leave `self` in env, so that it's passed back to `then` as `io`. */
+    request = s0_io_request_new(io, S0_IO_OPEN);
+    if (unlikely(request == NULL)) {
+        return s0_error_continuation_;
+    }
+
+    path = s0_io_take_input(env, "path");
+    if (unlikely(path == NULL)) {
+        s0_io_request_free(request);
+        return s0_error_continuation_;
+    }
+    mode = s0_io_take_input(env, "mode");
+    if (unlikely(mode == NULL)) {
+        s0_entity_free(path);
+        s0_io_request_free(request);
+        return s0_error_continuation_;
+    }
+
+    if (s0_entity_kind(path) != S0_ENTITY_KIND_LITERAL
+        || s0_entity_kind(mode) != S0_ENTITY_KIND_LITERAL) {
+        s0_entity_free(path);
+        s0_entity_free(mode);
+        return s0_io_request_reject
+            (request, env, "path and mode must be literals");
+    }
+
+    request->flags = s0_io_open_flags(mode);
+    s0_entity_free(mode);
+    if (request->flags == -1) {
+        s0_entity_free(path);
+        return s0_io_request_reject
+            (request, env, "mode must be `r`, `w`, or `a`");
+    }
+
+    request->path = malloc(s0_literal_size(path) + 1);
+    if (unlikely(request->path == NULL)) {
+        s0_entity_free(path);
+        s0_io_request_free(request);
+        s0_set_memory_error();
+        return s0_error_continuation_;
+    }
+    memcpy(request->path, s0_literal_content(path), s0_literal_size(path));
+    request->path[s0_literal_size(path)] = '\0';
+    s0_entity_free(path);
+    return s0_io_request_start(request, env);
+}
+
+/* Creates a request that operates on `file`, taking a new reference to it. */
+static struct s0_io_request *
+s0_io_file_request_new(struct s0_io_file *file, enum s0_io_op op)
+{
+    struct s0_io_request  *request = s0_io_request_new(file->io, op);
+    if (unlikely(request == NULL)) {
+        return NULL;
+    }
+    s0_ref_count_increment(&file->ref_count);
+    request->file = file;
+    return request;
+}
+
+static struct s0_continuation
+s0_io_read_execute(void *ud, struct s0_environment *env)
+{
+    struct s0_io_request  *request = s0_io_file_request_new(ud, S0_IO_READ);
+    if (unlikely(request == NULL)) {
+        return s0_error_continuation_;
+    }
+    if (unlikely(s0_io_request_acquire_buffer(request) != 0)) {
+        s0_io_request_free(request);
+        return s0_error_continuation_;
+    }
+    return s0_io_request_start(request, env);
+}
+
+static struct s0_continuation
+s0_io_write_execute(void *ud, struct s0_environment *env)
+{
+    struct s0_io_request  *request = s0_io_file_request_new(ud, S0_IO_WRITE);
+    if (unlikely(request == NULL)) {
+        return s0_error_continuation_;
+    }
+    request->data = s0_io_take_input(env, "data");
+    if (unlikely(request->data == NULL)) {
+        s0_io_request_free(request);
+        return s0_error_continuation_;
+    }
+    if (s0_entity_kind(request->data) != S0_ENTITY_KIND_LITERAL) {
+        return s0_io_request_reject(request, env, "data must be a literal");
+    }
+    return s0_io_request_start(request, env);
+}
+
+static struct s0_continuation
+s0_io_close_execute(void *ud, struct s0_environment *env)
+{
+    struct s0_entity  *self;
+    struct s0_io_request  *request = s0_io_file_request_new(ud, S0_IO_CLOSE);
+    if (unlikely(request == NULL)) {
+        return s0_error_continuation_;
+    }
+    /* The request keeps the file open until it's done with it. */
+    self = s0_io_take_input(env, "self");
+    if (unlikely(self == NULL)) {
+        s0_io_request_free(request);
+        return s0_error_continuation_;
+    }
+    s0_entity_free(self);
+    return s0_io_request_start(request, env);
+}
+
+static void
+s0_io_open_free_ud(void *ud)
+{
+}
+
+/* Adds a primitive method to object, taking control of ud. */
+static int
+s0_io_add_method(struct s0_entity *object, const char *name_str,
+                 const struct s0_environment_type *inputs,
+                 struct s0_continuation cont,
+                 s0_primitive_method_free_f *free_ud)
+{
+    struct s0_name  *name;
+    struct s0_environment_type  *inputs_copy;
+    struct s0_entity  *method;
+
+    inputs_copy = s0_environment_type_new_copy(inputs);
+    if (unlikely(inputs_copy == NULL)) {
+        free_ud(cont.ud);
+        return -1;
+    }
+
+    method = s0_primitive_method_new(inputs_copy, cont, free_ud);
+    if (unlikely(method == NULL)) {
+        return -1;
+    }
+
+    name = s0_name_new_str(name_str);
+    if (unlikely(name == NULL)) {
+        s0_entity_free(method);
+        return -1;
+    }
+
+    return s0_object_add(object, name, method);
+}
+
+static struct s0_entity *
+s0_io_file_object_new(struct s0_io *io, int fd)
+{
+    static const struct {
+        const char  *name;
+        enum s0_io_op  op;
+        struct s0_continuation (*execute)(void *, struct s0_environment *);
+    } methods[] = {
+        { "read", S0_IO_READ, s0_io_read_execute },
+        { "write", S0_IO_WRITE, s0_io_write_execute },
+        { "close", S0_IO_CLOSE, s0_io_close_execute }
+    };
+    struct s0_entity  *object;
+    struct s0_io_file  *file;
+    size_t  i;
+
+    file = malloc(sizeof(struct s0_io_file));
+    if (unlikely(file == NULL)) {
+        close(fd);
+        s0_set_memory_error();
+        return NULL;
+    }
+    /* Each method holds a reference to the file; we hold one more while we're
+     * creating them. */
+    file->ref_count = 1;
+    file->io = io;
+    file->fd = fd;
+
+    object = s0_object_new();
+    if (unlikely(object == NULL)) {
+        s0_io_file_unref(file);
+        return NULL;
+    }
+
+    for (i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        struct s0_continuation  cont;
+        s0_ref_count_increment(&file->ref_count);
+        cont.ud = file;
+        cont.invoke = methods[i].execute;
+        if (unlikely(s0_io_add_method
+                     (object, methods[i].name, io->inputs[methods[i].op],
+                      cont, s0_io_file_unref) != 0)) {
+            s0_entity_free(object);
+            s0_io_file_unref(file);
+            return NULL;
+        }
+    }
+
+    s0_io_file_unref(file);
+    return object;
+}
+
+struct s0_entity *
+s0_io_object_new(struct s0_io *io)
+{
+    struct s0_entity  *object;
+    struct s0_continuation  cont;
+
+    object = s0_object_new();
+    if (unlikely(object == NULL)) {
+        return NULL;
+    }
+
+    cont.ud = io;
+    cont.invoke = s0_io_open_execute;
+    if (unlikely(s0_io_add_method
+                 (object, "open", io->inputs[S0_IO_OPEN], cont,
+                  s0_io_open_free_ud) != 0)) {
+        s0_entity_free(object);
+        return NULL;
+    }
+    return object;
+}
+
+/* Types and invocations */
+
+/* Creates an environment type where each of the NULL-terminated `names` can
+ * be any entity. */
+static struct s0_environment_type *
+s0_io_any_type_new(const char *const *names)
+{
+    struct s0_environment_type  *type = s0_environment_type_new();
+    if (unlikely(type == NULL)) {
+        return NULL;
+    }
+    for (; *names != NULL; names++) {
+        struct s0_name  *name;
+        struct s0_entity_type  *etype;
+        name = s0_name_new_str(*names);
+        if (unlikely(name == NULL)) {
+            s0_environment_type_free(type);
+            return NULL;
+        }
+        etype = s0_any_entity_type_new();
+        if (unlikely(etype == NULL)) {
+            s0_name_free(name);
+            s0_environment_type_free(type);
+            return NULL;
+        }
+        if (unlikely(s0_environment_type_add(type, name, etype) != 0)) {
+            s0_environment_type_free(type);
+            return NULL;
+        }
+    }
+    return type;
+}
+
+/* Adds `name: type` to env_type, taking control of type. */
+static int
+s0_io_type_add(struct s0_environment_type *env_type, const char *name_str,
+               struct s0_entity_type *type)
+{
+    struct s0_name  *name;
+    if (unlikely(type == NULL)) {
+        return -1;
+    }
+    name = s0_name_new_str(name_str);
+    if (unlikely(name == NULL)) {
+        s0_entity_type_free(type);
+        return -1;
+    }
+    return s0_environment_type_add(env_type, name, type);
+}
+
+/* Adds `name: branch` to branches, taking control of branch. */
+static int
+s0_io_branch_add(struct s0_environment_type_mapping *branches,
+                 const char *name_str, struct s0_environment_type *branch)
+{
+    struct s0_name  *name;
+    if (unlikely(branch == NULL)) {
+        return -1;
+    }
+    name = s0_name_new_str(name_str);
+    if (unlikely(name == NULL)) {
+        s0_environment_type_free(branch);
+        return -1;
+    }
+    return s0_environment_type_mapping_add(branches, name, branch);
+}
+
+/* Describes one of our methods.  `inputs` are its inputs besides `self` and
+ * `then`; `self` is the name that we pass `self` back as, or NULL if the
+ * method consumes it; `success` and `failure` are the entries that we pass to
+ * each branch of `then`. */
+struct s0_io_method_spec {
+    const char  *inputs[3];
+    const char  *self;
+    const char  *success[3];
+    const char  *failure[3];
+};
+
+static const struct s0_io_method_spec  s0_io_method_specs[S0_IO_OP_COUNT] = {
+    /* open */  { { "path", "mode", NULL }, "io",
+                  { "io", "file", NULL }, { "io", "error", NULL } },
+    /* read */  { { NULL }, "file",
+                  { "file", "data", NULL }, { "file", "error", NULL } },
+    /* write */ { { "data", NULL }, "file",
+                  { "file", NULL }, { "file", "error", NULL } },
+    /* close */ { { NULL }, NULL,
+                  { NULL }, { "error", NULL } }
+};
+
+static struct s0_environment_type *
+s0_io_method_inputs_new(const struct s0_io_method_spec *spec)
+{
+    struct s0_environment_type  *inputs;
+    struct s0_environment_type  *self_elements;
+    struct s0_environment_type_mapping  *branches;
+
+    inputs = s0_io_any_type_new(spec->inputs);
+    if (unlikely(inputs == NULL)) {
+        return NULL;
+    }
+
+    self_elements = s0_environment_type_new();
+    if (unlikely(self_elements == NULL)
+        || unlikely(s0_io_type_add
+                    (inputs, "self",
+                     s0_object_entity_type_new(self_elements)) != 0)) {
+        s0_environment_type_free(inputs);
+        return NULL;
+    }
+
+    branches = s0_environment_type_mapping_new();
+    if (unlikely(branches == NULL)) {
+        s0_environment_type_free(inputs);
+        return NULL;
+    }
+    if (unlikely(s0_io_branch_add
+                 (branches, "success", s0_io_any_type_new(spec->success)) != 0)
+        || unlikely(s0_io_branch_add
+                    (branches, "failure",
+                     s0_io_any_type_new(spec->failure)) != 0)) {
+        s0_environment_type_mapping_free(branches);
+        s0_environment_type_free(inputs);
+        return NULL;
+    }
+    if (unlikely(s0_io_type_add
+                 (inputs, "then", s0_closure_entity_type_new(branches)) != 0)) {
+        s0_environment_type_free(inputs);
+        return NULL;
+    }
+    return inputs;
+}
+
+/* Creates the invocation that calls one branch of `then`.  The entries that
+ * we pass in keep their names, except that `self` becomes `self_str`. */
+static struct s0_invocation *
+s0_io_invocation_new(const char *branch_str, const char *const *names,
+                     const char *self_str)
+{
+    struct s0_name  *src;
+    struct s0_name  *branch;
+    struct s0_name_mapping  *params;
+
+    params = s0_name_mapping_new();
+    if (unlikely(params == NULL)) {
+        return NULL;
+    }
+    for (; *names != NULL; names++) {
+        const char  *from_str = *names;
+        struct s0_name  *from;
+        struct s0_name  *to;
+        if (self_str != NULL && strcmp(from_str, self_str) == 0) {
+            from_str = "self";
+        }
+        from = s0_name_new_str(from_str);
+        if (unlikely(from == NULL)) {
+            s0_name_mapping_free(params);
+            return NULL;
+        }
+        to = s0_name_new_str(*names);
+        if (unlikely(to == NULL)) {
+            s0_name_free(from);
+            s0_name_mapping_free(params);
+            return NULL;
+        }
+        if (unlikely(s0_name_mapping_add(params, from, to) != 0)) {
+            s0_name_mapping_free(params);
+            return NULL;
+        }
+    }
+
+    src = s0_name_new_str("then");
+    if (unlikely(src == NULL)) {
+        s0_name_mapping_free(params);
+        return NULL;
+    }
+    branch = s0_name_new_str(branch_str);
+    if (unlikely(branch == NULL)) {
+        s0_name_free(src);
+        s0_name_mapping_free(params);
+        return NULL;
+    }
+    return s0_invoke_closure_new(src, branch, params);
+}
+
+/* Contexts */
+
+static void
+s0_io_free_tables(struct s0_io *io)
+{
+    size_t  i;
+    for (i = 0; i < S0_IO_OP_COUNT; i++) {
+        if (io->inputs[i] != NULL) {
+            s0_environment_type_free(io->inputs[i]);
+        }
+        if (io->invocations[i][S0_IO_SUCCESS] != NULL) {
+            s0_invocation_free(io->invocations[i][S0_IO_SUCCESS]);
+        }
+        if (io->invocations[i][S0_IO_FAILURE] != NULL) {
+            s0_invocation_free(io->invocations[i][S0_IO_FAILURE]);
+        }
+    }
+}
+
+static int
+s0_io_init_tables(struct s0_io *io)
+{
+    size_t  i;
+    memset(io->inputs, 0, sizeof(io->inputs));
+    memset(io->invocations, 0, sizeof(io->invocations));
+    for (i = 0; i < S0_IO_OP_COUNT; i++) {
+        const struct s0_io_method_spec  *spec = &s0_io_method_specs[i];
+        io->inputs[i] = s0_io_method_inputs_new(spec);
+        io->invocations[i][S0_IO_SUCCESS] = s0_io_invocation_new
+            ("success", spec->success, spec->self);
+        io->invocations[i][S0_IO_FAILURE] = s0_io_invocation_new
+            ("failure", spec->failure, spec->self);
+        if (unlikely(io->inputs[i] == NULL)
+            || unlikely(io->invocations[i][S0_IO_SUCCESS] == NULL)
+            || unlikely(io->invocations[i][S0_IO_FAILURE] == NULL)) {
+            s0_io_free_tables(io);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+struct s0_io *
+s0_io_new(enum s0_io_backend backend)
+{
+    size_t  i;
+    struct s0_io  *io = malloc(sizeof(struct s0_io));
+    if (unlikely(io == NULL)) {
+        s0_set_memory_error();
+        return NULL;
+    }
+
+    if (unlikely(s0_io_init_tables(io) != 0)) {
+        free(io);
+        return NULL;
+    }
+
+    io->buffer_count = DEFAULT_IO_BUFFER_COUNT;
+    io->buffers = malloc(io->buffer_count * S0_IO_READ_SIZE);
+    io->free_buffers = malloc(io->buffer_count * sizeof(int));
+    if (unlikely(io->buffers == NULL || io->free_buffers == NULL)) {
+        free(io->buffers);
+        free(io->free_buffers);
+        s0_io_free_tables(io);
+        free(io);
+        s0_set_memory_error();
+        return NULL;
+    }
+    for (i = 0; i < io->buffer_count; i++) {
+        io->free_buffers[i] = io->buffer_count - i - 1;
+    }
+    io->free_buffer_count = io->buffer_count;
+    pthread_mutex_init(&io->buffer_lock, NULL);
+
+#if defined(S0_HAVE_IO_URING)
+    if (backend == S0_IO_BACKEND_DEFAULT
+        || backend == S0_IO_BACKEND_IO_URING) {
+        if (s0_io_uring_init(io, DEFAULT_IO_QUEUE_DEPTH) == 0) {
+            io->backend = S0_IO_BACKEND_IO_URING;
+            return io;
+        }
+    }
+#endif
+    if (backend == S0_IO_BACKEND_IO_URING) {
+        s0_set_error(S0_ERROR_UNKNOWN, "io_uring isn't available");
+    } else if (s0_io_threads_init(&io->threads, DEFAULT_IO_THREAD_COUNT)
+               == 0) {
+        io->backend = S0_IO_BACKEND_THREADS;
+        return io;
+    }
+
+    pthread_mutex_destroy(&io->buffer_lock);
+    free(io->buffers);
+    free(io->free_buffers);
+    s0_io_free_tables(io);
+    free(io);
+    return NULL;
+}
+
+void
+s0_io_free(struct s0_io *io)
+{
+#if defined(S0_HAVE_IO_URING)
+    if (io->backend == S0_IO_BACKEND_IO_URING) {
+        s0_io_uring_done(&io->uring, true);
+    }
+#endif
+    if (io->backend == S0_IO_BACKEND_THREADS) {
+        s0_io_threads_done(&io->threads, io->threads.thread_count);
+    }
+    assert(io->free_buffer_count == io->buffer_count);
+    pthread_mutex_destroy(&io->buffer_lock);
+    free(io->buffers);
+    free(io->free_buffers);
+    s0_io_free_tables(io);
+    free(io);
+}
+
+enum s0_io_backend
+s0_io_backend(const struct s0_io *io)
+{
+    return io->backend;
+}
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: Isolates and channels
+ */
+
+/* Channels */
+
+struct s0_channel_node {
+    struct s0_channel_node  *next;
+    struct s0_entity  *message;
+};
+
+/* The inputs of the `send` and `receive` primitives, and what they invoke.
+ * Shared-memory rings offer the same primitives. */
+struct s0_channel_methods {
+    struct s0_environment_type  *send_inputs;
+    struct s0_environment_type  *receive_inputs;
+    struct s0_invocation  *sent;
+    struct s0_invocation  *received;
+};
+
+/* The queue is Vyukov's intrusive MPSC queue.  Senders swap their node into
+ * `head` with a single atomic exchange, and then link the previous head to it;
+ * the receiver follows those links from `tail`.  The `stub` node means that
+ * the list is never completely empty, so senders never have to touch
+ * `tail`. */
+struct s0_channel {
+    size_t  ref_count;
+    struct s0_channel_node  *head;
+    struct s0_channel_node  *tail;
+    struct s0_channel_node  stub;
+    /* A receiver's execution that's suspended until a message arrives */
+    struct s0_execution  *waiting;
+    /* A message that the receiver took after a sender had already claimed
+     * `waiting`.  We deliver it once that sender completes the execution. */
+    struct s0_entity  *stash;
+    /* Lets receivers in synchronous executions sleep */
+    pthread_mutex_t  lock;
+    pthread_cond_t  not_empty;
+    size_t  sleepers;
+    struct s0_channel_methods  methods;
+};
+
+static void
+s0_channel_push(struct s0_channel *channel, struct s0_channel_node *node)
+{
+    struct s0_channel_node  *prev;
+    __atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+    prev = __atomic_exchange_n(&channel->head, node, __ATOMIC_SEQ_CST);
+    /* The receiver can't see node until we've linked it in. */
+    __atomic_store_n(&prev->next, node, __ATOMIC_SEQ_CST);
+}
+
+/* Returns NULL if the channel is empty, or if a sender has claimed the next
+ * spot in the queue but hasn't linked it in yet.  (That sender will wake up
+ * the receiver once it has.) */
+static struct s0_channel_node *
+s0_channel_pop(struct s0_channel *channel)
+{
+    struct s0_channel_node  *tail = channel->tail;
+    struct s0_channel_node  *next =
+        __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    struct s0_channel_node  *head;
+
+    if (tail == &channel->stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+        channel->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next != NULL) {
+        channel->tail = next;
+        return tail;
+    }
+
+    head = __atomic_load_n(&channel->head, __ATOMIC_ACQUIRE);
+    if (tail != head) {
+        return NULL;
+    }
+
+    /* tail is the last message; put the stub back behind it so that we can
+     * take it without leaving the list empty. */
+    s0_channel_push(channel, &channel->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next != NULL) {
+        channel->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+static struct s0_entity *
+s0_channel_take(struct s0_channel *channel)
+{
+    struct s0_entity  *message;
+    struct s0_channel_node  *node = s0_channel_pop(channel);
+    if (node == NULL) {
+        return NULL;
+    }
+    message = node->message;
+    free(node);
+    return message;
+}
+
+/* Blocks the calling thread until there's a message to take. */
+static struct s0_entity *
+s0_channel_wait(struct s0_channel *channel)
+{
+    struct s0_entity  *message;
+    pthread_mutex_lock(&channel->lock);
+    __atomic_add_fetch(&channel->sleepers, 1, __ATOMIC_SEQ_CST);
+    while ((message = s0_channel_take(channel)) == NULL) {
+        pthread_cond_wait(&channel->not_empty, &channel->lock);
+    }
+    __atomic_sub_fetch(&channel->sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&channel->lock);
+    return message;
+}
+
+static struct s0_continuation
+s0_channel_deliver(struct s0_channel *channel, struct s0_entity *message,
+                   struct s0_environment *env)
+{
+    struct s0_name  *name = s0_name_new_str("message");
+    if (unlikely(name == NULL)) {
+        s0_entity_free(message);
+        return s0_error_continuation_;
+    }
+    if (unlikely(s0_environment_add(env, name, message) != 0)) {
+        return s0_error_continuation_;
+    }
+    return s0_invocation_execute(channel->methods.received, env);
+}
+
+static struct s0_continuation
+s0_channel_receive_execute(void *ud, struct s0_environment *env)
+{
+    struct s0_channel  *channel = ud;
+    struct s0_execution  *execution;
+    struct s0_entity  *message;
+
+    if (channel->stash != NULL) {
+        message = channel->stash;
+        channel->stash = NULL;
+        return s0_channel_deliver(channel, message, env);
+    }
+
+    message = s0_channel_take(channel);
+    if (message != NULL) {
+        return s0_channel_deliver(channel, message, env);
+    }
+
+    execution = s0_execution_current();
+    if (execution == NULL) {
+        return s0_channel_deliver(channel, s0_channel_wait(channel), env);
+    }
+
+    /* Tell senders that we're waiting, and then check again, in case a
+     * message arrived before they could see us. */
+    assert(channel->waiting == NULL);
+    __atomic_store_n(&channel->waiting, execution, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    message = s0_channel_take(channel);
+    if (message == NULL) {
+        return s0_pending_continuation_;
+    }
+    if (__atomic_exchange_n(&channel->waiting, NULL, __ATOMIC_SEQ_CST)
+        != NULL) {
+        return s0_channel_deliver(channel, message, env);
+    }
+    /* A sender has already claimed the execution, and will complete it, which
+     * brings us back here. */
+    channel->stash = message;
+    return s0_pending_continuation_;
+}
+
+int
+s0_channel_send(struct s0_channel *channel, struct s0_entity *message)
+{
+    struct s0_channel_node  *node = malloc(sizeof(struct s0_channel_node));
+    if (unlikely(node == NULL)) {
+        s0_entity_free(message);
+        s0_set_memory_error();
+        return -1;
+    }
+    node->message = message;
+    s0_channel_push(channel, node);
+
+    if (__atomic_load_n(&channel->waiting, __ATOMIC_SEQ_CST) != NULL) {
+        struct s0_execution  *waiting = __atomic_exchange_n
+            (&channel->waiting, NULL, __ATOMIC_SEQ_CST);
+        if (waiting != NULL) {
+            struct s0_continuation  retry;
+            retry.ud = channel;
+            retry.invoke = s0_channel_receive_execute;
+            s0_execution_complete(waiting, NULL, NULL, retry);
+        }
+    }
+
+    if (__atomic_load_n(&channel->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&channel->lock);
+        pthread_cond_signal(&channel->not_empty);
+        pthread_mutex_unlock(&channel->lock);
+    }
+    return 0;
+}
+
+struct s0_entity *
+s0_channel_try_receive(struct s0_channel *channel)
+{
+    return s0_channel_take(channel);
+}
+
+static struct s0_continuation
+s0_channel_send_execute(void *ud, struct s0_environment *env)
+{
+    struct s0_channel  *channel = ud;
+    struct s0_entity  *message = s0_io_take_input(env, "message");
+    if (unlikely(message == NULL)) {
+        return s0_error_continuation_;
+    }
+    if (unlikely(s0_channel_send(channel, message) != 0)) {
+        return s0_error_continuation_;
+    }
+    return s0_invocation_execute(channel->methods.sent, env);
+}
+
+/* Creates the inputs of one of our methods: `self`, any of the
+ * NULL-terminated `inputs`, and a `then` closure whose `body` branch takes
+ * `outputs`. */
+static struct s0_environment_type *
+s0_channel_method_inputs_new(const char *const *inputs,
+                             const char *const *outputs)
+{
+    struct s0_environment_type  *type;
+    struct s0_environment_type  *self_elements;
+    struct s0_environment_type_mapping  *branches;
+
+    type = s0_io_any_type_new(inputs);
+    if (unlikely(type == NULL)) {
+        return NULL;
+    }
+
+    self_elements = s0_environment_type_new();
+    if (unlikely(self_elements == NULL)
+        || unlikely(s0_io_type_add
+                    (type, "self",
+                     s0_object_entity_type_new(self_elements)) != 0)) {
+        s0_environment_type_free(type);
+        return NULL;
+    }
+
+    branches = s0_environment_type_mapping_new();
+    if (unlikely(branches == NULL)) {
+        s0_environment_type_free(type);
+        return NULL;
+    }
+    if (unlikely(s0_io_branch_add
+                 (branches, "body", s0_io_any_type_new(outputs)) != 0)) {
+        s0_environment_type_mapping_free(branches);
+        s0_environment_type_free(type);
+        return NULL;
+    }
+    if (unlikely(s0_io_type_add
+                 (type, "then", s0_closure_entity_type_new(branches)) != 0)) {
+        s0_environment_type_free(type);
+        return NULL;
+    }
+    return type;
+}
+
+/* Adds `from: to` to params. */
+static int
+s0_channel_param_add(struct s0_name_mapping *params, const char *from_str,
+                     const char *to_str)
+{
+    struct s0_name  *from;
+    struct s0_name  *to;
+    from = s0_name_new_str(from_str);
+    if (unlikely(from == NULL)) {
+        return -1;
+    }
+    to = s0_name_new_str(to_str);
+    if (unlikely(to == NULL)) {
+        s0_name_free(from);
+        return -1;
+    }
+    return s0_name_mapping_add(params, from, to);
+}
+
+/* Creates the invocation that calls the `body` branch of `then`, passing in
+ * `self` as `self_name`, and `message` if there is one. */
+static struct s0_invocation *
+s0_channel_invocation_new(const char *self_name, bool has_message)
+{
+    struct s0_name  *src;
+    struct s0_name  *branch;
+    struct s0_name_mapping  *params;
+
+    params = s0_name_mapping_new();
+    if (unlikely(params == NULL)) {
+        return NULL;
+    }
+    if (unlikely(s0_channel_param_add(params, "self", self_name) != 0)
+        || (has_message
+            && unlikely(s0_channel_param_add
+                        (params, "message", "message") != 0))) {
+        s0_name_mapping_free(params);
+        return NULL;
+    }
+
+    src = s0_name_new_str("then");
+    if (unlikely(src == NULL)) {
+        s0_name_mapping_free(params);
+        return NULL;
+    }
+    branch = s0_name_new_str("body");
+    if (unlikely(branch == NULL)) {
+        s0_name_free(src);
+        s0_name_mapping_free(params);
+        return NULL;
+    }
+    return s0_invoke_closure_new(src, branch, params);
+}
+
+static void
+s0_channel_methods_done(struct s0_channel_methods *methods)
+{
+    if (methods->send_inputs != NULL) {
+        s0_environment_type_free(methods->send_inputs);
+    }
+    if (methods->receive_inputs != NULL) {
+        s0_environment_type_free(methods->receive_inputs);
+    }
+    if (methods->sent != NULL) {
+        s0_invocation_free(methods->sent);
+    }
+    if (methods->received != NULL) {
+        s0_invocation_free(methods->received);
+    }
+}
+
+static int
+s0_channel_methods_init(struct s0_channel_methods *methods)
+{
+    static const char  *const send_inputs[] = { "message", NULL };
+    static const char  *const send_outputs[] = { "sender", NULL };
+    static const char  *const receive_inputs[] = { NULL };
+    static const char  *const receive_outputs[] = {
+        "receiver", "message", NULL
+    };
+    methods->send_inputs =
+        s0_channel_method_inputs_new(send_inputs, send_outputs);
+    methods->receive_inputs =
+        s0_channel_method_inputs_new(receive_inputs, receive_outputs);
+    methods->sent = s0_channel_invocation_new("sender", false);
+    methods->received = s0_channel_invocation_new("receiver", true);
+    if (unlikely(methods->send_inputs == NULL)
+        || unlikely(methods->receive_inputs == NULL)
+        || unlikely(methods->sent == NULL)
+        || unlikely(methods->received == NULL)) {
+        s0_channel_methods_done(methods);
+        return -1;
+    }
+    return 0;
+}
+
+struct s0_channel *
+s0_channel_new(void)
+{
+    struct s0_channel  *channel = malloc(sizeof(struct s0_channel));
+    if (unlikely(channel == NULL)) {
+        s0_set_memory_error();
+        return NULL;
+    }
+
+    if (unlikely(s0_channel_methods_init(&channel->methods) != 0)) {
+        free(channel);
+        return NULL;
+    }
+
+    channel->ref_count = 1;
+    channel->stub.next = NULL;
+    channel->stub.message = NULL;
+    channel->head = &channel->stub;
+    channel->tail = &channel->stub;
+    channel->waiting = NULL;
+    channel->stash = NULL;
+    pthread_mutex_init(&channel->lock, NULL);
+    pthread_cond_init(&channel->not_empty, NULL);
+    channel->sleepers = 0;
+    return channel;
+}
+
+void
+s0_channel_free(struct s0_channel *channel)
+{
+    struct s0_entity  *message;
+    if (!s0_ref_count_decrement(&channel->ref_count)) {
+        return;
+    }
+    assert(channel->waiting == NULL);
+    while ((message = s0_channel_take(channel)) != NULL) {
+        s0_entity_free(message);
+    }
+    if (channel->stash != NULL) {
+        s0_entity_free(channel->stash);
+    }
+    pthread_cond_destroy(&channel->not_empty);
+    pthread_mutex_destroy(&channel->lock);
+    s0_channel_methods_done(&channel->methods);
+    free(channel);
+}
+
+static void
+s0_channel_unref(void *ud)
+{
+    s0_channel_free(ud);
+}
+
+/* Creates an object with a single primitive method.  The method holds its own
+ * reference (counted by `ref_count`) to ud, which it releases with
+ * `free_ud`. */
+static struct s0_entity *
+s0_channel_object_new(void *ud, size_t *ref_count, const char *method_name,
+                      const struct s0_environment_type *inputs,
+                      struct s0_continuation (*execute)
+                          (void *, struct s0_environment *),
+                      s0_primitive_method_free_f *free_ud)
+{
+    struct s0_entity  *object;
+    struct s0_continuation  cont;
+
+    object = s0_object_new();
+    if (unlikely(object == NULL)) {
+        return NULL;
+    }
+
+    s0_ref_count_increment(ref_count);
+    cont.ud = ud;
+    cont.invoke = execute;
+    if (unlikely(s0_io_add_method
+                 (object, method_name, inputs, cont, free_ud) != 0)) {
+        s0_entity_free(object);
+        return NULL;
+    }
+    return object;
+}
+
+struct s0_entity *
+s0_channel_sender_new(struct s0_channel *channel)
+{
+    return s0_channel_object_new
+        (channel, &channel->ref_count, "send", channel->methods.send_inputs,
+         s0_channel_send_execute, s0_channel_unref);
+}
+
+struct s0_entity *
+s0_channel_receiver_new(struct s0_channel *channel)
+{
+    return s0_channel_object_new
+        (channel, &channel->ref_count, "receive",
+         channel->methods.receive_inputs, s0_channel_receive_execute,
+         s0_channel_unref);
+}
+
+/* Isolates */
+
+struct s0_isolate {
+    struct s0_runtime  *runtime;
+    struct s0_event_loop  *loop;
+    pthread_t  thread;
+    /* Lets the isolate's thread sleep while it has nothing to run */
+    pthread_mutex_t  lock;
+    pthread_cond_t  work_available;
+    bool  stopping;
+};
+
+static void *
+s0_isolate_run(void *ud)
+{
+    struct s0_isolate  *isolate = ud;
+    s0_runtime_set_current(isolate->runtime);
+    pthread_mutex_lock(&isolate->lock);
+    for (;;) {
+        if (s0_event_loop_task_count(isolate->loop) > 0) {
+            pthread_mutex_unlock(&isolate->lock);
+            if (unlikely(s0_event_loop_run(isolate->loop) != 0)) {
+                /* The loop can't wait for events anymore, so none of the
+                 * suspended executions would ever finish. */
+                abort();
+            }
+            pthread_mutex_lock(&isolate->lock);
+        } else if (isolate->stopping) {
+            break;
+        } else {
+            pthread_cond_wait(&isolate->work_available, &isolate->lock);
+        }
+    }
+    pthread_mutex_unlock(&isolate->lock);
+    s0_runtime_set_current(NULL);
+    return NULL;
+}
+
+struct s0_isolate *
+s0_isolate_new(void)
+{
+    struct s0_isolate  *isolate = malloc(sizeof(struct s0_isolate));
+    if (unlikely(isolate == NULL)) {
+        s0_set_memory_error();
+        return NULL;
+    }
+
+    isolate->runtime = s0_runtime_new();
+    if (unlikely(isolate->runtime == NULL)) {
+        free(isolate);
+        return NULL;
+    }
+
+    isolate->loop = s0_event_loop_new();
+    if (unlikely(isolate->loop == NULL)) {
+        s0_runtime_free(isolate->runtime);
+        free(isolate);
+        return NULL;
+    }
+
+    pthread_mutex_init(&isolate->lock, NULL);
+    pthread_cond_init(&isolate->work_available, NULL);
+    isolate->stopping = false;
+    if (unlikely(pthread_create
+                 (&isolate->thread, NULL, s0_isolate_run, isolate) != 0)) {
+        pthread_cond_destroy(&isolate->work_available);
+        pthread_mutex_destroy(&isolate->lock);
+        s0_event_loop_free(isolate->loop);
+        s0_runtime_free(isolate->runtime);
+        free(isolate);
+        s0_set_error(S0_ERROR_UNKNOWN, "Cannot start isolate thread");
+        return NULL;
+    }
+    return isolate;
+}
+
+void
+s0_isolate_free(struct s0_isolate *isolate)
+{
+    pthread_mutex_lock(&isolate->lock);
+    isolate->stopping = true;
+    pthread_cond_signal(&isolate->work_available);
+    pthread_mutex_unlock(&isolate->lock);
+    pthread_join(isolate->thread, NULL);
+    pthread_cond_destroy(&isolate->work_available);
+    pthread_mutex_destroy(&isolate->lock);
+    s0_event_loop_free(isolate->loop);
+    s0_runtime_free(isolate->runtime);
+    free(isolate);
+}
+
+int
+s0_isolate_spawn(struct s0_isolate *isolate, struct s0_block *block,
+                 struct s0_environment *env,
+                 s0_event_loop_done_f *done, void *ud)
+{
+    if (unlikely(s0_event_loop_add(isolate->loop, block, env, done, ud) != 0)) {
+        return -1;
+    }
+    /* The loop's own wakeup is enough if it's already running; this covers
+     * the case where the isolate's thread is idle. */
+    pthread_mutex_lock(&isolate->lock);
+    pthread_cond_signal(&isolate->work_available);
+    pthread_mutex_unlock(&isolate->lock);
+    return 0;
+}
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: Binary encoding
+ */
+
+/* Each entity starts with a tag byte.  A literal's tag is followed by its
+ * size (as a LEB128 varint) and its content; an object's tag is followed by its
+ * number of entries, and then each entry's name (size and content) and
+ * entity. */
+#define S0_ENCODED_LITERAL  0x01
+#define S0_ENCODED_OBJECT   0x02
+
+/* Keeps a malicious message from exhausting our stack while decoding */
+#define MAX_DECODE_DEPTH  256
+
+static size_t
+s0_varint_size(size_t value)
+{
+    size_t  size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+static uint8_t *
+s0_varint_encode(uint8_t *dest, size_t value)
+{
+    while (value >= 0x80) {
+        *dest++ = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    *dest++ = (uint8_t) value;
+    return dest;
+}
+
+size_t
+s0_entity_encoded_size(const struct s0_entity *entity)
+{
+    size_t  size;
+    size_t  i;
+    size_t  count;
+
+    switch (s0_entity_kind(entity)) {
+        case S0_ENTITY_KIND_LITERAL:
+            size = s0_literal_size(entity);
+            return 1 + s0_varint_size(size) + size;
+
+        case S0_ENTITY_KIND_OBJECT:
+            count = s0_object_size(entity);
+            size = 1 + s0_varint_size(count);
+            for (i = 0; i < count; i++) {
+                struct s0_object_entry  entry = s0_object_at(entity, i);
+                size_t  name_size = s0_name_size(entry.name);
+                size_t  entity_size = s0_entity_encoded_size(entry.entity);
+                if (unlikely(entity_size == 0)) {
+                    s0_prefix_error
+                        ("In object entry `%s`:\n",
+                         s0_name_human_readable(entry.name));
+                    return 0;
+                }
+                size += s0_varint_size(name_size) + name_size + entity_size;
+            }
+            return size;
+
+        default:
+            s0_set_error
+                (S0_ERROR_UNKNOWN,
+                 "Can only encode literals and objects of them");
+            return 0;
+    }
+}
+
+static uint8_t *
+s0_entity_encode_into(const struct s0_entity *entity, uint8_t *dest)
+{
+    size_t  i;
+    size_t  count;
+
+    if (s0_entity_kind(entity) == S0_ENTITY_KIND_LITERAL) {
+        size_t  size = s0_literal_size(entity);
+        *dest++ = S0_ENCODED_LITERAL;
+        dest = s0_varint_encode(dest, size);
+        memcpy(dest, s0_literal_content(entity), size);
+        return dest + size;
+    }
+
+    assert(s0_entity_kind(entity) == S0_ENTITY_KIND_OBJECT);
+    count = s0_object_size(entity);
+    *dest++ = S0_ENCODED_OBJECT;
+    dest = s0_varint_encode(dest, count);
+    for (i = 0; i < count; i++) {
+        struct s0_object_entry  entry = s0_object_at(entity, i);
+        size_t  name_size = s0_name_size(entry.name);
+        dest = s0_varint_encode(dest, name_size);
+        memcpy(dest, s0_name_content(entry.name), name_size);
+        dest = s0_entity_encode_into(entry.entity, dest + name_size);
+    }
+    return dest;
+}
+
+void
+s0_entity_encode(const struct s0_entity *entity, void *dest)
+{
+    s0_entity_encode_into(entity, dest);
+}
+
+struct s0_decoder {
+    const uint8_t  *curr;
+    const uint8_t  *end;
+};
+
+static int
+s0_varint_decode(struct s0_decoder *decoder, size_t *value)
+{
+    unsigned int  shift = 0;
+    *value = 0;
+    while (decoder->curr < decoder->end && shift < sizeof(size_t) * 8) {
+        uint8_t  byte = *decoder->curr++;
+        *value |= (size_t) (byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return 0;
+        }
+        shift += 7;
+    }
+    s0_set_error(S0_ERROR_UNKNOWN, "Truncated or oversized length");
+    return -1;
+}
+
+/* Decodes a length, and makes sure that there are at least that many bytes
+ * left. */
+static int
+s0_decode_content(struct s0_decoder *decoder, size_t *size,
+                  const uint8_t **content)
+{
+    if (unlikely(s0_varint_decode(decoder, size) != 0)) {
+        return -1;
+    }
+    if (unlikely(*size > (size_t) (decoder->end - decoder->curr))) {
+        s0_set_error(S0_ERROR_UNKNOWN, "Truncated content");
+        return -1;
+    }
+    *content = decoder->curr;
+    decoder->curr += *size;
+    return 0;
+}
+
+static struct s0_entity *
+s0_entity_decode_from(struct s0_decoder *decoder, size_t depth)
+{
+    uint8_t  tag;
+    size_t  size;
+    const uint8_t  *content;
+    struct s0_entity  *object;
+    size_t  i;
+    size_t  count;
+
+    if (unlikely(decoder->curr == decoder->end)) {
+        s0_set_error(S0_ERROR_UNKNOWN, "Truncated entity");
+        return NULL;
+    }
+    tag = *decoder->curr++;
+
+    if (tag == S0_ENCODED_LITERAL) {
+        if (unlikely(s0_decode_content(decoder, &size, &content) != 0)) {
+            return NULL;
+        }
+        return s0_literal_new(size, content);
+    }
+
+    if (unlikely(tag != S0_ENCODED_OBJECT)) {
+        s0_set_error(S0_ERROR_UNKNOWN, "Unknown entity tag");
+        return NULL;
+    }
+    if (unlikely(depth == MAX_DECODE_DEPTH)) {
+        s0_set_error(S0_ERROR_UNKNOWN, "Objects are nested too deeply");
+        return NULL;
+    }
+    if (unlikely(s0_varint_decode(decoder, &count) != 0)) {
+        return NULL;
+    }
+
+    object = s0_object_new();
+    if (unlikely(object == NULL)) {
+        return NULL;
+    }
+    for (i = 0; i < count; i++) {
+        struct s0_name  *name;
+        struct s0_entity  *entity;
+        if (unlikely(s0_decode_content(decoder, &size, &content) != 0)) {
+            s0_entity_free(object);
+            return NULL;
+        }
+        name = s0_name_new(size, content);
+        if (unlikely(name == NULL)) {
+            s0_entity_free(object);
+            return NULL;
+        }
+        if (unlikely(s0_object_get(object, name) != NULL)) {
+            s0_set_error
+                (S0_ERROR_UNKNOWN, "Duplicate object entry `%s`",
+                 s0_name_human_readable(name));
+            s0_name_free(name);
+            s0_entity_free(object);
+            return NULL;
+        }
+        entity = s0_entity_decode_from(decoder, depth + 1);
+        if (unlikely(entity == NULL)) {
+            s0_name_free(name);
+            s0_entity_free(object);
+            return NULL;
+        }
+        if (unlikely(s0_object_add(object, name, entity) != 0)) {
+            s0_entity_free(object);
+            return NULL;
+        }
+    }
+    return object;
+}
+
+struct s0_entity *
+s0_entity_decode(const void *src, size_t size)
+{
+    struct s0_decoder  decoder;
+    struct s0_entity  *entity;
+    decoder.curr = src;
+    decoder.end = decoder.curr + size;
+    entity = s0_entity_decode_from(&decoder, 0);
+    if (unlikely(entity != NULL && decoder.curr != decoder.end)) {
+        s0_set_error(S0_ERROR_UNKNOWN, "Extra bytes after entity");
+        s0_entity_free(entity);
+        return NULL;
+    }
+    return entity;
+}
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: Shared-memory rings
+ */
+
+#define SHM_RING_MAGIC  0x53305247  /* "S0RG" */
+#define SHM_RING_CACHE_LINE  64
+/* Marks the unused space at the end of the ring when a record didn't fit */
+#define SHM_RING_WRAP  UINT32_MAX
+
+/* Lives at the start of the shared memory object, followed by the data
+ * area.  Each side's fields get their own cache line, so that the sender and
+ * receiver don't bounce a line back and forth on every message.  Positions are
+ * byte offsets that only ever grow; they wrap around the data area modulo its
+ * capacity, which is a power of two. */
+struct s0_shm_ring_header {
+    uint32_t  magic;
+    uint32_t  capacity;
+    char  pad0[SHM_RING_CACHE_LINE - 2 * sizeof(uint32_t)];
+    /* Written by the receiver */
+    uint64_t  head;
+    /* A futex that the receiver bumps after consuming a record */
+    uint32_t  space_seq;
+    uint32_t  sender_waiting;
+    char  pad1[SHM_RING_CACHE_LINE - sizeof(uint64_t) - 2 * sizeof(uint32_t)];
+    /* Written by the sender */
+    uint64_t  tail;
+    /* A futex that the sender bumps after publishing a record */
+    uint32_t  data_seq;
+    uint32_t  receiver_waiting;
+    char  pad2[SHM_RING_CACHE_LINE - sizeof(uint64_t) - 2 * sizeof(uint32_t)];
+};
+
+struct s0_shm_ring;
+
+/* Waits on one of a ring's futexes on behalf of an execution that's parked on
+ * it.  Event loops and schedulers can't poll a futex, so instead of blocking
+ * one of their threads, a resumable execution hands the wait off to a thread
+ * of the ring's own, which completes the execution (retrying the primitive)
+ * once the other side makes progress.  Each direction of the ring gets its
+ * own watcher, which is only started the first time it's needed. */
+struct s0_shm_ring_watcher {
+    struct s0_shm_ring  *ring;
+    pthread_mutex_t  lock;
+    pthread_cond_t  cond;
+    pthread_t  thread;
+    bool  started;
+    bool  stopping;
+    /* The execution that's waiting, if any */
+    struct s0_execution  *execution;
+    /* What we're waiting for */
+    uint32_t  *seq;
+    uint32_t  *waiting;
+    bool  (*ready)(struct s0_shm_ring *ring, size_t arg);
+    size_t  arg;
+    struct s0_continuation  retry;
+};
+
+struct s0_shm_ring {
+    size_t  ref_count;
+    struct s0_shm_ring_header  *header;
+    uint8_t  *data;
+    size_t  mapping_size;
+    /* A private copy of the header's capacity, which we validated when we
+     * mapped the ring.  Anyone who can map the shared memory object can
+     * rewrite the header, so we never index the data area using anything that
+     * we haven't checked against this. */
+    size_t  capacity;
+    /* Only set for the ring that created the shared memory object, which
+     * unlinks it when it's freed */
+    char  *name;
+    struct s0_channel_methods  methods;
+    struct s0_shm_ring_watcher  send_watcher;
+    struct s0_shm_ring_watcher  receive_watcher;
+};
+
+static void
+s0_futex_wait(uint32_t *addr, uint32_t expected)
+{
+    /* We don't use FUTEX_PRIVATE_FLAG, since the other side of the ring is
+     * usually in another process. */
+    syscall(SYS_futex, addr, FUTEX_WAIT, expected, NULL, NULL, 0);
+}
+
+static void
+s0_futex_wake(uint32_t *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/* Bumps `seq`, and wakes up the other side if it's waiting on it.  `waiting`
+ * counts the threads (on either side) that are waiting on seq. */
+static void
+s0_shm_ring_notify(uint32_t *seq, uint32_t *waiting)
+{
+    __atomic_add_fetch(seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST)) {
+        s0_futex_wake(seq);
+    }
+}
+
+/* Sleeps until `seq` changes.  The caller MUST have already found that it has
+ * to wait; we check once more (via `ready`) after announcing that we're
+ * waiting, in case the other side didn't see the announcement. */
+static void
+s0_shm_ring_wait(struct s0_shm_ring *ring, uint32_t *seq, uint32_t *waiting,
+                 bool (*ready)(struct s0_shm_ring *, size_t), size_t arg)
+{
+    uint32_t  expected = __atomic_load_n(seq, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(waiting, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!ready(ring, arg)) {
+        s0_futex_wait(seq, expected);
+    }
+    __atomic_sub_fetch(waiting, 1, __ATOMIC_RELAXED);
+}
+
+static size_t
+s0_shm_ring_record_size(size_t payload_size)
+{
+    return (sizeof(uint32_t) + payload_size + 7) & ~(size_t) 7;
+}
+
+/* The positions live in shared memory too, so they're just as untrusted as
+ * the capacity in the header.  The sender can never be more than a full ring
+ * ahead of the receiver (and never behind it). */
+static bool
+s0_shm_ring_positions_valid(const struct s0_shm_ring *ring, uint64_t head,
+                            uint64_t tail)
+{
+    return tail - head <= ring->capacity;
+}
+
+static void
+s0_shm_ring_set_corrupt_error(void)
+{
+    s0_set_error(S0_ERROR_UNKNOWN, "Corrupt shared-memory ring");
+}
+
+/* Also returns true if the positions are corrupt, so that no one waits for
+ * space that will never appear; s0_shm_ring_send checks them again. */
+static bool
+s0_shm_ring_has_space(struct s0_shm_ring *ring, size_t needed)
+{
+    uint64_t  head = __atomic_load_n(&ring->header->head, __ATOMIC_ACQUIRE);
+    uint64_t  tail = ring->header->tail;
+    return !s0_shm_ring_positions_valid(ring, head, tail)
+        || tail + needed - head <= ring->capacity;
+}
+
+static bool
+s0_shm_ring_has_data(struct s0_shm_ring *ring, size_t unused)
+{
+    uint64_t  tail = __atomic_load_n(&ring->header->tail, __ATOMIC_ACQUIRE);
+    return tail != ring->header->head;
+}
+
+/* Sends message.  If there isn't room yet and `block` is false, we don't wait;
+ * instead we fill in *needed with how much space we'd need (which is what
+ * s0_shm_ring_has_space expects) and return 1. */
+static int
+s0_shm_ring_send_(struct s0_shm_ring *ring, const struct s0_entity *message,
+                  bool block, size_t *needed_out)
+{
+    struct s0_shm_ring_header  *header = ring->header;
+    size_t  capacity = ring->capacity;
+    size_t  size;
+    size_t  record_size;
+    size_t  offset;
+    size_t  needed;
+    uint64_t  head;
+    uint64_t  tail;
+
+    size = s0_entity_encoded_size(message);
+    if (unlikely(size == 0)) {
+        return -1;
+    }
+    record_size = s0_shm_ring_record_size(size);
+    /* Larger records might never fit once we account for wrapping. */
+    if (unlikely(record_size > capacity / 2)) {
+        s0_set_error
+            (S0_ERROR_UNKNOWN,
+             "Message of %zu bytes is too large for a ring of %zu bytes",
+             size, capacity);
+        return -1;
     }
 
-    rc = s0_name_mapping_add(params, from, to);
-    if (unlikely(rc != 0)) {
-        s0_environment_free(closed_over);
-        s0_statement_list_free(statements);
-        s0_name_free(src);
-        s0_name_free(method_name);
-        s0_name_mapping_free(params);
-        return NULL;
+    tail = header->tail;
+    offset = tail & (capacity - 1);
+    needed = record_size;
+    if (capacity - offset < record_size) {
+        needed += capacity - offset;
+    }
+    while (!s0_shm_ring_has_space(ring, needed)) {
+        if (!block) {
+            *needed_out = needed;
+            return 1;
+        }
+        s0_shm_ring_wait
+            (ring, &header->space_seq, &header->sender_waiting,
+             s0_shm_ring_has_space, needed);
+    }
+    head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+    if (unlikely(!s0_shm_ring_positions_valid(ring, head, tail))) {
+        s0_shm_ring_set_corrupt_error();
+        return -1;
     }
 
-    from = s0_name_new_str("object");
-    if (unlikely(from == NULL)) {
-        s0_environment_free(closed_over);
-        s0_statement_list_free(statements);
-        s0_name_free(src);
-        s0_name_free(method_name);
-        s0_name_mapping_free(params);
-        return NULL;
+    if (needed != record_size) {
+        *(uint32_t *) (ring->data + offset) = SHM_RING_WRAP;
+        tail += capacity - offset;
+        offset = 0;
     }
+    *(uint32_t *) (ring->data + offset) = size;
+    s0_entity_encode(message, ring->data + offset + sizeof(uint32_t));
+    __atomic_store_n(&header->tail, tail + record_size, __ATOMIC_RELEASE);
+    s0_shm_ring_notify(&header->data_seq, &header->receiver_waiting);
+    return 0;
+}
 
-    to = s0_name_new_str("self");
-    if (unlikely(to == NULL)) {
-        s0_environment_free(closed_over);
-        s0_statement_list_free(statements);
-        s0_name_free(src);
-        s0_name_free(method_name);
-        s0_name_mapping_free(params);
-        s0_name_free(from);
-        return NULL;
+int
+s0_shm_ring_send(struct s0_shm_ring *ring, const struct s0_entity *message)
+{
+    return s0_shm_ring_send_(ring, message, true, NULL);
+}
+
+int
+s0_shm_ring_try_receive(struct s0_shm_ring *ring,
+                        struct s0_entity **message)
+{
+    struct s0_shm_ring_header  *header = ring->header;
+    size_t  capacity = ring->capacity;
+    uint64_t  head = header->head;
+    uint64_t  tail;
+    size_t  offset;
+    uint32_t  size;
+
+    *message = NULL;
+    tail = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+    if (tail == head) {
+        return 0;
+    }
+    if (unlikely(!s0_shm_ring_positions_valid(ring, head, tail))) {
+        s0_shm_ring_set_corrupt_error();
+        return -1;
     }
 
-    rc = s0_name_mapping_add(params, from, to);
-    if (unlikely(rc != 0)) {
-        s0_environment_free(closed_over);
-        s0_statement_list_free(statements);
-        s0_name_free(src);
-        s0_name_free(method_name);
-        s0_name_mapping_free(params);
-        return NULL;
+    offset = head & (capacity - 1);
+    size = *(uint32_t *) (ring->data + offset);
+    if (size == SHM_RING_WRAP) {
+        head += capacity - offset;
+        offset = 0;
+        size = *(uint32_t *) ring->data;
+    }
+    /* The record has to fit in the data area, and the sender has to have
+     * published all of it. */
+    if (unlikely(s0_shm_ring_record_size(size) > capacity - offset
+                 || head > tail
+                 || tail - head < s0_shm_ring_record_size(size))) {
+        s0_shm_ring_set_corrupt_error();
+        return -1;
     }
 
-    invocation = s0_invoke_method_new(src, method_name, params);
-    if (unlikely(invocation == NULL)) {
-        s0_environment_free(closed_over);
-        s0_statement_list_free(statements);
+    *message = s0_entity_decode(ring->data + offset + sizeof(uint32_t), size);
+    /* Skip over the record even if we can't decode it, so that the ring
+     * doesn't get stuck. */
+    __atomic_store_n
+        (&header->head, head + s0_shm_ring_record_size(size),
+         __ATOMIC_RELEASE);
+    s0_shm_ring_notify(&header->space_seq, &header->sender_waiting);
+    return (*message == NULL)? -1: 0;
+}
+
+struct s0_entity *
+s0_shm_ring_receive(struct s0_shm_ring *ring)
+{
+    struct s0_entity  *message;
+    while (!s0_shm_ring_has_data(ring, 0)) {
+        s0_shm_ring_wait
+            (ring, &ring->header->data_seq, &ring->header->receiver_waiting,
+             s0_shm_ring_has_data, 0);
+    }
+    if (unlikely(s0_shm_ring_try_receive(ring, &message) != 0)) {
         return NULL;
     }
+    return message;
+}
 
-    inputs = s0_environment_type_new();
-    if (unlikely(inputs == NULL)) {
-        s0_environment_free(closed_over);
-        s0_statement_list_free(statements);
-        s0_invocation_free(invocation);
-        return NULL;
+/* Watchers */
+
+static bool
+s0_shm_ring_watcher_ready(struct s0_shm_ring_watcher *watcher)
+{
+    return __atomic_load_n(&watcher->stopping, __ATOMIC_SEQ_CST)
+        || watcher->ready(watcher->ring, watcher->arg);
+}
+
+static void *
+s0_shm_ring_watcher_run(void *ud)
+{
+    struct s0_shm_ring_watcher  *watcher = ud;
+    pthread_mutex_lock(&watcher->lock);
+    for (;;) {
+        struct s0_execution  *execution;
+        while (watcher->execution == NULL && !watcher->stopping) {
+            pthread_cond_wait(&watcher->cond, &watcher->lock);
+        }
+        if (watcher->stopping) {
+            break;
+        }
+        execution = watcher->execution;
+        pthread_mutex_unlock(&watcher->lock);
+
+        /* This is s0_shm_ring_wait, except that s0_shm_ring_free can also
+         * wake us up. */
+        while (!s0_shm_ring_watcher_ready(watcher)) {
+            uint32_t  expected =
+                __atomic_load_n(watcher->seq, __ATOMIC_SEQ_CST);
+            __atomic_add_fetch(watcher->waiting, 1, __ATOMIC_SEQ_CST);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (!s0_shm_ring_watcher_ready(watcher)) {
+                s0_futex_wait(watcher->seq, expected);
+            }
+            __atomic_sub_fetch(watcher->waiting, 1, __ATOMIC_RELAXED);
+        }
+
+        pthread_mutex_lock(&watcher->lock);
+        watcher->execution = NULL;
+        if (watcher->stopping) {
+            break;
+        }
+        pthread_mutex_unlock(&watcher->lock);
+        s0_execution_complete(execution, NULL, NULL, watcher->retry);
+        pthread_mutex_lock(&watcher->lock);
     }
+    pthread_mutex_unlock(&watcher->lock);
+    return NULL;
+}
 
-    rc = s0_environment_type_add(inputs, input_name, result_type);
-    if (unlikely(rc != 0)) {
-        s0_environment_free(closed_over);
-        s0_statement_list_free(statements);
-        s0_invocation_free(invocation);
-        s0_environment_type_free(inputs);
-        return NULL;
+static int
+s0_shm_ring_watcher_init(struct s0_shm_ring_watcher *watcher,
+                         struct s0_shm_ring *ring,
+                         struct s0_continuation (*retry)
+                             (void *ud, struct s0_environment *env))
+{
+    if (unlikely(pthread_mutex_init(&watcher->lock, NULL) != 0)) {
+        s0_set_error(S0_ERROR_UNKNOWN, "Cannot create ring watcher lock");
+        return -1;
+    }
+    if (unlikely(pthread_cond_init(&watcher->cond, NULL) != 0)) {
+        pthread_mutex_destroy(&watcher->lock);
+        s0_set_error(S0_ERROR_UNKNOWN, "Cannot create ring watcher lock");
+        return -1;
     }
+    watcher->ring = ring;
+    watcher->started = false;
+    watcher->stopping = false;
+    watcher->execution = NULL;
+    watcher->seq = NULL;
+    watcher->waiting = NULL;
+    watcher->ready = NULL;
+    watcher->arg = 0;
+    watcher->retry.ud = ring;
+    watcher->retry.invoke = retry;
+    return 0;
+}
 
-    body = s0_block_new(inputs, statements, invocation);
-    if (unlikely(body == NULL)) {
-        s0_environment_free(closed_over);
-        return NULL;
+/* Stops the watcher's thread, if we ever started it.  No one can be parked on
+ * it, since they'd be holding a reference to the ring. */
+static void
+s0_shm_ring_watcher_done(struct s0_shm_ring_watcher *watcher)
+{
+    if (watcher->started) {
+        pthread_mutex_lock(&watcher->lock);
+        __atomic_store_n(&watcher->stopping, true, __ATOMIC_SEQ_CST);
+        pthread_cond_signal(&watcher->cond);
+        pthread_mutex_unlock(&watcher->lock);
+        if (watcher->seq != NULL) {
+            s0_shm_ring_notify(watcher->seq, watcher->waiting);
+        }
+        pthread_join(watcher->thread, NULL);
     }
+    pthread_cond_destroy(&watcher->cond);
+    pthread_mutex_destroy(&watcher->lock);
+}
 
-    blocks = s0_named_blocks_new();
-    if (unlikely(blocks == NULL)) {
-        s0_environment_free(closed_over);
-        s0_block_free(body);
-        return NULL;
+/* Parks `execution` until `ready` returns true, after which the watcher
+ * completes it with its retry continuation. */
+static int
+s0_shm_ring_watch(struct s0_shm_ring_watcher *watcher,
+                  struct s0_execution *execution, uint32_t *seq,
+                  uint32_t *waiting,
+                  bool (*ready)(struct s0_shm_ring *, size_t), size_t arg)
+{
+    int  rc;
+    pthread_mutex_lock(&watcher->lock);
+    if (unlikely(watcher->execution != NULL)) {
+        pthread_mutex_unlock(&watcher->lock);
+        s0_set_error
+            (S0_ERROR_UNKNOWN,
+             "Another execution is already waiting on this ring");
+        return -1;
     }
+    if (!watcher->started) {
+        rc = pthread_create
+            (&watcher->thread, NULL, s0_shm_ring_watcher_run, watcher);
+        if (unlikely(rc != 0)) {
+            pthread_mutex_unlock(&watcher->lock);
+            s0_set_error
+                (S0_ERROR_UNKNOWN, "Cannot start ring watcher: %s",
+                 strerror(rc));
+            return -1;
+        }
+        watcher->started = true;
+    }
+    watcher->execution = execution;
+    watcher->seq = seq;
+    watcher->waiting = waiting;
+    watcher->ready = ready;
+    watcher->arg = arg;
+    pthread_cond_signal(&watcher->cond);
+    pthread_mutex_unlock(&watcher->lock);
+    return 0;
+}
 
-    name = s0_name_new_str("body");
+
+/* Primitives */
+
+/* Synchronous executions wait for the other side right here.  Resumable ones
+ * (in an event loop or a scheduler) are parked instead, so that they don't tie
+ * up the thread that's running them; the ring's watcher retries the primitive
+ * once the other side has made progress. */
+
+static struct s0_continuation
+s0_shm_ring_send_execute(void *ud, struct s0_environment *env)
+{
+    int  rc;
+    struct s0_shm_ring  *ring = ud;
+    struct s0_execution  *execution = s0_execution_current();
+    struct s0_name  *name;
+    const struct s0_entity  *message;
+    size_t  needed;
+
+    name = s0_name_new_str("message");
     if (unlikely(name == NULL)) {
-        s0_environment_free(closed_over);
-        s0_block_free(body);
-        s0_named_blocks_free(blocks);
-        return NULL;
+        return s0_error_continuation_;
     }
+    message = s0_environment_get(env, name);
+    s0_name_free(name);
+    assert(message != NULL);
 
-    rc = s0_named_blocks_add(blocks, name, body);
+    rc = s0_shm_ring_send_(ring, message, execution == NULL, &needed);
+    if (rc == 1) {
+        rc = s0_shm_ring_watch
+            (&ring->send_watcher, execution, &ring->header->space_seq,
+             &ring->header->sender_waiting, s0_shm_ring_has_space, needed);
+        if (unlikely(rc != 0)) {
+            return s0_error_continuation_;
+        }
+        return s0_pending_continuation_;
+    }
     if (unlikely(rc != 0)) {
-        s0_environment_free(closed_over);
-        s0_named_blocks_free(blocks);
-        return NULL;
+        return s0_error_continuation_;
     }
-
-    return s0_closure_new(closed_over, blocks);
+    s0_entity_free(s0_io_take_input(env, "message"));
+    return s0_invocation_execute(ring->methods.sent, env);
 }
 
-
 static struct s0_continuation
-s0_finish_method_execute(void *ud, struct s0_environment *env)
+s0_shm_ring_receive_execute(void *ud, struct s0_environment *env)
 {
+    struct s0_shm_ring  *ring = ud;
+    struct s0_execution  *execution = s0_execution_current();
     struct s0_name  *name;
-    struct s0_entity  *self;
+    struct s0_entity  *message;
+
+    if (execution != NULL && !s0_shm_ring_has_data(ring, 0)) {
+        if (unlikely(s0_shm_ring_watch
+                     (&ring->receive_watcher, execution,
+                      &ring->header->data_seq,
+                      &ring->header->receiver_waiting,
+                      s0_shm_ring_has_data, 0) != 0)) {
+            return s0_error_continuation_;
+        }
+        return s0_pending_continuation_;
+    }
 
-    name = s0_name_new_str("self");
+    message = s0_shm_ring_receive(ring);
+    if (unlikely(message == NULL)) {
+        return s0_error_continuation_;
+    }
+    name = s0_name_new_str("message");
     if (unlikely(name == NULL)) {
+        s0_entity_free(message);
         return s0_error_continuation_;
     }
-
-    self = s0_environment_delete(env, name);
-    assert(self != NULL);
-    s0_name_free(name);
-    s0_entity_free(self);
-    return s0_finish_continuation_;
+    if (unlikely(s0_environment_add(env, name, message) != 0)) {
+        return s0_error_continuation_;
+    }
+    return s0_invocation_execute(ring->methods.received, env);
 }
 
-static void
-s0_finish_method_free_ud(void *ud)
+
+/* Rings */
+
+#define SHM_RING_MIN_CAPACITY  256
+
+/* Maps the ring in `fd`, taking control of fd. */
+static struct s0_shm_ring *
+s0_shm_ring_map(int fd, size_t mapping_size)
 {
-}
+    void  *mapping;
+    struct s0_shm_ring  *ring = malloc(sizeof(struct s0_shm_ring));
+    if (unlikely(ring == NULL)) {
+        close(fd);
+        s0_set_memory_error();
+        return NULL;
+    }
 
-static const struct s0_continuation s0_finish_method_continuation = {
-    NULL,
-    s0_finish_method_execute
-};
+    if (unlikely(s0_channel_methods_init(&ring->methods) != 0)) {
+        close(fd);
+        free(ring);
+        return NULL;
+    }
 
-static struct s0_entity *
-s0_finish_method_new(void)
+    if (unlikely(s0_shm_ring_watcher_init
+                 (&ring->send_watcher, ring, s0_shm_ring_send_execute) != 0)) {
+        close(fd);
+        s0_channel_methods_done(&ring->methods);
+        free(ring);
+        return NULL;
+    }
+    if (unlikely(s0_shm_ring_watcher_init
+                 (&ring->receive_watcher, ring,
+                  s0_shm_ring_receive_execute) != 0)) {
+        close(fd);
+        s0_shm_ring_watcher_done(&ring->send_watcher);
+        s0_channel_methods_done(&ring->methods);
+        free(ring);
+        return NULL;
+    }
+
+    mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+    close(fd);
+    if (unlikely(mapping == MAP_FAILED)) {
+        s0_set_error
+            (S0_ERROR_UNKNOWN, "Cannot map shared memory: %s",
+             strerror(errno));
+        s0_shm_ring_watcher_done(&ring->send_watcher);
+        s0_shm_ring_watcher_done(&ring->receive_watcher);
+        s0_channel_methods_done(&ring->methods);
+        free(ring);
+        return NULL;
+    }
+
+    ring->ref_count = 1;
+    ring->header = mapping;
+    ring->data = (uint8_t *) mapping + sizeof(struct s0_shm_ring_header);
+    ring->mapping_size = mapping_size;
+    ring->capacity = mapping_size - sizeof(struct s0_shm_ring_header);
+    ring->name = NULL;
+    return ring;
+}
+
+struct s0_shm_ring *
+s0_shm_ring_new(const char *name, size_t capacity)
 {
-    int  rc;
-    struct s0_environment_type  *inputs;
-    struct s0_name  *name;
-    struct s0_environment_type  *elements;
-    struct s0_entity_type  *type;
+    int  fd;
+    size_t  rounded = SHM_RING_MIN_CAPACITY;
+    size_t  mapping_size;
+    struct s0_shm_ring  *ring;
 
-    inputs = s0_environment_type_new();
-    if (unlikely(inputs == NULL)) {
+    while (rounded < capacity && rounded <= UINT32_MAX / 4) {
+        rounded *= 2;
+    }
+    if (unlikely(rounded < capacity)) {
+        s0_set_error
+            (S0_ERROR_UNKNOWN, "Ring capacity %zu is too large", capacity);
         return NULL;
     }
 
-    name = s0_name_new_str("self");
-    if (unlikely(name == NULL)) {
-        s0_environment_type_free(inputs);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (unlikely(fd == -1)) {
+        s0_set_error
+            (S0_ERROR_UNKNOWN, "Cannot create shared memory %s: %s",
+             name, strerror(errno));
         return NULL;
     }
 
-    elements = s0_environment_type_new();
-    if (unlikely(elements == NULL)) {
-        s0_environment_type_free(inputs);
-        s0_name_free(name);
+    /* ftruncate fills the new object with zeroes, which is how both positions
+     * and futexes start out. */
+    mapping_size = sizeof(struct s0_shm_ring_header) + rounded;
+    if (unlikely(ftruncate(fd, mapping_size) != 0)) {
+        s0_set_error
+            (S0_ERROR_UNKNOWN, "Cannot resize shared memory %s: %s",
+             name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
         return NULL;
     }
 
-    type = s0_object_entity_type_new(elements);
-    if (unlikely(type == NULL)) {
-        s0_environment_type_free(inputs);
-        s0_name_free(name);
+    ring = s0_shm_ring_map(fd, mapping_size);
+    if (unlikely(ring == NULL)) {
+        shm_unlink(name);
         return NULL;
     }
 
-    rc = s0_environment_type_add(inputs, name, type);
-    if (unlikely(rc != 0)) {
-        s0_environment_type_free(inputs);
+    ring->name = strdup(name);
+    if (unlikely(ring->name == NULL)) {
+        shm_unlink(name);
+        s0_shm_ring_free(ring);
+        s0_set_memory_error();
         return NULL;
     }
 
-    return s0_primitive_method_new
-        (inputs, s0_finish_method_continuation, s0_finish_method_free_ud);
+    ring->header->capacity = rounded;
+    /* Whoever opens the ring checks the magic number last. */
+    __atomic_store_n(&ring->header->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+    return ring;
 }
 
-struct s0_entity *
-s0_finish_new(void)
+struct s0_shm_ring *
+s0_shm_ring_open(const char *name)
 {
-    int  rc;
-    struct s0_entity  *object;
-    struct s0_name  *name;
-    struct s0_entity  *method;
+    int  fd;
+    struct stat  st;
+    struct s0_shm_ring  *ring;
 
-    object = s0_object_new();
-    if (unlikely(object == NULL)) {
+    fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+    if (unlikely(fd == -1)) {
+        s0_set_error
+            (S0_ERROR_UNKNOWN, "Cannot open shared memory %s: %s",
+             name, strerror(errno));
         return NULL;
     }
 
-    name = s0_name_new_str("finish");
-    if (unlikely(name == NULL)) {
-        s0_entity_free(object);
+    if (unlikely(fstat(fd, &st) != 0)) {
+        s0_set_error
+            (S0_ERROR_UNKNOWN, "Cannot inspect shared memory %s: %s",
+             name, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    if (unlikely((size_t) st.st_size < sizeof(struct s0_shm_ring_header))) {
+        s0_set_error
+            (S0_ERROR_UNKNOWN, "%s isn't a shared-memory ring", name);
+        close(fd);
         return NULL;
     }
 
-    method = s0_finish_method_new();
-    if (unlikely(method == NULL)) {
-        s0_entity_free(object);
-        s0_name_free(name);
+    ring = s0_shm_ring_map(fd, st.st_size);
+    if (unlikely(ring == NULL)) {
         return NULL;
     }
 
-    rc = s0_object_add(object, name, method);
-    if (unlikely(rc != 0)) {
-        s0_entity_free(object);
+    /* s0_shm_ring_map derived our copy of the capacity from the size of the
+     * object, which the header has to agree with. */
+    if (unlikely(__atomic_load_n(&ring->header->magic, __ATOMIC_ACQUIRE)
+                 != SHM_RING_MAGIC)
+        || unlikely(ring->header->capacity != ring->capacity)
+        || unlikely(ring->capacity < SHM_RING_MIN_CAPACITY)
+        || unlikely((ring->capacity & (ring->capacity - 1)) != 0)) {
+        s0_set_error
+            (S0_ERROR_UNKNOWN, "%s isn't a shared-memory ring", name);
+        s0_shm_ring_free(ring);
         return NULL;
     }
+    return ring;
+}
 
-    return object;
+void
+s0_shm_ring_free(struct s0_shm_ring *ring)
+{
+    if (!s0_ref_count_decrement(&ring->ref_count)) {
+        return;
+    }
+    s0_shm_ring_watcher_done(&ring->send_watcher);
+    s0_shm_ring_watcher_done(&ring->receive_watcher);
+    munmap(ring->header, ring->mapping_size);
+    if (ring->name != NULL) {
+        shm_unlink(ring->name);
+        free(ring->name);
+    }
+    s0_channel_methods_done(&ring->methods);
+    free(ring);
+}
+
+static void
+s0_shm_ring_unref(void *ud)
+{
+    s0_shm_ring_free(ud);
+}
+
+struct s0_entity *
+s0_shm_ring_sender_new(struct s0_shm_ring *ring)
+{
+    return s0_channel_object_new
+        (ring, &ring->ref_count, "send", ring->methods.send_inputs,
+         s0_shm_ring_send_execute, s0_shm_ring_unref);
+}
+
+struct s0_entity *
+s0_shm_ring_receiver_new(struct s0_shm_ring *ring)
+{
+    return s0_channel_object_new
+        (ring, &ring->ref_count, "receive", ring->methods.receive_inputs,
+         s0_shm_ring_receive_execute, s0_shm_ring_unref);
 }
@@ -25,6 +25,10 @@ struct s0_yaml_stream {
     FILE  *fp;
     bool  should_close_fp;
     bool  document_created;
+    /* While we're loading a module, where we record its blocks' locations,
+     * and the index of the block that we're currently inside of */
+    struct s0_source_map  *source_map;
+    size_t  source_parent;
     char  error[YAML_ERROR_SIZE];
 };
 
@@ -59,6 +63,7 @@ s0_yaml_stream_new_from_file(FILE *fp, const char *filename,
     stream->fp = fp;
     stream->document_created = false;
     stream->should_close_fp = should_close_fp;
+    stream->source_map = NULL;
     stream->error[0] = '\0';
     return stream;
 }
@@ -86,6 +91,7 @@ s0_yaml_stream_new_from_filename(const char *filename)
     stream->fp = NULL;
     stream->document_created = false;
     stream->should_close_fp = false;
+    stream->source_map = NULL;
     stream->error[0] = '\0';
     return stream;
 }
@@ -109,6 +115,7 @@ s0_yaml_stream_new_from_string(const char *str)
     stream->fp = NULL;
     stream->document_created = false;
     stream->should_close_fp = false;
+    stream->source_map = NULL;
     stream->error[0] = '\0';
     return stream;
 }
@@ -290,13 +297,27 @@ s0_yaml_node_mapping_get(const struct s0_yaml_node node, const char *needle)
     return result;
 }
 
+/* Names are interned in the current runtime's name table, so every mention of
+ * a name in a module shares a single instance. */
 static struct s0_name *
 s0_load_name(struct s0_yaml_node node)
 {
+    struct s0_name_table  *table;
+    struct s0_name  *name;
     ensure_scalar(node, "name");
-    return s0_name_new
-        (s0_yaml_node_get_node(node)->data.scalar.length,
+    table = s0_runtime_name_table(s0_runtime_current());
+    if (unlikely(table == NULL)) {
+        fill_memory_error(node.stream);
+        return NULL;
+    }
+    name = s0_name_table_intern
+        (table, s0_yaml_node_get_node(node)->data.scalar.length,
          s0_yaml_node_get_node(node)->data.scalar.value);
+    if (unlikely(name == NULL)) {
+        fill_memory_error(node.stream);
+        return NULL;
+    }
+    return name;
 }
 
 static struct s0_name_set *
@@ -591,7 +612,7 @@ s0_load_name_mapping(struct s0_yaml_node node)
 }
 
 static struct s0_block *
-s0_load_block(struct s0_yaml_node node,
+s0_load_block(struct s0_yaml_node node, const struct s0_name *name,
               struct s0_environment_type *closed_over);
 
 static struct s0_named_blocks *
@@ -628,7 +649,7 @@ s0_load_named_blocks(struct s0_yaml_node node,
         }
 
         item = s0_yaml_node_mapping_value_at(node, i);
-        block = s0_load_block(item, closed_over);
+        block = s0_load_block(item, name, closed_over);
         if (unlikely(block == NULL)) {
             s0_name_free(name);
             s0_named_blocks_free(blocks);
@@ -848,7 +869,7 @@ s0_load_create_method(struct s0_yaml_node node,
         return NULL;
     }
 
-    body = s0_load_block(item, NULL);
+    body = s0_load_block(item, dest, NULL);
     if (unlikely(body == NULL)) {
         s0_name_free(dest);
         return NULL;
@@ -1082,7 +1103,8 @@ s0_load_invocation(struct s0_yaml_node node, struct s0_environment_type *type)
 }
 
 static struct s0_block *
-s0_load_block(struct s0_yaml_node node, struct s0_environment_type *closed_over)
+s0_load_block_contents(struct s0_yaml_node node,
+                       struct s0_environment_type *closed_over)
 {
     int  rc;
     struct s0_yaml_node  item;
@@ -1171,22 +1193,117 @@ s0_load_block(struct s0_yaml_node node, struct s0_environment_type *closed_over)
     return s0_block_new(inputs, statements, invocation);
 }
 
+static int
+s0_add_source_position(struct s0_source_map *map, size_t index,
+                       struct s0_yaml_node node)
+{
+    const yaml_node_t  *yaml_node = s0_yaml_node_get_node(node);
+    return s0_source_map_add_position
+        (map, index, yaml_node->start_mark.line + 1,
+         yaml_node->start_mark.column + 1);
+}
+
+/* Records where each of a block's statements and its invocation were defined.
+ * We've already loaded the block, so we know that node is well-formed. */
+static int
+s0_load_block_positions(struct s0_yaml_node node, size_t index)
+{
+    struct s0_source_map  *map = node.stream->source_map;
+    struct s0_yaml_node  item;
+    size_t  i;
+    size_t  count;
+
+    item = s0_yaml_node_mapping_get(node, "statements");
+    count = s0_yaml_node_sequence_size(item);
+    for (i = 0; i < count; i++) {
+        if (unlikely(s0_add_source_position
+                     (map, index, s0_yaml_node_sequence_at(item, i)))) {
+            return -1;
+        }
+    }
+
+    item = s0_yaml_node_mapping_get(node, "invocation");
+    return s0_add_source_position(map, index, item);
+}
+
+/* Loads a block, and if we're loading a module, records where the block (and
+ * each of its statements) was defined in the module's source map.  `name` is
+ * what the block is called in the block that contains it, and can be NULL. */
+static struct s0_block *
+s0_load_block(struct s0_yaml_node node, const struct s0_name *name,
+              struct s0_environment_type *closed_over)
+{
+    struct s0_yaml_stream  *stream = node.stream;
+    const yaml_node_t  *yaml_node = s0_yaml_node_get_node(node);
+    size_t  parent = stream->source_parent;
+    size_t  index;
+    struct s0_block  *block;
+
+    if (stream->source_map == NULL) {
+        return s0_load_block_contents(node, closed_over);
+    }
+
+    if (unlikely(s0_source_map_add_block
+                 (stream->source_map, parent, name,
+                  yaml_node->start_mark.line + 1,
+                  yaml_node->start_mark.column + 1, &index))) {
+        fill_memory_error(stream);
+        return NULL;
+    }
+
+    /* Any blocks that we load while loading this one are nested inside of
+     * it. */
+    stream->source_parent = index;
+    block = s0_load_block_contents(node, closed_over);
+    stream->source_parent = parent;
+    if (unlikely(block == NULL)) {
+        return NULL;
+    }
+
+    /* The positions of any nested blocks were added while we loaded this
+     * block's statements, so now ours can be added contiguously. */
+    if (unlikely(s0_load_block_positions(node, index))) {
+        fill_memory_error(stream);
+        s0_block_free(block);
+        return NULL;
+    }
+    s0_block_set_source(block, stream->source_map, index);
+    return block;
+}
+
 static struct s0_entity *
 s0_load_module(struct s0_yaml_node root)
 {
+    struct s0_yaml_stream  *stream = root.stream;
     struct s0_block  *block;
     struct s0_environment  *env;
     struct s0_named_blocks  *blocks;
     struct s0_name  *name;
 
-    block = s0_load_block(root, NULL);
+    name = s0_name_new_str("module");
+    if (unlikely(name == NULL)) {
+        fill_memory_error(stream);
+        return NULL;
+    }
+
+    /* Each block that we load holds its own reference to the source map. */
+    stream->source_map = s0_source_map_new(stream->filename);
+    if (unlikely(stream->source_map == NULL)) {
+        fill_memory_error(stream);
+        s0_name_free(name);
+        return NULL;
+    }
+    stream->source_parent = S0_SOURCE_NO_PARENT;
+    block = s0_load_block(root, name, NULL);
+    s0_source_map_free(stream->source_map);
+    stream->source_map = NULL;
     if (unlikely(block == NULL)) {
+        s0_name_free(name);
         return NULL;
     }
 
     env = s0_environment_new();
     blocks = s0_named_blocks_new();
-    name = s0_name_new_str("module");
     if (unlikely(s0_named_blocks_add(blocks, name, block))) {
         s0_environment_free(env);
         s0_named_blocks_free(blocks);
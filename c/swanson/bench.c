@@ -0,0 +1,443 @@
+/* -*- coding: utf-8 -*-
+ * Copyright © 2016, Swanson Project.
+ * Please see the COPYING file in this distribution for license details.
+ */
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "swanson.h"
+#include "swanson/driver.h"
+#include "swanson/perf-counters.h"
+
+/*-----------------------------------------------------------------------------
+ * swanson bench
+ */
+
+#define DEFAULT_ITERATIONS  1000
+#define DEFAULT_WARMUP  100
+
+static void
+usage(FILE *out)
+{
+    fprintf(out,
+            "Usage: swanson bench [options] MODULE\n"
+            "\n"
+            "Executes the S₀ module in the YAML file MODULE repeatedly, with\n"
+            "a fresh set of inputs each time, and reports how long it takes.\n"
+            "\n"
+            "Options:\n"
+            "  -n, --iterations=N  Time N executions (default %d)\n"
+            "  -w, --warmup=N      Execute N times before timing anything\n"
+            "                      (default %d)\n"
+            "  --engine=ENGINE     Execute using ENGINE, which is one of\n"
+            "                      `direct` (the default), `event-loop`, or\n"
+            "                      `scheduler`\n"
+            "  --counters          Also read hardware performance counters,\n"
+            "                      and report them per executed statement\n"
+            "                      and per byte of YAML loaded\n"
+            "  --json              Print results as a JSON object\n"
+            "  -h, --help          Print this message\n",
+            DEFAULT_ITERATIONS, DEFAULT_WARMUP);
+}
+
+struct bench_results {
+    size_t  iterations;
+    /* Sorted, in seconds */
+    double  *latencies;
+    double  total;
+    size_t  allocations;
+    size_t  steps;
+    size_t  statements;
+    /* NULL unless we're reading hardware counters */
+    struct swanson_perf_counters  *counters;
+    /* Counted while executing */
+    struct swanson_perf_sample  execute;
+    /* Counted while loading the module */
+    struct swanson_perf_sample  load;
+    size_t  load_bytes;
+};
+
+static int
+compare_doubles(const void *a, const void *b)
+{
+    double  da = *(const double *) a;
+    double  db = *(const double *) b;
+    return (da < db)? -1: (da > db)? 1: 0;
+}
+
+static double
+percentile(const struct bench_results *results, double p)
+{
+    return results->latencies[(size_t) (p / 100 * (results->iterations - 1))];
+}
+
+/* Executes module once, and adds its measurements to results (if it's not
+ * NULL).  Creating and freeing the inputs is not included in the
+ * measurements. */
+static int
+bench_one(const char *filename, struct swanson_engine *engine,
+          struct s0_block *module, struct bench_results *results,
+          size_t index)
+{
+    struct swanson_inputs  inputs;
+    double  start;
+    double  elapsed;
+    size_t  start_steps;
+    size_t  start_statements;
+    size_t  start_allocations;
+    struct swanson_perf_sample  start_sample;
+    struct swanson_perf_sample  end_sample;
+    int  rc;
+
+    if (swanson_inputs_init(&inputs, module) != 0) {
+        return -1;
+    }
+
+    if (results != NULL && results->counters != NULL) {
+        swanson_perf_counters_read(results->counters, &start_sample);
+    }
+    start_allocations = s0_allocation_count();
+    start_statements = s0_execution_statement_count();
+    start_steps = s0_execution_step_count();
+    start = swanson_now();
+    rc = swanson_engine_execute(engine, module, &inputs);
+    elapsed = swanson_now() - start;
+    if (results != NULL && results->counters != NULL) {
+        swanson_perf_counters_read(results->counters, &end_sample);
+    }
+
+    if (rc != 0) {
+        fprintf(stderr, "%s: %s\n", filename, swanson_engine_error(engine));
+        swanson_inputs_done(&inputs);
+        return -1;
+    }
+
+    if (results != NULL) {
+        results->latencies[index] = elapsed;
+        results->total += elapsed;
+        results->steps += s0_execution_step_count() - start_steps;
+        results->statements +=
+            s0_execution_statement_count() - start_statements;
+        if (results->counters != NULL) {
+            swanson_perf_sample_accumulate
+                (&results->execute, &start_sample, &end_sample);
+        }
+        results->allocations +=
+            s0_allocation_count() - start_allocations;
+    }
+    swanson_inputs_done(&inputs);
+    return 0;
+}
+
+static void
+print_json_string(const char *str)
+{
+    putchar('"');
+    for (; *str != '\0'; str++) {
+        unsigned char  ch = *str;
+        if (ch == '"' || ch == '\\') {
+            printf("\\%c", ch);
+        } else if (ch < 0x20) {
+            printf("\\u%04x", ch);
+        } else {
+            putchar(ch);
+        }
+    }
+    putchar('"');
+}
+
+/* Prints `numerator / denominator`, or null if it's not defined. */
+static void
+print_json_ratio(bool available, double numerator, double denominator)
+{
+    if (available && denominator != 0) {
+        printf("%.3f", numerator / denominator);
+    } else {
+        printf("null");
+    }
+}
+
+static void
+print_json_counters(const struct bench_results *results)
+{
+    size_t  i;
+    printf(", \"counters\": {");
+    for (i = 0; i < SWANSON_PERF_COUNTER_COUNT; i++) {
+        bool  available =
+            swanson_perf_counter_available(results->counters, i);
+        printf("%s\"%s\": {\"per_statement\": ",
+               (i == 0)? "": ", ", swanson_perf_counter_name(i));
+        print_json_ratio(available, results->execute.values[i],
+                         results->statements);
+        printf(", \"per_yaml_byte\": ");
+        print_json_ratio(available, results->load.values[i],
+                         results->load_bytes);
+        printf("}");
+    }
+    printf("}");
+}
+
+static void
+print_json(const char *filename, enum swanson_engine_kind kind, size_t warmup,
+           const struct bench_results *results)
+{
+    double  n = results->iterations;
+    printf("{\"module\": ");
+    print_json_string(filename);
+    printf(", \"engine\": \"%s\"", swanson_engine_kind_name(kind));
+    printf(", \"iterations\": %zu", results->iterations);
+    printf(", \"warmup\": %zu", warmup);
+    printf(", \"runs_per_second\": %.3f", n / results->total);
+    printf(", \"latency_us\": {\"p50\": %.3f, \"p90\": %.3f, "
+           "\"p99\": %.3f, \"max\": %.3f}",
+           percentile(results, 50) * 1e6, percentile(results, 90) * 1e6,
+           percentile(results, 99) * 1e6, percentile(results, 100) * 1e6);
+    printf(", \"steps_per_run\": %.3f", results->steps / n);
+    printf(", \"statements_per_run\": %.3f", results->statements / n);
+    printf(", \"allocations_per_run\": %.3f", results->allocations / n);
+    if (results->counters != NULL) {
+        print_json_counters(results);
+    }
+    printf("}\n");
+}
+
+static void
+print_human_ratio(bool available, double numerator, double denominator)
+{
+    if (!available) {
+        printf("  %16s", "unavailable");
+    } else if (denominator == 0) {
+        printf("  %16s", "-");
+    } else {
+        printf("  %16.3f", numerator / denominator);
+    }
+}
+
+static void
+print_human_counters(const struct bench_results *results)
+{
+    size_t  i;
+    printf("\n%-14s  %16s  %16s\n",
+           "counter", "per statement", "per YAML byte");
+    for (i = 0; i < SWANSON_PERF_COUNTER_COUNT; i++) {
+        bool  available =
+            swanson_perf_counter_available(results->counters, i);
+        printf("%-14s", swanson_perf_counter_name(i));
+        print_human_ratio(available, results->execute.values[i],
+                          results->statements);
+        print_human_ratio(available, results->load.values[i],
+                          results->load_bytes);
+        printf("\n");
+    }
+}
+
+static void
+print_human(const char *filename, enum swanson_engine_kind kind,
+            size_t warmup, const struct bench_results *results)
+{
+    double  n = results->iterations;
+    printf("module:       %s\n", filename);
+    printf("engine:       %s\n", swanson_engine_kind_name(kind));
+    printf("iterations:   %zu (after %zu warmup)\n",
+           results->iterations, warmup);
+    printf("throughput:   %.1f runs/sec\n", n / results->total);
+    printf("latency p50:  %.3f µs\n", percentile(results, 50) * 1e6);
+    printf("latency p90:  %.3f µs\n", percentile(results, 90) * 1e6);
+    printf("latency p99:  %.3f µs\n", percentile(results, 99) * 1e6);
+    printf("latency max:  %.3f µs\n", percentile(results, 100) * 1e6);
+    printf("steps:        %.1f per run\n", results->steps / n);
+    printf("statements:   %.1f per run\n", results->statements / n);
+    printf("allocations:  %.1f per run\n", results->allocations / n);
+    if (results->counters != NULL) {
+        print_human_counters(results);
+    }
+}
+
+static int
+parse_count(const char *str, size_t *dest)
+{
+    char  *end;
+    unsigned long  value = strtoul(str, &end, 10);
+    if (*str == '\0' || *str == '-' || *end != '\0') {
+        return -1;
+    }
+    *dest = value;
+    return 0;
+}
+
+/* Loads the module, reading the counters (if any) while we do. */
+static struct s0_block *
+load_module(const char *filename, struct bench_results *results)
+{
+    struct swanson_perf_sample  start_sample;
+    struct swanson_perf_sample  end_sample;
+    struct s0_block  *module;
+    struct stat  st;
+
+    if (results->counters == NULL) {
+        return swanson_load_module(filename);
+    }
+
+    if (stat(filename, &st) == 0) {
+        results->load_bytes = st.st_size;
+    }
+    swanson_perf_counters_read(results->counters, &start_sample);
+    module = swanson_load_module(filename);
+    swanson_perf_counters_read(results->counters, &end_sample);
+    swanson_perf_sample_accumulate(&results->load, &start_sample, &end_sample);
+    return module;
+}
+
+static void
+free_counters(struct bench_results *results)
+{
+    if (results->counters != NULL) {
+        swanson_perf_counters_close(results->counters);
+    }
+}
+
+enum {
+    OPTION_ENGINE = 256,
+    OPTION_COUNTERS,
+    OPTION_JSON
+};
+
+static const struct option  options[] = {
+    { "iterations", required_argument, NULL, 'n' },
+    { "warmup", required_argument, NULL, 'w' },
+    { "engine", required_argument, NULL, OPTION_ENGINE },
+    { "counters", no_argument, NULL, OPTION_COUNTERS },
+    { "json", no_argument, NULL, OPTION_JSON },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+};
+
+int
+swanson_bench_main(int argc, char **argv)
+{
+    enum swanson_engine_kind  kind = SWANSON_ENGINE_DIRECT;
+    size_t  warmup = DEFAULT_WARMUP;
+    bool  json = false;
+    bool  use_counters = false;
+    struct swanson_perf_counters  counters;
+    const char  *filename;
+    struct s0_block  *module;
+    struct swanson_engine  *engine;
+    struct bench_results  results;
+    size_t  i;
+    int  opt;
+    int  rc;
+
+    results.iterations = DEFAULT_ITERATIONS;
+    while ((opt = getopt_long(argc, argv, "n:w:h", options, NULL)) != -1) {
+        switch (opt) {
+            case 'n':
+                if (parse_count(optarg, &results.iterations) != 0
+                        || results.iterations == 0) {
+                    fprintf(stderr, "Invalid iteration count `%s`\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'w':
+                if (parse_count(optarg, &warmup) != 0) {
+                    fprintf(stderr, "Invalid warmup count `%s`\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPTION_ENGINE:
+                if (swanson_engine_kind_parse(optarg, &kind) != 0) {
+                    fprintf(stderr, "Unknown engine `%s`\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPTION_COUNTERS:
+                use_counters = true;
+                break;
+            case OPTION_JSON:
+                json = true;
+                break;
+            case 'h':
+                usage(stdout);
+                return EXIT_SUCCESS;
+            default:
+                usage(stderr);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+    filename = argv[optind];
+
+    results.latencies = malloc(results.iterations * sizeof(double));
+    if (results.latencies == NULL) {
+        fprintf(stderr, "Cannot allocate %zu results\n", results.iterations);
+        return EXIT_FAILURE;
+    }
+    results.total = 0;
+    results.allocations = 0;
+    results.steps = 0;
+    results.statements = 0;
+    results.counters = NULL;
+    results.load_bytes = 0;
+    swanson_perf_sample_clear(&results.execute);
+    swanson_perf_sample_clear(&results.load);
+
+    /* Open the counters before the engine starts any worker threads, so that
+     * they're counted too. */
+    if (use_counters) {
+        if (swanson_perf_counters_open(&counters)) {
+            results.counters = &counters;
+        } else {
+            fprintf(stderr,
+                    "Hardware performance counters are unavailable: %s\n",
+                    strerror(counters.error));
+        }
+    }
+
+    module = load_module(filename, &results);
+    if (module == NULL) {
+        free_counters(&results);
+        free(results.latencies);
+        return EXIT_FAILURE;
+    }
+
+    engine = swanson_engine_new(kind);
+    if (engine == NULL) {
+        s0_block_free(module);
+        free_counters(&results);
+        free(results.latencies);
+        return EXIT_FAILURE;
+    }
+
+    rc = 0;
+    for (i = 0; rc == 0 && i < warmup; i++) {
+        rc = bench_one(filename, engine, module, NULL, i);
+    }
+    for (i = 0; rc == 0 && i < results.iterations; i++) {
+        rc = bench_one(filename, engine, module, &results, i);
+    }
+
+    if (rc == 0) {
+        qsort(results.latencies, results.iterations, sizeof(double),
+              compare_doubles);
+        if (json) {
+            print_json(filename, kind, warmup, &results);
+        } else {
+            print_human(filename, kind, warmup, &results);
+        }
+    }
+
+    swanson_engine_free(engine);
+    s0_block_free(module);
+    free_counters(&results);
+    free(results.latencies);
+    return (rc == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
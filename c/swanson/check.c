@@ -0,0 +1,323 @@
+/* -*- coding: utf-8 -*-
+ * Copyright © 2016, Swanson Project.
+ * Please see the COPYING file in this distribution for license details.
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "swanson.h"
+#include "swanson/directory-walker.h"
+#include "swanson/driver.h"
+
+/*-----------------------------------------------------------------------------
+ * swanson check
+ */
+
+static void
+usage(FILE *out)
+{
+    fprintf(out,
+            "Usage: swanson check [options] DIRECTORY...\n"
+            "\n"
+            "Loads and type-checks the S₀ module in each document of each\n"
+            "YAML file underneath each DIRECTORY, and reports how long\n"
+            "each file takes.\n"
+            "\n"
+            "Options:\n"
+            "  -j, --jobs=N  Check N files at a time (default: one per CPU)\n"
+            "  -h, --help    Print this message\n");
+}
+
+struct check_file {
+    char  *path;
+    /* Filled in by the worker that checks this file */
+    double  elapsed;
+    bool  failed;
+    /* NULL if we couldn't allocate a copy of the error */
+    char  *error;
+};
+
+struct check_files {
+    struct check_file  *files;
+    size_t  count;
+    size_t  allocated;
+    /* The next file that a worker should check */
+    size_t  next;
+    bool  out_of_memory;
+};
+
+static void
+check_files_add(int fd, const char *full_path, const char *rel_path,
+                void *ud)
+{
+    struct check_files  *files = ud;
+    char  *path;
+    if (files->out_of_memory) {
+        return;
+    }
+    if (files->count == files->allocated) {
+        size_t  new_allocated =
+            (files->allocated == 0)? 64: files->allocated * 2;
+        struct check_file  *new_files =
+            realloc(files->files, new_allocated * sizeof(struct check_file));
+        if (new_files == NULL) {
+            files->out_of_memory = true;
+            return;
+        }
+        files->files = new_files;
+        files->allocated = new_allocated;
+    }
+    path = strdup(full_path);
+    if (path == NULL) {
+        files->out_of_memory = true;
+        return;
+    }
+    files->files[files->count].path = path;
+    files->files[files->count].elapsed = 0;
+    files->files[files->count].failed = false;
+    files->files[files->count].error = NULL;
+    files->count++;
+}
+
+static void
+check_files_done(struct check_files *files)
+{
+    size_t  i;
+    for (i = 0; i < files->count; i++) {
+        free(files->files[i].path);
+        free(files->files[i].error);
+    }
+    free(files->files);
+}
+
+static int
+compare_check_files(const void *a, const void *b)
+{
+    const struct check_file  *fa = a;
+    const struct check_file  *fb = b;
+    return strcmp(fa->path, fb->path);
+}
+
+/* Appends the error from one of a file's documents to `error`, truncating it if
+ * it doesn't fit.  Returns the new length of `error`. */
+static size_t
+append_error(char *error, size_t length, size_t size, size_t doc_index,
+             const char *description)
+{
+    int  written;
+    if (length >= size - 1) {
+        return length;
+    }
+    written = snprintf(error + length, size - length, "%sdocument %zu: %s",
+                       (length == 0)? "": "\n", doc_index, description);
+    if (written < 0) {
+        return length;
+    }
+    length += written;
+    return (length < size)? length: size - 1;
+}
+
+/* Loads and type-checks the module in every document in the file.  A broken
+ * module doesn't stop us from checking the documents after it, but a YAML
+ * error does, since we can't tell where the next document starts. */
+static void
+check_one(struct check_file *file)
+{
+    char  error[SWANSON_MAX_ERROR_LENGTH];
+    char  doc_error[SWANSON_MAX_ERROR_LENGTH];
+    size_t  error_length = 0;
+    struct s0_yaml_stream  *stream;
+    size_t  doc_index;
+    double  start = swanson_now();
+
+    stream = s0_yaml_stream_new_from_filename(file->path);
+    if (stream == NULL) {
+        file->elapsed = swanson_now() - start;
+        file->failed = true;
+        file->error = strdup(s0_error_get_last_description());
+        return;
+    }
+
+    for (doc_index = 0; ; doc_index++) {
+        struct s0_yaml_node  doc = s0_yaml_stream_parse_document(stream);
+        struct s0_block  *module;
+        if (s0_yaml_node_is_error(doc)) {
+            error_length = append_error
+                (error, error_length, sizeof(error), doc_index,
+                 s0_yaml_stream_last_error(stream));
+            break;
+        }
+        if (s0_yaml_node_is_missing(doc)) {
+            if (doc_index == 0) {
+                error_length = append_error
+                    (error, error_length, sizeof(error), doc_index,
+                     "No module in file");
+            }
+            break;
+        }
+        module = swanson_try_parse_module(doc, doc_error, sizeof(doc_error));
+        if (module == NULL) {
+            error_length = append_error
+                (error, error_length, sizeof(error), doc_index, doc_error);
+        } else {
+            s0_block_free(module);
+        }
+    }
+    s0_yaml_stream_free(stream);
+
+    file->elapsed = swanson_now() - start;
+    if (error_length > 0) {
+        file->failed = true;
+        file->error = strdup(error);
+    }
+}
+
+/* Each worker claims the next unchecked file until there aren't any left. */
+static void *
+check_worker(void *ud)
+{
+    struct check_files  *files = ud;
+    for (;;) {
+        size_t  index = __atomic_fetch_add(&files->next, 1, __ATOMIC_RELAXED);
+        if (index >= files->count) {
+            return NULL;
+        }
+        check_one(&files->files[index]);
+    }
+}
+
+static void
+print_error(const char *error)
+{
+    const char  *nl;
+    if (error == NULL) {
+        printf("    (Cannot allocate error message)\n");
+        return;
+    }
+    nl = strchr(error, '\n');
+    while (nl != NULL) {
+        printf("    %.*s\n", (int) (nl - error), error);
+        error = nl + 1;
+        nl = strchr(error, '\n');
+    }
+    if (*error != '\0') {
+        printf("    %s\n", error);
+    }
+}
+
+static const struct option  options[] = {
+    { "jobs", required_argument, NULL, 'j' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+};
+
+int
+swanson_check_main(int argc, char **argv)
+{
+    long  cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t  job_count = (cpu_count > 0)? cpu_count: 1;
+    struct check_files  files = { NULL, 0, 0, 0, false };
+    pthread_t  *threads;
+    size_t  started;
+    size_t  failed;
+    double  start;
+    double  elapsed;
+    double  total;
+    size_t  i;
+    int  arg;
+    int  opt;
+
+    while ((opt = getopt_long(argc, argv, "j:h", options, NULL)) != -1) {
+        switch (opt) {
+            case 'j': {
+                char  *end;
+                long  value = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || value <= 0) {
+                    fprintf(stderr, "Invalid job count `%s`\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                job_count = value;
+                break;
+            }
+            case 'h':
+                usage(stdout);
+                return EXIT_SUCCESS;
+            default:
+                usage(stderr);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind == argc) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    for (arg = optind; arg < argc; arg++) {
+        if (walk_directory(argv[arg], check_files_add, &files) != 0) {
+            check_files_done(&files);
+            return EXIT_FAILURE;
+        }
+    }
+    if (files.out_of_memory) {
+        fprintf(stderr, "Cannot allocate list of files\n");
+        check_files_done(&files);
+        return EXIT_FAILURE;
+    }
+
+    /* There's no point in starting workers that won't have anything to do. */
+    if (job_count > files.count) {
+        job_count = (files.count == 0)? 1: files.count;
+    }
+    threads = malloc(job_count * sizeof(pthread_t));
+    if (threads == NULL) {
+        fprintf(stderr, "Cannot allocate %zu threads\n", job_count);
+        check_files_done(&files);
+        return EXIT_FAILURE;
+    }
+
+    /* The calling thread is one of the workers. */
+    start = swanson_now();
+    for (started = 0; started < job_count - 1; started++) {
+        if (pthread_create
+                (&threads[started], NULL, check_worker, &files) != 0) {
+            break;
+        }
+    }
+    check_worker(&files);
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    elapsed = swanson_now() - start;
+    free(threads);
+
+    /* Report the files in a stable order, regardless of the order that the
+     * directory walk or the workers got to them. */
+    qsort(files.files, files.count, sizeof(struct check_file),
+          compare_check_files);
+    failed = 0;
+    total = 0;
+    for (i = 0; i < files.count; i++) {
+        struct check_file  *file = &files.files[i];
+        total += file->elapsed;
+        if (!file->failed) {
+            printf("ok    %10.3f ms  %s\n", file->elapsed * 1e3, file->path);
+        } else {
+            failed++;
+            printf("FAIL  %10.3f ms  %s\n", file->elapsed * 1e3, file->path);
+            print_error(file->error);
+        }
+    }
+    printf("%zu files, %zu failed, in %.3f ms (%.3f ms of checking "
+           "with %zu jobs)\n",
+           files.count, failed, elapsed * 1e3, total * 1e3, started + 1);
+
+    check_files_done(&files);
+    return (failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
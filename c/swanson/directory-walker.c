@@ -3,31 +3,32 @@
  * Please see the COPYING file in this distribution for license details.
  */
 
-#include "directory-walker.h"
+#include "swanson/directory-walker.h"
 
 #include <assert.h>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
-#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
 #include "ccan/likely/likely.h"
 #include "ccan/str/str.h"
-#include "ccan/tap/tap.h"
 
 
-/* Process all of the direct child files and subdirectories of dir_fd.
- * walk_path should already contain the full relative path to the directory that
- * dir_fd refers to.  walk_path_end should point to the NUL terminator at the
- * end of that path. */
-static void
+/* Process all of the direct child files and subdirectories of dir_fd, which
+ * this function takes control of.  walk_path should already contain the full
+ * relative path to the directory that dir_fd refers to.  walk_path_end should
+ * point to the NUL terminator at the end of that path, and walk_path_limit
+ * just past the end of the buffer that walk_path lives in. */
+static int
 walk_directory_fd(int dir_fd, char *walk_path, char *walk_rel_path,
-                  char *walk_path_end, directory_walker_callback *callback,
-                  void *user_data)
+                  char *walk_path_end, const char *walk_path_limit,
+                  directory_walker_callback *callback, void *user_data)
 {
     DIR  *dir;
     struct dirent  *dirent;
@@ -35,8 +36,10 @@ walk_directory_fd(int dir_fd, char *walk_path, char *walk_rel_path,
 
     dir = fdopendir(dir_fd);
     if (unlikely(dir == NULL)) {
-        diag("Cannot open directory: %s", strerror(errno));
-        exit(EXIT_FAILURE);
+        fprintf(stderr, "Cannot open directory %s: %s\n",
+                walk_path, strerror(errno));
+        close(dir_fd);
+        return -1;
     }
 
     while ((dirent = readdir(dir)) != NULL) {
@@ -48,39 +51,60 @@ walk_directory_fd(int dir_fd, char *walk_path, char *walk_rel_path,
         }
 
         /* Append the child's base name to the directory's path, yielding the
-         * full relative path to the child. */
+         * full relative path to the child.  Leave room for the slash that we
+         * add if it's a directory, and for the NUL terminator. */
+        if (unlikely(strlen(dirent->d_name) + 2 >
+                     (size_t) (walk_path_limit - walk_path_end))) {
+            fprintf(stderr, "Cannot open file %s%s: %s\n",
+                    walk_path, dirent->d_name, strerror(ENAMETOOLONG));
+            closedir(dir);
+            errno = ENAMETOOLONG;
+            return -1;
+        }
         child_walk_path_end = stpcpy(walk_path_end, dirent->d_name);
 
         /* Open up the child to see whether it's a file or directory. */
         child_fd = openat(dir_fd, dirent->d_name, O_RDONLY);
-        if (child_fd == -1) {
-            diag("Cannot open file: %s", strerror(errno));
-            exit(EXIT_FAILURE);
+        if (unlikely(child_fd == -1)) {
+            fprintf(stderr, "Cannot open file %s: %s\n",
+                    walk_path, strerror(errno));
+            closedir(dir);
+            return -1;
         }
 
-        if (fstat(child_fd, &child_stat) == -1) {
-            diag("Cannot stat file: %s", strerror(errno));
-            exit(EXIT_FAILURE);
+        if (unlikely(fstat(child_fd, &child_stat) == -1)) {
+            fprintf(stderr, "Cannot stat file %s: %s\n",
+                    walk_path, strerror(errno));
+            close(child_fd);
+            closedir(dir);
+            return -1;
         }
 
         /* If the child is a directory, recurse into it.  Otherwise call the
          * callback. */
         if (S_ISDIR(child_stat.st_mode)) {
             *child_walk_path_end++ = '/';
-            walk_directory_fd
-                (child_fd, walk_path, walk_rel_path, child_walk_path_end,
-                 callback, user_data);
-            close(child_fd);
+            *child_walk_path_end = '\0';
+            if (unlikely(walk_directory_fd
+                         (child_fd, walk_path, walk_rel_path,
+                          child_walk_path_end, walk_path_limit, callback,
+                          user_data))) {
+                closedir(dir);
+                return -1;
+            }
         } else if (strends(dirent->d_name, ".yaml")) {
             callback(child_fd, walk_path, walk_rel_path, user_data);
             close(child_fd);
+        } else {
+            close(child_fd);
         }
     }
 
     closedir(dir);
+    return 0;
 }
 
-void
+int
 walk_directory(const char *root_path, directory_walker_callback *callback,
                void *user_data)
 {
@@ -91,10 +115,19 @@ walk_directory(const char *root_path, directory_walker_callback *callback,
 
     assert(root_path != NULL && *root_path != '\0');
 
+    /* Leave room for the slash that we might add, and the NUL terminator. */
+    if (strlen(root_path) + 2 > sizeof(walk_path)) {
+        fprintf(stderr, "Cannot open directory %s: %s\n",
+                root_path, strerror(ENAMETOOLONG));
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
     dir_fd = open(root_path, O_RDONLY);
     if (dir_fd == -1) {
-        diag("Cannot open directory: %s", strerror(errno));
-        exit(EXIT_FAILURE);
+        fprintf(stderr, "Cannot open directory %s: %s\n",
+                root_path, strerror(errno));
+        return -1;
     }
 
     /* After this block, walk_path will contain a copy of root_path, and is
@@ -113,7 +146,7 @@ walk_directory(const char *root_path, directory_walker_callback *callback,
     }
     walk_rel_path = walk_path_end;
 
-    walk_directory_fd
-        (dir_fd, walk_path, walk_rel_path, walk_path_end, callback, user_data);
-    close(dir_fd);
+    return walk_directory_fd
+        (dir_fd, walk_path, walk_rel_path, walk_path_end,
+         walk_path + sizeof(walk_path), callback, user_data);
 }
@@ -9,16 +9,18 @@
 extern "C" {
 #endif
 
-/* Called for each file found during a directory walk.  The file will already be
- * open for reading via fd.  filename is only valid for the duration of this
- * call. */
+/* Called for each YAML file found during a directory walk.  The file will
+ * already be open for reading via fd.  full_path and rel_path are only valid
+ * for the duration of this call. */
 typedef void
 directory_walker_callback(int fd, const char *full_path, const char *rel_path,
                           void *user_data);
 
-/* Assumes that we're running in a TAP test harness; if there are any I/O
- * errors, prints out an error message using diag() and aborts. */
-void
+/* Calls callback for each YAML file underneath root_path.  If there are any I/O
+ * errors, prints out an error message to stderr, stops walking, and returns
+ * -1.  A path that doesn't fit in PATH_MAX bytes is an error, which sets errno
+ * to ENAMETOOLONG. */
+int
 walk_directory(const char *root_path, directory_walker_callback *callback,
                void *user_data);
 
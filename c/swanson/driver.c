@@ -0,0 +1,354 @@
+/* -*- coding: utf-8 -*-
+ * Copyright © 2016, Swanson Project.
+ * Please see the COPYING file in this distribution for license details.
+ */
+
+#include "swanson/driver.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "swanson.h"
+
+/*-----------------------------------------------------------------------------
+ * Modules
+ */
+
+struct s0_block *
+swanson_try_parse_module(struct s0_yaml_node doc, char *error,
+                         size_t error_size)
+{
+    struct s0_entity  *module;
+    struct s0_name  *name;
+    struct s0_block  *block;
+
+    module = s0_yaml_document_parse_module(doc);
+    if (module == NULL) {
+        snprintf(error, error_size, "%s",
+                 s0_yaml_stream_last_error(doc.stream));
+        return NULL;
+    }
+
+    name = s0_name_new_str("module");
+    if (name == NULL) {
+        snprintf(error, error_size, "%s", s0_error_get_last_description());
+        s0_entity_free(module);
+        return NULL;
+    }
+    block = s0_named_blocks_delete(s0_closure_named_blocks(module), name);
+    s0_name_free(name);
+    s0_entity_free(module);
+    return block;
+}
+
+struct s0_block *
+swanson_try_load_module(const char *filename, char *error, size_t error_size)
+{
+    struct s0_yaml_stream  *stream;
+    struct s0_yaml_node  doc;
+    struct s0_block  *block;
+
+    stream = s0_yaml_stream_new_from_filename(filename);
+    if (stream == NULL) {
+        snprintf(error, error_size, "%s", s0_error_get_last_description());
+        return NULL;
+    }
+
+    doc = s0_yaml_stream_parse_document(stream);
+    if (s0_yaml_node_is_error(doc)) {
+        snprintf(error, error_size, "%s", s0_yaml_stream_last_error(stream));
+        s0_yaml_stream_free(stream);
+        return NULL;
+    }
+    if (s0_yaml_node_is_missing(doc)) {
+        snprintf(error, error_size, "No module in file");
+        s0_yaml_stream_free(stream);
+        return NULL;
+    }
+
+    block = swanson_try_parse_module(doc, error, error_size);
+    s0_yaml_stream_free(stream);
+    return block;
+}
+
+struct s0_block *
+swanson_load_module(const char *filename)
+{
+    char  error[SWANSON_MAX_ERROR_LENGTH];
+    struct s0_block  *block =
+        swanson_try_load_module(filename, error, sizeof(error));
+    if (block == NULL) {
+        fprintf(stderr, "%s: %s\n", filename, error);
+    }
+    return block;
+}
+
+
+/*-----------------------------------------------------------------------------
+ * Standard inputs
+ */
+
+static struct s0_entity *
+swanson_input_new(struct swanson_inputs *inputs, const struct s0_name *name)
+{
+    const char  *content = s0_name_content(name);
+    struct s0_entity  *entity;
+    if (strcmp(content, "finish") == 0) {
+        entity = s0_finish_new();
+    } else if (strcmp(content, "return") == 0) {
+        struct s0_name  *result_name = s0_name_new_str("result");
+        struct s0_entity_type  *result_type = s0_any_entity_type_new();
+        if (result_name == NULL || result_type == NULL) {
+            if (result_name != NULL) {
+                s0_name_free(result_name);
+            }
+            if (result_type != NULL) {
+                s0_entity_type_free(result_type);
+            }
+            entity = NULL;
+        } else {
+            entity = s0_extractor_new
+                (result_name, result_type, &inputs->result);
+        }
+    } else {
+        fprintf(stderr,
+                "Module input `%s` must be `finish` or `return`\n", content);
+        return NULL;
+    }
+    if (entity == NULL) {
+        fprintf(stderr, "%s\n", s0_error_get_last_description());
+    }
+    return entity;
+}
+
+int
+swanson_inputs_init(struct swanson_inputs *inputs,
+                    const struct s0_block *module)
+{
+    const struct s0_environment_type  *types = s0_block_inputs(module);
+    size_t  i;
+
+    inputs->result = NULL;
+    inputs->env = s0_environment_new();
+    if (inputs->env == NULL) {
+        fprintf(stderr, "%s\n", s0_error_get_last_description());
+        return -1;
+    }
+
+    for (i = 0; i < s0_environment_type_size(types); i++) {
+        struct s0_environment_type_entry  entry =
+            s0_environment_type_at(types, i);
+        struct s0_entity  *entity;
+        struct s0_name  *name;
+
+        entity = swanson_input_new(inputs, entry.name);
+        if (entity == NULL) {
+            swanson_inputs_done(inputs);
+            return -1;
+        }
+        name = s0_name_new_copy(entry.name);
+        if (name == NULL || s0_environment_add(inputs->env, name, entity)) {
+            fprintf(stderr, "%s\n", s0_error_get_last_description());
+            swanson_inputs_done(inputs);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void
+swanson_inputs_done(struct swanson_inputs *inputs)
+{
+    if (inputs->env != NULL) {
+        s0_environment_free(inputs->env);
+        inputs->env = NULL;
+    }
+    if (inputs->result != NULL) {
+        s0_entity_free(inputs->result);
+        inputs->result = NULL;
+    }
+}
+
+
+/*-----------------------------------------------------------------------------
+ * Engines
+ */
+
+struct swanson_engine {
+    enum swanson_engine_kind  kind;
+    struct s0_event_loop  *loop;
+    struct s0_scheduler  *scheduler;
+    /* Filled in by swanson_engine_done */
+    struct s0_environment  *env;
+    int  rc;
+    char  error[SWANSON_MAX_ERROR_LENGTH];
+};
+
+int
+swanson_engine_kind_parse(const char *name, enum swanson_engine_kind *kind)
+{
+    if (strcmp(name, "direct") == 0) {
+        *kind = SWANSON_ENGINE_DIRECT;
+    } else if (strcmp(name, "event-loop") == 0) {
+        *kind = SWANSON_ENGINE_EVENT_LOOP;
+    } else if (strcmp(name, "scheduler") == 0) {
+        *kind = SWANSON_ENGINE_SCHEDULER;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char *
+swanson_engine_kind_name(enum swanson_engine_kind kind)
+{
+    switch (kind) {
+        case SWANSON_ENGINE_DIRECT:
+            return "direct";
+        case SWANSON_ENGINE_EVENT_LOOP:
+            return "event-loop";
+        case SWANSON_ENGINE_SCHEDULER:
+            return "scheduler";
+    }
+    return NULL;
+}
+
+struct swanson_engine *
+swanson_engine_new(enum swanson_engine_kind kind)
+{
+    struct swanson_engine  *engine = malloc(sizeof(struct swanson_engine));
+    if (engine == NULL) {
+        fprintf(stderr, "Cannot allocate engine\n");
+        return NULL;
+    }
+
+    engine->kind = kind;
+    engine->loop = NULL;
+    engine->scheduler = NULL;
+    engine->error[0] = '\0';
+    if (kind == SWANSON_ENGINE_EVENT_LOOP) {
+        engine->loop = s0_event_loop_new();
+        if (engine->loop == NULL) {
+            fprintf(stderr, "%s\n", s0_error_get_last_description());
+            free(engine);
+            return NULL;
+        }
+    } else if (kind == SWANSON_ENGINE_SCHEDULER) {
+        long  cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+        engine->scheduler = s0_scheduler_new((cpu_count > 0)? cpu_count: 1);
+        if (engine->scheduler == NULL) {
+            fprintf(stderr, "%s\n", s0_error_get_last_description());
+            free(engine);
+            return NULL;
+        }
+    }
+    return engine;
+}
+
+void
+swanson_engine_free(struct swanson_engine *engine)
+{
+    if (engine->loop != NULL) {
+        s0_event_loop_free(engine->loop);
+    }
+    if (engine->scheduler != NULL) {
+        s0_scheduler_free(engine->scheduler);
+    }
+    free(engine);
+}
+
+/* Records the outcome of an execution.  For the scheduler, this runs on a
+ * worker thread, so that's the only place we can see the error. */
+static void
+swanson_engine_done(void *ud, struct s0_environment *env, int rc)
+{
+    struct swanson_engine  *engine = ud;
+    engine->env = env;
+    engine->rc = rc;
+    if (rc != 0) {
+        snprintf(engine->error, sizeof(engine->error), "%s",
+                 s0_error_get_last_description());
+    }
+}
+
+int
+swanson_engine_execute(struct swanson_engine *engine, struct s0_block *module,
+                       struct swanson_inputs *inputs)
+{
+    struct s0_environment  *env = inputs->env;
+    int  rc;
+
+    engine->error[0] = '\0';
+    switch (engine->kind) {
+        case SWANSON_ENGINE_DIRECT:
+            swanson_engine_done(engine, env, s0_block_execute(module, env));
+            break;
+
+        case SWANSON_ENGINE_EVENT_LOOP:
+            /* The loop takes control of env, and gives it back to us once the
+             * execution finishes. */
+            inputs->env = NULL;
+            rc = s0_event_loop_add
+                (engine->loop, module, env, swanson_engine_done, engine);
+            if (rc != 0) {
+                snprintf(engine->error, sizeof(engine->error), "%s",
+                         s0_error_get_last_description());
+                return -1;
+            }
+            if (s0_event_loop_run(engine->loop) != 0) {
+                snprintf(engine->error, sizeof(engine->error), "%s",
+                         s0_error_get_last_description());
+                return -1;
+            }
+            break;
+
+        case SWANSON_ENGINE_SCHEDULER:
+            inputs->env = NULL;
+            rc = s0_scheduler_submit
+                (engine->scheduler, module, env, swanson_engine_done, engine);
+            if (rc != 0) {
+                snprintf(engine->error, sizeof(engine->error), "%s",
+                         s0_error_get_last_description());
+                return -1;
+            }
+            s0_scheduler_wait(engine->scheduler);
+            break;
+    }
+
+    inputs->env = engine->env;
+    return engine->rc;
+}
+
+const char *
+swanson_engine_error(const struct swanson_engine *engine)
+{
+    return engine->error;
+}
+
+
+/*-----------------------------------------------------------------------------
+ * Statistics
+ */
+
+double
+swanson_now(void)
+{
+    struct timespec  ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+long
+swanson_peak_rss(void)
+{
+    struct rusage  usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    /* Linux reports this in KiB already. */
+    return usage.ru_maxrss;
+}
@@ -0,0 +1,129 @@
+/* -*- coding: utf-8 -*-
+ * Copyright © 2016, Swanson Project.
+ * Please see the COPYING file in this distribution for license details.
+ */
+
+#ifndef SWANSON_DRIVER_H
+#define SWANSON_DRIVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "swanson.h"
+
+/*-----------------------------------------------------------------------------
+ * Modules
+ */
+
+/* The longest error message that we'll keep around. */
+#define SWANSON_MAX_ERROR_LENGTH  4096
+
+/* Loads the module in the first YAML document in `filename`, and returns its
+ * body.  Prints an error to stderr and returns NULL if we can't. */
+struct s0_block *
+swanson_load_module(const char *filename);
+
+/* Like swanson_load_module, but describes any error in `error` instead of
+ * printing it.  Loading a module type-checks all of its blocks, so you can use
+ * this to verify modules without executing them.  You can call this from any
+ * thread. */
+struct s0_block *
+swanson_try_load_module(const char *filename, char *error, size_t error_size);
+
+/* Like swanson_try_load_module, but loads the module from `doc`, which must be
+ * a valid document from a YAML stream. */
+struct s0_block *
+swanson_try_parse_module(struct s0_yaml_node doc, char *error,
+                         size_t error_size);
+
+
+/*-----------------------------------------------------------------------------
+ * Standard inputs
+ */
+
+/* We can provide a module with any of the following inputs:
+ *
+ *   finish: an object whose `finish` method ends the execution
+ *   return: a closure whose `body` branch takes a `result`, which it saves,
+ *           and then ends the execution */
+struct swanson_inputs {
+    struct s0_environment  *env;
+    /* Filled in if the module passes something to `return` */
+    struct s0_entity  *result;
+};
+
+/* Creates the inputs that `module` asks for.  Prints an error to stderr and
+ * returns -1 if it asks for anything we can't provide. */
+int
+swanson_inputs_init(struct swanson_inputs *inputs,
+                    const struct s0_block *module);
+
+void
+swanson_inputs_done(struct swanson_inputs *inputs);
+
+
+/*-----------------------------------------------------------------------------
+ * Engines
+ */
+
+enum swanson_engine_kind {
+    /* Run the trampoline directly, via s0_block_execute */
+    SWANSON_ENGINE_DIRECT,
+    /* Run on an event loop on the calling thread */
+    SWANSON_ENGINE_EVENT_LOOP,
+    /* Run on a work-stealing scheduler, with one worker per CPU */
+    SWANSON_ENGINE_SCHEDULER
+};
+
+/* Returns -1 if `name` isn't `direct`, `event-loop`, or `scheduler`. */
+int
+swanson_engine_kind_parse(const char *name, enum swanson_engine_kind *kind);
+
+const char *
+swanson_engine_kind_name(enum swanson_engine_kind kind);
+
+struct swanson_engine;
+
+struct swanson_engine *
+swanson_engine_new(enum swanson_engine_kind kind);
+
+void
+swanson_engine_free(struct swanson_engine *engine);
+
+/* Executes `module` within `inputs->env`, and waits for it to finish.  Returns
+ * -1 if the execution fails; swanson_engine_error describes why. */
+int
+swanson_engine_execute(struct swanson_engine *engine, struct s0_block *module,
+                       struct swanson_inputs *inputs);
+
+const char *
+swanson_engine_error(const struct swanson_engine *engine);
+
+
+/*-----------------------------------------------------------------------------
+ * Statistics
+ */
+
+/* Returns the current time, in seconds, from a monotonic clock. */
+double
+swanson_now(void);
+
+/* Returns the peak resident set size of this process, in KiB. */
+long
+swanson_peak_rss(void);
+
+
+/*-----------------------------------------------------------------------------
+ * Commands
+ */
+
+int
+swanson_bench_main(int argc, char **argv);
+
+int
+swanson_check_main(int argc, char **argv);
+
+int
+swanson_run_main(int argc, char **argv);
+
+#endif /* SWANSON_DRIVER_H */
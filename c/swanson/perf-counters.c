@@ -0,0 +1,159 @@
+/* -*- coding: utf-8 -*-
+ * Copyright © 2016, Swanson Project.
+ * Please see the COPYING file in this distribution for license details.
+ */
+
+#include "swanson/perf-counters.h"
+
+#include <errno.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+static const char  *counter_names[SWANSON_PERF_COUNTER_COUNT] = {
+    "cycles",
+    "instructions",
+    "cache-misses",
+    "branch-misses"
+};
+
+const char *
+swanson_perf_counter_name(enum swanson_perf_counter counter)
+{
+    return counter_names[counter];
+}
+
+bool
+swanson_perf_counter_available(const struct swanson_perf_counters *counters,
+                               enum swanson_perf_counter counter)
+{
+    return counters->fds[counter] != -1;
+}
+
+void
+swanson_perf_sample_clear(struct swanson_perf_sample *sample)
+{
+    memset(sample, 0, sizeof(struct swanson_perf_sample));
+}
+
+void
+swanson_perf_sample_accumulate(struct swanson_perf_sample *total,
+                               const struct swanson_perf_sample *start,
+                               const struct swanson_perf_sample *end)
+{
+    size_t  i;
+    for (i = 0; i < SWANSON_PERF_COUNTER_COUNT; i++) {
+        total->values[i] += end->values[i] - start->values[i];
+    }
+}
+
+#if defined(__linux__)
+
+static const uint64_t  counter_configs[SWANSON_PERF_COUNTER_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+static int
+perf_counter_open(uint64_t config)
+{
+    struct perf_event_attr  attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.inherit = 1;
+    /* Unprivileged processes can usually only count user-space events. */
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+bool
+swanson_perf_counters_open(struct swanson_perf_counters *counters)
+{
+    bool  any_available = false;
+    size_t  i;
+    counters->error = 0;
+    for (i = 0; i < SWANSON_PERF_COUNTER_COUNT; i++) {
+        counters->fds[i] = perf_counter_open(counter_configs[i]);
+        if (counters->fds[i] == -1) {
+            if (counters->error == 0) {
+                counters->error = errno;
+            }
+        } else {
+            any_available = true;
+        }
+    }
+    return any_available;
+}
+
+void
+swanson_perf_counters_close(struct swanson_perf_counters *counters)
+{
+    size_t  i;
+    for (i = 0; i < SWANSON_PERF_COUNTER_COUNT; i++) {
+        if (counters->fds[i] != -1) {
+            close(counters->fds[i]);
+            counters->fds[i] = -1;
+        }
+    }
+}
+
+void
+swanson_perf_counters_read(const struct swanson_perf_counters *counters,
+                           struct swanson_perf_sample *sample)
+{
+    size_t  i;
+    for (i = 0; i < SWANSON_PERF_COUNTER_COUNT; i++) {
+        /* value, time enabled, time running */
+        uint64_t  data[3];
+        sample->values[i] = 0;
+        if (counters->fds[i] == -1
+                || read(counters->fds[i], data, sizeof(data))
+                   != sizeof(data)) {
+            continue;
+        }
+        if (data[2] != 0 && data[2] < data[1]) {
+            sample->values[i] =
+                (uint64_t) ((double) data[0] * data[1] / data[2]);
+        } else {
+            sample->values[i] = data[0];
+        }
+    }
+}
+
+#else
+
+bool
+swanson_perf_counters_open(struct swanson_perf_counters *counters)
+{
+    size_t  i;
+    for (i = 0; i < SWANSON_PERF_COUNTER_COUNT; i++) {
+        counters->fds[i] = -1;
+    }
+    counters->error = ENOSYS;
+    return false;
+}
+
+void
+swanson_perf_counters_close(struct swanson_perf_counters *counters)
+{
+}
+
+void
+swanson_perf_counters_read(const struct swanson_perf_counters *counters,
+                           struct swanson_perf_sample *sample)
+{
+    swanson_perf_sample_clear(sample);
+}
+
+#endif
@@ -0,0 +1,72 @@
+/* -*- coding: utf-8 -*-
+ * Copyright © 2016, Swanson Project.
+ * Please see the COPYING file in this distribution for license details.
+ */
+
+#ifndef SWANSON_PERF_COUNTERS_H
+#define SWANSON_PERF_COUNTERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Reads hardware performance counters for the current process, using Linux's
+ * perf_event_open.  The counters are often unavailable (on other platforms, in
+ * virtual machines without a virtual PMU, or when perf_event_paranoid forbids
+ * it), so each one can be missing independently, and callers should report
+ * those as unavailable instead of failing. */
+
+enum swanson_perf_counter {
+    SWANSON_PERF_CYCLES,
+    SWANSON_PERF_INSTRUCTIONS,
+    SWANSON_PERF_CACHE_MISSES,
+    SWANSON_PERF_BRANCH_MISSES,
+    SWANSON_PERF_COUNTER_COUNT
+};
+
+/* Returns the name that `perf` uses for a counter. */
+const char *
+swanson_perf_counter_name(enum swanson_perf_counter counter);
+
+struct swanson_perf_counters {
+    /* -1 if the counter is unavailable */
+    int  fds[SWANSON_PERF_COUNTER_COUNT];
+    /* Why the first unavailable counter couldn't be opened */
+    int  error;
+};
+
+/* A snapshot of every counter's running total. */
+struct swanson_perf_sample {
+    uint64_t  values[SWANSON_PERF_COUNTER_COUNT];
+};
+
+/* Starts counting.  The counters include every thread that this thread creates
+ * afterwards, so open them before you start any worker threads that you want
+ * to measure.  Returns whether any of the counters are available; if none are,
+ * `counters->error` is the errno describing why not. */
+bool
+swanson_perf_counters_open(struct swanson_perf_counters *counters);
+
+void
+swanson_perf_counters_close(struct swanson_perf_counters *counters);
+
+bool
+swanson_perf_counter_available(const struct swanson_perf_counters *counters,
+                               enum swanson_perf_counter counter);
+
+/* Fills in the current total of each available counter, scaled up to account
+ * for any time that the kernel had to multiplex it off of the PMU.  Subtract
+ * two samples to measure the region between them. */
+void
+swanson_perf_counters_read(const struct swanson_perf_counters *counters,
+                           struct swanson_perf_sample *sample);
+
+/* Adds the difference between `end` and `start` to `total`. */
+void
+swanson_perf_sample_accumulate(struct swanson_perf_sample *total,
+                               const struct swanson_perf_sample *start,
+                               const struct swanson_perf_sample *end);
+
+void
+swanson_perf_sample_clear(struct swanson_perf_sample *sample);
+
+#endif /* SWANSON_PERF_COUNTERS_H */
@@ -0,0 +1,269 @@
+/* -*- coding: utf-8 -*-
+ * Copyright © 2016, Swanson Project.
+ * Please see the COPYING file in this distribution for license details.
+ */
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "swanson.h"
+#include "swanson/driver.h"
+
+/*-----------------------------------------------------------------------------
+ * swanson run
+ */
+
+static void
+usage(FILE *out)
+{
+    fprintf(out,
+            "Usage: swanson run [options] MODULE\n"
+            "\n"
+            "Executes the S₀ module in the YAML file MODULE.\n"
+            "\n"
+            "Options:\n"
+            "  --engine=ENGINE  Execute using ENGINE, which is one of\n"
+            "                   `direct` (the default), `event-loop`, or\n"
+            "                   `scheduler`\n"
+            "  --stats          Print execution statistics to stderr\n"
+            "  --profile        Print how much time each block and primitive\n"
+            "                   method took to stderr\n"
+            "  --profile-folded=FILE\n"
+            "                   Write the same profile to FILE as folded\n"
+            "                   stacks, for flamegraph.pl\n"
+            "  --trace=FILE     Write a trace of every block, statement,\n"
+            "                   invocation, and primitive call to FILE, in\n"
+            "                   Chrome's trace event format\n"
+            "  -h, --help       Print this message\n");
+}
+
+static void
+print_result(const struct s0_entity *result)
+{
+    switch (s0_entity_kind(result)) {
+        case S0_ENTITY_KIND_ATOM:
+            printf("<atom>\n");
+            break;
+        case S0_ENTITY_KIND_CLOSURE:
+            printf("<closure>\n");
+            break;
+        case S0_ENTITY_KIND_LITERAL:
+            fwrite(s0_literal_content(result), 1, s0_literal_size(result),
+                   stdout);
+            printf("\n");
+            break;
+        case S0_ENTITY_KIND_METHOD:
+        case S0_ENTITY_KIND_PRIMITIVE_METHOD:
+            printf("<method>\n");
+            break;
+        case S0_ENTITY_KIND_OBJECT:
+            printf("<object>\n");
+            break;
+    }
+}
+
+static void
+print_stats(double elapsed, size_t steps, size_t allocations)
+{
+    fprintf(stderr, "wall time:    %.3f ms\n", elapsed * 1e3);
+    fprintf(stderr, "steps:        %zu\n", steps);
+    fprintf(stderr, "allocations:  %zu\n", allocations);
+    fprintf(stderr, "peak RSS:     %ld KiB\n", swanson_peak_rss());
+}
+
+/* Prints the profile as a table (if `table`), and to `folded_filename` as
+ * folded stacks (if it's not NULL). */
+static int
+write_profile(bool table, const char *folded_filename)
+{
+    FILE  *out;
+    int  rc = 0;
+
+    if (table) {
+        fflush(stdout);
+        if (s0_profiler_write_table(stderr) != 0) {
+            rc = -1;
+        }
+    }
+
+    if (folded_filename != NULL) {
+        out = fopen(folded_filename, "w");
+        if (out == NULL) {
+            perror(folded_filename);
+            return -1;
+        }
+        if (s0_profiler_write_folded(out) != 0) {
+            fprintf(stderr, "%s: %s\n",
+                    folded_filename, s0_error_get_last_description());
+            rc = -1;
+        }
+        if (fclose(out) != 0) {
+            perror(folded_filename);
+            rc = -1;
+        }
+    }
+    return rc;
+}
+
+static int
+write_trace(const char *filename)
+{
+    FILE  *out;
+    int  rc = 0;
+
+    out = fopen(filename, "w");
+    if (out == NULL) {
+        perror(filename);
+        return -1;
+    }
+    if (s0_tracer_write_chrome_json(out) != 0) {
+        fprintf(stderr, "%s: %s\n",
+                filename, s0_error_get_last_description());
+        rc = -1;
+    }
+    if (fclose(out) != 0) {
+        perror(filename);
+        rc = -1;
+    }
+    return rc;
+}
+
+enum {
+    OPTION_ENGINE = 256,
+    OPTION_STATS,
+    OPTION_PROFILE,
+    OPTION_PROFILE_FOLDED,
+    OPTION_TRACE
+};
+
+static const struct option  options[] = {
+    { "engine", required_argument, NULL, OPTION_ENGINE },
+    { "stats", no_argument, NULL, OPTION_STATS },
+    { "profile", no_argument, NULL, OPTION_PROFILE },
+    { "profile-folded", required_argument, NULL, OPTION_PROFILE_FOLDED },
+    { "trace", required_argument, NULL, OPTION_TRACE },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+};
+
+int
+swanson_run_main(int argc, char **argv)
+{
+    enum swanson_engine_kind  kind = SWANSON_ENGINE_DIRECT;
+    bool  stats = false;
+    bool  profile = false;
+    const char  *profile_folded = NULL;
+    const char  *trace = NULL;
+    const char  *filename;
+    struct s0_block  *module;
+    struct swanson_engine  *engine;
+    struct swanson_inputs  inputs;
+    double  start;
+    size_t  start_steps;
+    size_t  start_allocations;
+    double  elapsed;
+    size_t  steps;
+    size_t  allocations;
+    int  opt;
+    int  rc;
+
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (opt) {
+            case OPTION_ENGINE:
+                if (swanson_engine_kind_parse(optarg, &kind) != 0) {
+                    fprintf(stderr, "Unknown engine `%s`\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPTION_STATS:
+                stats = true;
+                break;
+            case OPTION_PROFILE:
+                profile = true;
+                break;
+            case OPTION_PROFILE_FOLDED:
+                profile_folded = optarg;
+                break;
+            case OPTION_TRACE:
+                trace = optarg;
+                break;
+            case 'h':
+                usage(stdout);
+                return EXIT_SUCCESS;
+            default:
+                usage(stderr);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+    filename = argv[optind];
+
+    module = swanson_load_module(filename);
+    if (module == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    engine = swanson_engine_new(kind);
+    if (engine == NULL) {
+        s0_block_free(module);
+        return EXIT_FAILURE;
+    }
+
+    if (swanson_inputs_init(&inputs, module) != 0) {
+        swanson_engine_free(engine);
+        s0_block_free(module);
+        return EXIT_FAILURE;
+    }
+
+    if (profile || profile_folded != NULL) {
+        s0_profiler_start();
+    }
+    if (trace != NULL) {
+        s0_tracer_start();
+    }
+    start_allocations = s0_allocation_count();
+    start_steps = s0_execution_step_count();
+    start = swanson_now();
+    rc = swanson_engine_execute(engine, module, &inputs);
+    elapsed = swanson_now() - start;
+    s0_profiler_stop();
+    s0_tracer_stop();
+    steps = s0_execution_step_count() - start_steps;
+    allocations = s0_allocation_count() - start_allocations;
+
+    if (rc != 0) {
+        fprintf(stderr, "%s: %s\n", filename, swanson_engine_error(engine));
+    } else if (inputs.result != NULL) {
+        print_result(inputs.result);
+    }
+
+    if (stats) {
+        fflush(stdout);
+        print_stats(elapsed, steps, allocations);
+    }
+
+    if (profile || profile_folded != NULL) {
+        if (write_profile(profile, profile_folded) != 0) {
+            rc = -1;
+        }
+        s0_profiler_reset();
+    }
+
+    if (trace != NULL) {
+        if (write_trace(trace) != 0) {
+            rc = -1;
+        }
+        s0_tracer_reset();
+    }
+
+    swanson_inputs_done(&inputs);
+    swanson_engine_free(engine);
+    s0_block_free(module);
+    return (rc == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
@@ -3,7 +3,60 @@
  * Please see the COPYING file in this distribution for license details.
  */
 
-int main(void)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "swanson/driver.h"
+
+struct command {
+    const char  *name;
+    int (*main)(int argc, char **argv);
+};
+
+static const struct command  commands[] = {
+    { "bench", swanson_bench_main },
+    { "check", swanson_check_main },
+    { "run", swanson_run_main },
+    { NULL, NULL }
+};
+
+static void
+usage(FILE *out)
 {
-    return 0;
+    fprintf(out,
+            "Usage: swanson COMMAND [options]\n"
+            "\n"
+            "Commands:\n"
+            "  bench  Measure how long an S₀ module takes to execute\n"
+            "  check  Load and type-check every S₀ module in a directory\n"
+            "  run    Execute an S₀ module\n"
+            "\n"
+            "Run `swanson COMMAND --help` for details about each command.\n");
+}
+
+int main(int argc, char **argv)
+{
+    const struct command  *command;
+
+    if (argc < 2) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+        usage(stdout);
+        return EXIT_SUCCESS;
+    }
+
+    for (command = commands; command->name != NULL; command++) {
+        if (strcmp(argv[1], command->name) == 0) {
+            /* Let the command parse its options as if it were argv[0]. */
+            return command->main(argc - 1, argv + 1);
+        }
+    }
+
+    fprintf(stderr, "Unknown command `%s`\n\n", argv[1]);
+    usage(stderr);
+    return EXIT_FAILURE;
 }
@@ -0,0 +1,508 @@
+/* -*- coding: utf-8 -*-
+ * Copyright © 2016, Swanson Project.
+ * Please see the COPYING file in this distribution for license details.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ccan/likely/likely.h"
+#include "ccan/tap/tap.h"
+#include "swanson.h"
+#include "swanson/directory-walker.h"
+#include "swanson/driver.h"
+
+
+static void
+print_error_message(const char *prefix, const char *curr)
+{
+    const char  *nl = strchr(curr, '\n');
+    while (nl != NULL) {
+        diag("%s%.*s", prefix, (int) (nl - curr), curr);
+        curr = nl + 1;
+        nl = strchr(curr, '\n');
+    }
+    diag("%s%s", prefix, curr);
+}
+
+
+/* First we walk through the requested directory, looking for YAML files.  We
+ * create a "test case file" descriptor for each one. */
+
+struct test_case_file {
+    struct test_case_file  *next;
+    const char  *full_path;
+    const char  *rel_path;
+};
+
+static struct test_case_file  *test_case_files = NULL;
+
+static void
+test_case_file_new(const char *full_path, const char *rel_path)
+{
+    struct test_case_file  *test_case_file =
+        malloc(sizeof(struct test_case_file));
+    assert(test_case_file != NULL);
+    test_case_file->full_path = strdup(full_path);
+    assert(test_case_file->full_path != NULL);
+    test_case_file->rel_path = strdup(rel_path);
+    assert(test_case_file->rel_path != NULL);
+    test_case_file->next = test_case_files;
+    test_case_files = test_case_file;
+}
+
+static void
+test_case_file_free(struct test_case_file *test_case_file)
+{
+    free((void *) test_case_file->full_path);
+    free((void *) test_case_file->rel_path);
+    free(test_case_file);
+}
+
+static void
+create_test_case(int child_fd, const char *full_path, const char *rel_path,
+                 void *user_data)
+{
+    test_case_file_new(full_path, rel_path);
+}
+
+static void
+load_test_cases(const char *directory)
+{
+    if (walk_directory(directory, create_test_case, NULL) != 0) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+/* Then we walk through each test case file, counting the number of total test
+ * cases that are in them.  We run each test case once with each engine. */
+
+static const enum swanson_engine_kind  engine_kinds[] = {
+    SWANSON_ENGINE_DIRECT,
+    SWANSON_ENGINE_EVENT_LOOP,
+    SWANSON_ENGINE_SCHEDULER
+};
+
+#define ENGINE_COUNT  (sizeof(engine_kinds) / sizeof(engine_kinds[0]))
+
+static unsigned int  test_case_count = 0;
+
+static void
+count_test_cases(void)
+{
+    struct test_case_file  *curr;
+    for (curr = test_case_files; curr != NULL; curr = curr->next) {
+        struct s0_yaml_stream  *stream;
+        struct s0_yaml_node  node;
+
+        stream = s0_yaml_stream_new_from_filename(curr->full_path);
+        assert(stream != NULL);
+
+        for (node = s0_yaml_stream_parse_document(stream);
+             s0_yaml_node_is_valid(node);
+             node = s0_yaml_stream_parse_document(stream)) {
+            test_case_count += ENGINE_COUNT;
+        }
+
+        if (unlikely(s0_yaml_node_is_error(node))) {
+            diag("Error reading from %s: %s", curr->rel_path,
+                 s0_yaml_stream_last_error(stream));
+            exit(EXIT_FAILURE);
+        }
+
+        s0_yaml_stream_free(stream);
+    }
+}
+
+
+/* Inputs and results */
+
+#define SUCCESSFUL_EXECUTION_TAG  SWANSON_TAG_PREFIX "successful-execution"
+#define ATOM_TAG     SWANSON_TAG_PREFIX "atom"
+#define EXTRACT_TAG  SWANSON_TAG_PREFIX "extract"
+#define FINISH_TAG   SWANSON_TAG_PREFIX "finish"
+#define LITERAL_TAG  SWANSON_TAG_PREFIX "literal"
+
+#define MAX_INPUT_COUNT  16
+
+struct test_inputs {
+    struct swanson_inputs  inputs;
+    size_t  count;
+    /* The name of each input, and what its extractor (if any) received. */
+    struct s0_yaml_node  names[MAX_INPUT_COUNT];
+    bool  extractors[MAX_INPUT_COUNT];
+    struct s0_entity  *results[MAX_INPUT_COUNT];
+};
+
+static struct s0_name *
+name_from_scalar(struct s0_yaml_node node)
+{
+    return s0_name_new
+        (s0_yaml_node_scalar_size(node), s0_yaml_node_scalar_content(node));
+}
+
+static struct s0_entity *
+test_input_new(struct test_inputs *inputs, size_t index,
+               struct s0_yaml_node node)
+{
+    if (s0_yaml_node_has_tag(node, FINISH_TAG)) {
+        return s0_finish_new();
+    } else if (s0_yaml_node_has_tag(node, EXTRACT_TAG)) {
+        struct s0_name  *input_name;
+        struct s0_entity_type  *result_type;
+        if (unlikely(!s0_yaml_node_is_scalar(node))) {
+            diag("!s0!extract input must be a scalar");
+            exit(EXIT_FAILURE);
+        }
+        input_name = name_from_scalar(node);
+        result_type = s0_any_entity_type_new();
+        if (input_name == NULL || result_type == NULL) {
+            return NULL;
+        }
+        inputs->extractors[index] = true;
+        return s0_extractor_new
+            (input_name, result_type, &inputs->results[index]);
+    } else {
+        diag("Input must be !s0!finish or !s0!extract");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void
+test_inputs_init(struct test_inputs *inputs, struct s0_yaml_node node)
+{
+    size_t  i;
+
+    inputs->inputs.result = NULL;
+    inputs->inputs.env = s0_environment_new();
+    assert(inputs->inputs.env != NULL);
+
+    inputs->count = 0;
+    if (s0_yaml_node_is_missing(node)) {
+        return;
+    }
+    if (unlikely(!s0_yaml_node_is_mapping(node))) {
+        diag("Test case inputs must be a mapping");
+        exit(EXIT_FAILURE);
+    }
+    if (unlikely(s0_yaml_node_mapping_size(node) > MAX_INPUT_COUNT)) {
+        diag("Test case has too many inputs");
+        exit(EXIT_FAILURE);
+    }
+
+    inputs->count = s0_yaml_node_mapping_size(node);
+    for (i = 0; i < inputs->count; i++) {
+        struct s0_yaml_node  key = s0_yaml_node_mapping_key_at(node, i);
+        struct s0_name  *name;
+        struct s0_entity  *entity;
+
+        inputs->names[i] = key;
+        inputs->extractors[i] = false;
+        inputs->results[i] = NULL;
+        entity = test_input_new
+            (inputs, i, s0_yaml_node_mapping_value_at(node, i));
+        name = name_from_scalar(key);
+        if (unlikely(entity == NULL || name == NULL
+                     || s0_environment_add(inputs->inputs.env, name, entity))) {
+            diag("%s", s0_error_get_last_description());
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void
+test_inputs_done(struct test_inputs *inputs)
+{
+    size_t  i;
+    for (i = 0; i < inputs->count; i++) {
+        if (inputs->results[i] != NULL) {
+            s0_entity_free(inputs->results[i]);
+        }
+    }
+    swanson_inputs_done(&inputs->inputs);
+}
+
+static bool
+result_matches(const struct s0_entity *result, struct s0_yaml_node expected)
+{
+    enum s0_entity_kind  kind = s0_entity_kind(result);
+    if (s0_yaml_node_has_tag(expected, LITERAL_TAG)) {
+        return kind == S0_ENTITY_KIND_LITERAL
+            && s0_literal_size(result) == s0_yaml_node_scalar_size(expected)
+            && memcmp(s0_literal_content(result),
+                      s0_yaml_node_scalar_content(expected),
+                      s0_literal_size(result)) == 0;
+    } else if (s0_yaml_node_has_tag(expected, ATOM_TAG)) {
+        return kind == S0_ENTITY_KIND_ATOM;
+    } else if (s0_yaml_node_has_tag(expected, S0_CLOSURE_TAG)) {
+        return kind == S0_ENTITY_KIND_CLOSURE;
+    } else if (s0_yaml_node_has_tag(expected, S0_METHOD_TAG)) {
+        return kind == S0_ENTITY_KIND_METHOD
+            || kind == S0_ENTITY_KIND_PRIMITIVE_METHOD;
+    } else if (s0_yaml_node_has_tag(expected, S0_OBJECT_TAG)) {
+        return kind == S0_ENTITY_KIND_OBJECT;
+    } else {
+        diag("Unknown kind of expected result");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Every extractor named in `results` must have received a matching entity, and
+ * every other extractor must not have received anything. */
+static bool
+check_results(struct test_inputs *inputs, struct s0_yaml_node results)
+{
+    bool  ok = true;
+    size_t  i;
+    for (i = 0; i < inputs->count; i++) {
+        struct s0_yaml_node  expected;
+        const char  *name = s0_yaml_node_scalar_content(inputs->names[i]);
+        if (!inputs->extractors[i]) {
+            continue;
+        }
+        expected = s0_yaml_node_is_missing(results)?
+            results: s0_yaml_node_mapping_get(results, name);
+        if (s0_yaml_node_is_missing(expected)) {
+            if (inputs->results[i] != NULL) {
+                diag("    `%s` received an unexpected result", name);
+                ok = false;
+            }
+        } else if (inputs->results[i] == NULL) {
+            diag("    `%s` didn't receive a result", name);
+            ok = false;
+        } else if (!result_matches(inputs->results[i], expected)) {
+            diag("    `%s` received the wrong result", name);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+
+/* Budgets */
+
+static bool
+parse_budget(struct s0_yaml_node node, size_t *dest)
+{
+    char  *end;
+    if (unlikely(!s0_yaml_node_is_scalar(node))) {
+        diag("Budget must be a number");
+        exit(EXIT_FAILURE);
+    }
+    *dest = strtoul(s0_yaml_node_scalar_content(node), &end, 10);
+    if (unlikely(*end != '\0')) {
+        diag("Budget must be a number");
+        exit(EXIT_FAILURE);
+    }
+    return true;
+}
+
+/* A budget is either a single number, which applies to every engine, or a
+ * mapping from engine names to numbers.  Returns false if there's no budget for
+ * this engine. */
+static bool
+get_budget(struct s0_yaml_node budget, const char *key,
+           enum swanson_engine_kind kind, size_t *dest)
+{
+    struct s0_yaml_node  node;
+    if (s0_yaml_node_is_missing(budget)) {
+        return false;
+    }
+    node = s0_yaml_node_mapping_get(budget, key);
+    if (s0_yaml_node_is_missing(node)) {
+        return false;
+    }
+    if (s0_yaml_node_is_mapping(node)) {
+        node = s0_yaml_node_mapping_get(node, swanson_engine_kind_name(kind));
+        if (s0_yaml_node_is_missing(node)) {
+            return false;
+        }
+    }
+    return parse_budget(node, dest);
+}
+
+static bool
+check_budget(struct s0_yaml_node budget, const char *key,
+             enum swanson_engine_kind kind, size_t actual)
+{
+    size_t  limit;
+    if (!get_budget(budget, key, kind, &limit)) {
+        return true;
+    }
+    if (actual > limit) {
+        diag("    Used %zu %s, but the budget is %zu", actual, key, limit);
+        return false;
+    }
+    return true;
+}
+
+
+/* And then we can finally run them! */
+
+static struct swanson_engine  *engines[ENGINE_COUNT];
+
+static void
+run_test_case(struct s0_yaml_node node, struct s0_block *module,
+              size_t engine_index)
+{
+    enum swanson_engine_kind  kind = engine_kinds[engine_index];
+    struct swanson_engine  *engine = engines[engine_index];
+    struct s0_yaml_node  name = s0_yaml_node_mapping_get(node, "name");
+    struct s0_yaml_node  budget = s0_yaml_node_mapping_get(node, "budget");
+    struct test_inputs  inputs;
+    size_t  start_steps;
+    size_t  start_allocations;
+    size_t  steps;
+    size_t  allocations;
+    bool  ok = true;
+
+    test_inputs_init(&inputs, s0_yaml_node_mapping_get(node, "inputs"));
+    start_allocations = s0_allocation_count();
+    start_steps = s0_execution_step_count();
+    if (swanson_engine_execute(engine, module, &inputs.inputs) != 0) {
+        diag("    Unexpected error:");
+        print_error_message("      ", swanson_engine_error(engine));
+        ok = false;
+    }
+    steps = s0_execution_step_count() - start_steps;
+    allocations = s0_allocation_count() - start_allocations;
+
+    if (ok) {
+        ok = check_results(&inputs, s0_yaml_node_mapping_get(node, "results"));
+        ok = check_budget(budget, "steps", kind, steps) && ok;
+        ok = check_budget(budget, "allocations", kind, allocations) && ok;
+    }
+
+    ok(ok, "%.*s [%s]",
+       (int) s0_yaml_node_scalar_size(name),
+       s0_yaml_node_scalar_content(name),
+       swanson_engine_kind_name(kind));
+    test_inputs_done(&inputs);
+}
+
+static struct s0_block *
+load_module(struct s0_yaml_node node)
+{
+    struct s0_yaml_node  module_node = s0_yaml_node_mapping_get(node, "module");
+    struct s0_entity  *module;
+    struct s0_name  *name;
+    struct s0_block  *block;
+
+    if (unlikely(!s0_yaml_node_is_mapping(module_node))) {
+        diag("Test case must have a module");
+        exit(EXIT_FAILURE);
+    }
+
+    module = s0_yaml_document_parse_module(module_node);
+    if (module == NULL) {
+        return NULL;
+    }
+    name = s0_name_new_str("module");
+    assert(name != NULL);
+    block = s0_named_blocks_delete(s0_closure_named_blocks(module), name);
+    s0_name_free(name);
+    s0_entity_free(module);
+    return block;
+}
+
+static void
+run_test_cases(void)
+{
+    struct test_case_file  *curr;
+    for (curr = test_case_files; curr != NULL; curr = curr->next) {
+        struct s0_yaml_stream  *stream;
+        struct s0_yaml_node  node;
+
+        diag("%s", curr->rel_path);
+        stream = s0_yaml_stream_new_from_filename(curr->full_path);
+        assert(stream != NULL);
+
+        for (node = s0_yaml_stream_parse_document(stream);
+             s0_yaml_node_is_valid(node);
+             node = s0_yaml_stream_parse_document(stream)) {
+            struct s0_yaml_node  name;
+            struct s0_block  *module;
+            size_t  i;
+
+            if (unlikely(!s0_yaml_node_is_mapping(node))) {
+                diag("Expected a YAML mapping");
+                exit(EXIT_FAILURE);
+            }
+
+            if (unlikely(!s0_yaml_node_has_tag
+                         (node, SUCCESSFUL_EXECUTION_TAG))) {
+                diag("Test case has unknown tag");
+                exit(EXIT_FAILURE);
+            }
+
+            name = s0_yaml_node_mapping_get(node, "name");
+            if (unlikely(!s0_yaml_node_is_scalar(name))) {
+                diag("Test case must have a scalar name");
+                exit(EXIT_FAILURE);
+            }
+
+            module = load_module(node);
+            if (module == NULL) {
+                for (i = 0; i < ENGINE_COUNT; i++) {
+                    fail("%.*s [%s]",
+                         (int) s0_yaml_node_scalar_size(name),
+                         s0_yaml_node_scalar_content(name),
+                         swanson_engine_kind_name(engine_kinds[i]));
+                }
+                diag("    Unexpected error:");
+                print_error_message
+                    ("      ", s0_yaml_stream_last_error(stream));
+                continue;
+            }
+
+            for (i = 0; i < ENGINE_COUNT; i++) {
+                run_test_case(node, module, i);
+            }
+            s0_block_free(module);
+        }
+
+        if (unlikely(s0_yaml_node_is_error(node))) {
+            diag("Error reading from %s:", curr->rel_path);
+            print_error_message("  ", s0_yaml_stream_last_error(stream));
+            exit(EXIT_FAILURE);
+        }
+
+        s0_yaml_stream_free(stream);
+    }
+}
+
+
+int
+main(int argc, char **argv)
+{
+    size_t  i;
+    int  arg;
+
+    for (arg = 1; arg < argc; arg++) {
+        load_test_cases(argv[arg]);
+    }
+
+    for (i = 0; i < ENGINE_COUNT; i++) {
+        engines[i] = swanson_engine_new(engine_kinds[i]);
+        assert(engines[i] != NULL);
+    }
+
+    count_test_cases();
+    plan_tests(test_case_count);
+    run_test_cases();
+
+    for (i = 0; i < ENGINE_COUNT; i++) {
+        swanson_engine_free(engines[i]);
+    }
+
+    struct test_case_file  *curr;
+    struct test_case_file  *next;
+    for (curr = test_case_files; curr != NULL; curr = next) {
+        next = curr->next;
+        test_case_file_free(curr);
+    }
+
+    return exit_status();
+}
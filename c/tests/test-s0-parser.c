@@ -7,8 +7,8 @@
 
 #include "ccan/likely/likely.h"
 #include "ccan/tap/tap.h"
-#include "directory-walker.h"
 #include "swanson.h"
+#include "swanson/directory-walker.h"
 #include "yaml.h"
 
 
@@ -70,7 +70,9 @@ create_test_case(int child_fd, const char *full_path, const char *rel_path,
 static void
 load_test_cases(const char *directory)
 {
-    walk_directory(directory, create_test_case, NULL);
+    if (walk_directory(directory, create_test_case, NULL) != 0) {
+        exit(EXIT_FAILURE);
+    }
 }
 
 
@@ -3,7 +3,16 @@
  * Please see the COPYING file in this distribution for license details.
  */
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 
 #include "swanson.h"
 #include "test-cases.h"
@@ -135,6 +144,143 @@ load_block(const char *str)
     return block;
 }
 
+/*-----------------------------------------------------------------------------
+ * S₀: Runtimes
+ */
+
+TEST_CASE_GROUP("S₀ runtimes");
+
+/* Records a type mismatch error in the current runtime. */
+static void
+cause_type_mismatch(void)
+{
+    struct s0_entity_type  *type;
+    struct s0_entity  *atom;
+    check_alloc(type, entity_type(
+                YAML
+                "!s0!closure\n"
+                "branches:\n"
+                "  cont: {}\n"
+                ));
+    check_alloc(atom, s0_atom_new());
+    check(!s0_entity_type_satisfied_by(type, atom));
+    s0_entity_free(atom);
+    s0_entity_type_free(type);
+}
+
+TEST_CASE("runtimes keep track of their own errors") {
+    struct s0_runtime  *runtime1;
+    struct s0_runtime  *runtime2;
+    check_alloc(runtime1, s0_runtime_new());
+    check_alloc(runtime2, s0_runtime_new());
+    check(s0_runtime_error_code(runtime1) == S0_ERROR_NONE);
+    check(s0_runtime_error_code(runtime2) == S0_ERROR_NONE);
+    /* Cause an error while runtime1 is current */
+    check(s0_runtime_set_current(runtime1) == NULL);
+    check(s0_runtime_current() == runtime1);
+    cause_type_mismatch();
+    check(s0_error_get_last_code() == S0_ERROR_TYPE_MISMATCH);
+    /* Switching to runtime2 shouldn't show runtime1's error */
+    check(s0_runtime_set_current(runtime2) == runtime1);
+    check(s0_error_get_last_code() == S0_ERROR_NONE);
+    check(strcmp(s0_error_get_last_description(), "") == 0);
+    /* ...but runtime1 should still remember it */
+    check(s0_runtime_error_code(runtime1) == S0_ERROR_TYPE_MISMATCH);
+    check(strcmp(s0_runtime_error_description(runtime1), "") != 0);
+    /* Switch back to the default runtime */
+    check(s0_runtime_set_current(NULL) == runtime2);
+    check(s0_runtime_current() != runtime1);
+    check(s0_runtime_current() != runtime2);
+    s0_runtime_free(runtime1);
+    s0_runtime_free(runtime2);
+}
+
+TEST_CASE("runtimes have their own name tables") {
+    struct s0_runtime  *runtime1;
+    struct s0_runtime  *runtime2;
+    struct s0_name_table  *table1;
+    struct s0_name_table  *table2;
+    struct s0_name_table  *default_table;
+    check_alloc(runtime1, s0_runtime_new());
+    check_alloc(runtime2, s0_runtime_new());
+    check_nonnull(table1 = s0_runtime_name_table(runtime1));
+    check_nonnull(table2 = s0_runtime_name_table(runtime2));
+    check_nonnull(default_table = s0_runtime_name_table(s0_runtime_current()));
+    check(table1 != table2);
+    check(table1 != default_table);
+    check(s0_runtime_name_table(runtime1) == table1);
+    check(s0_name_table_intern(table1, 1, "a") !=
+          s0_name_table_intern(table2, 1, "a"));
+    s0_runtime_free(runtime1);
+    s0_runtime_free(runtime2);
+}
+
+static void *
+get_default_name_table(void *ud)
+{
+    struct s0_name_table  **table = ud;
+    *table = s0_runtime_name_table(s0_runtime_current());
+    return NULL;
+}
+
+TEST_CASE("default runtimes share a name table") {
+    pthread_t  thread;
+    struct s0_name_table  *ours;
+    struct s0_name_table  *theirs = NULL;
+    check_nonnull(ours = s0_runtime_name_table(s0_runtime_current()));
+    check0(pthread_create(&thread, NULL, get_default_name_table, &theirs));
+    check0(pthread_join(thread, NULL));
+    check(theirs == ours);
+}
+
+TEST_CASE("error descriptions include all prefixes") {
+    struct s0_environment_type  *type;
+    struct s0_environment  *env;
+    struct s0_name  *name;
+    struct s0_entity  *atom;
+    /* Construct ⦃a:⤿{cont:{}}⦄ */
+    check_alloc(type, environment_type(
+                YAML
+                "a: !s0!closure\n"
+                "  branches:\n"
+                "    cont: {}\n"
+                ));
+    /* Construct {a:⋄} */
+    check_alloc(env, s0_environment_new());
+    check_alloc(name, s0_name_new_str("a"));
+    check_alloc(atom, s0_atom_new());
+    check0(s0_environment_add(env, name, atom));
+    /* Verify that the error mentions the environment entry */
+    check(!s0_environment_type_satisfied_by(type, env));
+    check(s0_error_get_last_code() == S0_ERROR_TYPE_MISMATCH);
+    check(strcmp(s0_error_get_last_description(),
+                 "In environment entry `a`:\n"
+                 "Entity is not a closure") == 0);
+    /* Free everything */
+    s0_environment_free(env);
+    s0_environment_type_free(type);
+}
+
+TEST_CASE("error descriptions include numeric details") {
+    struct s0_environment_type  *type;
+    struct s0_environment  *env;
+    /* Construct ⦃a:*⦄ */
+    check_alloc(type, environment_type(
+                YAML
+                "a: !s0!any {}\n"
+                ));
+    /* Construct {} */
+    check_alloc(env, s0_environment_new());
+    /* Verify that the error mentions the sizes */
+    check(!s0_environment_type_satisfied_by(type, env));
+    check(strcmp(s0_error_get_last_description(),
+                 "Environment has the wrong number of entries: "
+                 "has 0, needs 1") == 0);
+    /* Free everything */
+    s0_environment_free(env);
+    s0_environment_type_free(type);
+}
+
 /*-----------------------------------------------------------------------------
  * S₀: Names
  */
@@ -191,6 +337,148 @@ TEST_CASE("can compare names") {
     s0_name_free(n3);
 }
 
+/*-----------------------------------------------------------------------------
+ * S₀: Name tables
+ */
+
+TEST_CASE_GROUP("S₀ name tables");
+
+TEST_CASE("can create empty name table") {
+    struct s0_name_table  *table;
+    check_alloc(table, s0_name_table_new(16));
+    check(s0_name_table_size(table) == 0);
+    s0_name_table_free(table);
+}
+
+TEST_CASE("interning the same name twice returns the same instance") {
+    struct s0_name_table  *table;
+    struct s0_name  *name;
+    const struct s0_name  *a1;
+    const struct s0_name  *a2;
+    const struct s0_name  *a3;
+    const struct s0_name  *b;
+    check_alloc(table, s0_name_table_new(16));
+    check_nonnull(a1 = s0_name_table_intern(table, 1, "a"));
+    check_nonnull(b = s0_name_table_intern(table, 1, "b"));
+    check_nonnull(a2 = s0_name_table_intern(table, 1, "a"));
+    check_alloc(name, s0_name_new_str("a"));
+    check_nonnull(a3 = s0_name_table_intern_name(table, name));
+    check(a1 == a2);
+    check(a1 == a3);
+    check(a1 != b);
+    check(s0_name_eq(a1, name));
+    check(!s0_name_eq(a1, b));
+    check(s0_name_table_size(table) == 2);
+    s0_name_free(name);
+    s0_name_table_free(table);
+}
+
+TEST_CASE("can intern more names than there are buckets") {
+    struct s0_name_table  *table;
+    const struct s0_name  *interned[100];
+    char  buf[16];
+    size_t  i;
+    check_alloc(table, s0_name_table_new(4));
+    for (i = 0; i < 100; i++) {
+        snprintf(buf, sizeof(buf), "name%zu", i);
+        check_nonnull(interned[i] =
+                      s0_name_table_intern(table, strlen(buf), buf));
+    }
+    check(s0_name_table_size(table) == 100);
+    for (i = 0; i < 100; i++) {
+        snprintf(buf, sizeof(buf), "name%zu", i);
+        check(s0_name_table_intern(table, strlen(buf), buf) == interned[i]);
+    }
+    s0_name_table_free(table);
+}
+
+TEST_CASE("interned names can be handed to containers") {
+    struct s0_name_table  *table;
+    struct s0_name_set  *set;
+    struct s0_name  *a;
+    check_alloc(table, s0_name_table_new(16));
+    check_alloc(set, s0_name_set_new());
+    check_nonnull(a = s0_name_table_intern(table, 1, "a"));
+    check0(s0_name_set_add(set, a));
+    s0_name_set_free(set);
+    /* The set didn't free the table's instance. */
+    check(s0_name_table_intern(table, 1, "a") == a);
+    check(strcmp(s0_name_content(a), "a") == 0);
+    s0_name_table_free(table);
+}
+
+TEST_CASE("renaming an environment doesn't modify interned names") {
+    struct s0_name_table  *table;
+    struct s0_environment  *env;
+    struct s0_name_mapping  *mapping;
+    struct s0_entity  *atom;
+    struct s0_name  *a;
+    struct s0_name  *b;
+    check_alloc(table, s0_name_table_new(16));
+    check_nonnull(a = s0_name_table_intern(table, 1, "a"));
+    check_nonnull(b = s0_name_table_intern(table, 1, "b"));
+    check_alloc(env, s0_environment_new());
+    check_alloc(atom, s0_atom_new());
+    check0(s0_environment_add(env, a, atom));
+    check_alloc(mapping, s0_name_mapping_new());
+    check0(s0_name_mapping_add(mapping, a, b));
+    check0(s0_environment_rename(env, mapping));
+    check(s0_environment_get(env, b) == atom);
+    check(s0_environment_get(env, a) == NULL);
+    check(strcmp(s0_name_content(a), "a") == 0);
+    s0_name_mapping_free(mapping);
+    s0_environment_free(env);
+    s0_name_table_free(table);
+}
+
+#define INTERN_THREAD_COUNT  8
+#define INTERN_NAME_COUNT  1000
+
+struct intern_thread {
+    pthread_t  thread;
+    struct s0_name_table  *table;
+    const struct s0_name  *interned[INTERN_NAME_COUNT];
+};
+
+static void *
+intern_names(void *ud)
+{
+    struct intern_thread  *thread = ud;
+    size_t  i;
+    for (i = 0; i < INTERN_NAME_COUNT; i++) {
+        char  buf[16];
+        snprintf(buf, sizeof(buf), "name%zu", i);
+        thread->interned[i] =
+            s0_name_table_intern(thread->table, strlen(buf), buf);
+    }
+    return NULL;
+}
+
+TEST_CASE("threads interning the same names agree on the instances") {
+    struct s0_name_table  *table;
+    struct intern_thread  threads[INTERN_THREAD_COUNT];
+    size_t  i;
+    size_t  j;
+    /* Use a small table so that threads contend on the buckets */
+    check_alloc(table, s0_name_table_new(8));
+    for (i = 0; i < INTERN_THREAD_COUNT; i++) {
+        threads[i].table = table;
+        check0(pthread_create
+               (&threads[i].thread, NULL, intern_names, &threads[i]));
+    }
+    for (i = 0; i < INTERN_THREAD_COUNT; i++) {
+        check0(pthread_join(threads[i].thread, NULL));
+    }
+    check(s0_name_table_size(table) == INTERN_NAME_COUNT);
+    for (i = 0; i < INTERN_THREAD_COUNT; i++) {
+        for (j = 0; j < INTERN_NAME_COUNT; j++) {
+            check_nonnull(threads[i].interned[j]);
+            check(threads[i].interned[j] == threads[0].interned[j]);
+        }
+    }
+    s0_name_table_free(table);
+}
+
 /*-----------------------------------------------------------------------------
  * S₀: Name sets
  */
@@ -284,6 +572,56 @@ TEST_CASE("can create a copy of a name set") {
     s0_name_set_free(copy);
 }
 
+TEST_CASE("name sets with same names in different order are equal") {
+    struct s0_name_set  *set1;
+    struct s0_name_set  *set2;
+    struct s0_name  *name;
+    const char  *names[] = { "m", "zz", "a", "q", "bb", "c", "aaa", "e", "x" };
+    size_t  count = sizeof(names) / sizeof(names[0]);
+    size_t  i;
+    check_alloc(set1, s0_name_set_new());
+    check_alloc(set2, s0_name_set_new());
+    for (i = 0; i < count; i++) {
+        check_alloc(name, s0_name_new_str(names[i]));
+        check0(s0_name_set_add(set1, name));
+        check_alloc(name, s0_name_new_str(names[count - i - 1]));
+        check0(s0_name_set_add(set2, name));
+    }
+    check(s0_name_set_eq(set1, set2));
+    for (i = 0; i < count; i++) {
+        check_alloc(name, s0_name_new_str(names[i]));
+        check(s0_name_set_contains(set1, name));
+        check(s0_name_set_contains(set2, name));
+        s0_name_free(name);
+    }
+    /* Adding one more name to one of the sets makes them unequal */
+    check_alloc(name, s0_name_new_str("b"));
+    check(!s0_name_set_contains(set1, name));
+    check0(s0_name_set_add(set1, name));
+    check(!s0_name_set_eq(set1, set2));
+    s0_name_set_free(set1);
+    s0_name_set_free(set2);
+}
+
+TEST_CASE("name sets with different names of the same size are not equal") {
+    struct s0_name_set  *set1;
+    struct s0_name_set  *set2;
+    struct s0_name  *name;
+    check_alloc(set1, s0_name_set_new());
+    check_alloc(name, s0_name_new_str("a"));
+    check0(s0_name_set_add(set1, name));
+    check_alloc(name, s0_name_new_str("b"));
+    check0(s0_name_set_add(set1, name));
+    check_alloc(set2, s0_name_set_new());
+    check_alloc(name, s0_name_new_str("a"));
+    check0(s0_name_set_add(set2, name));
+    check_alloc(name, s0_name_new_str("c"));
+    check0(s0_name_set_add(set2, name));
+    check(!s0_name_set_eq(set1, set2));
+    s0_name_set_free(set1);
+    s0_name_set_free(set2);
+}
+
 TEST_CASE("can iterate through names in set") {
     struct s0_name_set  *set;
     struct s0_name  *name;
@@ -400,6 +738,40 @@ TEST_CASE("can check which names belong to mapping") {
     s0_name_mapping_free(mapping);
 }
 
+TEST_CASE("can look up names in a large name mapping") {
+    struct s0_name_mapping  *mapping;
+    struct s0_name  *from;
+    struct s0_name  *to;
+    const struct s0_name  *actual;
+    const char  *froms[] = { "m", "zz", "a", "q", "bb", "c", "aaa", "e", "x" };
+    const char  *tos[] = { "1", "2", "3", "4", "5", "6", "7", "8", "9" };
+    size_t  count = sizeof(froms) / sizeof(froms[0]);
+    size_t  i;
+    check_alloc(mapping, s0_name_mapping_new());
+    /* Add names out of order, and enough of them to grow the mapping. */
+    for (i = 0; i < count; i++) {
+        check_alloc(from, s0_name_new_str(froms[i]));
+        check_alloc(to, s0_name_new_str(tos[i]));
+        check0(s0_name_mapping_add(mapping, from, to));
+    }
+    check(s0_name_mapping_size(mapping) == count);
+    for (i = 0; i < count; i++) {
+        check_alloc(from, s0_name_new_str(froms[i]));
+        check_alloc(to, s0_name_new_str(tos[i]));
+        check_nonnull(actual = s0_name_mapping_get(mapping, from));
+        check(s0_name_eq(actual, to));
+        s0_name_free(from);
+        s0_name_free(to);
+    }
+    check_alloc(from, s0_name_new_str("b"));
+    check(s0_name_mapping_get(mapping, from) == NULL);
+    s0_name_free(from);
+    check_alloc(from, s0_name_new_str("zzz"));
+    check(s0_name_mapping_get(mapping, from) == NULL);
+    s0_name_free(from);
+    s0_name_mapping_free(mapping);
+}
+
 TEST_CASE("can create a copy of a name mapping") {
     struct s0_name_mapping  *mapping;
     struct s0_name_mapping  *copy;
@@ -554,7 +926,12 @@ TEST_CASE("can create a copy of named blocks") {
     check0(s0_named_blocks_add(blocks, name, block));
     check_alloc(copy, s0_named_blocks_new_copy(blocks));
     check(s0_named_blocks_eq(blocks, copy));
+    /* The copy shares the original's blocks, and keeps them alive. */
+    check_alloc(name, s0_name_new_str("b"));
+    check(s0_named_blocks_get(copy, name) == block);
     s0_named_blocks_free(blocks);
+    check(s0_named_blocks_get(copy, name) == block);
+    s0_name_free(name);
     s0_named_blocks_free(copy);
 }
 
@@ -586,6 +963,56 @@ TEST_CASE("can delete block in named blocks") {
     s0_named_blocks_free(blocks);
 }
 
+TEST_CASE("deleting from named blocks updates size") {
+    struct s0_named_blocks  *blocks;
+    struct s0_name  *name;
+    struct s0_block  *block;
+    check_alloc(blocks, s0_named_blocks_new());
+    check_alloc(name, s0_name_new_str("a"));
+    check_alloc(block, create_empty_block());
+    check0(s0_named_blocks_add(blocks, name, block));
+    check_alloc(name, s0_name_new_str("b"));
+    check_alloc(block, create_empty_block());
+    check0(s0_named_blocks_add(blocks, name, block));
+    check(s0_named_blocks_size(blocks) == 2);
+
+    check_alloc(name, s0_name_new_str("a"));
+    check_nonnull(block = s0_named_blocks_delete(blocks, name));
+    check(s0_named_blocks_size(blocks) == 1);
+    s0_block_free(block);
+    /* Deleting a missing name doesn't change anything */
+    check(s0_named_blocks_delete(blocks, name) == NULL);
+    check(s0_named_blocks_size(blocks) == 1);
+    s0_name_free(name);
+
+    s0_named_blocks_free(blocks);
+}
+
+TEST_CASE("can look up blocks in large named blocks") {
+    struct s0_named_blocks  *blocks;
+    struct s0_name  *name;
+    struct s0_block  *added[9];
+    const char  *names[] = { "m", "zz", "a", "q", "bb", "c", "aaa", "e", "x" };
+    size_t  count = sizeof(names) / sizeof(names[0]);
+    size_t  i;
+    check_alloc(blocks, s0_named_blocks_new());
+    for (i = 0; i < count; i++) {
+        check_alloc(name, s0_name_new_str(names[i]));
+        check_alloc(added[i], create_empty_block());
+        check0(s0_named_blocks_add(blocks, name, added[i]));
+    }
+    check(s0_named_blocks_size(blocks) == count);
+    for (i = 0; i < count; i++) {
+        check_alloc(name, s0_name_new_str(names[i]));
+        check(s0_named_blocks_get(blocks, name) == added[i]);
+        s0_name_free(name);
+    }
+    check_alloc(name, s0_name_new_str("b"));
+    check(s0_named_blocks_get(blocks, name) == NULL);
+    s0_name_free(name);
+    s0_named_blocks_free(blocks);
+}
+
 /*-----------------------------------------------------------------------------
  * S₀: Statements
  */
@@ -916,8 +1343,11 @@ TEST_CASE("can create block") {
     check_alloc(invocation, s0_invoke_closure_new(src, branch, params));
     check_alloc(block, s0_block_new(inputs, statements, invocation));
     check(s0_block_inputs(block) == inputs);
-    check(s0_block_statements(block) == statements);
-    check(s0_block_invocation(block) == invocation);
+    check(s0_statement_list_size(s0_block_statements(block)) == 0);
+    check(s0_invocation_kind(s0_block_invocation(block)) ==
+          S0_INVOCATION_KIND_INVOKE_CLOSURE);
+    check(s0_invoke_closure_src(s0_block_invocation(block)) == src);
+    check(s0_invoke_closure_branch(s0_block_invocation(block)) == branch);
     s0_block_free(block);
 }
 
@@ -943,6 +1373,146 @@ TEST_CASE("can copy a block") {
     s0_block_free(copy);
 }
 
+/*-----------------------------------------------------------------------------
+ * S₀: Source maps
+ */
+
+TEST_CASE_GROUP("S₀ source maps");
+
+#define CLOSURE_MODULE \
+    YAML \
+    "inputs:\n" \
+    "  finish: !s0!object\n" \
+    "    finish: !s0!method\n" \
+    "      inputs:\n" \
+    "        self: !s0!object {}\n" \
+    "statements:\n" \
+    "  - !s0!create-closure\n" \
+    "    dest: continue\n" \
+    "    closed-over: []\n" \
+    "    branches:\n" \
+    "      body:\n" \
+    "        inputs:\n" \
+    "          finish: !s0!object\n" \
+    "            finish: !s0!method\n" \
+    "              inputs:\n" \
+    "                self: !s0!object {}\n" \
+    "        statements: []\n" \
+    "        invocation:\n" \
+    "          !s0!invoke-method\n" \
+    "          src: finish\n" \
+    "          method: finish\n" \
+    "          parameters:\n" \
+    "            finish: self\n" \
+    "invocation:\n" \
+    "  !s0!invoke-closure\n" \
+    "  src: continue\n" \
+    "  branch: body\n" \
+    "  parameters:\n" \
+    "    finish: finish\n"
+
+TEST_CASE("the loader interns a module's names in the current runtime") {
+    struct s0_block  *block;
+    struct s0_statement  *stmt;
+    struct s0_name_table  *table;
+    check_alloc(block, load_block(CLOSURE_MODULE));
+    check_nonnull(table = s0_runtime_name_table(s0_runtime_current()));
+    stmt = s0_statement_list_at(s0_block_statements(block), 0);
+    check(s0_create_closure_dest(stmt) ==
+          s0_invoke_closure_src(s0_block_invocation(block)));
+    check(s0_create_closure_dest(stmt) ==
+          s0_name_table_intern(table, 8, "continue"));
+    s0_block_free(block);
+}
+
+TEST_CASE("blocks created directly don't have a source location") {
+    struct s0_block  *block;
+    struct s0_source_location  location;
+    check_alloc(block, create_empty_block());
+    check(!s0_block_source_location(block, &location));
+    check(s0_block_source_name(block) == NULL);
+    s0_block_free(block);
+}
+
+TEST_CASE("loaded blocks know where they were defined") {
+    struct s0_block  *block;
+    struct s0_statement  *stmt;
+    struct s0_name  *name;
+    struct s0_block  *branch;
+    struct s0_source_location  location;
+    check_alloc(block, load_block(CLOSURE_MODULE));
+    /* The module itself */
+    check(s0_block_source_location(block, &location));
+    check(location.filename == NULL);
+    check(location.line == 3);
+    check(location.column == 1);
+    check(strcmp(s0_name_human_readable(s0_block_source_name(block)),
+                 "module") == 0);
+    /* The closure's branch */
+    stmt = s0_statement_list_at(s0_block_statements(block), 0);
+    check_alloc(name, s0_name_new_str("body"));
+    branch = s0_named_blocks_get(s0_create_closure_branches(stmt), name);
+    s0_name_free(name);
+    check_nonnull(branch);
+    check(s0_block_source_location(branch, &location));
+    check(location.line == 14);
+    check(location.column == 9);
+    check(strcmp(s0_name_human_readable(s0_block_source_name(branch)),
+                 "body") == 0);
+    s0_block_free(block);
+}
+
+TEST_CASE("loaded blocks know where their statements were defined") {
+    struct s0_block  *block;
+    struct s0_statement  *stmt;
+    struct s0_name  *name;
+    struct s0_block  *branch;
+    struct s0_source_location  location;
+    check_alloc(block, load_block(CLOSURE_MODULE));
+    /* The module's create-closure statement */
+    check(s0_block_statement_location(block, 0, &location));
+    check(location.filename == NULL);
+    check(location.line == 9);
+    check(location.column == 5);
+    /* The module's invocation */
+    check(s0_block_invocation_location(block, &location));
+    check(location.line == 27);
+    check(location.column == 3);
+    check(s0_block_statement_location(block, 1, &location));
+    check(location.line == 27);
+    /* The branch doesn't have any statements, just an invocation */
+    stmt = s0_statement_list_at(s0_block_statements(block), 0);
+    check_alloc(name, s0_name_new_str("body"));
+    branch = s0_named_blocks_get(s0_create_closure_branches(stmt), name);
+    s0_name_free(name);
+    check_nonnull(branch);
+    check(s0_block_invocation_location(branch, &location));
+    check(location.line == 21);
+    check(location.column == 11);
+    s0_block_free(block);
+}
+
+TEST_CASE("blocks created directly don't have statement locations") {
+    struct s0_block  *block;
+    struct s0_source_location  location;
+    check_alloc(block, create_empty_block());
+    check(!s0_block_invocation_location(block, &location));
+    s0_block_free(block);
+}
+
+TEST_CASE("copies of blocks keep their source location") {
+    struct s0_block  *block;
+    struct s0_block  *copy;
+    struct s0_source_location  location;
+    check_alloc(block, load_block(CLOSURE_MODULE));
+    check_alloc(copy, s0_block_new_copy(block));
+    s0_block_free(block);
+    check(s0_block_source_location(copy, &location));
+    check(location.line == 3);
+    check(location.column == 1);
+    s0_block_free(copy);
+}
+
 /*-----------------------------------------------------------------------------
  * S₀: Atoms
  */
@@ -1340,6 +1910,81 @@ TEST_CASE("can extract entries from an environment") {
     s0_environment_free(dest);
 }
 
+TEST_CASE("can't extract missing entries from an environment") {
+    struct s0_environment  *src;
+    struct s0_environment  *dest;
+    struct s0_name  *name;
+    struct s0_name_set  *set;
+    /* Construct {a:⋄} */
+    check_alloc(src, s0_environment_new());
+    check_alloc(name, s0_name_new_str("a"));
+    check0(s0_environment_add(src, name, s0_atom_new()));
+    /* Try to extract `a` and `b` into dest */
+    check_alloc(set, s0_name_set_new());
+    check_alloc(name, s0_name_new_str("a"));
+    check0(s0_name_set_add(set, name));
+    check_alloc(name, s0_name_new_str("b"));
+    check0(s0_name_set_add(set, name));
+    check_alloc(dest, s0_environment_new());
+    check(s0_environment_extract(dest, src, set) == -1);
+    check(s0_error_get_last_code() == S0_ERROR_UNDEFINED);
+    check(strcmp(s0_error_get_last_description(),
+                 "Environment doesn't have an entry named `b`") == 0);
+    /* Free everything */
+    s0_name_set_free(set);
+    s0_environment_free(src);
+    s0_environment_free(dest);
+}
+
+TEST_CASE("can extract several entries from an environment") {
+    struct s0_environment  *src;
+    struct s0_environment  *dest;
+    struct s0_name  *name;
+    struct s0_entity  *atoms[5];
+    const char  *names[] = { "a", "b", "c", "d", "e" };
+    struct s0_name_set  *set;
+    size_t  i;
+    /* Construct {a:⋄,b:⋄,c:⋄,d:⋄} */
+    check_alloc(src, s0_environment_new());
+    for (i = 0; i < 4; i++) {
+        check_alloc(name, s0_name_new_str(names[i]));
+        check_alloc(atoms[i], s0_atom_new());
+        check0(s0_environment_add(src, name, atoms[i]));
+    }
+    /* Construct {e:⋄} */
+    check_alloc(dest, s0_environment_new());
+    check_alloc(name, s0_name_new_str("e"));
+    check_alloc(atoms[4], s0_atom_new());
+    check0(s0_environment_add(dest, name, atoms[4]));
+    /* Extract `a`, `b`, and `d` into dest */
+    check_alloc(set, s0_name_set_new());
+    check_alloc(name, s0_name_new_str("d"));
+    check0(s0_name_set_add(set, name));
+    check_alloc(name, s0_name_new_str("a"));
+    check0(s0_name_set_add(set, name));
+    check_alloc(name, s0_name_new_str("b"));
+    check0(s0_name_set_add(set, name));
+    check0(s0_environment_extract(dest, src, set));
+    s0_name_set_free(set);
+    /* Verify that src == {c:⋄} */
+    check(s0_environment_size(src) == 1);
+    for (i = 0; i < 5; i++) {
+        check_alloc(name, s0_name_new_str(names[i]));
+        check(s0_environment_get(src, name) == (i == 2? atoms[i]: NULL));
+        s0_name_free(name);
+    }
+    /* Verify that dest == {a:⋄,b:⋄,d:⋄,e:⋄} */
+    check(s0_environment_size(dest) == 4);
+    for (i = 0; i < 5; i++) {
+        check_alloc(name, s0_name_new_str(names[i]));
+        check(s0_environment_get(dest, name) == (i == 2? NULL: atoms[i]));
+        s0_name_free(name);
+    }
+    /* Free everything */
+    s0_environment_free(src);
+    s0_environment_free(dest);
+}
+
 TEST_CASE("can merge environments") {
     struct s0_environment  *src;
     struct s0_environment  *dest;
@@ -1523,24 +2168,57 @@ TEST_CASE("{a:⋄,b:⋄}[a→b,b→a] == {a:⋄,b:⋄}") {
     s0_environment_free(env);
 }
 
-/*-----------------------------------------------------------------------------
- * S₀: Entity types: Any
- */
-
-TEST_CASE_GROUP("S₀ entity types: any");
-
-TEST_CASE("can load * from string") {
-    struct s0_entity_type  *expected;
-    struct s0_entity_type  *actual;
-    /* expected = * */
-    check_alloc(expected, s0_any_entity_type_new());
-    /* Load type from YAML string */
-    check_alloc(actual, entity_type(YAML "!s0!any {}"));
-    /* Verify actual == expected */
-    check(s0_entity_type_equiv(actual, expected));
-    /* Free everything */
-    s0_entity_type_free(actual);
-    s0_entity_type_free(expected);
+TEST_CASE("{a:⋄}[a→<long name>] == {<long name>:⋄}") {
+    struct s0_environment  *env;
+    struct s0_name  *name;
+    struct s0_entity  *atom;
+    struct s0_name_mapping  *mapping;
+    struct s0_name  *from;
+    struct s0_name  *to;
+    const char  *long_name =
+        "a name that is much longer than any of the names we started with";
+    /* Construct {a:⋄} */
+    check_alloc(env, s0_environment_new());
+    check_alloc(name, s0_name_new_str("a"));
+    check_alloc(atom, s0_atom_new());
+    check0(s0_environment_add(env, name, atom));
+    /* Construct [a→<long name>] */
+    check_alloc(mapping, s0_name_mapping_new());
+    check_alloc(from, s0_name_new_str("a"));
+    check_alloc(to, s0_name_new_str(long_name));
+    check0(s0_name_mapping_add(mapping, from, to));
+    /* Apply renaming */
+    check0(s0_environment_rename(env, mapping));
+    /* Verify that result == {<long name>:⋄} */
+    check_alloc(name, s0_name_new_str("a"));
+    check(s0_environment_get(env, name) == NULL);
+    s0_name_free(name);
+    check_alloc(name, s0_name_new_str(long_name));
+    check(s0_environment_get(env, name) == atom);
+    s0_name_free(name);
+    /* Free everything */
+    s0_name_mapping_free(mapping);
+    s0_environment_free(env);
+}
+
+/*-----------------------------------------------------------------------------
+ * S₀: Entity types: Any
+ */
+
+TEST_CASE_GROUP("S₀ entity types: any");
+
+TEST_CASE("can load * from string") {
+    struct s0_entity_type  *expected;
+    struct s0_entity_type  *actual;
+    /* expected = * */
+    check_alloc(expected, s0_any_entity_type_new());
+    /* Load type from YAML string */
+    check_alloc(actual, entity_type(YAML "!s0!any {}"));
+    /* Verify actual == expected */
+    check(s0_entity_type_equiv(actual, expected));
+    /* Free everything */
+    s0_entity_type_free(actual);
+    s0_entity_type_free(expected);
 }
 
 TEST_CASE("can copy *") {
@@ -3841,6 +4519,2443 @@ TEST_CASE("can extract an entity from an S₀ execution") {
     s0_block_free(block);
 }
 
+static bool
+literal_equals(const struct s0_entity *entity, const char *expected)
+{
+    return entity != NULL
+        && s0_entity_kind(entity) == S0_ENTITY_KIND_LITERAL
+        && s0_literal_size(entity) == strlen(expected)
+        && memcmp(s0_literal_content(entity), expected, strlen(expected)) == 0;
+}
+
+TEST_CASE("can execute a copy of a block after freeing the original") {
+    struct s0_environment  *env;
+    struct s0_name  *name;
+    struct s0_entity  *extractor;
+    struct s0_entity_type  *result_type;
+    struct s0_entity  *result = NULL;
+    struct s0_block  *block;
+    struct s0_block  *copy;
+    /* Create an environment with an extractor closure */
+    check_alloc(env, s0_environment_new());
+    check_alloc(name, s0_name_new_str("result"));
+    check_alloc(result_type, s0_any_entity_type_new());
+    check_alloc(extractor, s0_extractor_new(name, result_type, &result));
+    check_alloc(name, s0_name_new_str("finish"));
+    check0(s0_environment_add(env, name, extractor));
+    /* Create a block, copy it, and free the original before we execute the
+     * copy, so that the copy can't lean on anything the original owned. */
+    check_alloc(block, load_block(
+                YAML
+                "inputs:\n"
+                "  finish: !s0!closure\n"
+                "    branches:\n"
+                "      body:\n"
+                "        result: !s0!any {}\n"
+                "statements:\n"
+                "  - !s0!create-literal\n"
+                "    dest: result\n"
+                "    content: hello\n"
+                "  - !s0!create-closure\n"
+                "    dest: continue\n"
+                "    closed-over: [finish]\n"
+                "    branches:\n"
+                "      body:\n"
+                "        inputs:\n"
+                "          result: !s0!any {}\n"
+                "        statements: []\n"
+                "        invocation:\n"
+                "          !s0!invoke-closure\n"
+                "          src: finish\n"
+                "          branch: body\n"
+                "          parameters:\n"
+                "            result: result\n"
+                "invocation:\n"
+                "  !s0!invoke-closure\n"
+                "  src: continue\n"
+                "  branch: body\n"
+                "  parameters:\n"
+                "    result: result\n"
+                ));
+    check_alloc(copy, s0_block_new_copy(block));
+    s0_block_free(block);
+    /* Execute the copy */
+    check0(s0_block_execute(copy, env));
+    check(literal_equals(result, "hello"));
+    /* Free everything */
+    s0_environment_free(env);
+    s0_entity_free(result);
+    s0_block_free(copy);
+}
+
+/* Loads a block that creates a closure and then invokes it, passing an atom
+ * through to `finish`. */
+static struct s0_block *
+load_closure_chain_block(void)
+{
+    return load_block(
+                YAML
+                "inputs:\n"
+                "  finish: !s0!closure\n"
+                "    branches:\n"
+                "      body:\n"
+                "        result: !s0!any {}\n"
+                "statements:\n"
+                "  - !s0!create-atom\n"
+                "    dest: result\n"
+                "  - !s0!create-closure\n"
+                "    dest: next\n"
+                "    closed-over: [finish]\n"
+                "    branches:\n"
+                "      body:\n"
+                "        inputs:\n"
+                "          value: !s0!any {}\n"
+                "        statements: []\n"
+                "        invocation:\n"
+                "          !s0!invoke-closure\n"
+                "          src: finish\n"
+                "          branch: body\n"
+                "          parameters:\n"
+                "            value: result\n"
+                "invocation:\n"
+                "  !s0!invoke-closure\n"
+                "  src: next\n"
+                "  branch: body\n"
+                "  parameters:\n"
+                "    result: value\n");
+}
+
+/* Creates an environment whose `finish` is an extractor that stores the result
+ * of an execution into *result. */
+static struct s0_environment *
+create_extractor_environment(struct s0_entity **result)
+{
+    struct s0_environment  *env;
+    struct s0_name  *name;
+    struct s0_entity_type  *result_type;
+    struct s0_entity  *extractor;
+    env = s0_environment_new();
+    name = s0_name_new_str("result");
+    result_type = s0_any_entity_type_new();
+    extractor = s0_extractor_new(name, result_type, result);
+    name = s0_name_new_str("finish");
+    if (env == NULL || extractor == NULL || name == NULL
+        || s0_environment_add(env, name, extractor) != 0) {
+        if (env != NULL) {
+            s0_environment_free(env);
+        }
+        return NULL;
+    }
+    return env;
+}
+
+TEST_CASE("can execute a block one step at a time") {
+    struct s0_environment  *env;
+    struct s0_entity  *result = NULL;
+    struct s0_block  *block;
+    struct s0_execution  *execution;
+    enum s0_execution_status  status;
+    size_t  suspensions = 0;
+    check_alloc(block, load_closure_chain_block());
+    check_alloc(env, create_extractor_environment(&result));
+    /* Execute the block, resuming it until it finishes */
+    status = s0_block_execute_bounded(block, env, 1, &execution);
+    while (status == S0_EXECUTION_SUSPENDED) {
+        check_nonnull(execution);
+        suspensions++;
+        status = s0_execution_resume(execution, 1);
+    }
+    check(status == S0_EXECUTION_FINISHED);
+    check(suspensions > 0);
+    /* Verify that we got an atom */
+    check_nonnull(result);
+    check(s0_entity_kind(result) == S0_ENTITY_KIND_ATOM);
+    /* Free everything */
+    s0_environment_free(env);
+    s0_entity_free(result);
+    s0_block_free(block);
+}
+
+TEST_CASE("can execute a block without suspending") {
+    struct s0_environment  *env;
+    struct s0_entity  *result = NULL;
+    struct s0_block  *block;
+    struct s0_execution  *execution;
+    check_alloc(block, load_closure_chain_block());
+    check_alloc(env, create_extractor_environment(&result));
+    check(s0_block_execute_bounded(block, env, SIZE_MAX, &execution)
+          == S0_EXECUTION_FINISHED);
+    check(execution == NULL);
+    check_nonnull(result);
+    s0_environment_free(env);
+    s0_entity_free(result);
+    s0_block_free(block);
+}
+
+TEST_CASE("can cancel a suspended execution") {
+    struct s0_environment  *env;
+    struct s0_entity  *result = NULL;
+    struct s0_block  *block;
+    struct s0_execution  *execution;
+    check_alloc(block, load_closure_chain_block());
+    check_alloc(env, create_extractor_environment(&result));
+    check(s0_block_execute_bounded(block, env, 1, &execution)
+          == S0_EXECUTION_SUSPENDED);
+    check_nonnull(execution);
+    s0_execution_cancel(execution);
+    check(result == NULL);
+    /* Free everything */
+    s0_environment_free(env);
+    s0_block_free(block);
+}
+
+TEST_CASE("bounded execution checks the block's inputs") {
+    struct s0_environment  *env;
+    struct s0_block  *block;
+    struct s0_execution  *execution;
+    check_alloc(block, load_closure_chain_block());
+    check_alloc(env, s0_environment_new());
+    check(s0_block_execute_bounded(block, env, 1, &execution)
+          == S0_EXECUTION_ERROR);
+    check(execution == NULL);
+    s0_environment_free(env);
+    s0_block_free(block);
+}
+
+#define EXECUTION_THREAD_COUNT  8
+#define EXECUTIONS_PER_THREAD  2000
+
+struct execution_thread {
+    pthread_t  thread;
+    struct s0_block  *block;
+    unsigned int  failures;
+};
+
+static void *
+execute_shared_block(void *ud)
+{
+    struct execution_thread  *thread = ud;
+    unsigned int  i;
+    for (i = 0; i < EXECUTIONS_PER_THREAD; i++) {
+        struct s0_environment  *env;
+        struct s0_name  *name;
+        struct s0_entity  *extractor;
+        struct s0_entity_type  *result_type;
+        struct s0_entity  *result = NULL;
+
+        env = s0_environment_new();
+        name = s0_name_new_str("result");
+        result_type = s0_any_entity_type_new();
+        extractor = s0_extractor_new(name, result_type, &result);
+        name = s0_name_new_str("finish");
+        if (env == NULL || extractor == NULL || name == NULL
+            || s0_environment_add(env, name, extractor) != 0
+            || s0_block_execute(thread->block, env) != 0
+            || result == NULL
+            || s0_entity_kind(result) != S0_ENTITY_KIND_ATOM) {
+            thread->failures++;
+        }
+        if (env != NULL) {
+            s0_environment_free(env);
+        }
+        if (result != NULL) {
+            s0_entity_free(result);
+        }
+    }
+    return NULL;
+}
+
+TEST_CASE("can execute a shared block from several threads") {
+    struct s0_block  *block;
+    struct execution_thread  threads[EXECUTION_THREAD_COUNT];
+    size_t  i;
+    /* Create a block that creates a closure and then invokes it */
+    check_alloc(block, load_closure_chain_block());
+    /* Execute the block in several threads at once */
+    for (i = 0; i < EXECUTION_THREAD_COUNT; i++) {
+        threads[i].block = block;
+        threads[i].failures = 0;
+        check0(pthread_create
+               (&threads[i].thread, NULL, execute_shared_block, &threads[i]));
+    }
+    for (i = 0; i < EXECUTION_THREAD_COUNT; i++) {
+        check0(pthread_join(threads[i].thread, NULL));
+        check(threads[i].failures == 0);
+    }
+    /* Free everything */
+    s0_block_free(block);
+}
+
+/*-----------------------------------------------------------------------------
+ * S₀: Profiling
+ */
+
+TEST_CASE_GROUP("S₀ profiling");
+
+static struct s0_environment *
+finish_environment(void)
+{
+    struct s0_environment  *env;
+    struct s0_name  *name;
+    struct s0_entity  *finish;
+    env = s0_environment_new();
+    name = s0_name_new_str("finish");
+    finish = s0_finish_new();
+    if (env == NULL || name == NULL || finish == NULL
+            || s0_environment_add(env, name, finish) != 0) {
+        return NULL;
+    }
+    return env;
+}
+
+/* Returns the profile in the given format, which you must free. */
+static char *
+write_profile(int (*write)(FILE *))
+{
+    char  *content;
+    size_t  size;
+    FILE  *out = open_memstream(&content, &size);
+    if (out == NULL) {
+        return NULL;
+    }
+    if (write(out) != 0) {
+        fclose(out);
+        free(content);
+        return NULL;
+    }
+    fclose(out);
+    return content;
+}
+
+TEST_CASE("profiler doesn't record anything while it's stopped") {
+    struct s0_environment  *env;
+    struct s0_block  *block;
+    char  *profile;
+    s0_profiler_reset();
+    check_alloc(env, finish_environment());
+    check_alloc(block, load_block(CLOSURE_MODULE));
+    check0(s0_block_execute(block, env));
+    check_alloc(profile, write_profile(s0_profiler_write_folded));
+    check(strcmp(profile, "") == 0);
+    free(profile);
+    s0_environment_free(env);
+    s0_block_free(block);
+}
+
+TEST_CASE("profiler records each block by where it was defined") {
+    struct s0_environment  *env;
+    struct s0_block  *block;
+    char  *profile;
+    size_t  i;
+    s0_profiler_reset();
+    check_alloc(block, load_block(CLOSURE_MODULE));
+    s0_profiler_start();
+    for (i = 0; i < 3; i++) {
+        check_alloc(env, finish_environment());
+        check0(s0_block_execute(block, env));
+        s0_environment_free(env);
+    }
+    s0_profiler_stop();
+    s0_block_free(block);
+    /* The profiler keeps the blocks around until it's reset. */
+    check_alloc(profile, write_profile(s0_profiler_write_folded));
+    check(strstr(profile, "[string];module 3:1 ") != NULL);
+    check(strstr(profile, "[string];module 3:1;body 14:9 ") != NULL);
+    check(strstr(profile, "[primitives];finish ") != NULL);
+    free(profile);
+    check_alloc(profile, write_profile(s0_profiler_write_table));
+    check(strstr(profile, "             3  ") != NULL);
+    check(strstr(profile, "[string]:14:9 `body`") != NULL);
+    check(strstr(profile, "primitive `finish`") != NULL);
+    free(profile);
+    s0_profiler_reset();
+}
+
+
+/*-----------------------------------------------------------------------------
+ * S₀: Tracing
+ */
+
+TEST_CASE_GROUP("S₀ tracing");
+
+TEST_CASE("tracer doesn't record anything while it's stopped") {
+    struct s0_environment  *env;
+    struct s0_block  *block;
+    char  *trace;
+    s0_tracer_reset();
+    check_alloc(env, finish_environment());
+    check_alloc(block, load_block(CLOSURE_MODULE));
+    check0(s0_block_execute(block, env));
+    check_alloc(trace, write_profile(s0_tracer_write_chrome_json));
+    check(strstr(trace, "\"traceEvents\": [\n]") != NULL);
+    check(strstr(trace, "\"ph\"") == NULL);
+    free(trace);
+    s0_environment_free(env);
+    s0_block_free(block);
+}
+
+TEST_CASE("tracer records each block, statement, and invocation") {
+    struct s0_environment  *env;
+    struct s0_block  *block;
+    char  *trace;
+    s0_tracer_reset();
+    check_alloc(block, load_block(CLOSURE_MODULE));
+    check_alloc(env, finish_environment());
+    s0_tracer_start();
+    check0(s0_block_execute(block, env));
+    s0_tracer_stop();
+    s0_environment_free(env);
+    s0_block_free(block);
+    /* The tracer keeps the source maps around until it's reset. */
+    check_alloc(trace, write_profile(s0_tracer_write_chrome_json));
+    check(strstr(trace, "{\"name\": \"module\", \"cat\": \"block\"")
+          != NULL);
+    check(strstr(trace, "\"location\": \"[string]:14:9\"") != NULL);
+    check(strstr(trace, "{\"name\": \"create-closure\"") != NULL);
+    check(strstr(trace, "{\"name\": \"invoke-closure\"") != NULL);
+    /* Statements and invocations know where they were defined, too. */
+    check(strstr(trace, "\"index\": 0, \"location\": \"[string]:9:5\"")
+          != NULL);
+    check(strstr(trace, "\"index\": 0, \"location\": \"[string]:21:11\"")
+          != NULL);
+    check(strstr(trace, "{\"name\": \"invoke-method\"") != NULL);
+    check(strstr(trace, "{\"name\": \"primitive\"") != NULL);
+    check(strstr(trace, "\"dropped_events\": \"0\"") != NULL);
+    free(trace);
+    s0_tracer_reset();
+}
+
+struct traced_thread {
+    pthread_t  thread;
+    struct s0_block  *block;
+    struct s0_environment  *env;
+    int  rc;
+};
+
+static void *
+run_traced_thread(void *ud)
+{
+    struct traced_thread  *thread = ud;
+    thread->rc = s0_block_execute(thread->block, thread->env);
+    return NULL;
+}
+
+TEST_CASE("tracer keeps an exited thread's events until it's reset") {
+    struct traced_thread  thread;
+    char  *trace;
+    s0_tracer_reset();
+    check_alloc(thread.block, load_block(CLOSURE_MODULE));
+    check_alloc(thread.env, finish_environment());
+    s0_tracer_start();
+    check0(pthread_create(&thread.thread, NULL, run_traced_thread, &thread));
+    check0(pthread_join(thread.thread, NULL));
+    s0_tracer_stop();
+    check0(thread.rc);
+    s0_environment_free(thread.env);
+    s0_block_free(thread.block);
+    check_alloc(trace, write_profile(s0_tracer_write_chrome_json));
+    check(strstr(trace, "{\"name\": \"module\", \"cat\": \"block\"")
+          != NULL);
+    free(trace);
+    /* Resetting frees the exited thread's buffer. */
+    s0_tracer_reset();
+    check_alloc(trace, write_profile(s0_tracer_write_chrome_json));
+    check(strstr(trace, "\"traceEvents\": [\n]") != NULL);
+    free(trace);
+}
+
+/*-----------------------------------------------------------------------------
+ * S₀: Scheduler
+ */
+
+TEST_CASE_GROUP("S₀ scheduler");
+
+#define SCHEDULER_WORKER_COUNT  4
+#define SCHEDULER_TASK_COUNT  1000
+
+struct scheduled_task {
+    struct s0_entity  *result;
+    bool  done;
+    int  rc;
+};
+
+static void
+scheduled_task_done(void *ud, struct s0_environment *env, int rc)
+{
+    struct scheduled_task  *task = ud;
+    task->done = true;
+    task->rc = rc;
+    s0_environment_free(env);
+}
+
+TEST_CASE("can run many tasks on a scheduler") {
+    struct s0_scheduler  *scheduler;
+    struct s0_block  *block;
+    struct scheduled_task  *tasks;
+    size_t  i;
+    check_alloc(block, load_closure_chain_block());
+    check_alloc(tasks, calloc(SCHEDULER_TASK_COUNT,
+                              sizeof(struct scheduled_task)));
+    check_alloc(scheduler, s0_scheduler_new(SCHEDULER_WORKER_COUNT));
+    /* Submit all of the tasks */
+    for (i = 0; i < SCHEDULER_TASK_COUNT; i++) {
+        struct s0_environment  *env;
+        struct s0_name  *name;
+        struct s0_entity_type  *result_type;
+        struct s0_entity  *extractor;
+        check_alloc(env, s0_environment_new());
+        check_alloc(name, s0_name_new_str("result"));
+        check_alloc(result_type, s0_any_entity_type_new());
+        check_alloc(extractor, s0_extractor_new
+                    (name, result_type, &tasks[i].result));
+        check_alloc(name, s0_name_new_str("finish"));
+        check0(s0_environment_add(env, name, extractor));
+        check0(s0_scheduler_submit
+               (scheduler, block, env, scheduled_task_done, &tasks[i]));
+    }
+    /* Wait for them to finish */
+    s0_scheduler_wait(scheduler);
+    for (i = 0; i < SCHEDULER_TASK_COUNT; i++) {
+        check(tasks[i].done);
+        check0(tasks[i].rc);
+        check_nonnull(tasks[i].result);
+        check(s0_entity_kind(tasks[i].result) == S0_ENTITY_KIND_ATOM);
+        s0_entity_free(tasks[i].result);
+    }
+    /* Free everything */
+    s0_scheduler_free(scheduler);
+    s0_block_free(block);
+    free(tasks);
+}
+
+TEST_CASE("can preempt tasks on a scheduler") {
+    struct s0_scheduler  *scheduler;
+    struct s0_block  *block;
+    struct scheduled_task  *tasks;
+    size_t  i;
+    check_alloc(block, load_closure_chain_block());
+    check_alloc(tasks, calloc(SCHEDULER_TASK_COUNT,
+                              sizeof(struct scheduled_task)));
+    check_alloc(scheduler, s0_scheduler_new(SCHEDULER_WORKER_COUNT));
+    /* Preempt every task after every step */
+    s0_scheduler_set_time_slice(scheduler, 1);
+    for (i = 0; i < SCHEDULER_TASK_COUNT; i++) {
+        struct s0_environment  *env;
+        check_alloc(env, create_extractor_environment(&tasks[i].result));
+        check0(s0_scheduler_submit
+               (scheduler, block, env, scheduled_task_done, &tasks[i]));
+    }
+    s0_scheduler_wait(scheduler);
+    for (i = 0; i < SCHEDULER_TASK_COUNT; i++) {
+        check(tasks[i].done);
+        check0(tasks[i].rc);
+        check_nonnull(tasks[i].result);
+        check(s0_entity_kind(tasks[i].result) == S0_ENTITY_KIND_ATOM);
+        s0_entity_free(tasks[i].result);
+    }
+    /* Free everything */
+    s0_scheduler_free(scheduler);
+    s0_block_free(block);
+    free(tasks);
+}
+
+TEST_CASE("scheduler reports failed tasks") {
+    struct s0_scheduler  *scheduler;
+    struct s0_block  *block;
+    struct s0_environment  *env;
+    struct scheduled_task  task = { NULL, false, 0 };
+    check_alloc(block, load_closure_chain_block());
+    check_alloc(scheduler, s0_scheduler_new(2));
+    /* An empty environment doesn't satisfy the block's inputs */
+    check_alloc(env, s0_environment_new());
+    check0(s0_scheduler_submit
+           (scheduler, block, env, scheduled_task_done, &task));
+    s0_scheduler_free(scheduler);
+    check(task.done);
+    check(task.rc == -1);
+    check(task.result == NULL);
+    s0_block_free(block);
+}
+
+/*-----------------------------------------------------------------------------
+ * S₀: Event loops
+ */
+
+TEST_CASE_GROUP("S₀ event loops");
+
+/* Counts how far another thread has gotten, so that a test can wait for it to
+ * reach a particular point instead of sleeping and hoping. */
+struct progress {
+    pthread_mutex_t  lock;
+    pthread_cond_t  advanced;
+    size_t  count;
+};
+
+static void
+progress_init(struct progress *progress)
+{
+    pthread_mutex_init(&progress->lock, NULL);
+    pthread_cond_init(&progress->advanced, NULL);
+    progress->count = 0;
+}
+
+static void
+progress_done(struct progress *progress)
+{
+    pthread_cond_destroy(&progress->advanced);
+    pthread_mutex_destroy(&progress->lock);
+}
+
+static void
+progress_advance(struct progress *progress)
+{
+    pthread_mutex_lock(&progress->lock);
+    progress->count++;
+    pthread_cond_broadcast(&progress->advanced);
+    pthread_mutex_unlock(&progress->lock);
+}
+
+/* Blocks until progress_advance has been called at least `count` times. */
+static void
+progress_wait(struct progress *progress, size_t count)
+{
+    pthread_mutex_lock(&progress->lock);
+    while (progress->count < count) {
+        pthread_cond_wait(&progress->advanced, &progress->lock);
+    }
+    pthread_mutex_unlock(&progress->lock);
+}
+
+/* An asynchronous primitive that reads a byte from a file descriptor, and
+ * passes an atom to `finish` once it arrives. */
+struct pipe_reader {
+    struct s0_event_loop  *loop;
+    int  fd;
+    /* If there's no loop, complete the primitive before it returns */
+    bool  complete_immediately;
+    struct s0_execution  *execution;
+    struct s0_invocation  *invocation;
+    /* If non-NULL, we advance this once the primitive has parked its
+     * execution, and again once the byte arrives. */
+    struct progress  *progress;
+};
+
+static struct s0_continuation
+pipe_reader_continue(void *ud, struct s0_environment *env)
+{
+    struct pipe_reader  *reader = ud;
+    return s0_invocation_execute(reader->invocation, env);
+}
+
+static void
+pipe_reader_complete(struct pipe_reader *reader)
+{
+    struct s0_continuation  next;
+    next.ud = reader;
+    next.invoke = pipe_reader_continue;
+    s0_execution_complete
+        (reader->execution, s0_name_new_str("result"), s0_atom_new(), next);
+}
+
+static void
+pipe_reader_ready(void *ud, uint32_t events)
+{
+    struct pipe_reader  *reader = ud;
+    char  byte;
+    if (read(reader->fd, &byte, 1) != 1) {
+        s0_execution_complete
+            (reader->execution, NULL, NULL, s0_error_continuation());
+        return;
+    }
+    if (reader->progress != NULL) {
+        progress_advance(reader->progress);
+    }
+    pipe_reader_complete(reader);
+}
+
+static struct s0_continuation
+pipe_reader_read(void *ud, struct s0_environment *env)
+{
+    struct pipe_reader  *reader = ud;
+    struct s0_name  *name = s0_name_new_str("self");
+    s0_entity_free(s0_environment_delete(env, name));
+    s0_name_free(name);
+
+    reader->execution = s0_execution_current();
+    if (reader->loop != NULL) {
+        if (s0_event_loop_watch
+            (reader->loop, reader->fd, EPOLLIN, pipe_reader_ready, reader)
+            != 0) {
+            return s0_error_continuation();
+        }
+    } else if (reader->complete_immediately) {
+        pipe_reader_complete(reader);
+    }
+    if (reader->progress != NULL) {
+        progress_advance(reader->progress);
+    }
+    return s0_pending_continuation();
+}
+
+static void
+pipe_reader_free_ud(void *ud)
+{
+    /* The test owns the reader */
+}
+
+static struct s0_entity *
+create_pipe_reader(struct pipe_reader *reader)
+{
+    struct s0_name_mapping  *params;
+    struct s0_environment_type  *inputs;
+    struct s0_continuation  cont;
+    struct s0_entity  *object;
+    struct s0_entity  *method;
+
+    params = s0_name_mapping_new();
+    if (params == NULL
+        || s0_name_mapping_add(params, s0_name_new_str("result"),
+                               s0_name_new_str("result")) != 0) {
+        return NULL;
+    }
+    reader->invocation = s0_invoke_closure_new
+        (s0_name_new_str("finish"), s0_name_new_str("body"), params);
+    if (reader->invocation == NULL) {
+        return NULL;
+    }
+
+    inputs = environment_type(
+            YAML
+            "self: !s0!object {}\n"
+            "finish: !s0!closure\n"
+            "  branches:\n"
+            "    body:\n"
+            "      result: !s0!any {}\n");
+    if (inputs == NULL) {
+        return NULL;
+    }
+    cont.ud = reader;
+    cont.invoke = pipe_reader_read;
+    method = s0_primitive_method_new(inputs, cont, pipe_reader_free_ud);
+    object = s0_object_new();
+    if (method == NULL || object == NULL
+        || s0_object_add(object, s0_name_new_str("read"), method) != 0) {
+        return NULL;
+    }
+    return object;
+}
+
+/* Creates an environment that can execute load_pipe_reader_block, which
+ * stores its result into *result. */
+static struct s0_environment *
+create_pipe_reader_environment(struct pipe_reader *reader,
+                               struct s0_entity **result)
+{
+    struct s0_environment  *env;
+    struct s0_entity  *object;
+    env = create_extractor_environment(result);
+    if (env == NULL) {
+        return NULL;
+    }
+    object = create_pipe_reader(reader);
+    if (object == NULL
+        || s0_environment_add(env, s0_name_new_str("reader"), object) != 0) {
+        s0_environment_free(env);
+        return NULL;
+    }
+    return env;
+}
+
+static struct s0_block *
+load_pipe_reader_block(void)
+{
+    return load_block(
+                YAML
+                "inputs:\n"
+                "  finish: !s0!closure\n"
+                "    branches:\n"
+                "      body:\n"
+                "        result: !s0!any {}\n"
+                "  reader: !s0!object\n"
+                "    read: !s0!method\n"
+                "      inputs:\n"
+                "        self: !s0!object {}\n"
+                "        finish: !s0!closure\n"
+                "          branches:\n"
+                "            body:\n"
+                "              result: !s0!any {}\n"
+                "statements: []\n"
+                "invocation:\n"
+                "  !s0!invoke-method\n"
+                "  src: reader\n"
+                "  method: read\n"
+                "  parameters:\n"
+                "    reader: self\n"
+                "    finish: finish\n");
+}
+
+TEST_CASE("synchronous executions can't be suspended") {
+    struct s0_environment  *env;
+    struct s0_entity  *result = NULL;
+    struct s0_block  *block;
+    struct pipe_reader  reader = { NULL, -1, false, NULL, NULL, NULL };
+    check_alloc(block, load_pipe_reader_block());
+    check_alloc(env, create_pipe_reader_environment(&reader, &result));
+    check(s0_block_execute(block, env) == -1);
+    check(reader.execution == NULL);
+    check(result == NULL);
+    s0_environment_free(env);
+    s0_invocation_free(reader.invocation);
+    s0_block_free(block);
+}
+
+TEST_CASE("primitives can complete before they return") {
+    struct s0_environment  *env;
+    struct s0_entity  *result = NULL;
+    struct s0_block  *block;
+    struct s0_execution  *execution;
+    struct pipe_reader  reader = { NULL, -1, true, NULL, NULL, NULL };
+    check_alloc(block, load_pipe_reader_block());
+    check_alloc(env, create_pipe_reader_environment(&reader, &result));
+    check_alloc(execution, s0_execution_new(block, env));
+    check(s0_execution_resume(execution, SIZE_MAX) == S0_EXECUTION_FINISHED);
+    check_nonnull(result);
+    check(s0_entity_kind(result) == S0_ENTITY_KIND_ATOM);
+    s0_environment_free(env);
+    s0_entity_free(result);
+    s0_invocation_free(reader.invocation);
+    s0_block_free(block);
+}
+
+TEST_CASE("pending executions can be resumed once they complete") {
+    struct s0_environment  *env;
+    struct s0_entity  *result = NULL;
+    struct s0_block  *block;
+    struct s0_execution  *execution;
+    struct pipe_reader  reader = { NULL, -1, false, NULL, NULL, NULL };
+    check_alloc(block, load_pipe_reader_block());
+    check_alloc(env, create_pipe_reader_environment(&reader, &result));
+    check(s0_block_execute_bounded(block, env, SIZE_MAX, &execution)
+          == S0_EXECUTION_PENDING);
+    check(execution == reader.execution);
+    /* Resuming before the primitive completes doesn't do anything */
+    check(s0_execution_resume(execution, SIZE_MAX) == S0_EXECUTION_PENDING);
+    check(result == NULL);
+    pipe_reader_complete(&reader);
+    check(s0_execution_resume(execution, SIZE_MAX) == S0_EXECUTION_FINISHED);
+    check_nonnull(result);
+    s0_environment_free(env);
+    s0_entity_free(result);
+    s0_invocation_free(reader.invocation);
+    s0_block_free(block);
+}
+
+TEST_CASE("scheduler resumes tasks once their primitives complete") {
+    struct s0_scheduler  *scheduler;
+    struct s0_environment  *env;
+    struct s0_block  *block;
+    struct progress  progress;
+    struct pipe_reader  reader = { NULL, -1, false, NULL, NULL, &progress };
+    struct scheduled_task  task = { NULL, false, 0 };
+    progress_init(&progress);
+    check_alloc(block, load_pipe_reader_block());
+    check_alloc(scheduler, s0_scheduler_new(2));
+    check_alloc(env, create_pipe_reader_environment(&reader, &task.result));
+    check0(s0_scheduler_submit
+           (scheduler, block, env, scheduled_task_done, &task));
+    /* Wait for the task to park itself, and then complete it from here */
+    progress_wait(&progress, 1);
+    pipe_reader_complete(&reader);
+    s0_scheduler_wait(scheduler);
+    check(task.done);
+    check0(task.rc);
+    check_nonnull(task.result);
+    s0_entity_free(task.result);
+    /* Free everything */
+    s0_scheduler_free(scheduler);
+    s0_invocation_free(reader.invocation);
+    s0_block_free(block);
+    progress_done(&progress);
+}
+
+#define PIPE_COUNT  32
+
+struct pipe_writer {
+    pthread_t  thread;
+    int  fds[PIPE_COUNT];
+    struct progress  progress[PIPE_COUNT];
+};
+
+static void *
+write_to_pipes(void *ud)
+{
+    struct pipe_writer  *writer = ud;
+    size_t  i;
+    /* Write in reverse order, so that the loop can't just run the executions
+     * in the order they were added.  Each write waits for its reader to park,
+     * and we wait for the reader to see it before moving on to the next. */
+    for (i = PIPE_COUNT; i > 0; i--) {
+        progress_wait(&writer->progress[i - 1], 1);
+        if (write(writer->fds[i - 1], "x", 1) != 1) {
+            break;
+        }
+        progress_wait(&writer->progress[i - 1], 2);
+    }
+    return NULL;
+}
+
+TEST_CASE("event loop can drive many executions waiting on pipes") {
+    struct s0_event_loop  *loop;
+    struct s0_block  *block;
+    struct pipe_reader  readers[PIPE_COUNT];
+    struct scheduled_task  tasks[PIPE_COUNT];
+    struct pipe_writer  writer;
+    size_t  i;
+    check_alloc(block, load_pipe_reader_block());
+    check_alloc(loop, s0_event_loop_new());
+    for (i = 0; i < PIPE_COUNT; i++) {
+        int  fds[2];
+        struct s0_environment  *env;
+        check0(pipe(fds));
+        readers[i].loop = loop;
+        readers[i].fd = fds[0];
+        readers[i].complete_immediately = false;
+        readers[i].execution = NULL;
+        readers[i].progress = &writer.progress[i];
+        progress_init(&writer.progress[i]);
+        writer.fds[i] = fds[1];
+        tasks[i].result = NULL;
+        tasks[i].done = false;
+        tasks[i].rc = 0;
+        check_alloc(env, create_pipe_reader_environment
+                    (&readers[i], &tasks[i].result));
+        check0(s0_event_loop_add
+               (loop, block, env, scheduled_task_done, &tasks[i]));
+    }
+    /* Feed the pipes from another thread while the loop runs */
+    check0(pthread_create(&writer.thread, NULL, write_to_pipes, &writer));
+    check0(s0_event_loop_run(loop));
+    check0(pthread_join(writer.thread, NULL));
+    for (i = 0; i < PIPE_COUNT; i++) {
+        check(tasks[i].done);
+        check0(tasks[i].rc);
+        check_nonnull(tasks[i].result);
+        check(s0_entity_kind(tasks[i].result) == S0_ENTITY_KIND_ATOM);
+        s0_entity_free(tasks[i].result);
+        s0_invocation_free(readers[i].invocation);
+        close(readers[i].fd);
+        close(writer.fds[i]);
+        progress_done(&writer.progress[i]);
+    }
+    /* Free everything */
+    s0_event_loop_free(loop);
+    s0_block_free(block);
+}
+
+/*-----------------------------------------------------------------------------
+ * S₀: File I/O
+ */
+
+TEST_CASE_GROUP("S₀ file I/O");
+
+/* An object with `success` and `failure` methods, which records everything
+ * that's passed to them. */
+struct recorder {
+    struct s0_environment  *results;
+    bool  succeeded;
+    bool  failed;
+};
+
+static struct s0_continuation
+recorder_record(struct recorder *recorder, struct s0_environment *env)
+{
+    struct s0_name  *name = s0_name_new_str("self");
+    s0_entity_free(s0_environment_delete(env, name));
+    s0_name_free(name);
+    if (s0_environment_merge(recorder->results, env) != 0) {
+        return s0_error_continuation();
+    }
+    return s0_finish_continuation();
+}
+
+static struct s0_continuation
+recorder_success(void *ud, struct s0_environment *env)
+{
+    struct recorder  *recorder = ud;
+    recorder->succeeded = true;
+    return recorder_record(recorder, env);
+}
+
+static struct s0_continuation
+recorder_failure(void *ud, struct s0_environment *env)
+{
+    struct recorder  *recorder = ud;
+    recorder->failed = true;
+    return recorder_record(recorder, env);
+}
+
+static void
+recorder_free_ud(void *ud)
+{
+    /* The test owns the recorder */
+}
+
+static struct s0_entity *
+create_recorder(struct recorder *recorder, const char *success_inputs,
+                const char *failure_inputs)
+{
+    struct s0_entity  *object;
+    struct s0_continuation  cont;
+    struct s0_environment_type  *inputs;
+    struct s0_entity  *method;
+
+    object = s0_object_new();
+    if (object == NULL) {
+        return NULL;
+    }
+
+    inputs = environment_type(success_inputs);
+    cont.ud = recorder;
+    cont.invoke = recorder_success;
+    method = (inputs == NULL)? NULL:
+        s0_primitive_method_new(inputs, cont, recorder_free_ud);
+    if (method == NULL
+        || s0_object_add(object, s0_name_new_str("success"), method) != 0) {
+        s0_entity_free(object);
+        return NULL;
+    }
+
+    inputs = environment_type(failure_inputs);
+    cont.invoke = recorder_failure;
+    method = (inputs == NULL)? NULL:
+        s0_primitive_method_new(inputs, cont, recorder_free_ud);
+    if (method == NULL
+        || s0_object_add(object, s0_name_new_str("failure"), method) != 0) {
+        s0_entity_free(object);
+        return NULL;
+    }
+    return object;
+}
+
+/* Each I/O method gets its own block, which invokes the method on `target`,
+ * and sends whatever it produces to `recorder`. */
+struct io_operation {
+    const char  *block;
+    const char  *success_inputs;
+    const char  *failure_inputs;
+};
+
+static const struct io_operation  io_open = {
+    YAML
+    "inputs:\n"
+    "  target: !s0!object\n"
+    "    open: !s0!method\n"
+    "      inputs:\n"
+    "        self: !s0!object {}\n"
+    "        path: !s0!any {}\n"
+    "        mode: !s0!any {}\n"
+    "        then: !s0!closure\n"
+    "          branches:\n"
+    "            success: {io: !s0!any {}, file: !s0!any {}}\n"
+    "            failure: {io: !s0!any {}, error: !s0!any {}}\n"
+    "  recorder: !s0!object\n"
+    "    success: !s0!method\n"
+    "      inputs: {self: !s0!object {}, io: !s0!any {}, file: !s0!any {}}\n"
+    "    failure: !s0!method\n"
+    "      inputs: {self: !s0!object {}, io: !s0!any {}, error: !s0!any {}}\n"
+    "  path: !s0!any {}\n"
+    "  mode: !s0!any {}\n"
+    "statements:\n"
+    "  - !s0!create-closure\n"
+    "    dest: then\n"
+    "    closed-over: [recorder]\n"
+    "    branches:\n"
+    "      success:\n"
+    "        inputs:\n"
+    "          io: !s0!any {}\n"
+    "          file: !s0!any {}\n"
+    "        statements: []\n"
+    "        invocation:\n"
+    "          !s0!invoke-method\n"
+    "          src: recorder\n"
+    "          method: success\n"
+    "          parameters:\n"
+    "            recorder: self\n"
+    "            io: io\n"
+    "            file: file\n"
+    "      failure:\n"
+    "        inputs:\n"
+    "          io: !s0!any {}\n"
+    "          error: !s0!any {}\n"
+    "        statements: []\n"
+    "        invocation:\n"
+    "          !s0!invoke-method\n"
+    "          src: recorder\n"
+    "          method: failure\n"
+    "          parameters:\n"
+    "            recorder: self\n"
+    "            io: io\n"
+    "            error: error\n"
+    "invocation:\n"
+    "  !s0!invoke-method\n"
+    "  src: target\n"
+    "  method: open\n"
+    "  parameters:\n"
+    "    target: self\n"
+    "    path: path\n"
+    "    mode: mode\n"
+    "    then: then\n",
+    YAML "{self: !s0!object {}, io: !s0!any {}, file: !s0!any {}}\n",
+    YAML "{self: !s0!object {}, io: !s0!any {}, error: !s0!any {}}\n"
+};
+
+static const struct io_operation  io_read = {
+    YAML
+    "inputs:\n"
+    "  target: !s0!object\n"
+    "    read: !s0!method\n"
+    "      inputs:\n"
+    "        self: !s0!object {}\n"
+    "        then: !s0!closure\n"
+    "          branches:\n"
+    "            success: {file: !s0!any {}, data: !s0!any {}}\n"
+    "            failure: {file: !s0!any {}, error: !s0!any {}}\n"
+    "  recorder: !s0!object\n"
+    "    success: !s0!method\n"
+    "      inputs: {self: !s0!object {}, file: !s0!any {}, data: !s0!any {}}\n"
+    "    failure: !s0!method\n"
+    "      inputs: {self: !s0!object {}, file: !s0!any {}, error: !s0!any {}}\n"
+    "statements:\n"
+    "  - !s0!create-closure\n"
+    "    dest: then\n"
+    "    closed-over: [recorder]\n"
+    "    branches:\n"
+    "      success:\n"
+    "        inputs:\n"
+    "          file: !s0!any {}\n"
+    "          data: !s0!any {}\n"
+    "        statements: []\n"
+    "        invocation:\n"
+    "          !s0!invoke-method\n"
+    "          src: recorder\n"
+    "          method: success\n"
+    "          parameters:\n"
+    "            recorder: self\n"
+    "            file: file\n"
+    "            data: data\n"
+    "      failure:\n"
+    "        inputs:\n"
+    "          file: !s0!any {}\n"
+    "          error: !s0!any {}\n"
+    "        statements: []\n"
+    "        invocation:\n"
+    "          !s0!invoke-method\n"
+    "          src: recorder\n"
+    "          method: failure\n"
+    "          parameters:\n"
+    "            recorder: self\n"
+    "            file: file\n"
+    "            error: error\n"
+    "invocation:\n"
+    "  !s0!invoke-method\n"
+    "  src: target\n"
+    "  method: read\n"
+    "  parameters:\n"
+    "    target: self\n"
+    "    then: then\n",
+    YAML "{self: !s0!object {}, file: !s0!any {}, data: !s0!any {}}\n",
+    YAML "{self: !s0!object {}, file: !s0!any {}, error: !s0!any {}}\n"
+};
+
+static const struct io_operation  io_write = {
+    YAML
+    "inputs:\n"
+    "  target: !s0!object\n"
+    "    write: !s0!method\n"
+    "      inputs:\n"
+    "        self: !s0!object {}\n"
+    "        data: !s0!any {}\n"
+    "        then: !s0!closure\n"
+    "          branches:\n"
+    "            success: {file: !s0!any {}}\n"
+    "            failure: {file: !s0!any {}, error: !s0!any {}}\n"
+    "  recorder: !s0!object\n"
+    "    success: !s0!method\n"
+    "      inputs: {self: !s0!object {}, file: !s0!any {}}\n"
+    "    failure: !s0!method\n"
+    "      inputs: {self: !s0!object {}, file: !s0!any {}, error: !s0!any {}}\n"
+    "  data: !s0!any {}\n"
+    "statements:\n"
+    "  - !s0!create-closure\n"
+    "    dest: then\n"
+    "    closed-over: [recorder]\n"
+    "    branches:\n"
+    "      success:\n"
+    "        inputs:\n"
+    "          file: !s0!any {}\n"
+    "        statements: []\n"
+    "        invocation:\n"
+    "          !s0!invoke-method\n"
+    "          src: recorder\n"
+    "          method: success\n"
+    "          parameters:\n"
+    "            recorder: self\n"
+    "            file: file\n"
+    "      failure:\n"
+    "        inputs:\n"
+    "          file: !s0!any {}\n"
+    "          error: !s0!any {}\n"
+    "        statements: []\n"
+    "        invocation:\n"
+    "          !s0!invoke-method\n"
+    "          src: recorder\n"
+    "          method: failure\n"
+    "          parameters:\n"
+    "            recorder: self\n"
+    "            file: file\n"
+    "            error: error\n"
+    "invocation:\n"
+    "  !s0!invoke-method\n"
+    "  src: target\n"
+    "  method: write\n"
+    "  parameters:\n"
+    "    target: self\n"
+    "    data: data\n"
+    "    then: then\n",
+    YAML "{self: !s0!object {}, file: !s0!any {}}\n",
+    YAML "{self: !s0!object {}, file: !s0!any {}, error: !s0!any {}}\n"
+};
+
+static const struct io_operation  io_close = {
+    YAML
+    "inputs:\n"
+    "  target: !s0!object\n"
+    "    close: !s0!method\n"
+    "      inputs:\n"
+    "        self: !s0!object {}\n"
+    "        then: !s0!closure\n"
+    "          branches:\n"
+    "            success: {}\n"
+    "            failure: {error: !s0!any {}}\n"
+    "  recorder: !s0!object\n"
+    "    success: !s0!method\n"
+    "      inputs: {self: !s0!object {}}\n"
+    "    failure: !s0!method\n"
+    "      inputs: {self: !s0!object {}, error: !s0!any {}}\n"
+    "statements:\n"
+    "  - !s0!create-closure\n"
+    "    dest: then\n"
+    "    closed-over: [recorder]\n"
+    "    branches:\n"
+    "      success:\n"
+    "        inputs: {}\n"
+    "        statements: []\n"
+    "        invocation:\n"
+    "          !s0!invoke-method\n"
+    "          src: recorder\n"
+    "          method: success\n"
+    "          parameters:\n"
+    "            recorder: self\n"
+    "      failure:\n"
+    "        inputs:\n"
+    "          error: !s0!any {}\n"
+    "        statements: []\n"
+    "        invocation:\n"
+    "          !s0!invoke-method\n"
+    "          src: recorder\n"
+    "          method: failure\n"
+    "          parameters:\n"
+    "            recorder: self\n"
+    "            error: error\n"
+    "invocation:\n"
+    "  !s0!invoke-method\n"
+    "  src: target\n"
+    "  method: close\n"
+    "  parameters:\n"
+    "    target: self\n"
+    "    then: then\n",
+    YAML "{self: !s0!object {}}\n",
+    YAML "{self: !s0!object {}, error: !s0!any {}}\n"
+};
+
+static void
+io_operation_done(void *ud, struct s0_environment *env, int rc)
+{
+    int  *result = ud;
+    *result = rc;
+    s0_environment_free(env);
+}
+
+/* Runs one I/O operation on `target`, with any extra inputs from `env`
+ * (which we take control of).  If `loop` is NULL, we execute the operation
+ * synchronously.  Fills in `recorder` with the results, which you must free. */
+static int
+run_io_operation(const struct io_operation *operation,
+                 struct s0_event_loop *loop, struct s0_entity *target,
+                 struct s0_environment *env, struct recorder *recorder)
+{
+    struct s0_block  *block;
+    struct s0_entity  *recorder_object;
+    int  rc = -1;
+
+    recorder->results = s0_environment_new();
+    recorder->succeeded = false;
+    recorder->failed = false;
+    recorder_object = create_recorder
+        (recorder, operation->success_inputs, operation->failure_inputs);
+    block = load_block(operation->block);
+    if (recorder->results == NULL || recorder_object == NULL || block == NULL
+        || s0_environment_add(env, s0_name_new_str("target"), target) != 0
+        || s0_environment_add
+           (env, s0_name_new_str("recorder"), recorder_object) != 0) {
+        return -1;
+    }
+
+    if (loop == NULL) {
+        rc = s0_block_execute(block, env);
+        s0_environment_free(env);
+    } else if (s0_event_loop_add(loop, block, env, io_operation_done, &rc) != 0
+               || s0_event_loop_run(loop) != 0) {
+        rc = -1;
+    }
+    s0_block_free(block);
+    return rc;
+}
+
+static struct s0_entity *
+recorder_take(struct recorder *recorder, const char *name_str)
+{
+    struct s0_name  *name = s0_name_new_str(name_str);
+    struct s0_entity  *entity = s0_environment_delete(recorder->results, name);
+    s0_name_free(name);
+    return entity;
+}
+
+static struct s0_environment *
+open_inputs(const char *path, const char *mode)
+{
+    struct s0_environment  *env = s0_environment_new();
+    if (env == NULL
+        || s0_environment_add
+           (env, s0_name_new_str("path"), s0_literal_new_str(path)) != 0
+        || s0_environment_add
+           (env, s0_name_new_str("mode"), s0_literal_new_str(mode)) != 0) {
+        return NULL;
+    }
+    return env;
+}
+
+/* Writes a file, reads it back, and checks the error cases. */
+static void
+exercise_io(struct s0_io *io, struct s0_event_loop *loop)
+{
+    char  path[] = "/tmp/test-swanson-io-XXXXXX";
+    struct recorder  recorder;
+    struct s0_environment  *env;
+    struct s0_entity  *io_object;
+    struct s0_entity  *file;
+    struct s0_entity  *data;
+    struct s0_entity  *error;
+    int  fd;
+
+    check((fd = mkstemp(path)) != -1);
+    close(fd);
+    check_alloc(io_object, s0_io_object_new(io));
+
+    /* Write the file */
+    check_alloc(env, open_inputs(path, "w"));
+    check0(run_io_operation(&io_open, loop, io_object, env, &recorder));
+    check(recorder.succeeded);
+    check_alloc(io_object, recorder_take(&recorder, "io"));
+    check_alloc(file, recorder_take(&recorder, "file"));
+    s0_environment_free(recorder.results);
+
+    check_alloc(env, s0_environment_new());
+    check0(s0_environment_add
+           (env, s0_name_new_str("data"), s0_literal_new_str("hello world")));
+    check0(run_io_operation(&io_write, loop, file, env, &recorder));
+    check(recorder.succeeded);
+    check_alloc(file, recorder_take(&recorder, "file"));
+    s0_environment_free(recorder.results);
+
+    check_alloc(env, s0_environment_new());
+    check0(run_io_operation(&io_close, loop, file, env, &recorder));
+    check(recorder.succeeded);
+    check(s0_environment_size(recorder.results) == 0);
+    s0_environment_free(recorder.results);
+
+    /* Read it back */
+    check_alloc(env, open_inputs(path, "r"));
+    check0(run_io_operation(&io_open, loop, io_object, env, &recorder));
+    check(recorder.succeeded);
+    check_alloc(io_object, recorder_take(&recorder, "io"));
+    check_alloc(file, recorder_take(&recorder, "file"));
+    s0_environment_free(recorder.results);
+
+    check_alloc(env, s0_environment_new());
+    check0(run_io_operation(&io_read, loop, file, env, &recorder));
+    check(recorder.succeeded);
+    check_alloc(file, recorder_take(&recorder, "file"));
+    check_alloc(data, recorder_take(&recorder, "data"));
+    check(literal_equals(data, "hello world"));
+    s0_entity_free(data);
+    s0_environment_free(recorder.results);
+
+    /* An empty literal means we're at the end of the file */
+    check_alloc(env, s0_environment_new());
+    check0(run_io_operation(&io_read, loop, file, env, &recorder));
+    check(recorder.succeeded);
+    check_alloc(file, recorder_take(&recorder, "file"));
+    check_alloc(data, recorder_take(&recorder, "data"));
+    check(literal_equals(data, ""));
+    s0_entity_free(data);
+    s0_environment_free(recorder.results);
+
+    /* Writing to a read-only file fails, but gives the file back */
+    check_alloc(env, s0_environment_new());
+    check0(s0_environment_add
+           (env, s0_name_new_str("data"), s0_literal_new_str("nope")));
+    check0(run_io_operation(&io_write, loop, file, env, &recorder));
+    check(recorder.failed);
+    check_alloc(file, recorder_take(&recorder, "file"));
+    check_alloc(error, recorder_take(&recorder, "error"));
+    check(s0_entity_kind(error) == S0_ENTITY_KIND_LITERAL);
+    s0_entity_free(error);
+    s0_environment_free(recorder.results);
+
+    check_alloc(env, s0_environment_new());
+    check0(run_io_operation(&io_close, loop, file, env, &recorder));
+    check(recorder.succeeded);
+    s0_environment_free(recorder.results);
+
+    /* Opening a file that doesn't exist fails */
+    unlink(path);
+    check_alloc(env, open_inputs(path, "r"));
+    check0(run_io_operation(&io_open, loop, io_object, env, &recorder));
+    check(recorder.failed);
+    check_alloc(io_object, recorder_take(&recorder, "io"));
+    check_alloc(error, recorder_take(&recorder, "error"));
+    check(s0_entity_kind(error) == S0_ENTITY_KIND_LITERAL);
+    s0_entity_free(error);
+    s0_environment_free(recorder.results);
+
+    /* So does using an invalid mode */
+    check_alloc(env, open_inputs(path, "rw"));
+    check0(run_io_operation(&io_open, loop, io_object, env, &recorder));
+    check(recorder.failed);
+    check_alloc(io_object, recorder_take(&recorder, "io"));
+    check_alloc(error, recorder_take(&recorder, "error"));
+    check(literal_equals(error, "mode must be `r`, `w`, or `a`"));
+    s0_entity_free(error);
+    s0_environment_free(recorder.results);
+    s0_entity_free(io_object);
+}
+
+TEST_CASE("can use the I/O primitives synchronously") {
+    struct s0_io  *io;
+    check_alloc(io, s0_io_new(S0_IO_BACKEND_THREADS));
+    exercise_io(io, NULL);
+    s0_io_free(io);
+}
+
+TEST_CASE("can use the I/O primitives with the thread pool") {
+    struct s0_io  *io;
+    struct s0_event_loop  *loop;
+    check_alloc(io, s0_io_new(S0_IO_BACKEND_THREADS));
+    check(s0_io_backend(io) == S0_IO_BACKEND_THREADS);
+    check_alloc(loop, s0_event_loop_new());
+    exercise_io(io, loop);
+    s0_event_loop_free(loop);
+    s0_io_free(io);
+}
+
+TEST_CASE("can use the I/O primitives with io_uring") {
+    struct s0_io  *io;
+    struct s0_event_loop  *loop;
+    io = s0_io_new(S0_IO_BACKEND_IO_URING);
+    if (io == NULL) {
+        /* Not every kernel (or sandbox) lets us use io_uring. */
+        return;
+    }
+    check(s0_io_backend(io) == S0_IO_BACKEND_IO_URING);
+    check_alloc(loop, s0_event_loop_new());
+    exercise_io(io, loop);
+    s0_event_loop_free(loop);
+    s0_io_free(io);
+}
+
+/* Opens `path` through `io_object`, which we hand back via `io_object`, and
+ * fills in `file` with the opened file. */
+static void
+open_through(struct s0_entity **io_object, struct s0_event_loop *loop,
+             const char *path, const char *mode, struct s0_entity **file)
+{
+    struct recorder  recorder;
+    check0(run_io_operation
+           (&io_open, loop, *io_object, open_inputs(path, mode), &recorder));
+    check(recorder.succeeded);
+    check_alloc(*io_object, recorder_take(&recorder, "io"));
+    check_alloc(*file, recorder_take(&recorder, "file"));
+    s0_environment_free(recorder.results);
+}
+
+TEST_CASE("one I/O object can open several files") {
+    char  path1[] = "/tmp/test-swanson-io-XXXXXX";
+    char  path2[] = "/tmp/test-swanson-io-XXXXXX";
+    struct s0_io  *io;
+    struct s0_event_loop  *loop;
+    struct s0_entity  *io_object;
+    struct s0_entity  *file1;
+    struct s0_entity  *file2;
+    struct s0_entity  *data;
+    struct s0_environment  *env;
+    struct recorder  recorder;
+    int  fd;
+
+    check((fd = mkstemp(path1)) != -1);
+    close(fd);
+    check((fd = mkstemp(path2)) != -1);
+    close(fd);
+    check_alloc(io, s0_io_new(S0_IO_BACKEND_THREADS));
+    check_alloc(loop, s0_event_loop_new());
+    check_alloc(io_object, s0_io_object_new(io));
+
+    /* Both files are open at the same time. */
+    open_through(&io_object, loop, path1, "w", &file1);
+    open_through(&io_object, NULL, path2, "w", &file2);
+
+    check_alloc(env, s0_environment_new());
+    check0(s0_environment_add
+           (env, s0_name_new_str("data"), s0_literal_new_str("first")));
+    check0(run_io_operation(&io_write, loop, file1, env, &recorder));
+    check(recorder.succeeded);
+    check_alloc(file1, recorder_take(&recorder, "file"));
+    s0_environment_free(recorder.results);
+
+    check_alloc(env, s0_environment_new());
+    check0(s0_environment_add
+           (env, s0_name_new_str("data"), s0_literal_new_str("second")));
+    check0(run_io_operation(&io_write, loop, file2, env, &recorder));
+    check(recorder.succeeded);
+    check_alloc(file2, recorder_take(&recorder, "file"));
+    s0_environment_free(recorder.results);
+
+    check_alloc(env, s0_environment_new());
+    check0(run_io_operation(&io_close, loop, file1, env, &recorder));
+    check(recorder.succeeded);
+    s0_environment_free(recorder.results);
+    check_alloc(env, s0_environment_new());
+    check0(run_io_operation(&io_close, loop, file2, env, &recorder));
+    check(recorder.succeeded);
+    s0_environment_free(recorder.results);
+
+    /* Each file got its own contents. */
+    open_through(&io_object, loop, path1, "r", &file1);
+    check_alloc(env, s0_environment_new());
+    check0(run_io_operation(&io_read, loop, file1, env, &recorder));
+    check(recorder.succeeded);
+    check_alloc(data, recorder_take(&recorder, "data"));
+    check(literal_equals(data, "first"));
+    s0_entity_free(data);
+    s0_environment_free(recorder.results);
+
+    open_through(&io_object, loop, path2, "r", &file2);
+    check_alloc(env, s0_environment_new());
+    check0(run_io_operation(&io_read, loop, file2, env, &recorder));
+    check(recorder.succeeded);
+    check_alloc(data, recorder_take(&recorder, "data"));
+    check(literal_equals(data, "second"));
+    s0_entity_free(data);
+    s0_environment_free(recorder.results);
+
+    s0_entity_free(io_object);
+    s0_event_loop_free(loop);
+    s0_io_free(io);
+    unlink(path1);
+    unlink(path2);
+}
+
+/* A primitive that synchronously opens a file, from within whatever execution
+ * invokes it. */
+struct nested_open {
+    struct s0_io  *io;
+    const char  *path;
+    int  rc;
+    struct recorder  recorder;
+};
+
+static struct s0_continuation
+nested_open_run(void *ud, struct s0_environment *env)
+{
+    struct nested_open  *nested = ud;
+    struct s0_name  *name = s0_name_new_str("self");
+    s0_entity_free(s0_environment_delete(env, name));
+    s0_name_free(name);
+    nested->rc = run_io_operation
+        (&io_open, NULL, s0_io_object_new(nested->io),
+         open_inputs(nested->path, "r"), &nested->recorder);
+    return s0_finish_continuation();
+}
+
+static struct s0_entity *
+create_nested_open(struct nested_open *nested)
+{
+    struct s0_environment_type  *inputs;
+    struct s0_continuation  cont;
+    struct s0_entity  *object;
+    struct s0_entity  *method;
+    inputs = environment_type(YAML "{self: !s0!object {}}\n");
+    if (inputs == NULL) {
+        return NULL;
+    }
+    cont.ud = nested;
+    cont.invoke = nested_open_run;
+    method = s0_primitive_method_new(inputs, cont, recorder_free_ud);
+    object = s0_object_new();
+    if (method == NULL || object == NULL
+        || s0_object_add(object, s0_name_new_str("run"), method) != 0) {
+        return NULL;
+    }
+    return object;
+}
+
+TEST_CASE("synchronous I/O works inside of an event loop's executions") {
+    char  path[] = "/tmp/test-swanson-io-XXXXXX";
+    struct nested_open  nested;
+    struct s0_event_loop  *loop;
+    struct s0_block  *block;
+    struct s0_environment  *env;
+    struct s0_entity  *file;
+    int  rc = -1;
+    int  fd;
+    check((fd = mkstemp(path)) != -1);
+    close(fd);
+    check_alloc(nested.io, s0_io_new(S0_IO_BACKEND_THREADS));
+    nested.path = path;
+    nested.rc = -1;
+    check_alloc(loop, s0_event_loop_new());
+    check_alloc(block, load_block(
+                YAML
+                "inputs:\n"
+                "  nested: !s0!object\n"
+                "    run: !s0!method\n"
+                "      inputs:\n"
+                "        self: !s0!object {}\n"
+                "statements: []\n"
+                "invocation:\n"
+                "  !s0!invoke-method\n"
+                "  src: nested\n"
+                "  method: run\n"
+                "  parameters:\n"
+                "    nested: self\n"));
+    check_alloc(env, s0_environment_new());
+    check0(s0_environment_add
+           (env, s0_name_new_str("nested"), create_nested_open(&nested)));
+    check0(s0_event_loop_add(loop, block, env, io_operation_done, &rc));
+    check0(s0_event_loop_run(loop));
+    /* The open happened synchronously, instead of suspending the event loop's
+     * execution on its behalf. */
+    check0(rc);
+    check0(nested.rc);
+    check(nested.recorder.succeeded);
+    check_alloc(file, recorder_take(&nested.recorder, "file"));
+    s0_entity_free(file);
+    s0_environment_free(nested.recorder.results);
+    s0_event_loop_free(loop);
+    s0_block_free(block);
+    s0_io_free(nested.io);
+    unlink(path);
+}
+
+TEST_CASE("default I/O backend is always available") {
+    struct s0_io  *io;
+    check_alloc(io, s0_io_new(S0_IO_BACKEND_DEFAULT));
+    check(s0_io_backend(io) != S0_IO_BACKEND_DEFAULT);
+    s0_io_free(io);
+}
+
+/*-----------------------------------------------------------------------------
+ * S₀: Isolates and channels
+ */
+
+TEST_CASE_GROUP("S₀ isolates and channels");
+
+#define MESSAGE_COUNT  64
+
+static const char  *const send_block =
+    YAML
+    "inputs:\n"
+    "  sender: !s0!object\n"
+    "    send: !s0!method\n"
+    "      inputs:\n"
+    "        self: !s0!object {}\n"
+    "        message: !s0!any {}\n"
+    "        then: !s0!closure\n"
+    "          branches:\n"
+    "            body: {sender: !s0!any {}}\n"
+    "  recorder: !s0!object\n"
+    "    success: !s0!method\n"
+    "      inputs: {self: !s0!object {}, sender: !s0!any {}}\n"
+    "    failure: !s0!method\n"
+    "      inputs: {self: !s0!object {}}\n"
+    "  message: !s0!any {}\n"
+    "statements:\n"
+    "  - !s0!create-closure\n"
+    "    dest: then\n"
+    "    closed-over: [recorder]\n"
+    "    branches:\n"
+    "      body:\n"
+    "        inputs:\n"
+    "          sender: !s0!any {}\n"
+    "        statements: []\n"
+    "        invocation:\n"
+    "          !s0!invoke-method\n"
+    "          src: recorder\n"
+    "          method: success\n"
+    "          parameters:\n"
+    "            recorder: self\n"
+    "            sender: sender\n"
+    "invocation:\n"
+    "  !s0!invoke-method\n"
+    "  src: sender\n"
+    "  method: send\n"
+    "  parameters:\n"
+    "    sender: self\n"
+    "    message: message\n"
+    "    then: then\n";
+
+static const char  *const receive_block =
+    YAML
+    "inputs:\n"
+    "  receiver: !s0!object\n"
+    "    receive: !s0!method\n"
+    "      inputs:\n"
+    "        self: !s0!object {}\n"
+    "        then: !s0!closure\n"
+    "          branches:\n"
+    "            body: {receiver: !s0!any {}, message: !s0!any {}}\n"
+    "  recorder: !s0!object\n"
+    "    success: !s0!method\n"
+    "      inputs:\n"
+    "        {self: !s0!object {}, receiver: !s0!any {}, message: !s0!any {}}\n"
+    "    failure: !s0!method\n"
+    "      inputs: {self: !s0!object {}}\n"
+    "statements:\n"
+    "  - !s0!create-closure\n"
+    "    dest: then\n"
+    "    closed-over: [recorder]\n"
+    "    branches:\n"
+    "      body:\n"
+    "        inputs:\n"
+    "          receiver: !s0!any {}\n"
+    "          message: !s0!any {}\n"
+    "        statements: []\n"
+    "        invocation:\n"
+    "          !s0!invoke-method\n"
+    "          src: recorder\n"
+    "          method: success\n"
+    "          parameters:\n"
+    "            recorder: self\n"
+    "            receiver: receiver\n"
+    "            message: message\n"
+    "invocation:\n"
+    "  !s0!invoke-method\n"
+    "  src: receiver\n"
+    "  method: receive\n"
+    "  parameters:\n"
+    "    receiver: self\n"
+    "    then: then\n";
+
+/* Creates the inputs for send_block or receive_block.  `message` can be NULL
+ * if you don't need one.  Takes control of everything. */
+static struct s0_environment *
+create_channel_environment(const char *target_name, struct s0_entity *target,
+                           struct recorder *recorder,
+                           const char *success_inputs,
+                           struct s0_entity *message)
+{
+    struct s0_environment  *env;
+    struct s0_entity  *recorder_object;
+    recorder->results = s0_environment_new();
+    recorder->succeeded = false;
+    recorder->failed = false;
+    recorder_object = create_recorder
+        (recorder, success_inputs, YAML "{self: !s0!object {}}\n");
+    env = s0_environment_new();
+    if (recorder->results == NULL || recorder_object == NULL || env == NULL
+        || s0_environment_add(env, s0_name_new_str(target_name), target) != 0
+        || s0_environment_add
+           (env, s0_name_new_str("recorder"), recorder_object) != 0
+        || (message != NULL
+            && s0_environment_add
+               (env, s0_name_new_str("message"), message) != 0)) {
+        return NULL;
+    }
+    return env;
+}
+
+#define SENDER_RESULTS \
+    YAML "{self: !s0!object {}, sender: !s0!any {}}\n"
+#define RECEIVER_RESULTS \
+    YAML "{self: !s0!object {}, receiver: !s0!any {}, message: !s0!any {}}\n"
+
+/* Creates a closure whose environment contains a single literal. */
+static struct s0_entity *
+create_message_closure(void)
+{
+    struct s0_environment  *env;
+    struct s0_named_blocks  *blocks;
+    env = s0_environment_new();
+    blocks = s0_named_blocks_new();
+    if (env == NULL || blocks == NULL
+        || s0_environment_add
+           (env, s0_name_new_str("payload"), s0_literal_new_str("hi")) != 0) {
+        return NULL;
+    }
+    return s0_closure_new(env, blocks);
+}
+
+TEST_CASE("channels move entities without copying them") {
+    struct s0_channel  *channel;
+    struct s0_entity  *atom;
+    struct s0_entity  *closure;
+    struct s0_environment  *closure_env;
+    struct s0_entity  *received;
+    check_alloc(channel, s0_channel_new());
+    check(s0_channel_try_receive(channel) == NULL);
+    check_alloc(atom, s0_atom_new());
+    check_alloc(closure, create_message_closure());
+    closure_env = s0_closure_environment(closure);
+    check0(s0_channel_send(channel, atom));
+    check0(s0_channel_send(channel, closure));
+    check_alloc(received, s0_channel_try_receive(channel));
+    check(received == atom);
+    s0_entity_free(received);
+    check_alloc(received, s0_channel_try_receive(channel));
+    check(received == closure);
+    check(s0_closure_environment(received) == closure_env);
+    s0_entity_free(received);
+    check(s0_channel_try_receive(channel) == NULL);
+    /* Any messages that are left over are freed with the channel */
+    check_alloc(atom, s0_atom_new());
+    check0(s0_channel_send(channel, atom));
+    s0_channel_free(channel);
+}
+
+TEST_CASE("can send and receive in synchronous executions") {
+    struct s0_channel  *channel;
+    struct s0_block  *sender;
+    struct s0_block  *receiver;
+    struct s0_environment  *env;
+    struct s0_entity  *message;
+    struct s0_entity  *received;
+    struct recorder  recorder;
+    check_alloc(channel, s0_channel_new());
+    check_alloc(sender, load_block(send_block));
+    check_alloc(receiver, load_block(receive_block));
+    check_alloc(message, s0_literal_new_str("hello"));
+    check_alloc(env, create_channel_environment
+                ("sender", s0_channel_sender_new(channel), &recorder,
+                 SENDER_RESULTS, message));
+    check0(s0_block_execute(sender, env));
+    check(recorder.succeeded);
+    check(s0_environment_size(recorder.results) == 1);
+    s0_environment_free(recorder.results);
+    s0_environment_free(env);
+    check_alloc(env, create_channel_environment
+                ("receiver", s0_channel_receiver_new(channel), &recorder,
+                 RECEIVER_RESULTS, NULL));
+    check0(s0_block_execute(receiver, env));
+    check(recorder.succeeded);
+    check_alloc(received, recorder_take(&recorder, "message"));
+    check(received == message);
+    s0_entity_free(received);
+    s0_environment_free(recorder.results);
+    s0_environment_free(env);
+    s0_block_free(sender);
+    s0_block_free(receiver);
+    s0_channel_free(channel);
+}
+
+/* Sends a message from another thread, once the test says that the receiver
+ * has gotten as far as it can without one. */
+struct waiting_sender {
+    pthread_t  thread;
+    struct s0_channel  *channel;
+    struct s0_entity  *message;
+    struct progress  ready;
+};
+
+static void *
+send_once_ready(void *ud)
+{
+    struct waiting_sender  *sender = ud;
+    progress_wait(&sender->ready, 1);
+    s0_channel_send(sender->channel, sender->message);
+    return NULL;
+}
+
+/* The event loop only looks at its watches once every ready execution has run
+ * as far as it can, so a receiver in the loop has suspended itself by the time
+ * this fires. */
+static void
+sender_ready(void *ud, uint32_t events)
+{
+    struct waiting_sender  *sender = ud;
+    progress_advance(&sender->ready);
+}
+
+TEST_CASE("synchronous receivers block until a message arrives") {
+    struct s0_channel  *channel;
+    struct s0_block  *receiver;
+    struct s0_environment  *env;
+    struct s0_entity  *received;
+    struct recorder  recorder;
+    struct waiting_sender  sender;
+    check_alloc(channel, s0_channel_new());
+    check_alloc(receiver, load_block(receive_block));
+    check_alloc(sender.message, s0_atom_new());
+    sender.channel = channel;
+    progress_init(&sender.ready);
+    check_alloc(env, create_channel_environment
+                ("receiver", s0_channel_receiver_new(channel), &recorder,
+                 RECEIVER_RESULTS, NULL));
+    check0(pthread_create(&sender.thread, NULL, send_once_ready, &sender));
+    /* We can't tell from here when the execution below starts blocking, so
+     * the message can arrive just before or just after it does; either way,
+     * the receiver must end up with it. */
+    progress_advance(&sender.ready);
+    check0(s0_block_execute(receiver, env));
+    check0(pthread_join(sender.thread, NULL));
+    progress_done(&sender.ready);
+    check_alloc(received, recorder_take(&recorder, "message"));
+    check(received == sender.message);
+    s0_entity_free(received);
+    s0_environment_free(recorder.results);
+    s0_environment_free(env);
+    s0_block_free(receiver);
+    s0_channel_free(channel);
+}
+
+TEST_CASE("suspended receivers resume when another thread sends") {
+    struct s0_channel  *channel;
+    struct s0_block  *receiver;
+    struct s0_event_loop  *loop;
+    struct s0_environment  *env;
+    struct s0_entity  *received;
+    struct recorder  recorder;
+    struct waiting_sender  sender;
+    int  fds[2];
+    int  rc = -1;
+    check_alloc(channel, s0_channel_new());
+    check_alloc(receiver, load_block(receive_block));
+    check_alloc(loop, s0_event_loop_new());
+    check_alloc(sender.message, s0_atom_new());
+    sender.channel = channel;
+    progress_init(&sender.ready);
+    check_alloc(env, create_channel_environment
+                ("receiver", s0_channel_receiver_new(channel), &recorder,
+                 RECEIVER_RESULTS, NULL));
+    check0(s0_event_loop_add(loop, receiver, env, io_operation_done, &rc));
+    /* The write end of an empty pipe is always writable, so this fires the
+     * first time the loop checks for events. */
+    check0(pipe(fds));
+    check0(s0_event_loop_watch(loop, fds[1], EPOLLOUT, sender_ready, &sender));
+    check0(pthread_create(&sender.thread, NULL, send_once_ready, &sender));
+    check0(s0_event_loop_run(loop));
+    check0(pthread_join(sender.thread, NULL));
+    close(fds[0]);
+    close(fds[1]);
+    progress_done(&sender.ready);
+    check0(rc);
+    check(recorder.succeeded);
+    check_alloc(received, recorder_take(&recorder, "message"));
+    check(received == sender.message);
+    s0_entity_free(received);
+    s0_environment_free(recorder.results);
+    s0_event_loop_free(loop);
+    s0_block_free(receiver);
+    s0_channel_free(channel);
+}
+
+/* Sends each message from its own execution in one isolate, while another
+ * isolate receives them one at a time, spawning a new execution for each. */
+struct isolate_receiver {
+    struct s0_isolate  *isolate;
+    struct s0_block  *block;
+    struct recorder  recorder;
+    struct s0_entity  *received[MESSAGE_COUNT];
+    size_t  count;
+    size_t  failures;
+};
+
+static int
+spawn_receive(struct isolate_receiver *receiver, struct s0_entity *object);
+
+static void
+receive_done(void *ud, struct s0_environment *env, int rc)
+{
+    struct isolate_receiver  *receiver = ud;
+    struct s0_entity  *object;
+    s0_environment_free(env);
+    if (rc != 0) {
+        receiver->failures++;
+        return;
+    }
+    receiver->received[receiver->count++] =
+        recorder_take(&receiver->recorder, "message");
+    object = recorder_take(&receiver->recorder, "receiver");
+    s0_environment_free(receiver->recorder.results);
+    if (receiver->count == MESSAGE_COUNT) {
+        s0_entity_free(object);
+    } else if (spawn_receive(receiver, object) != 0) {
+        receiver->failures++;
+    }
+}
+
+static int
+spawn_receive(struct isolate_receiver *receiver, struct s0_entity *object)
+{
+    struct s0_environment  *env = create_channel_environment
+        ("receiver", object, &receiver->recorder, RECEIVER_RESULTS, NULL);
+    if (env == NULL) {
+        return -1;
+    }
+    return s0_isolate_spawn
+        (receiver->isolate, receiver->block, env, receive_done, receiver);
+}
+
+struct isolate_send {
+    struct recorder  recorder;
+    int  rc;
+};
+
+static void
+send_done(void *ud, struct s0_environment *env, int rc)
+{
+    struct isolate_send  *send = ud;
+    send->rc = rc;
+    s0_environment_free(env);
+    s0_environment_free(send->recorder.results);
+}
+
+TEST_CASE("isolates can move entities through channels") {
+    struct s0_channel  *channel;
+    struct s0_isolate  *sending;
+    struct isolate_receiver  receiver;
+    struct s0_block  *sender_block;
+    struct s0_entity  *sent[MESSAGE_COUNT];
+    struct isolate_send  sends[MESSAGE_COUNT];
+    size_t  i;
+    check_alloc(channel, s0_channel_new());
+    check_alloc(sender_block, load_block(send_block));
+    check_alloc(receiver.block, load_block(receive_block));
+    check_alloc(receiver.isolate, s0_isolate_new());
+    check_alloc(sending, s0_isolate_new());
+    receiver.count = 0;
+    receiver.failures = 0;
+    /* Start receiving first, so that the receiver has to wait */
+    check0(spawn_receive(&receiver, s0_channel_receiver_new(channel)));
+    for (i = 0; i < MESSAGE_COUNT; i++) {
+        struct s0_environment  *env;
+        if (i % 2 == 0) {
+            check_alloc(sent[i], s0_atom_new());
+        } else {
+            check_alloc(sent[i], create_message_closure());
+        }
+        sends[i].rc = -1;
+        check_alloc(env, create_channel_environment
+                    ("sender", s0_channel_sender_new(channel),
+                     &sends[i].recorder, SENDER_RESULTS, sent[i]));
+        check0(s0_isolate_spawn
+               (sending, sender_block, env, send_done, &sends[i]));
+    }
+    s0_isolate_free(sending);
+    s0_isolate_free(receiver.isolate);
+    check(receiver.failures == 0);
+    check(receiver.count == MESSAGE_COUNT);
+    /* There's only one sending thread, so messages arrive in order */
+    for (i = 0; i < MESSAGE_COUNT; i++) {
+        check0(sends[i].rc);
+        check(receiver.received[i] == sent[i]);
+        s0_entity_free(receiver.received[i]);
+    }
+    s0_block_free(sender_block);
+    s0_block_free(receiver.block);
+    s0_channel_free(channel);
+}
+
+/*-----------------------------------------------------------------------------
+ * S₀: Shared-memory rings
+ */
+
+TEST_CASE_GROUP("S₀ shared-memory rings");
+
+/* Creates an object containing a literal and a nested object. */
+static struct s0_entity *
+create_encodable_object(const char *content)
+{
+    struct s0_entity  *object;
+    struct s0_entity  *nested;
+    object = s0_object_new();
+    nested = s0_object_new();
+    if (object == NULL || nested == NULL
+        || s0_object_add
+           (nested, s0_name_new_str("content"),
+            s0_literal_new_str(content)) != 0
+        || s0_object_add(object, s0_name_new_str("nested"), nested) != 0
+        || s0_object_add
+           (object, s0_name_new_str("empty"), s0_literal_new(0, NULL)) != 0) {
+        return NULL;
+    }
+    return object;
+}
+
+static bool
+encodable_object_equals(const struct s0_entity *object, const char *content)
+{
+    struct s0_name  *name;
+    const struct s0_entity  *nested;
+    const struct s0_entity  *empty;
+    const struct s0_entity  *literal;
+    if (object == NULL || s0_entity_kind(object) != S0_ENTITY_KIND_OBJECT
+        || s0_object_size(object) != 2) {
+        return false;
+    }
+    name = s0_name_new_str("nested");
+    nested = s0_object_get(object, name);
+    s0_name_free(name);
+    name = s0_name_new_str("empty");
+    empty = s0_object_get(object, name);
+    s0_name_free(name);
+    if (nested == NULL || s0_entity_kind(nested) != S0_ENTITY_KIND_OBJECT
+        || empty == NULL || !literal_equals(empty, "")) {
+        return false;
+    }
+    name = s0_name_new_str("content");
+    literal = s0_object_get(nested, name);
+    s0_name_free(name);
+    return literal_equals(literal, content);
+}
+
+TEST_CASE("can encode and decode literals and objects") {
+    struct s0_entity  *object;
+    struct s0_entity  *decoded;
+    size_t  size;
+    char  *buf;
+    check_alloc(object, create_encodable_object("hello"));
+    size = s0_entity_encoded_size(object);
+    check(size > 0);
+    check_alloc(buf, malloc(size));
+    s0_entity_encode(object, buf);
+    check_alloc(decoded, s0_entity_decode(buf, size));
+    check(decoded != object);
+    check(encodable_object_equals(decoded, "hello"));
+    s0_entity_free(decoded);
+    /* Truncated and padded encodings are both errors */
+    check(s0_entity_decode(buf, size - 1) == NULL);
+    check(s0_entity_decode(buf, 0) == NULL);
+    free(buf);
+    check_alloc(buf, malloc(size + 1));
+    s0_entity_encode(object, buf);
+    buf[size] = 0;
+    check(s0_entity_decode(buf, size + 1) == NULL);
+    free(buf);
+    s0_entity_free(object);
+}
+
+TEST_CASE("can't encode atoms or closures") {
+    struct s0_entity  *atom;
+    struct s0_entity  *closure;
+    struct s0_entity  *object;
+    check_alloc(atom, s0_atom_new());
+    check(s0_entity_encoded_size(atom) == 0);
+    check_alloc(closure, create_message_closure());
+    check(s0_entity_encoded_size(closure) == 0);
+    s0_entity_free(closure);
+    check_alloc(object, s0_object_new());
+    check0(s0_object_add(object, s0_name_new_str("atom"), atom));
+    check(s0_entity_encoded_size(object) == 0);
+    s0_entity_free(object);
+}
+
+static void
+ring_name(char *buf, size_t size)
+{
+    snprintf(buf, size, "/test-swanson-%ld", (long) getpid());
+}
+
+TEST_CASE("shared-memory rings pass messages in order") {
+    char  name[64];
+    struct s0_shm_ring  *sender;
+    struct s0_shm_ring  *receiver;
+    struct s0_entity  *message;
+    size_t  sent = 0;
+    size_t  received = 0;
+    ring_name(name, sizeof(name));
+    check_alloc(sender, s0_shm_ring_new(name, 0));
+    check_alloc(receiver, s0_shm_ring_open(name));
+    check0(s0_shm_ring_try_receive(receiver, &message));
+    check(message == NULL);
+    /* Send in batches of three, so that records wrap around the ring at
+     * different offsets. */
+    while (received < 200) {
+        size_t  i;
+        for (i = 0; i < 3; i++) {
+            char  content[32];
+            snprintf(content, sizeof(content), "message %zu", sent++);
+            check_alloc(message, create_encodable_object(content));
+            check0(s0_shm_ring_send(sender, message));
+            s0_entity_free(message);
+        }
+        while (received < sent) {
+            char  content[32];
+            snprintf(content, sizeof(content), "message %zu", received++);
+            check_alloc(message, s0_shm_ring_receive(receiver));
+            check(encodable_object_equals(message, content));
+            s0_entity_free(message);
+        }
+    }
+    check0(s0_shm_ring_try_receive(receiver, &message));
+    check(message == NULL);
+    s0_shm_ring_free(receiver);
+    s0_shm_ring_free(sender);
+    /* Freeing the ring that created the shared memory removes it */
+    check(s0_shm_ring_open(name) == NULL);
+}
+
+TEST_CASE("shared-memory rings reject messages that don't fit") {
+    char  name[64];
+    char  content[256];
+    struct s0_shm_ring  *ring;
+    struct s0_entity  *message;
+    ring_name(name, sizeof(name));
+    check_alloc(ring, s0_shm_ring_new(name, 256));
+    memset(content, 'x', sizeof(content));
+    check_alloc(message, s0_literal_new(sizeof(content), content));
+    check(s0_shm_ring_send(ring, message) == -1);
+    s0_entity_free(message);
+    check_alloc(message, s0_atom_new());
+    check(s0_shm_ring_send(ring, message) == -1);
+    s0_entity_free(message);
+    s0_shm_ring_free(ring);
+}
+
+/* Where the ring's header keeps its capacity, and the receiver's and sender's
+ * positions.  Each side's fields start on their own cache line. */
+#define RING_CAPACITY_OFFSET  4
+#define RING_HEAD_OFFSET  64
+#define RING_TAIL_OFFSET  128
+#define RING_DATA_OFFSET  192
+
+TEST_CASE("shared-memory rings don't trust their shared header") {
+    char  name[64];
+    struct s0_shm_ring  *ring;
+    struct s0_entity  *message;
+    uint8_t  *header;
+    int  fd;
+    ring_name(name, sizeof(name));
+    check_alloc(ring, s0_shm_ring_new(name, 256));
+    /* Map the ring's header ourselves, like a misbehaving peer would. */
+    check((fd = shm_open(name, O_RDWR, 0)) != -1);
+    header = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    check(header != MAP_FAILED);
+    /* A larger capacity doesn't let anyone index past the end of the ring */
+    *(uint32_t *) (header + RING_CAPACITY_OFFSET) = UINT32_MAX / 2 + 1;
+    *(uint64_t *) (header + RING_TAIL_OFFSET) = 1 << 20;
+    check(s0_shm_ring_try_receive(ring, &message) == -1);
+    check(message == NULL);
+    check_alloc(message, create_encodable_object("hello"));
+    check(s0_shm_ring_send(ring, message) == -1);
+    s0_entity_free(message);
+    /* Nor does a record that claims to be larger than what's been sent */
+    *(uint32_t *) (header + RING_CAPACITY_OFFSET) = 256;
+    *(uint64_t *) (header + RING_HEAD_OFFSET) = 0;
+    *(uint64_t *) (header + RING_TAIL_OFFSET) = 8;
+    *(uint32_t *) (header + RING_DATA_OFFSET) = 100;
+    check(s0_shm_ring_try_receive(ring, &message) == -1);
+    check(message == NULL);
+    munmap(header, 4096);
+    s0_shm_ring_free(ring);
+}
+
+#define RING_MESSAGE_COUNT  1000
+
+/* Runs in the child process, so we can't use the check macros. */
+static int
+send_from_child(const char *name)
+{
+    struct s0_shm_ring  *ring;
+    struct s0_block  *block;
+    struct s0_entity  *sender;
+    size_t  i;
+    ring = s0_shm_ring_open(name);
+    block = load_block(send_block);
+    if (ring == NULL || block == NULL) {
+        return -1;
+    }
+    sender = s0_shm_ring_sender_new(ring);
+    for (i = 0; i < RING_MESSAGE_COUNT; i++) {
+        char  content[32];
+        struct recorder  recorder;
+        struct s0_environment  *env;
+        snprintf(content, sizeof(content), "message %zu", i);
+        env = create_channel_environment
+            ("sender", sender, &recorder, SENDER_RESULTS,
+             create_encodable_object(content));
+        if (env == NULL || s0_block_execute(block, env) != 0) {
+            return -1;
+        }
+        sender = recorder_take(&recorder, "sender");
+        s0_environment_free(recorder.results);
+        s0_environment_free(env);
+    }
+    s0_entity_free(sender);
+    s0_block_free(block);
+    s0_shm_ring_free(ring);
+    return 0;
+}
+
+TEST_CASE("can pass entities between processes with shared-memory rings") {
+    char  name[64];
+    struct s0_shm_ring  *ring;
+    struct s0_block  *block;
+    struct s0_entity  *receiver;
+    pid_t  pid;
+    int  status;
+    size_t  i;
+    ring_name(name, sizeof(name));
+    check_alloc(ring, s0_shm_ring_new(name, 4096));
+    check_alloc(block, load_block(receive_block));
+    pid = fork();
+    check(pid != -1);
+    if (pid == 0) {
+        _exit(send_from_child(name) == 0? EXIT_SUCCESS: EXIT_FAILURE);
+    }
+    check_alloc(receiver, s0_shm_ring_receiver_new(ring));
+    for (i = 0; i < RING_MESSAGE_COUNT; i++) {
+        char  content[32];
+        struct recorder  recorder;
+        struct s0_environment  *env;
+        struct s0_entity  *message;
+        snprintf(content, sizeof(content), "message %zu", i);
+        check_alloc(env, create_channel_environment
+                    ("receiver", receiver, &recorder, RECEIVER_RESULTS,
+                     NULL));
+        check0(s0_block_execute(block, env));
+        check_alloc(message, recorder_take(&recorder, "message"));
+        check(encodable_object_equals(message, content));
+        s0_entity_free(message);
+        check_alloc(receiver, recorder_take(&recorder, "receiver"));
+        s0_environment_free(recorder.results);
+        s0_environment_free(env);
+    }
+    check(waitpid(pid, &status, 0) == pid);
+    check(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+    s0_entity_free(receiver);
+    s0_block_free(block);
+    s0_shm_ring_free(ring);
+}
+
+/* Runs send_block and receive_block on the same ring, as two executions in one
+ * event loop, adding the receiver first if `receive_first`.  If the first one
+ * had to block its thread while waiting for the other, the loop could never
+ * finish. */
+static void
+ring_event_loop_exchange(struct s0_shm_ring *ring, bool receive_first,
+                         const char *expected)
+{
+    struct s0_event_loop  *loop;
+    struct s0_block  *sender_block;
+    struct s0_block  *receiver_block;
+    struct recorder  send_recorder;
+    struct recorder  receive_recorder;
+    struct s0_environment  *send_env;
+    struct s0_environment  *receive_env;
+    struct s0_entity  *message;
+    int  send_rc = -1;
+    int  receive_rc = -1;
+    check_alloc(loop, s0_event_loop_new());
+    check_alloc(sender_block, load_block(send_block));
+    check_alloc(receiver_block, load_block(receive_block));
+    check_alloc(send_env, create_channel_environment
+                ("sender", s0_shm_ring_sender_new(ring), &send_recorder,
+                 SENDER_RESULTS, create_encodable_object("last")));
+    check_alloc(receive_env, create_channel_environment
+                ("receiver", s0_shm_ring_receiver_new(ring),
+                 &receive_recorder, RECEIVER_RESULTS, NULL));
+    if (receive_first) {
+        check0(s0_event_loop_add
+               (loop, receiver_block, receive_env, io_operation_done,
+                &receive_rc));
+    }
+    check0(s0_event_loop_add
+           (loop, sender_block, send_env, io_operation_done, &send_rc));
+    if (!receive_first) {
+        check0(s0_event_loop_add
+               (loop, receiver_block, receive_env, io_operation_done,
+                &receive_rc));
+    }
+    check0(s0_event_loop_run(loop));
+    check0(send_rc);
+    check0(receive_rc);
+    check(send_recorder.succeeded);
+    check(receive_recorder.succeeded);
+    check_alloc(message, recorder_take(&receive_recorder, "message"));
+    check(encodable_object_equals(message, expected));
+    s0_entity_free(message);
+    s0_environment_free(send_recorder.results);
+    s0_environment_free(receive_recorder.results);
+    s0_event_loop_free(loop);
+    s0_block_free(sender_block);
+    s0_block_free(receiver_block);
+}
+
+TEST_CASE("ring receivers park instead of blocking an event loop") {
+    char  name[64];
+    struct s0_shm_ring  *ring;
+    ring_name(name, sizeof(name));
+    check_alloc(ring, s0_shm_ring_new(name, 256));
+    ring_event_loop_exchange(ring, true, "last");
+    s0_shm_ring_free(ring);
+}
+
+TEST_CASE("ring senders park instead of blocking an event loop") {
+    char  name[64];
+    struct s0_shm_ring  *ring;
+    struct s0_entity  *message;
+    size_t  record_size;
+    size_t  used;
+    size_t  count = 0;
+    size_t  i;
+    ring_name(name, sizeof(name));
+    check_alloc(ring, s0_shm_ring_new(name, 256));
+    /* Fill the ring, so that the next message (which needs to wrap around the
+     * end of the ring) doesn't fit until someone receives. */
+    check_alloc(message, create_encodable_object("fill"));
+    record_size = (sizeof(uint32_t) + s0_entity_encoded_size(message) + 7)
+        & ~(size_t) 7;
+    for (used = 0; used + record_size <= 256; used += record_size) {
+        check0(s0_shm_ring_send(ring, message));
+        count++;
+    }
+    s0_entity_free(message);
+    check(count > 1);
+    /* The receiver gets the first message that we sent above, which makes
+     * room for the sender. */
+    ring_event_loop_exchange(ring, false, "fill");
+    for (i = 1; i < count; i++) {
+        check_alloc(message, s0_shm_ring_receive(ring));
+        check(encodable_object_equals(message, "fill"));
+        s0_entity_free(message);
+    }
+    check_alloc(message, s0_shm_ring_receive(ring));
+    check(encodable_object_equals(message, "last"));
+    s0_entity_free(message);
+    s0_shm_ring_free(ring);
+}
+
 /*-----------------------------------------------------------------------------
  * Harness
  */